@@ -0,0 +1,173 @@
+#include "buffer.h"
+#include "string.h"
+
+static inline uint32_t Buffer_LoadIndex(Buffer_t* buffer, uint32_t* index)
+{
+	if (buffer->spsc)
+		return __atomic_load_n(index, __ATOMIC_ACQUIRE);
+	return *index;
+}
+
+static inline void Buffer_StoreIndex(Buffer_t* buffer, uint32_t* index, uint32_t value)
+{
+	if (buffer->spsc)
+		__atomic_store_n(index, value, __ATOMIC_RELEASE);
+	else
+		*index = value;
+}
+
+void Buffer_Init(Buffer_t* buffer, uint8_t* dataBuffer, uint32_t maxSize)
+{
+	uint32_t size = 1;
+	while (size <= maxSize / 2)
+		size <<= 1;
+	buffer->buffer  = dataBuffer;
+	buffer->maxSize = size;
+	buffer->front   = 0;
+	buffer->rear    = 0;
+	buffer->spsc    = false;
+	memset(dataBuffer,0,maxSize);
+}
+
+void Buffer_InitSPSC(Buffer_t* buffer, uint8_t* dataBuffer, uint32_t maxSize)
+{
+	Buffer_Init(buffer, dataBuffer, maxSize);
+	buffer->spsc = true;
+}
+
+//////////////////////////////
+///@breif put up to length data to queue
+///@retval the length actually put
+/////////////////////////////
+uint32_t Buffer_Write(Buffer_t* buffer, const uint8_t* data, uint32_t length)
+{
+	uint32_t rear = buffer->rear;
+	uint32_t room = buffer->maxSize - (rear - Buffer_LoadIndex(buffer, &buffer->front));
+	if (length > room)
+		length = room;
+	uint32_t offset = rear & (buffer->maxSize - 1);
+	uint32_t first = buffer->maxSize - offset;
+	if (first > length)
+		first = length;
+	memcpy(buffer->buffer + offset, data, first);
+	memcpy(buffer->buffer, data + first, length - first);
+	Buffer_StoreIndex(buffer, &buffer->rear, rear + length);
+	return length;
+}
+
+//////////////////////////////
+///@breif get up to length data from queue
+///@retval the length actually got
+/////////////////////////////
+uint32_t Buffer_Read(Buffer_t* buffer, uint8_t* data, uint32_t length)
+{
+	uint32_t front = buffer->front;
+	uint32_t size = Buffer_LoadIndex(buffer, &buffer->rear) - front;
+	if (length > size)
+		length = size;
+	uint32_t offset = front & (buffer->maxSize - 1);
+	uint32_t first = buffer->maxSize - offset;
+	if (first > length)
+		first = length;
+	memcpy(data, buffer->buffer + offset, first);
+	memcpy(data + first, buffer->buffer, length - first);
+	Buffer_StoreIndex(buffer, &buffer->front, front + length);
+	return length;
+}
+
+//////////////////////////////
+///@breif put multiple node data to queue 
+///@param data: the first node data adress of node data array will put into queue
+///@param length: the length of node data that will put into queue
+/////////////////////////////
+bool Buffer_Puts(Buffer_t* buffer, uint8_t* data, uint16_t length)
+{
+	if (Buffer_Free(buffer) < length)//队满
+		return false;
+	Buffer_Write(buffer, data, length);
+	return true;
+}
+
+
+//////////////////////////////
+///@breif get multiple node data from queue
+///@param data: the first node data adress of node data array will get from the queue
+///@param length: the length of node data that will get from the queue
+/////////////////////////////
+bool Buffer_Gets(Buffer_t* buffer, uint8_t *data, uint16_t length)
+{
+	if (Buffer_Size(buffer)<length)
+		return false;
+	Buffer_Read(buffer, data, length);
+	return true;
+}
+
+
+/**
+ * query some data from the queue, and the data remain be a part of the queue
+ * @param data the address of the data save to
+ * @param startPosition Index of where to start query
+ * #param num The number of data will be query
+ * @retval Is query succeed
+ */
+int32_t Buffer_Query(Buffer_t* buffer, uint8_t* data, uint16_t length, uint16_t startPosition)
+{
+	uint32_t mask = buffer->maxSize - 1;
+	uint32_t size = Buffer_Size(buffer) - Buffer_Size2(buffer, startPosition);
+	uint32_t index = startPosition & mask;
+
+	if (length == 0)
+		return -1;
+	for (; size >= length; --size, index = (index + 1) & mask)
+	{
+		uint16_t i = 0;
+		while (i < length && buffer->buffer[(index + i) & mask] == data[i])
+			++i;
+		if (i == length)//find success
+			return index;
+	}
+
+	return -1;
+}
+
+////////////////////////////
+///@brief get the size of queue
+///@retval the size of queue
+///////////////////////////
+uint32_t Buffer_Size(Buffer_t* buffer)
+{
+	return Buffer_LoadIndex(buffer, &buffer->rear) - Buffer_LoadIndex(buffer, &buffer->front);
+}
+
+////////////////////////////
+///@brief get size sigh specific end position
+///
+////////////////////////////
+
+uint32_t Buffer_Size2(Buffer_t* buffer,uint32_t index)
+{
+	return (index - Buffer_LoadIndex(buffer, &buffer->front)) & (buffer->maxSize - 1);
+}
+
+////////////////////////////
+///@brief get the free space of queue
+///////////////////////////
+uint32_t Buffer_Free(Buffer_t* buffer)
+{
+	return buffer->maxSize - Buffer_Size(buffer);
+}
+
+
+////////////////////////////////
+///@breif clear the queue
+////////////////////////////////
+void Buffer_Clear(Buffer_t* buffer)
+{
+	Buffer_StoreIndex(buffer, &buffer->front, Buffer_LoadIndex(buffer, &buffer->rear));
+}
+
+
+int32_t Buffer_StartPostion(Buffer_t* buffer)
+{
+	return Buffer_LoadIndex(buffer, &buffer->front) & (buffer->maxSize - 1);
+}
@@ -21,24 +21,41 @@ extern "C" {
 
 
 typedef struct {
-	uint16_t   front;
-	uint16_t   rear;
+	uint32_t   front;   //read index, free running, only the consumer writes it
+	uint32_t   rear;    //write index, free running, only the producer writes it
 	uint8_t*   buffer;
-	uint32_t   maxSize;
+	uint32_t   maxSize; //power of two
+	bool       spsc;
 }Buffer_t;
 
-//注意，没有使用长度这个变量，是为了防止有中断打断时快速反应（用mfront和mrear计算）
-//在put和get函数中体会，所以函数都是先操作头指针和尾指针，再进行存数
-//可以添加锁操作
+//front and rear are never wrapped, only masked with maxSize-1 on access, so
+//size is always rear-front and all maxSize bytes are usable.
+//Every put/get moves data with at most two memcpy, one for each side of the
+//wrap point.
+//In SPSC mode one producer and one consumer may work on the buffer at the
+//same time without a lock, e.g. the UART IRQ on core0 and a thread on core1:
+//the producer only moves rear and the consumer only moves front, and each
+//index is published with release semantics after the data it covers.
 
 
+//////////////////////////////
+///@breif init the queue
+///@param maxSize: rounded down to a power of two
+/////////////////////////////
 void Buffer_Init(Buffer_t* buffer, uint8_t* dataBuffer, uint32_t maxSize);
 
 
+//////////////////////////////
+///@breif init the queue for lock-free single producer, single consumer use
+/////////////////////////////
+void Buffer_InitSPSC(Buffer_t* buffer, uint8_t* dataBuffer, uint32_t maxSize);
+
+
 //////////////////////////////
 ///@breif put multiple node data to queue 
 ///@param data: the first node data adress of node data array will put into queue
 ///@param length: the length of node data that will put into queue
+///@retval false if there is not room for all of it, nothing is put then
 /////////////////////////////
 bool Buffer_Puts(Buffer_t* buffer, uint8_t* data, uint16_t length);
 
@@ -47,10 +64,23 @@ bool Buffer_Puts(Buffer_t* buffer, uint8_t* data, uint16_t length);
 ///@breif get multiple node data from queue
 ///@param data: the first node data adress of node data array will get from the queue
 ///@param length: the length of node data that will get from the queue
+///@retval false if less than length data in the queue, nothing is got then
 /////////////////////////////
 bool Buffer_Gets(Buffer_t* buffer, uint8_t *data, uint16_t length);
 
 
+//////////////////////////////
+///@breif put up to length data to queue
+///@retval the length actually put
+/////////////////////////////
+uint32_t Buffer_Write(Buffer_t* buffer, const uint8_t* data, uint32_t length);
+
+
+//////////////////////////////
+///@breif get up to length data from queue
+///@retval the length actually got
+/////////////////////////////
+uint32_t Buffer_Read(Buffer_t* buffer, uint8_t* data, uint32_t length);
 
 
 int32_t Buffer_StartPostion(Buffer_t* buffer);
@@ -75,8 +105,15 @@ uint32_t Buffer_Size(Buffer_t* buffer);
 uint32_t Buffer_Size2(Buffer_t* buffer,uint32_t index);
 
 
+////////////////////////////
+///@breif get the free space of queue
+///////////////////////////
+uint32_t Buffer_Free(Buffer_t* buffer);
+
+
 ////////////////////////////////
 ///@breif clear the queue
+///@note in SPSC mode only the consumer may call this
 ////////////////////////////////
 void Buffer_Clear(Buffer_t* buffer);
 
@@ -86,4 +123,3 @@ void Buffer_Clear(Buffer_t* buffer);
 #endif
 
 #endif
-
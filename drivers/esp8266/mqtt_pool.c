@@ -0,0 +1,137 @@
+#include <string.h>
+
+#include "mqtt_pool.h"
+
+void mqtt_pool_init(mqtt_pool_t *pool, uint8_t *arena, uint16_t arena_size) {
+    memset(pool, 0, sizeof(*pool));
+    pool->arena = arena;
+    pool->arena_size = arena_size;
+}
+
+// Find `need` contiguous arena bytes after the newest message. A message never
+// straddles the end of the arena; the space left there is skipped instead.
+static int32_t mqtt_pool_arena_alloc(mqtt_pool_t *pool, size_t need) {
+    uint16_t at;
+    if (!pool->wrapped) {
+        if ((size_t)(pool->arena_size - pool->arena_head) >= need) {
+            at = pool->arena_head;
+        } else if (pool->arena_tail >= need) {
+            at = 0;
+            pool->wrapped = true;
+        } else {
+            return -1;
+        }
+    } else if ((size_t)(pool->arena_tail - pool->arena_head) >= need) {
+        at = pool->arena_head;
+    } else {
+        return -1;
+    }
+    pool->arena_head = at + need;
+    return at;
+}
+
+bool mqtt_pool_begin(mqtt_pool_t *pool, const char *topic, size_t topic_len, size_t data_len) {
+    if (pool->open) {
+        // the previous message never got all of its payload
+        mqtt_pool_end(pool);
+    }
+    if (pool->count == MQTT_POOL_LEN || pool->arena == NULL) {
+        ++pool->dropped;
+        return false;
+    }
+    if (pool->count == 0) {
+        pool->arena_head = 0;
+        pool->arena_tail = 0;
+        pool->wrapped = false;
+    }
+    bool wrapped = pool->wrapped;
+    uint16_t head = pool->arena_head;
+    int32_t at = mqtt_pool_arena_alloc(pool, topic_len + data_len);
+    if (at < 0) {
+        ++pool->overflow;
+        return false;
+    }
+    memcpy(pool->arena + at, topic, topic_len);
+    mqtt_pool_msg_t *msg = &pool->msg[(pool->head + pool->count) % MQTT_POOL_LEN];
+    msg->offset = at;
+    msg->topic_len = topic_len;
+    msg->data_len = 0;
+    pool->open = true;
+    pool->open_wrapped = wrapped;
+    pool->open_head = head;
+    pool->open_remain = data_len;
+    return true;
+}
+
+void mqtt_pool_append(mqtt_pool_t *pool, const uint8_t *data, size_t len) {
+    if (!pool->open) {
+        return;
+    }
+    mqtt_pool_msg_t *msg = &pool->msg[(pool->head + pool->count) % MQTT_POOL_LEN];
+    len = len < pool->open_remain ? len : pool->open_remain;
+    memcpy(pool->arena + msg->offset + msg->topic_len + msg->data_len, data, len);
+    msg->data_len += len;
+    pool->open_remain -= len;
+}
+
+void mqtt_pool_end(mqtt_pool_t *pool) {
+    if (!pool->open) {
+        return;
+    }
+    pool->open = false;
+    if (pool->open_remain > 0) {
+        // give the room back, nothing was taken after it
+        pool->arena_head = pool->open_head;
+        pool->wrapped = pool->open_wrapped;
+        if (pool->count == 0) {
+            pool->arena_head = 0;
+            pool->arena_tail = 0;
+            pool->wrapped = false;
+        }
+        ++pool->dropped;
+        return;
+    }
+    ++pool->count;
+    ++pool->received;
+}
+
+bool mqtt_pool_put(mqtt_pool_t *pool, const char *topic, size_t topic_len, const uint8_t *data, size_t data_len) {
+    if (!mqtt_pool_begin(pool, topic, topic_len, data_len)) {
+        return false;
+    }
+    mqtt_pool_append(pool, data, data_len);
+    mqtt_pool_end(pool);
+    return true;
+}
+
+bool mqtt_pool_peek(mqtt_pool_t *pool, const char **topic, size_t *topic_len, const uint8_t **data, size_t *data_len) {
+    if (pool->count == 0) {
+        return false;
+    }
+    const mqtt_pool_msg_t *msg = &pool->msg[pool->head];
+    *topic = (const char *)pool->arena + msg->offset;
+    *topic_len = msg->topic_len;
+    *data = pool->arena + msg->offset + msg->topic_len;
+    *data_len = msg->data_len;
+    return true;
+}
+
+void mqtt_pool_pop(mqtt_pool_t *pool) {
+    if (pool->count == 0) {
+        return;
+    }
+    pool->head = (pool->head + 1) % MQTT_POOL_LEN;
+    --pool->count;
+    if (pool->count == 0 && !pool->open) {
+        pool->arena_head = 0;
+        pool->arena_tail = 0;
+        pool->wrapped = false;
+        return;
+    }
+    uint16_t tail = pool->msg[pool->head].offset;
+    if (pool->wrapped && tail < pool->arena_tail) {
+        // the oldest message is now one placed after the wrap
+        pool->wrapped = false;
+    }
+    pool->arena_tail = tail;
+}
@@ -0,0 +1,64 @@
+#ifndef MICROPY_INCLUDED_DRIVERS_ESP8266_MQTT_POOL_H
+#define MICROPY_INCLUDED_DRIVERS_ESP8266_MQTT_POOL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Inbound MQTT messages waiting for dispatch. The slots and the arena holding
+// their topic and payload bytes are allocated once, so receiving a message
+// touches no heap; messages are taken out in arrival order.
+
+#define MQTT_POOL_LEN           (8)     // messages waiting at most
+#define MQTT_POOL_ARENA_SIZE    (2048)  // topic and payload bytes of those messages
+
+typedef struct _mqtt_pool_msg_t {
+    uint16_t offset;        // of the topic in the arena, the payload follows it
+    uint16_t topic_len;
+    uint16_t data_len;
+} mqtt_pool_msg_t;
+
+typedef struct _mqtt_pool_t {
+    mqtt_pool_msg_t msg[MQTT_POOL_LEN];
+    uint8_t head;           // oldest message
+    uint8_t count;
+    bool wrapped;           // arena in use from tail to the end and from 0 to head
+    bool scheduled;         // delivery of the messages is pending, set by the owner
+    uint16_t arena_head;    // where the next message goes
+    uint16_t arena_tail;    // where the oldest message starts
+    uint16_t arena_size;
+    uint8_t *arena;
+    bool open;              // the slot after the newest message is being filled
+    bool open_wrapped;      // `wrapped` and `arena_head` before its room was taken
+    uint16_t open_head;
+    uint16_t open_remain;   // payload bytes it still expects
+    uint32_t received;      // messages put in the pool
+    uint32_t dropped;       // messages lost because all slots were taken, or cut short
+    uint32_t overflow;      // messages lost because the arena had no room
+} mqtt_pool_t;
+
+void mqtt_pool_init(mqtt_pool_t *pool, uint8_t *arena, uint16_t arena_size);
+
+// Copy a message in. Return false, and count it, if there is no room.
+bool mqtt_pool_put(mqtt_pool_t *pool, const char *topic, size_t topic_len, const uint8_t *data, size_t data_len);
+
+// Copy a message in as its payload arrives: begin() takes a slot and arena
+// room for all of it and copies the topic, append() adds payload bytes, and
+// end() makes the message visible once data_len bytes were appended, or drops
+// it if fewer were.  Return false from begin(), and count it, if there is no
+// room; the payload is then discarded by append() and end().
+bool mqtt_pool_begin(mqtt_pool_t *pool, const char *topic, size_t topic_len, size_t data_len);
+void mqtt_pool_append(mqtt_pool_t *pool, const uint8_t *data, size_t len);
+void mqtt_pool_end(mqtt_pool_t *pool);
+
+// Look at the oldest message, false if there is none. The pointers stay
+// valid until it is popped.
+bool mqtt_pool_peek(mqtt_pool_t *pool, const char **topic, size_t *topic_len, const uint8_t **data, size_t *data_len);
+
+void mqtt_pool_pop(mqtt_pool_t *pool);
+
+static inline uint8_t mqtt_pool_count(const mqtt_pool_t *pool) {
+    return pool->count;
+}
+
+#endif // MICROPY_INCLUDED_DRIVERS_ESP8266_MQTT_POOL_H
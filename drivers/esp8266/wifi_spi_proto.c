@@ -0,0 +1,137 @@
+#include <string.h>
+
+#include "wifi_spi_proto.h"
+
+uint32_t esp8285_spi_frame_build(uint8_t *buf, uint32_t size, uint8_t cmd, const esp8285_spi_param_t *params, uint32_t params_num, bool len_16)
+{
+    uint32_t packet_len = 4; // header + end byte
+
+    for (uint32_t i = 0; i < params_num; i++)
+    {
+        packet_len += params[i].param_len + (len_16 ? 2 : 1);
+    }
+    packet_len = (packet_len + 3) & ~3;
+
+    if (packet_len > size)
+        return 0;
+
+    buf[0] = START_CMD;
+    buf[1] = cmd & ~REPLY_FLAG;
+    buf[2] = params_num;
+
+    uint32_t ptr = 3;
+    for (uint32_t i = 0; i < params_num; i++)
+    {
+        if (len_16)
+            buf[ptr++] = (uint8_t)((params[i].param_len >> 8) & 0xFF);
+        buf[ptr++] = (uint8_t)(params[i].param_len & 0xFF);
+        memcpy(buf + ptr, params[i].param, params[i].param_len);
+        ptr += params[i].param_len;
+    }
+    buf[ptr++] = END_CMD;
+    memset(buf + ptr, 0, packet_len - ptr);
+
+    return packet_len;
+}
+
+int32_t esp8285_spi_frame_parse(const uint8_t *buf, uint32_t len, uint8_t cmd, bool len_16, esp8285_spi_resp_t *resp)
+{
+    // START, cmd, nparams
+    if (len < 3)
+        return 3;
+    if (buf[0] != START_CMD || buf[1] != (cmd | REPLY_FLAG) || buf[2] > ESP8285_SPI_MAX_PARAMS)
+        return -1;
+
+    uint32_t ptr = 3;
+    resp->params_num = buf[2];
+    for (uint32_t i = 0; i < resp->params_num; i++)
+    {
+        uint32_t need = ptr + (len_16 ? 2 : 1);
+        if (len < need)
+            return need;
+        uint32_t param_len = buf[ptr++];
+        if (len_16)
+            param_len = (param_len << 8) | buf[ptr++];
+        // a length field or END always follows, ask for it along with the data
+        if (len < ptr + param_len + 1)
+            return ptr + param_len + 1;
+        resp->params[i].param_len = param_len;
+        resp->params[i].param = buf + ptr;
+        ptr += param_len;
+    }
+
+    if (len < ptr + 1)
+        return ptr + 1;
+    return buf[ptr] == END_CMD ? 0 : -1;
+}
+
+int8_t esp8285_spi_proto_send(esp8285_spi_proto_t *p, uint8_t cmd, const esp8285_spi_param_t *params, uint32_t params_num, bool len_16)
+{
+    uint32_t len = esp8285_spi_frame_build(p->tx, sizeof(p->tx), cmd, params, params_num, len_16);
+
+    if (len == 0 || p->io->begin(p->io->ctx) != 0)
+        return -1;
+    p->io->transfer(p->io->ctx, p->tx, NULL, len);
+    p->io->end(p->io->ctx);
+
+    return 0;
+}
+
+int8_t esp8285_spi_proto_recv(esp8285_spi_proto_t *p, uint8_t cmd, bool len_16, esp8285_spi_resp_t *resp)
+{
+    if (p->io->begin(p->io->ctx) != 0)
+        return -1;
+
+    // the NIC clocks out filler until the reply starts, so read in chunks
+    // until START shows up, then move the partial frame to the front
+    memset(p->tx, 0xff, sizeof(p->tx));
+    uint32_t len = 0;
+    uint32_t scanned = 0;
+    int8_t ret = -1;
+    while (scanned < sizeof(p->rx))
+    {
+        p->io->transfer(p->io->ctx, p->tx, p->rx, ESP8285_SPI_RX_CHUNK);
+        scanned += ESP8285_SPI_RX_CHUNK;
+
+        uint32_t i = 0;
+        while (i < ESP8285_SPI_RX_CHUNK && p->rx[i] != START_CMD && p->rx[i] != ERR_CMD)
+            i++;
+        if (i == ESP8285_SPI_RX_CHUNK)
+            continue;
+        if (p->rx[i] == ERR_CMD)
+            goto done;
+        len = ESP8285_SPI_RX_CHUNK - i;
+        memmove(p->rx, p->rx + i, len);
+        break;
+    }
+    if (len == 0)
+        goto done;
+
+    // each parse tells how much of the frame is still missing, so the rest
+    // arrives in as many transfers as there are length fields to discover
+    for (;;)
+    {
+        int32_t need = esp8285_spi_frame_parse(p->rx, len, cmd, len_16, resp);
+        if (need <= 0)
+        {
+            ret = need;
+            break;
+        }
+        if ((uint32_t)need > sizeof(p->rx))
+            break;
+        p->io->transfer(p->io->ctx, p->tx, p->rx + len, need - len);
+        len = need;
+    }
+
+done:
+    p->io->end(p->io->ctx);
+    return ret;
+}
+
+int8_t esp8285_spi_proto_command(esp8285_spi_proto_t *p, uint8_t cmd, const esp8285_spi_param_t *params, uint32_t params_num,
+    bool sent_len_16, bool recv_len_16, esp8285_spi_resp_t *resp)
+{
+    if (esp8285_spi_proto_send(p, cmd, params, params_num, sent_len_16) != 0)
+        return -1;
+    return esp8285_spi_proto_recv(p, cmd, recv_len_16, resp);
+}
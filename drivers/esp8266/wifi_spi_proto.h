@@ -0,0 +1,111 @@
+#ifndef MICROPY_INCLUDED_DRIVERS_ESP8266_WIFI_SPI_PROTO_H
+#define MICROPY_INCLUDED_DRIVERS_ESP8266_WIFI_SPI_PROTO_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Framing of the ESP8285 SPI command protocol, independent of the bus so it
+// can run against a fake NIC off target.
+//
+// command: START cmd nparams {len[1|2] data}* END, padded to 4 bytes
+// reply:   START cmd|REPLY nparams {len[1|2] data}* END
+
+#define ESP8285_SPI_FRAME_SIZE      (512)   // largest frame either way, incl. padding
+#define ESP8285_SPI_MAX_PARAMS      (32)
+#define ESP8285_SPI_RX_CHUNK        (32)    // bytes read per transfer before the frame length is known
+
+typedef enum
+{
+    SET_NET_CMD                 = (0x10),
+    SET_PASSPHRASE_CMD          = (0x11),
+    GET_CONN_STATUS_CMD         = (0x20),
+    GET_IPADDR_CMD              = (0x21),
+    GET_MACADDR_CMD             = (0x22),
+    GET_CURR_SSID_CMD           = (0x23),
+    GET_CURR_RSSI_CMD           = (0x25),
+    GET_CURR_ENCT_CMD           = (0x26),
+    SCAN_NETWORKS               = (0x27),
+    GET_SOCKET_CMD              = (0x3F),
+    GET_STATE_TCP_CMD           = (0x29),
+    DATA_SENT_TCP_CMD           = (0x2A),
+    AVAIL_DATA_TCP_CMD          = (0x2B),
+    GET_DATA_TCP_CMD            = (0x2C),
+    START_CLIENT_TCP_CMD        = (0x2D),
+    STOP_CLIENT_TCP_CMD         = (0x2E),
+    GET_CLIENT_STATE_TCP_CMD    = (0x2F),
+    DISCONNECT_CMD              = (0x30),
+    GET_IDX_RSSI_CMD            = (0x32),
+    GET_IDX_ENCT_CMD            = (0x33),
+    REQ_HOST_BY_NAME_CMD        = (0x34),
+    GET_HOST_BY_NAME_CMD        = (0x35),
+    START_SCAN_NETWORKS         = (0x36),
+    GET_FW_VERSION_CMD          = (0x37),
+    SEND_UDP_DATA_CMD           = (0x39), // START_CLIENT_TCP_CMD set ip,port, then ADD_UDP_DATA_CMD to add data then SEND_UDP_DATA_CMD to call sendto
+    GET_REMOTE_INFO_CMD         = (0x3A),
+    PING_CMD                    = (0x3E),
+    SEND_DATA_TCP_CMD           = (0x44),
+    GET_DATABUF_TCP_CMD         = (0x45),
+    ADD_UDP_DATA_CMD            = (0x46),
+    GET_ADC_VAL_CMD             = (0x53),
+    SOFT_RESET_CMD              = (0x54),
+    START_CMD                   = (0xE0),
+    END_CMD                     = (0xEE),
+    ERR_CMD                     = (0xEF)
+}esp8285_cmd_enum_t;
+
+typedef enum {
+    CMD_FLAG                    = (0),
+    REPLY_FLAG                  = (1<<7)
+}esp8285_flag_t;
+
+typedef struct
+{
+    uint32_t param_len;
+    const uint8_t *param;
+} esp8285_spi_param_t;
+
+// A parsed reply; the params point into the receive frame buffer and are
+// valid until the next command.
+typedef struct
+{
+    uint32_t params_num;
+    esp8285_spi_param_t params[ESP8285_SPI_MAX_PARAMS];
+} esp8285_spi_resp_t;
+
+// Bus access. begin() selects the NIC once it is ready (0, or -1 on timeout),
+// end() deselects it. transfer() is full duplex, `dest` may be NULL.
+typedef struct _esp8285_spi_transport_t
+{
+    int8_t (*begin)(void *ctx);
+    void (*end)(void *ctx);
+    void (*transfer)(void *ctx, const uint8_t *src, uint8_t *dest, uint32_t len);
+    void *ctx;
+} esp8285_spi_transport_t;
+
+typedef struct _esp8285_spi_proto_t
+{
+    const esp8285_spi_transport_t *io;
+    uint8_t tx[ESP8285_SPI_FRAME_SIZE];
+    uint8_t rx[ESP8285_SPI_FRAME_SIZE];
+} esp8285_spi_proto_t;
+
+// Serialize a command frame into `buf`. Return its padded length, or 0 if it
+// does not fit in `size` bytes.
+uint32_t esp8285_spi_frame_build(uint8_t *buf, uint32_t size, uint8_t cmd, const esp8285_spi_param_t *params, uint32_t params_num, bool len_16);
+
+// Parse a reply to `cmd` starting at buf[0] (START). Return 0 when the frame
+// is complete and `resp` filled in, -1 if it is malformed, or else the number
+// of bytes the frame needs at least, which is more than `len`.
+int32_t esp8285_spi_frame_parse(const uint8_t *buf, uint32_t len, uint8_t cmd, bool len_16, esp8285_spi_resp_t *resp);
+
+// Send a command frame in one transfer, 0 or -1.
+int8_t esp8285_spi_proto_send(esp8285_spi_proto_t *p, uint8_t cmd, const esp8285_spi_param_t *params, uint32_t params_num, bool len_16);
+
+// Read the reply to `cmd` with as few transfers as the frame allows, 0 or -1.
+int8_t esp8285_spi_proto_recv(esp8285_spi_proto_t *p, uint8_t cmd, bool len_16, esp8285_spi_resp_t *resp);
+
+// esp8285_spi_proto_send() followed by esp8285_spi_proto_recv().
+int8_t esp8285_spi_proto_command(esp8285_spi_proto_t *p, uint8_t cmd, const esp8285_spi_param_t *params, uint32_t params_num,
+    bool sent_len_16, bool recv_len_16, esp8285_spi_resp_t *resp);
+
+#endif // MICROPY_INCLUDED_DRIVERS_ESP8266_WIFI_SPI_PROTO_H
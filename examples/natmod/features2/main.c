@@ -2,6 +2,7 @@
     - using floats
     - defining additional code in Python (see test.py)
     - have extra C code in a separate file (see prod.c)
+    - allocating many small blocks from an arena and freeing them at once
 */
 
 // Include the header file to get access to the MicroPython API
@@ -63,6 +64,36 @@ STATIC mp_obj_t productf(mp_obj_fun_bc_t *self, size_t n_args, size_t n_kw, mp_o
     return mp_const_none;
 }
 
+// A node of a linked list, allocated from an arena
+typedef struct _node_t {
+    struct _node_t *next;
+    mp_int_t val;
+} node_t;
+
+// A function that builds a linked list of the integers 1 to n and sums it.
+// The nodes are allocated from an arena, which is kept on the C stack where
+// the GC can see it, and they are all freed together at the end.
+STATIC mp_obj_t arena_sum(mp_obj_t n_in) {
+    mp_int_t n = mp_obj_get_int(n_in);
+    mp_arena_t arena;
+    mp_arena_init(&arena, 16 * sizeof(node_t));
+    node_t *head = NULL;
+    for (mp_int_t i = 1; i <= n; ++i) {
+        node_t *node = mp_arena_alloc(&arena, sizeof(node_t));
+        node->next = head;
+        node->val = i;
+        head = node;
+    }
+    mp_arena_trim(&arena);
+    mp_int_t sum = 0;
+    for (node_t *node = head; node != NULL; node = node->next) {
+        sum += node->val;
+    }
+    mp_arena_free(&arena);
+    return mp_obj_new_int(sum);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(arena_sum_obj, arena_sum);
+
 // This is the entry point and is called when the module is imported
 mp_obj_t mpy_init(mp_obj_fun_bc_t *self, size_t n_args, size_t n_kw, mp_obj_t *args) {
     // This must be first, it sets up the globals dict and other things
@@ -74,6 +105,7 @@ mp_obj_t mpy_init(mp_obj_fun_bc_t *self, size_t n_args, size_t n_kw, mp_obj_t *a
     #if USE_DOUBLE
     mp_store_global(MP_QSTR_add_d, MP_OBJ_FROM_PTR(&add_d_obj));
     #endif
+    mp_store_global(MP_QSTR_arena_sum, MP_OBJ_FROM_PTR(&arena_sum_obj));
 
     // The productf function uses the most general C argument interface
     mp_store_global(MP_QSTR_productf, MP_DYNRUNTIME_MAKE_FUNCTION(productf));
@@ -20,6 +20,9 @@ def test():
     if "add_d" in globals():
         tests.append(isclose(add_d(0.1, 0.2), 0.3))
 
+    tests.append(arena_sum(0) == 0)
+    tests.append(arena_sum(1000) == 500500)
+
     print(tests)
 
     if not all(tests):
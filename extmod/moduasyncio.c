@@ -24,6 +24,7 @@
  * THE SOFTWARE.
  */
 
+#include "py/gc.h"
 #include "py/runtime.h"
 #include "py/smallint.h"
 #include "py/pairheap.h"
@@ -104,6 +105,7 @@ STATIC mp_obj_t task_queue_push_sorted(size_t n_args, const mp_obj_t *args) {
         task->ph_key = args[2];
     }
     self->heap = (mp_obj_task_t *)mp_pairheap_push(task_lt, &self->heap->pairheap, &task->pairheap);
+    MP_GC_WRITE_BARRIER(self);
     return mp_const_none;
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(task_queue_push_sorted_obj, 2, 3, task_queue_push_sorted);
@@ -115,6 +117,7 @@ STATIC mp_obj_t task_queue_pop_head(mp_obj_t self_in) {
         mp_raise_msg(&mp_type_IndexError, MP_ERROR_TEXT("empty heap"));
     }
     self->heap = (mp_obj_task_t *)mp_pairheap_pop(task_lt, &self->heap->pairheap);
+    MP_GC_WRITE_BARRIER(self);
     return MP_OBJ_FROM_PTR(head);
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_1(task_queue_pop_head_obj, task_queue_pop_head);
@@ -123,6 +126,7 @@ STATIC mp_obj_t task_queue_remove(mp_obj_t self_in, mp_obj_t task_in) {
     mp_obj_task_queue_t *self = MP_OBJ_TO_PTR(self_in);
     mp_obj_task_t *task = MP_OBJ_TO_PTR(task_in);
     self->heap = (mp_obj_task_t *)mp_pairheap_delete(task_lt, &self->heap->pairheap, &task->pairheap);
+    MP_GC_WRITE_BARRIER(self);
     return mp_const_none;
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_2(task_queue_remove_obj, task_queue_remove);
@@ -162,6 +166,12 @@ STATIC mp_obj_t task_make_new(const mp_obj_type_t *type, size_t n_args, size_t n
     self->waiting = mp_const_none;
     self->ph_key = MP_OBJ_NEW_SMALL_INT(0);
     if (n_args == 2) {
+        #if MICROPY_GC_ROOTS
+        if (uasyncio_context != args[1]) {
+            // the context may outlive the module that passed it
+            gc_root_add(&uasyncio_context, 1);
+        }
+        #endif
         uasyncio_context = args[1];
     }
     return MP_OBJ_FROM_PTR(self);
@@ -272,6 +282,7 @@ STATIC void task_attr(mp_obj_t self_in, qstr attr, mp_obj_t *dest) {
             self->waiting = dest[1];
             dest[0] = MP_OBJ_NULL;
         }
+        MP_GC_WRITE_BARRIER(self);
     }
 }
 
@@ -286,6 +297,7 @@ STATIC mp_obj_t task_getiter(mp_obj_t self_in, mp_obj_iter_buf_t *iter_buf) {
         } else {
             // Lazily allocate the waiting queue.
             self->waiting = task_queue_make_new(&task_queue_type, 0, 0, NULL);
+            MP_GC_WRITE_BARRIER(self);
         }
     }
     return self_in;
@@ -30,6 +30,7 @@
 
 #include <stdio.h>
 
+#include "py/gc.h"
 #include "py/runtime.h"
 #include "py/obj.h"
 #include "py/objlist.h"
@@ -194,6 +195,7 @@ STATIC mp_obj_t poll_register(size_t n_args, const mp_obj_t *args) {
         flags = MP_STREAM_POLL_RD | MP_STREAM_POLL_WR;
     }
     poll_map_add(&self->poll_map, &args[1], 1, flags, false);
+    MP_GC_WRITE_BARRIER(self);
     return mp_const_none;
 }
 MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(poll_register_obj, 2, 3, poll_register);
@@ -283,6 +285,7 @@ STATIC mp_obj_t poll_ipoll(size_t n_args, const mp_obj_t *args) {
 
     if (self->ret_tuple == MP_OBJ_NULL) {
         self->ret_tuple = mp_obj_new_tuple(2, NULL);
+        MP_GC_WRITE_BARRIER(self);
     }
 
     int n_ready = poll_poll_internal(n_args, args);
@@ -312,6 +315,7 @@ STATIC mp_obj_t poll_iternext(mp_obj_t self_in) {
             mp_obj_tuple_t *t = MP_OBJ_TO_PTR(self->ret_tuple);
             t->items[0] = poll_obj->obj;
             t->items[1] = MP_OBJ_NEW_SMALL_INT(poll_obj->flags_ret);
+            MP_GC_WRITE_BARRIER(t);
             if (self->flags & FLAG_ONESHOT) {
                 // Don't poll next time, until new event flags will be set explicitly
                 poll_obj->flags = 0;
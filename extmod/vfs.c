@@ -27,6 +27,7 @@
 #include <stdint.h>
 #include <string.h>
 
+#include "py/gc.h"
 #include "py/runtime.h"
 #include "py/objstr.h"
 #include "py/mperrno.h"
@@ -247,15 +248,20 @@ mp_obj_t mp_vfs_mount(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args
 
     // insert the vfs into the mount table
     mp_vfs_mount_t **vfsp = &MP_STATE_VM(vfs_mount_table);
+    mp_vfs_mount_t *prev = NULL;
     while (*vfsp != NULL) {
         if ((*vfsp)->len == 1) {
             // make sure anything mounted at the root stays at the end of the list
             vfs->next = *vfsp;
             break;
         }
+        prev = *vfsp;
         vfsp = &(*vfsp)->next;
     }
     *vfsp = vfs;
+    if (prev != NULL) {
+        MP_GC_WRITE_BARRIER(prev);
+    }
 
     return mp_const_none;
 }
@@ -269,10 +275,14 @@ mp_obj_t mp_vfs_umount(mp_obj_t mnt_in) {
     if (mp_obj_is_str(mnt_in)) {
         mnt_str = mp_obj_str_get_data(mnt_in, &mnt_len);
     }
-    for (mp_vfs_mount_t **vfsp = &MP_STATE_VM(vfs_mount_table); *vfsp != NULL; vfsp = &(*vfsp)->next) {
+    mp_vfs_mount_t *prev = NULL;
+    for (mp_vfs_mount_t **vfsp = &MP_STATE_VM(vfs_mount_table); *vfsp != NULL; prev = *vfsp, vfsp = &(*vfsp)->next) {
         if ((mnt_str != NULL && !memcmp(mnt_str, (*vfsp)->str, mnt_len + 1)) || (*vfsp)->obj == mnt_in) {
             vfs = *vfsp;
             *vfsp = (*vfsp)->next;
+            if (prev != NULL) {
+                MP_GC_WRITE_BARRIER(prev);
+            }
             break;
         }
     }
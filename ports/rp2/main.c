@@ -47,6 +47,8 @@
 #include "hardware/structs/rosc.h"
 
 extern uint8_t __StackTop, __StackBottom;
+extern uint8_t __scratch_x_end__, __StackOneBottom;
+extern uint8_t __StackLimit, __GcHeapTop;
 static char gc_heap[192 * 1024];
 
 // Embed version info in the binary in machine readable form
@@ -91,7 +93,20 @@ int main(int argc, char **argv) {
     // Initialise stack extents and GC heap.
     mp_stack_set_top(&__StackTop);
     mp_stack_set_limit(&__StackTop - &__StackBottom - 256);
+    #if MICROPY_STACK_HIGH_WATER
+    // core1 traces only the used part of this stack, see mp_thread_gc_others()
+    mp_stack_fill(&__StackBottom, &__StackTop);
+    #endif
     gc_init(&gc_heap[0], &gc_heap[MP_ARRAY_SIZE(gc_heap)]);
+    #if MICROPY_GC_SPLIT_HEAP
+    // The RAM between the C heap and the end of the striped banks, which
+    // gc_heap leaves over.
+    gc_add(&__StackLimit, &__GcHeapTop);
+    // Core1 is always launched with a stack of its own, so the scratch X bank
+    // (SRAM4) it would otherwise use for its stack can go to the heap, less
+    // the time critical code placed there.
+    gc_add(&__scratch_x_end__, &__StackOneBottom);
+    #endif
 
     for (;;) {
 
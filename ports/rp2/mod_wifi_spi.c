@@ -17,6 +17,8 @@
 #include "wifi_spi_io.h"
 //#include "fpioa.h"
 
+#define ESP8285_SPI_BAUDRATE    (4000000)
+
 typedef struct _esp8285_nic_obj_t
 {
     mp_obj_base_t base;
@@ -200,9 +202,31 @@ STATIC void esp8285_make_new_helper(esp8285_nic_obj_t *self, size_t n_args, cons
     mp_arg_val_t args_parsed[MP_ARRAY_SIZE(allowed_args)];
     mp_arg_parse_all(n_args, pos_args, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args_parsed);
 
+    cs = mp_hal_get_pin_obj(args_parsed[ARG_cs].u_obj);
+    rst = (args_parsed[ARG_rst].u_obj == mp_const_none) ? -1 : mp_hal_get_pin_obj(args_parsed[ARG_rst].u_obj);
+    rdy = mp_hal_get_pin_obj(args_parsed[ARG_rdy].u_obj);
+    mosi = mp_hal_get_pin_obj(args_parsed[ARG_mosi].u_obj);
+    miso = mp_hal_get_pin_obj(args_parsed[ARG_miso].u_obj);
+    sclk = mp_hal_get_pin_obj(args_parsed[ARG_sclk].u_obj);
+
+    // if the pins belong to one SPI peripheral, clock the frames with it and
+    // DMA instead of bit-banging
+    mp_obj_base_t *spi = NULL;
+    int spi_id = (sclk & 8) >> 3;
+    if ((sclk & 3) == 2 && (mosi & 3) == 3 && (miso & 3) == 0
+        && ((mosi & 8) >> 3) == spi_id && ((miso & 8) >> 3) == spi_id)
+    {
+        mp_obj_t spi_args[] = {
+            MP_OBJ_NEW_SMALL_INT(spi_id), MP_OBJ_NEW_SMALL_INT(ESP8285_SPI_BAUDRATE),
+            MP_OBJ_NEW_QSTR(MP_QSTR_sck), args_parsed[ARG_sclk].u_obj,
+            MP_OBJ_NEW_QSTR(MP_QSTR_mosi), args_parsed[ARG_mosi].u_obj,
+            MP_OBJ_NEW_QSTR(MP_QSTR_miso), args_parsed[ARG_miso].u_obj,
+        };
+        spi = MP_OBJ_TO_PTR(machine_spi_type.make_new(&machine_spi_type, 2, 3, spi_args));
+    }
 
     esp8285_spi_config_io(cs , rst, rdy ,
-                        mosi , miso , sclk );
+                        mosi , miso , sclk, spi);
     esp8285_spi_init();
     /* char* version = m_new(char, 32);
     char* ret = esp8285_spi_firmware_version(version);
@@ -630,6 +654,41 @@ STATIC mp_uint_t esp8285_socket_recvfrom(mod_network_socket_obj_t *socket, byte
 	return read_len;
 }
  */
+STATIC int esp8285_socket_ioctl(mod_network_socket_obj_t *socket, mp_uint_t request, mp_uint_t arg, int *_errno) {
+	if((mp_obj_type_t*)&mod_network_nic_type_esp8285 != mp_obj_get_type(MP_OBJ_TO_PTR(socket->nic)))
+	{
+		*_errno = MP_EPIPE;
+		return MP_STREAM_ERROR;
+	}
+    if(request != MP_STREAM_POLL)
+    {
+        *_errno = MP_EINVAL;
+        return MP_STREAM_ERROR;
+    }
+    esp8285_nic_obj_t* self = (esp8285_nic_obj_t*)socket->nic;
+    if(self->sock_id < 0)
+        return MP_STREAM_POLL_HUP | (arg & MP_STREAM_POLL_RD);
+    // two short commands: how much the NIC holds for us, and whether the
+    // connection is still up
+    int32_t avail = esp8285_spi_socket_available(self->sock_id);
+    int8_t status = esp8285_spi_socket_status(self->sock_id);
+    if(avail < 0 || status < 0)
+        return MP_STREAM_POLL_ERR;
+    mp_uint_t ret = 0;
+    if((arg & MP_STREAM_POLL_RD) && (avail > 0 || status != SOCKET_ESTABLISHED))
+        ret |= MP_STREAM_POLL_RD;
+    if(status == SOCKET_ESTABLISHED)
+    {
+        // the firmware queues writes without blocking
+        ret |= arg & MP_STREAM_POLL_WR;
+    }
+    else if(socket->u_param.type == MOD_NETWORK_SOCK_STREAM)
+    {
+        ret |= MP_STREAM_POLL_HUP;
+    }
+    return ret;
+}
+
  /* 
 STATIC void esp8285_socket_close(mod_network_socket_obj_t *socket) {
 	if((mp_obj_type_t*)&mod_network_nic_type_esp8285 != mp_obj_get_type(MP_OBJ_TO_PTR(socket->nic)))
@@ -676,12 +735,12 @@ const mod_network_nic_type_t mod_network_nic_type_esp8285 = {
     .close = esp8285_socket_close,
     .sendto = esp8285_socket_sendto,
     .recvfrom = esp8285_socket_recvfrom, */
+    .ioctl = esp8285_socket_ioctl,
     /*
     .bind = cc3k_socket_bind,
     .listen = cc3k_socket_listen,
     .accept = cc3k_socket_accept,
     .setsockopt = cc3k_socket_setsockopt,
     .settimeout = cc3k_socket_settimeout,
-    .ioctl = cc3k_socket_ioctl,
 */
 };
@@ -36,7 +36,7 @@
 #include "modmachine.h"
 #include "wifi_uart.h"
 #include "mpconfigboard.h"
-#include "buffer.h"
+#include "drivers/esp8266/buffer.h"
 
 STATIC bool nic_connected = false;
 typedef struct _nic_obj_t
@@ -69,7 +69,20 @@ STATIC void esp8266_socket_close(mod_network_socket_obj_t *socket)
         return;
     }
     nic_obj_t *self = MP_OBJ_TO_PTR(socket->nic);
-    releaseTCP(&self->esp8266);
+    if (socket->link_id < 0)
+    {
+        return;
+    }
+    if (self->esp8266.mux)
+    {
+        releaseTCP_mul(&self->esp8266, '0' + socket->link_id);
+    }
+    else
+    {
+        releaseTCP(&self->esp8266);
+    }
+    esp8266_link_close(&self->esp8266, socket->link_id);
+    socket->link_id = -1;
 }
 
 STATIC mp_uint_t esp8266_socket_recv(mod_network_socket_obj_t *socket, byte *buf, mp_uint_t len, int *_errno)
@@ -82,8 +95,7 @@ STATIC mp_uint_t esp8266_socket_recv(mod_network_socket_obj_t *socket, byte *buf
     nic_obj_t *self = MP_OBJ_TO_PTR(socket->nic);
     int ret = 0;
     uint32_t read_len = 0;
-    ret = esp_recv(&self->esp8266, (char *)buf, len, &read_len, (uint32_t)(socket->timeout * 1000), &socket->peer_closed, socket->first_read_after_write);
-    socket->first_read_after_write = false;
+    ret = esp_recv(&self->esp8266, socket->link_id, (char *)buf, len, &read_len, (uint32_t)(socket->timeout * 1000), &socket->peer_closed);
     if (ret == -1)
     {
         *_errno = MP_EPIPE;
@@ -121,9 +133,33 @@ STATIC mp_uint_t esp8266_socket_send(mod_network_socket_obj_t *socket, const byt
         *_errno = MP_ENOTCONN;
         return MP_STREAM_ERROR;
     }
-    Buffer_Clear(&self->esp8266.buffer); //clear receive buffer
-    socket->first_read_after_write = true;
-    if (0 == esp_send(&self->esp8266, (const char *)buf, len, (uint32_t)(socket->timeout * 1000)))
+    if (socket->timeout == 0)
+    {
+        // non-blocking: queue one chunk, a failure shows up on the next call
+        if (self->esp8266.send_failed & (1 << socket->link_id))
+        {
+            self->esp8266.send_failed &= ~(1 << socket->link_id);
+            *_errno = MP_EPIPE;
+            return MP_STREAM_ERROR;
+        }
+        len = MIN(len, ESP8266_MAX_ONCE_SEND);
+        if (!esp_send_async(&self->esp8266, socket->link_id, (const char *)buf, len))
+        {
+            *_errno = MP_EAGAIN;
+            return MP_STREAM_ERROR;
+        }
+        return len;
+    }
+    bool sent;
+    if (self->esp8266.mux)
+    {
+        sent = esp_send_mul(&self->esp8266, '0' + socket->link_id, (const char *)buf, len);
+    }
+    else
+    {
+        sent = esp_send(&self->esp8266, (const char *)buf, len, (uint32_t)(socket->timeout * 1000));
+    }
+    if (!sent)
     {
         *_errno = MP_EPIPE;
         return MP_STREAM_ERROR;
@@ -131,6 +167,40 @@ STATIC mp_uint_t esp8266_socket_send(mod_network_socket_obj_t *socket, const byt
     return len;
 }
 
+STATIC int esp8266_socket_ioctl(mod_network_socket_obj_t *socket, mp_uint_t request, mp_uint_t arg, int *_errno)
+{
+    if ((mp_obj_type_t *)&mod_network_nic_type_esp8266 != mp_obj_get_type(MP_OBJ_TO_PTR(socket->nic)))
+    {
+        *_errno = MP_EPIPE;
+        return MP_STREAM_ERROR;
+    }
+    if (request != MP_STREAM_POLL)
+    {
+        *_errno = MP_EINVAL;
+        return MP_STREAM_ERROR;
+    }
+    nic_obj_t *self = MP_OBJ_TO_PTR(socket->nic);
+    uint8_t state = esp8266_link_poll(&self->esp8266, socket->link_id);
+    mp_uint_t ret = 0;
+    if ((arg & MP_STREAM_POLL_RD) && ((state & ESP8266_LINK_READABLE) || socket->peer_closed))
+    {
+        ret |= MP_STREAM_POLL_RD;
+    }
+    if ((arg & MP_STREAM_POLL_WR) && (state & ESP8266_LINK_WRITABLE) && !socket->peer_closed)
+    {
+        ret |= MP_STREAM_POLL_WR;
+    }
+    if ((state & ESP8266_LINK_CLOSED) || socket->peer_closed)
+    {
+        ret |= MP_STREAM_POLL_HUP;
+    }
+    if (state & ESP8266_LINK_FAILED)
+    {
+        ret |= MP_STREAM_POLL_ERR;
+    }
+    return ret;
+}
+
 STATIC int esp8266_socket_socket(mod_network_socket_obj_t *socket, int *_errno)
 {
 
@@ -146,36 +216,29 @@ STATIC int esp8266_socket_connect(mod_network_socket_obj_t *socket, byte *ip, mp
     }
     socket->peer_closed = false;
     nic_obj_t *self = MP_OBJ_TO_PTR(socket->nic);
-    switch (socket->u_param.type)
-    {
-    case MOD_NETWORK_SOCK_STREAM:
+    int8_t link = esp8266_link_open(&self->esp8266);
+    if (link < 0)
     {
-        if (false == createTCP(&self->esp8266, (char *)ip, port))
-        {
-            *_errno = -1;
-            return -1;
-        }
-        break;
+        *_errno = MP_ENOMEM;
+        return -1;
     }
-    case MOD_NETWORK_SOCK_DGRAM:
+    bool connected;
+    const char *type = socket->u_param.type == MOD_NETWORK_SOCK_DGRAM ? "UDP" : "TCP";
+    if (self->esp8266.mux)
     {
-        if (false == registerUDP(&self->esp8266, (char *)ip, port))
-        {
-            *_errno = -1;
-            return -1;
-        }
-        break;
+        connected = sATCIPSTARTMultiple(&self->esp8266, '0' + link, (char *)type, (char *)ip, port);
     }
-    default:
+    else
     {
-        if (false == createTCP(&self->esp8266, (char *)ip, port))
-        {
-            *_errno = -1;
-            return -1;
-        }
-        break;
+        connected = sATCIPSTARTSingle(&self->esp8266, type, (char *)ip, port);
     }
+    if (false == connected)
+    {
+        esp8266_link_close(&self->esp8266, link);
+        *_errno = -1;
+        return -1;
     }
+    socket->link_id = link;
     return 0;
 }
 
@@ -193,6 +256,15 @@ STATIC int esp8266_socket_gethostbyname(mp_obj_t nic, const char *name, mp_uint_
 
 STATIC int esp8266_mqtt(mqtt_obj_t *mqtt, int *_errno)
 {
+    nic_obj_t *self = MP_OBJ_TO_PTR(mqtt->nic);
+    mqtt_pool_t *pool = &self->esp8266.mqtt_rx;
+    if (pool->arena == NULL)
+    {
+        // only allocated once a client needs it, messages are pooled from now on
+        mqtt_pool_init(pool, m_new(uint8_t, MQTT_POOL_ARENA_SIZE), MQTT_POOL_ARENA_SIZE);
+    }
+    self->esp8266.mqtt_client = MP_OBJ_FROM_PTR(mqtt);
+    self->esp8266.mqtt_dispatch = MP_OBJ_FROM_PTR(&mqtt_dispatch_obj);
     return 0;
 }
 STATIC int esp8266_mqtt_setcfg(mqtt_obj_t *mqtt, const char* client_id, const char* username, const char* password, int cert_key_ID, int CA_ID, const char* path)
@@ -248,14 +320,18 @@ STATIC int esp8266_mqtt_ping(mqtt_obj_t *mqtt, const char *name, mp_uint_t len,
 
 }
 
-STATIC int esp8266_mqtt_publish(mqtt_obj_t *mqtt, const char *topic, const char *data, uint8_t qos, uint8_t retain)
+STATIC int esp8266_mqtt_publish(mqtt_obj_t *mqtt, const char *topic, const uint8_t *data, size_t data_len, uint8_t qos, uint8_t retain, bool block)
 {
 	if ((mp_obj_type_t *)&mod_network_nic_type_esp8266 != mp_obj_get_type(MP_OBJ_TO_PTR(mqtt->nic)))
     {
         return -1;
     }
     nic_obj_t *self = MP_OBJ_TO_PTR(mqtt->nic);
-    if (false == sMQTTPUB(&self->esp8266, 0, (char *)topic, (char *)data, qos, retain))
+    if (!block)
+    {
+        return sMQTTPUBRAW_async(&self->esp8266, 0, topic, data, data_len, qos, retain) ? 0 : MP_EAGAIN;
+    }
+    if (false == sMQTTPUBRAW(&self->esp8266, 0, topic, data, data_len, qos, retain))
     {
         return -1;
     }  
@@ -276,23 +352,30 @@ STATIC int esp8266_mqtt_subscribe(mqtt_obj_t *mqtt, const char *topic, uint8_t q
     return 0;
 }
 
-STATIC int esp8266_mqtt_wait_msg(mqtt_obj_t *mqtt, mqtt_msg* mqttmsg)
+STATIC int esp8266_mqtt_wait_msg(mqtt_obj_t *mqtt, uint32_t timeout_ms)
 {	
 	if ((mp_obj_type_t *)&mod_network_nic_type_esp8266 != mp_obj_get_type(MP_OBJ_TO_PTR(mqtt->nic)))
     {
         return -1;
     }
     nic_obj_t *self = MP_OBJ_TO_PTR(mqtt->nic);
-    if (false == get_mqttsubrecv(&self->esp8266, 0, mqttmsg)) 
-    {
-        return 0;
-    } 
-    return 1;
+    return esp8266_mqtt_poll(&self->esp8266, timeout_ms);
 }
 
-STATIC int esp8266_mqtt_check_msg(mqtt_obj_t *mqtt, const char *name, mp_uint_t len, uint8_t *out_ip)
+STATIC mqtt_pool_t *esp8266_mqtt_pool(mqtt_obj_t *mqtt)
 {
+    nic_obj_t *self = MP_OBJ_TO_PTR(mqtt->nic);
+    return &self->esp8266.mqtt_rx;
+}
 
+// Keep queued AT commands moving while the VM waits (MICROPY_EVENT_POLL_HOOK).
+STATIC void esp8266_poll(mp_obj_t nic)
+{
+    nic_obj_t *self = MP_OBJ_TO_PTR(nic);
+    if (self->esp8266.at.count > 0)
+    {
+        esp8266_at_poll(&self->esp8266);
+    }
 }
 
 STATIC mp_obj_t esp8266_make_new(const mp_obj_type_t *type, size_t n_args, size_t n_kw, const mp_obj_t *args)
@@ -316,6 +399,11 @@ STATIC mp_obj_t esp8266_make_new(const mp_obj_type_t *type, size_t n_args, size_
     nic_obj_t *nic_obj = m_new_obj(nic_obj_t);
     uint8_t *buff = m_new(uint8_t, ESP8266_BUF_SIZE);
     Buffer_Init(&nic_obj->esp8266.buffer, buff, ESP8266_BUF_SIZE);
+    esp8266_ipd_reset(&nic_obj->esp8266);
+    esp8266_at_init(&nic_obj->esp8266);
+    nic_obj->esp8266.mux = false;
+    nic_obj->esp8266.link_used = 0;
+    memset(nic_obj->esp8266.link_rx, 0, sizeof(nic_obj->esp8266.link_rx));
     nic_obj->base.type = (mp_obj_type_t *)&mod_network_nic_type_esp8266;
     nic_obj->esp8266.uart_obj = wifi_uart;
     nic_obj->uart_obj = wifi_uart;
@@ -608,6 +696,16 @@ STATIC mp_obj_t esp8266_config(size_t n_args, const mp_obj_t *args, mp_map_t *kw
         }
         break;
     }
+    case MP_QSTR_urc_stats:
+    {
+        // (too long, handler raised): response lines that were lost
+        mp_obj_t items[2] = {
+            mp_obj_new_int_from_uint(self->esp8266.at.urc_overlong),
+            mp_obj_new_int_from_uint(self->esp8266.at.urc_failed),
+        };
+        val = mp_obj_new_tuple(2, items);
+        break;
+    }
     default:
         goto unknown;
     }
@@ -800,12 +898,14 @@ const mod_network_nic_type_t mod_network_nic_type_esp8266 = {
         .make_new = esp8266_make_new,
         .locals_dict = (mp_obj_dict_t *)&esp8266_locals_dict,
     },
+    .poll = esp8266_poll,
     .gethostbyname = esp8266_socket_gethostbyname,
     .connect = esp8266_socket_connect,
     .socket = esp8266_socket_socket,
     .send = esp8266_socket_send,
     .recv = esp8266_socket_recv,
     .close = esp8266_socket_close,
+    .ioctl = esp8266_socket_ioctl,
 	.mqtt = esp8266_mqtt,
 	.mqtt_setcfg = esp8266_mqtt_setcfg,
 	.mqtt_set_last_will = esp8266_mqtt_set_last_will,
@@ -815,7 +915,7 @@ const mod_network_nic_type_t mod_network_nic_type_esp8266 = {
 	.mqtt_publish = esp8266_mqtt_publish,
 	.mqtt_subscribe = esp8266_mqtt_subscribe,
 	.mqtt_wait_msg = esp8266_mqtt_wait_msg,
-	.mqtt_check_msg = esp8266_mqtt_check_msg,
+	.mqtt_pool = esp8266_mqtt_pool,
     /*  
     .bind = cc3k_socket_bind,
     .listen = cc3k_socket_listen,
@@ -824,6 +924,5 @@ const mod_network_nic_type_t mod_network_nic_type_esp8266 = {
     .recvfrom = cc3k_socket_recvfrom,
     .setsockopt = cc3k_socket_setsockopt,
     .settimeout = cc3k_socket_settimeout,
-    .ioctl = cc3k_socket_ioctl,
 */
 };
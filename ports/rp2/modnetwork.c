@@ -73,6 +73,16 @@ mp_obj_t mod_network_find_nic(const uint8_t *ip) {
     nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, "no available NIC"));
 }
 
+void mod_network_poll_events(void) {
+    mp_obj_t nic = MP_STATE_PORT(modnetwork_nic);
+    if (nic != MP_OBJ_NULL) {
+        mod_network_nic_type_t *nic_type = (mod_network_nic_type_t *)mp_obj_get_type(nic);
+        if (nic_type->poll != NULL) {
+            nic_type->poll(nic);
+        }
+    }
+}
+
 STATIC mp_obj_t network_route(void) {
 	
     return MP_OBJ_FROM_PTR(MP_STATE_PORT(modnetwork_nic));
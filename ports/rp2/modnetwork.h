@@ -53,11 +53,12 @@ mp_obj_t mod_network_nic_ifconfig(struct netif *netif, size_t n_args, const mp_o
 
 struct _mod_network_socket_obj_t;
 struct _mqtt_obj_t;
-struct _mqtt_msg;
+struct _mqtt_pool_t;
 typedef struct _mod_network_nic_type_t {
     mp_obj_type_t base;
 
     // API for non-socket operations
+    void (*poll)(mp_obj_t nic); // let background work progress, may be NULL
     int (*gethostbyname)(mp_obj_t nic, const char *name, mp_uint_t len, uint8_t *ip_out);
 
     // API for socket operations; return -1 on error
@@ -80,10 +81,10 @@ typedef struct _mod_network_nic_type_t {
 	int (*mqtt_connect)(struct _mqtt_obj_t *mqtt, const char *name, mp_uint_t len, uint8_t *out_ip);
 	int (*mqtt_disconnect)(struct _mqtt_obj_t *mqtt);
 	int (*mqtt_ping)(struct _mqtt_obj_t *mqtt, const char *name, mp_uint_t len, uint8_t *out_ip);
-	int (*mqtt_publish)(struct _mqtt_obj_t *mqtt, const char *topic, const char *data, uint8_t qos, uint8_t retain);
+	int (*mqtt_publish)(struct _mqtt_obj_t *mqtt, const char *topic, const uint8_t *data, size_t data_len, uint8_t qos, uint8_t retain, bool block);
 	int (*mqtt_subscribe)(struct _mqtt_obj_t *mqtt, const char *topic, uint8_t qos);
-	int (*mqtt_wait_msg)(struct _mqtt_obj_t *mqtt,struct _mqtt_msg *mqttmsg);
-	int (*mqtt_check_msg)(struct _mqtt_obj_t *mqtt, const char *name, mp_uint_t len, uint8_t *out_ip);
+	int (*mqtt_wait_msg)(struct _mqtt_obj_t *mqtt, uint32_t timeout_ms);
+	struct _mqtt_pool_t *(*mqtt_pool)(struct _mqtt_obj_t *mqtt);
 
 } mod_network_nic_type_t;
 
@@ -100,9 +101,9 @@ typedef struct _mod_network_socket_obj_t {
         mp_uint_t u_state;
     };
     int8_t fd;
+    int8_t link_id; // NIC connection id, -1 if none
     float timeout;
     bool peer_closed;
-    bool first_read_after_write;
 } mod_network_socket_obj_t;
 typedef void (*mqtt_callback)(const char * topic, const char * msg);
 typedef struct _mqtt_obj_t {
@@ -121,11 +122,10 @@ typedef struct _mqtt_obj_t {
 	int timeout;
 	mqtt_callback mqtt_callback_fn;
 } mqtt_obj_t;
-typedef struct _mqtt_msg
-{
-	mp_obj_t topic;
-	mp_obj_t msg;
-}mqtt_msg;
+
+// Delivers the messages pooled by the NIC to the client's callback; the NIC
+// schedules it with the client as argument.
+extern const mp_obj_fun_builtin_fixed_t mqtt_dispatch_obj;
 
 extern const mod_network_nic_type_t mod_network_nic_type_esp8285;
 extern const mod_network_nic_type_t mod_network_nic_type_esp8266;
@@ -136,5 +136,6 @@ void mod_network_init(void);
 void mod_network_deinit(void);
 void mod_network_register_nic(mp_obj_t nic);
 mp_obj_t mod_network_find_nic(const uint8_t *ip);
+void mod_network_poll_events(void);
 
 #endif // MICROPY_INCLUDED_MAIX_MODNETWORK_H
@@ -34,6 +34,7 @@
 #include "py/mperrno.h"
 #include "lib/netutils/netutils.h"
 #include "modnetwork.h"
+#include "drivers/esp8266/mqtt_pool.h"
 
 #if MICROPY_PY_UMQTT && !MICROPY_PY_LWIP
 
@@ -124,12 +125,13 @@ STATIC mp_obj_t mqtt_ping(mp_obj_t self_in, mp_obj_t addr_in) {
 STATIC MP_DEFINE_CONST_FUN_OBJ_2(mqtt_ping_obj, mqtt_ping);
 
 STATIC mp_obj_t mqtt_publish(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
-	enum { ARG_topic, ARG_data, ARG_qos, ARG_retain};
+	enum { ARG_topic, ARG_data, ARG_qos, ARG_retain, ARG_block};
     static const mp_arg_t allowed_args[] = {
         { MP_QSTR_mqtt_topic, MP_ARG_REQUIRED | MP_ARG_OBJ, {.u_obj = MP_OBJ_NULL} },
         { MP_QSTR_mqtt_data, MP_ARG_REQUIRED | MP_ARG_OBJ, {.u_obj = MP_OBJ_NULL} },
         { MP_QSTR_mqtt_qos, MP_ARG_INT, {.u_int = -1} },
         { MP_QSTR_mqtt_retain, MP_ARG_INT , {.u_int = -1} },
+        { MP_QSTR_block, MP_ARG_KW_ONLY | MP_ARG_BOOL, {.u_bool = true} },
     };	
 	mqtt_obj_t *self = MP_OBJ_TO_PTR(pos_args[0]);
     mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
@@ -142,11 +144,11 @@ STATIC mp_obj_t mqtt_publish(size_t n_args, const mp_obj_t *pos_args, mp_map_t *
         topic = mp_obj_str_get_data(args[ARG_topic].u_obj, &topic_len);
     }
 
-    size_t data_len = 0;
-    const char *data = NULL;
+    // any buffer (str, bytes, bytearray, memoryview, array) is sent as is
+    mp_buffer_info_t data = { .buf = NULL, .len = 0 };
     if (args[ARG_data].u_obj != mp_const_none)
     {
-        data = mp_obj_str_get_data(args[ARG_data].u_obj, &data_len);
+        mp_get_buffer_raise(args[ARG_data].u_obj, &data, MP_BUFFER_READ);
     }
 
 	int qos = 0;
@@ -161,14 +163,62 @@ STATIC mp_obj_t mqtt_publish(size_t n_args, const mp_obj_t *pos_args, mp_map_t *
         // not connected
         mp_raise_OSError(MP_ENOTCONN);
     }	
-    if (self->nic_type->mqtt_publish(self, topic, data, qos, retain) != 0) {
-        mp_raise_OSError(-1);
+    // with block=False the publish is only queued, and OSError(EAGAIN) means the queue is full
+    int ret = self->nic_type->mqtt_publish(self, topic, data.buf, data.len, qos, retain, args[ARG_block].u_bool);
+    if (ret != 0) {
+        mp_raise_OSError(ret);
     }
     return mp_const_none;
 
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_KW(mqtt_publish_obj, 2, mqtt_publish);
 
+// publish_many(msgs, qos, retain, *, block=True): publish each (topic, data)
+// pair of the iterable `msgs` without a Python call per message. Returns the
+// number published; with block=False it stops early once the queue is full.
+STATIC mp_obj_t mqtt_publish_many(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
+	enum { ARG_msgs, ARG_qos, ARG_retain, ARG_block};
+    static const mp_arg_t allowed_args[] = {
+        { MP_QSTR_msgs, MP_ARG_REQUIRED | MP_ARG_OBJ, {.u_obj = MP_OBJ_NULL} },
+        { MP_QSTR_mqtt_qos, MP_ARG_INT, {.u_int = -1} },
+        { MP_QSTR_mqtt_retain, MP_ARG_INT , {.u_int = -1} },
+        { MP_QSTR_block, MP_ARG_KW_ONLY | MP_ARG_BOOL, {.u_bool = true} },
+    };
+	mqtt_obj_t *self = MP_OBJ_TO_PTR(pos_args[0]);
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args - 1, pos_args + 1, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+
+	int qos = args[ARG_qos].u_int > 0 ? args[ARG_qos].u_int : 0;
+	int retain = args[ARG_retain].u_int > 0 ? args[ARG_retain].u_int : 0;
+	bool block = args[ARG_block].u_bool;
+	if (self->nic == MP_OBJ_NULL) {
+        // not connected
+        mp_raise_OSError(MP_ENOTCONN);
+    }
+
+    mp_obj_iter_buf_t iter_buf;
+    mp_obj_t iterable = mp_getiter(args[ARG_msgs].u_obj, &iter_buf);
+    mp_obj_t item;
+    mp_int_t count = 0;
+    while ((item = mp_iternext(iterable)) != MP_OBJ_STOP_ITERATION) {
+        mp_obj_t *msg;
+        mp_obj_get_array_fixed_n(item, 2, &msg);
+        const char *topic = mp_obj_str_get_str(msg[0]);
+        mp_buffer_info_t data;
+        mp_get_buffer_raise(msg[1], &data, MP_BUFFER_READ);
+        int ret = self->nic_type->mqtt_publish(self, topic, data.buf, data.len, qos, retain, block);
+        if (ret == MP_EAGAIN && !block) {
+            break;
+        }
+        if (ret != 0) {
+            mp_raise_OSError(ret);
+        }
+        ++count;
+    }
+    return MP_OBJ_NEW_SMALL_INT(count);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(mqtt_publish_many_obj, 2, mqtt_publish_many);
+
 STATIC mp_obj_t mqtt_subscribe(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
 	enum { ARG_topic,  ARG_qos};
     static const mp_arg_t allowed_args[] = {
@@ -199,34 +249,72 @@ STATIC mp_obj_t mqtt_subscribe(size_t n_args, const mp_obj_t *pos_args, mp_map_t
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_KW(mqtt_subscribe_obj, 1, mqtt_subscribe);
 
-STATIC mp_obj_t mqtt_wait_msg(mp_obj_t self_in) {
+// Scheduled by the NIC when it has pooled messages. The strings are only made
+// here, so receiving never allocates; the callback gets a [topic, msg] list.
+STATIC mp_obj_t mqtt_dispatch(mp_obj_t self_in) {
+	mqtt_obj_t *self = MP_OBJ_TO_PTR(self_in);
+	mqtt_pool_t *pool = self->nic_type->mqtt_pool(self);
+	const char *topic;
+	size_t topic_len;
+	const uint8_t *data;
+	size_t data_len;
+	pool->scheduled = false;
+	while (mqtt_pool_peek(pool, &topic, &topic_len, &data, &data_len)) {
+		mp_obj_t list = mp_obj_new_list(0, NULL);
+		mp_obj_list_append(list, mp_obj_new_str(topic, topic_len));
+		mp_obj_list_append(list, mp_obj_new_str((const char *)data, data_len));
+		mqtt_pool_pop(pool);
+		if (self->mqtt_callback_fn != NULL) {
+			mp_call_function_1((mp_obj_t)self->mqtt_callback_fn, list);
+		}
+	}
+	return mp_const_none;
+}
+MP_DEFINE_CONST_FUN_OBJ_1(mqtt_dispatch_obj, mqtt_dispatch);
+
+STATIC mp_obj_t mqtt_wait(mp_obj_t self_in, uint32_t timeout_ms) {
 	mqtt_obj_t *self = MP_OBJ_TO_PTR(self_in);
-	//mqtt_msg *mqttmsg = NULL;
-	mqtt_msg mqttmsg;
-	mqttmsg.topic = mp_const_none;
-	mqttmsg.msg = mp_const_none;
 	if (self->nic == MP_OBJ_NULL) {
         // not connected
         mp_raise_OSError(MP_ENOTCONN);
     }
-	if (self->nic_type->mqtt_wait_msg(self, &mqttmsg) > 0) {
-	/*********************************Test****************************************************
-		mp_printf(MP_PYTHON_PRINTER, "test mqtt_wait_msg:1.%s 2.%s \n",
-        mqttmsg.topic, mqttmsg.msg);
-	*********************************End***************************************************/
-        	mp_obj_t list = mp_obj_new_list(0, NULL);
-			mp_obj_list_append(list, mqttmsg.topic);
-			mp_obj_list_append(list, mqttmsg.msg);
-			mp_sched_schedule(self->mqtt_callback_fn, list);
+	// the messages go to the callback through the scheduler
+	int pending = self->nic_type->mqtt_wait_msg(self, timeout_ms);
+	if (pending < 0) {
+        mp_raise_OSError(MP_EINVAL);
     }
-	return mp_const_none;
+	return MP_OBJ_NEW_SMALL_INT(pending);
+}
+
+STATIC mp_obj_t mqtt_wait_msg(mp_obj_t self_in) {
+	return mqtt_wait(self_in, 3000);
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_1(mqtt_wait_msg_obj, mqtt_wait_msg);
 
-STATIC mp_obj_t mqtt_check_msg(mp_obj_t self_in, mp_obj_t addr_in) {
+STATIC mp_obj_t mqtt_check_msg(mp_obj_t self_in) {
+	return mqtt_wait(self_in, 0);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(mqtt_check_msg_obj, mqtt_check_msg);
 
+// (received, dropped, overflow, pending): messages pooled so far, lost because
+// all pool slots were taken or they were malformed or cut short, lost because
+// the arena was full, and not yet delivered
+STATIC mp_obj_t mqtt_stats(mp_obj_t self_in) {
+	mqtt_obj_t *self = MP_OBJ_TO_PTR(self_in);
+	if (self->nic == MP_OBJ_NULL) {
+        // not connected
+        mp_raise_OSError(MP_ENOTCONN);
+    }
+	mqtt_pool_t *pool = self->nic_type->mqtt_pool(self);
+	mp_obj_t tuple[4] = {
+		mp_obj_new_int_from_uint(pool->received),
+		mp_obj_new_int_from_uint(pool->dropped),
+		mp_obj_new_int_from_uint(pool->overflow),
+		MP_OBJ_NEW_SMALL_INT(mqtt_pool_count(pool)),
+	};
+	return mp_obj_new_tuple(4, tuple);
 }
-STATIC MP_DEFINE_CONST_FUN_OBJ_2(mqtt_check_msg_obj, mqtt_check_msg);
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(mqtt_stats_obj, mqtt_stats);
 
 STATIC const mp_rom_map_elem_t mqtt_locals_dict_table[] = {
 	{ MP_ROM_QSTR(MP_QSTR___del__), MP_ROM_PTR(&mp_stream_close_obj) },
@@ -237,9 +325,11 @@ STATIC const mp_rom_map_elem_t mqtt_locals_dict_table[] = {
     { MP_ROM_QSTR(MP_QSTR_disconnect), MP_ROM_PTR(&mqtt_disconnect_obj) },	
     //{ MP_ROM_QSTR(MP_QSTR_ping), MP_ROM_PTR(&mqtt_ping_obj) },	
     { MP_ROM_QSTR(MP_QSTR_publish), MP_ROM_PTR(&mqtt_publish_obj) },	
+    { MP_ROM_QSTR(MP_QSTR_publish_many), MP_ROM_PTR(&mqtt_publish_many_obj) },
     { MP_ROM_QSTR(MP_QSTR_subscribe), MP_ROM_PTR(&mqtt_subscribe_obj) },	
     { MP_ROM_QSTR(MP_QSTR_wait_msg), MP_ROM_PTR(&mqtt_wait_msg_obj) },	
-    //{ MP_ROM_QSTR(MP_QSTR_check_msg), MP_ROM_PTR(&mqtt_check_msg_obj) },	
+    { MP_ROM_QSTR(MP_QSTR_check_msg), MP_ROM_PTR(&mqtt_check_msg_obj) },
+    { MP_ROM_QSTR(MP_QSTR_stats), MP_ROM_PTR(&mqtt_stats_obj) },
 };
 	
 STATIC MP_DEFINE_CONST_DICT(mqtt_locals_dict, mqtt_locals_dict_table);
@@ -265,6 +355,7 @@ STATIC mp_obj_t mqtt_make_new(const mp_obj_type_t *type, size_t n_args, size_t n
 	self->base.type = &MQTTClient_type;
     self->nic = MP_OBJ_NULL;
     self->nic_type = NULL;
+    self->mqtt_callback_fn = NULL;
 		
 	size_t client_id_len =0;
     if (args[ARG_client_id].u_obj != MP_OBJ_NULL) {
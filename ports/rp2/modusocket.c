@@ -404,6 +404,7 @@ STATIC mp_obj_t socket_make_new(const mp_obj_type_t *type, size_t n_args, size_t
     {
         mp_raise_OSError(MP_ENOMEM);
     }
+    s->link_id = -1;
     s->timeout = 10; // default timeout: 10s
     s->peer_closed = false;
 	if (n_args >= 1) {
@@ -453,10 +454,19 @@ mp_uint_t socket_ioctl(mp_obj_t self_in, mp_uint_t request, uintptr_t arg, int *
             self->fd = -1;
         }
         return 0;
+    }
+    if (self->nic == MP_OBJ_NULL) {
+        if (request == MP_STREAM_POLL) {
+            // not connected yet: nothing to report; closed: invalid
+            return self->fd < 0 ? MP_STREAM_POLL_NVAL : 0;
+        }
+        *errcode = MP_ENOTCONN;
+        return MP_STREAM_ERROR;
     }
 	if(self->nic_type->ioctl)
     	return self->nic_type->ioctl(self, request, arg, errcode);
-    return EPERM;
+    *errcode = MP_EINVAL;
+    return MP_STREAM_ERROR;
 }
 
 
@@ -54,8 +54,10 @@
 // Python internal features
 #define MICROPY_READER_VFS                      (1)
 #define MICROPY_ENABLE_GC                       (1)
+#define MICROPY_GC_SPLIT_HEAP                   (1)
 #define MICROPY_ENABLE_FINALISER                (1)
 #define MICROPY_STACK_CHECK                     (1)
+#define MICROPY_STACK_HIGH_WATER                (1)
 #define MICROPY_ENABLE_EMERGENCY_EXCEPTION_BUF  (1)
 #define MICROPY_KBD_EXCEPTION                   (1)
 #define MICROPY_HELPER_REPL                     (1)
@@ -213,6 +215,8 @@ extern const struct _mp_obj_module_t mp_module_umqtt;
     do { \
         extern void mp_handle_pending(bool); \
         mp_handle_pending(true); \
+        extern void mod_network_poll_events(void); \
+        mod_network_poll_events(); \
         best_effort_wfe_or_timeout(make_timeout_time_ms(1)); \
         MICROPY_HW_USBDEV_TASK_HOOK \
     } while (0);
@@ -27,6 +27,7 @@
 #include "py/runtime.h"
 #include "py/gc.h"
 #include "py/mpthread.h"
+#include "py/stackctrl.h"
 #include "pico/stdlib.h"
 #include "pico/multicore.h"
 
@@ -41,9 +42,18 @@ STATIC void *core1_arg = NULL;
 STATIC uint32_t *core1_stack = NULL;
 STATIC size_t core1_stack_num_words = 0;
 
+#if MICROPY_GC_PARALLEL_MARK
+spin_lock_t *mp_thread_gc_mark_spin;
+STATIC uint32_t gc_mark_core1_stack[256];
+STATIC volatile bool gc_mark_core1_busy;
+#endif
+
 void mp_thread_init(void) {
     mp_thread_set_state(&mp_state_ctx.thread);
     core1_entry = NULL;
+    #if MICROPY_GC_PARALLEL_MARK
+    mp_thread_gc_mark_spin = spin_lock_instance(spin_lock_claim_unused(true));
+    #endif
 }
 
 void mp_thread_deinit(void) {
@@ -51,15 +61,24 @@ void mp_thread_deinit(void) {
     core1_entry = NULL;
 }
 
+// Trace the stack of the other core, which keeps running, from the deepest
+// it has been used if it was filled for that.
+STATIC void gc_collect_stack(void *bottom, void *top) {
+    #if MICROPY_STACK_HIGH_WATER
+    bottom = mp_stack_high_water(bottom, top);
+    #endif
+    gc_collect_root(bottom, ((uintptr_t)top - (uintptr_t)bottom) / sizeof(uintptr_t));
+}
+
 void mp_thread_gc_others(void) {
     if (get_core_num() == 0) {
         // GC running on core0, trace core1's stack, if it's running.
         if (core1_entry != NULL) {
-            gc_collect_root((void **)core1_stack, core1_stack_num_words);
+            gc_collect_stack(core1_stack, core1_stack + core1_stack_num_words);
         }
     } else {
         // GC running on core1, trace core0's stack.
-        gc_collect_root((void **)&__StackBottom, (&__StackTop - &__StackBottom) / sizeof(uintptr_t));
+        gc_collect_stack(&__StackBottom, &__StackTop);
     }
 }
 
@@ -71,6 +90,29 @@ STATIC void core1_entry_wrapper(void) {
     // returning from here will loop the core forever (WFI)
 }
 
+#if MICROPY_GC_PARALLEL_MARK
+
+STATIC void gc_mark_core1_entry(void) {
+    gc_mark_worker();
+    gc_mark_core1_busy = false;
+    // returning from here will loop the core forever (WFI)
+}
+
+void mp_thread_gc_mark_parallel(void) {
+    // core1 can only help while no thread has been started on it
+    bool helper = get_core_num() == 0 && core1_entry == NULL;
+    if (helper) {
+        gc_mark_core1_busy = true;
+        multicore_reset_core1();
+        multicore_launch_core1_with_stack(gc_mark_core1_entry, gc_mark_core1_stack, sizeof(gc_mark_core1_stack));
+    }
+    gc_mark_worker();
+    while (helper && gc_mark_core1_busy) {
+    }
+}
+
+#endif // MICROPY_GC_PARALLEL_MARK
+
 void mp_thread_create(void *(*entry)(void *), void *arg, size_t *stack_size) {
     // Check if core1 is already in use.
     if (core1_entry != NULL) {
@@ -92,6 +134,10 @@ void mp_thread_create(void *(*entry)(void *), void *arg, size_t *stack_size) {
 
     // Allocate stack.
     core1_stack = m_new(uint32_t, core1_stack_num_words);
+    #if MICROPY_STACK_HIGH_WATER
+    // Fill it, so that core0 traces only the part core1 uses.
+    mp_stack_fill(core1_stack, core1_stack + core1_stack_num_words);
+    #endif
 
     // Create thread on core1.
     multicore_reset_core1();
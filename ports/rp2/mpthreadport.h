@@ -62,4 +62,32 @@ static inline void mp_thread_mutex_unlock(mp_thread_mutex_t *m) {
     mutex_exit(m);
 }
 
+#if MICROPY_GC_PARALLEL_MARK
+extern spin_lock_t *mp_thread_gc_mark_spin;
+
+static inline void mp_thread_gc_mark_lock(void) {
+    spin_lock_unsafe_blocking(mp_thread_gc_mark_spin);
+}
+
+static inline void mp_thread_gc_mark_unlock(void) {
+    spin_unlock_unsafe(mp_thread_gc_mark_spin);
+    // the pool and the idle count only change under the lock, wake the
+    // other core if it is waiting for that
+    __sev();
+}
+
+static inline void mp_thread_gc_mark_pause(void) {
+    __wfe();
+}
+
+static inline uint8_t mp_thread_gc_mark_fetch_or(uint8_t *ptr, uint8_t bits) {
+    // Cortex-M0+ has no exclusive load/store, so this takes the spinlock too
+    mp_thread_gc_mark_lock();
+    uint8_t old = *ptr;
+    *ptr = old | bits;
+    mp_thread_gc_mark_unlock();
+    return old;
+}
+#endif
+
 #endif // MICROPY_INCLUDED_RP2_MPTHREADPORT_H
@@ -1,4 +1,5 @@
 #include <stdlib.h>
+#include <string.h>
 
 #include "wifi_spi.h"
 #include "wifi_spi_io.h"
@@ -14,7 +15,12 @@
 // -1 error, no response
 
 static void esp8285_spi_reset(void);
-static int8_t esp8285_spi_send_command(uint8_t cmd, esp8285_spi_params_t *params, uint8_t param_len_16);
+
+// command and reply frames are built and parsed in place here, so no command
+// allocates and each frame moves in one or a few bulk transfers
+static esp8285_spi_proto_t esp8285_spi_proto = {
+    .io = &esp8285_spi_io,
+};
 
 void esp8285_spi_init(void)
 {
@@ -63,7 +69,7 @@ static void esp8285_spi_reset(void)
     else
     {
         //soft reset
-        esp8285_spi_send_command(SOFT_RESET_CMD, NULL, 0);
+        esp8285_spi_proto_send(&esp8285_spi_proto, SOFT_RESET_CMD, NULL, 0, 0);
         sleep_ms(1500);
     }
 
@@ -97,351 +103,23 @@ int8_t esp8285_spi_wait_for_ready(void)
     return -1;
 }
 
-#define lc_buf_len 256
-uint8_t lc_send_buf[lc_buf_len];
-uint8_t lc_buf_flag = 0;
-
-/// Send over a command with a list of parameters
-// -1 error
-// other right
-static int8_t esp8285_spi_send_command(uint8_t cmd, esp8285_spi_params_t *params, uint8_t param_len_16)
-{
-    uint32_t packet_len = 0;
-
-    packet_len = 4; // header + end byte
-    if (params != NULL)
-    {
-        for (uint32_t i = 0; i < params->params_num; i++)
-        {
-            packet_len += params->params[i]->param_len;
-            packet_len += 1; // size byte
-            if (param_len_16)
-                packet_len += 1;
-        }
-    }
-    while (packet_len % 4 != 0)
-        packet_len += 1;
-
-    uint8_t *sendbuf = NULL;
-
-    if (packet_len > lc_buf_len)
-    {
-        sendbuf = (uint8_t *)malloc(sizeof(uint8_t) * packet_len);
-        lc_buf_flag = 0;
-        if (!sendbuf)
-        {
-#if (ESP8285_SPI_DEBUG)
-            mp_printf(MP_PYTHON_PRINTER,"%s: malloc error\r\n", __func__);
-#endif
-            return -1;
-        }
-    }
-    else
-    {
-        sendbuf = lc_send_buf;
-        lc_buf_flag = 1;
-    }
-
-    sendbuf[0] = START_CMD;
-    sendbuf[1] = cmd & ~REPLY_FLAG;
-    if (params != NULL)
-        sendbuf[2] = params->params_num;
-    else
-        sendbuf[2] = 0;
-
-    uint32_t ptr = 3;
-
-    if (params != NULL)
-    {
-        //handle parameters here
-        for (uint32_t i = 0; i < params->params_num; i++)
-        {
-#if (ESP8285_SPI_DEBUG >= 2)
-            mp_printf(MP_PYTHON_PRINTER,"\tSending param #%d is %d bytes long\r\n", i, params->params[i]->param_len);
-#endif
-
-            if (param_len_16)
-            {
-                sendbuf[ptr] = (uint8_t)((params->params[i]->param_len >> 8) & 0xFF);
-                ptr += 1;
-            }
-            sendbuf[ptr] = (uint8_t)(params->params[i]->param_len & 0xFF);
-            ptr += 1;
-            memcpy(sendbuf + ptr, params->params[i]->param, params->params[i]->param_len);
-            ptr += params->params[i]->param_len;
-        }
-    }
-    sendbuf[ptr] = END_CMD;
-
-    esp8285_spi_wait_for_ready();
-    gpio_put(cs_num, 0);
-
-    uint64_t tm = time_us_32();
-    while ((time_us_32() - tm) < 1000 * 1000)
-    {
-        if (gpio_get(rdy_num))
-            break;
-        sleep_ms(1);
-    }
-
-    if ((time_us_32() - tm) > 1000 * 1000)
-    {
-#if (ESP8285_SPI_DEBUG)
-        mp_printf(MP_PYTHON_PRINTER,"ESP32 timed out on SPI select\r\n");
-#endif
-        gpio_put(cs_num, 1);
-        if (lc_buf_flag == 0)
-        {
-            free(sendbuf);
-            sendbuf = NULL;
-        }
-        else
-        {
-            memset(sendbuf, 0, packet_len);
-        }
-        return -1;
-    }
-
-    soft_spi_rw_len(sendbuf, NULL, packet_len);
-    gpio_put(cs_num, 1);
-
-#if (ESP8285_SPI_DEBUG >= 3)
-    if (packet_len < 100)
-    {
-        mp_printf(MP_PYTHON_PRINTER,"Wrote buf packet_len --> %d: ", packet_len);
-        for (uint32_t i = 0; i < packet_len; i++)
-            mp_printf(MP_PYTHON_PRINTER,"%02x ", sendbuf[i]);
-        mp_printf(MP_PYTHON_PRINTER,"\r\n");
-    }
-#endif
-    if (lc_buf_flag == 0)
-    {
-        free(sendbuf);
-        sendbuf = NULL;
-    }
-    else
-    {
-        memset(sendbuf, 0, packet_len);
-    }
-    return 0;
-}
-uint8_t esp8285_spi_read_byte(void)
-{
-    uint8_t read = 0x0;
-
-    read = soft_spi_rw(0xff);
-
-#if (ESP8285_SPI_DEBUG >= 3)
-    mp_printf(MP_PYTHON_PRINTER,"\t\tRead:%02x\r\n", read);
-#endif
-
-    return read;
-}
-
-///Read many bytes from SPI
-void esp8285_spi_read_bytes(uint8_t *buffer, uint32_t len)
-{
-    soft_spi_rw_len(NULL, buffer, len);
-
-#if (ESP8285_SPI_DEBUG >= 3)
-    if (len < 100)
-    {
-        mp_printf(MP_PYTHON_PRINTER,"\t\tRead:");
-        for (uint32_t i = 0; i < len; i++)
-            mp_printf(MP_PYTHON_PRINTER,"%02x ", *(buffer + i));
-        mp_printf(MP_PYTHON_PRINTER,"\r\n");
-    }
-#endif
-}
-
-///Read a byte with a time-out, and if we get it, check that its what we expect
+/// Send over a command with a list of parameters and read back its reply,
+/// `resp` points into the frame buffer until the next command
 //0 succ
 //-1 error
-int8_t esp8285_spi_wait_spi_char(uint8_t want)
-{
-    uint8_t read = 0x0;
-    uint64_t tm = time_us_32();
-
-    while ((time_us_32() - tm) < 100 * 1000)
-    {
-        read = esp8285_spi_read_byte();
-
-        if (read == ERR_CMD)
-        {
-#if ESP8285_SPI_DEBUG
-            mp_printf(MP_PYTHON_PRINTER,"Error response to command\r\n");
-#endif
-            return -1;
-        }
-        else if (read == want)
-            return 0;
-    }
-
-#if 0
-    if ((time_us_32() - tm) > 100 * 1000)
-    {
-#if ESP8285_SPI_DEBUG
-        mp_printf(MP_PYTHON_PRINTER,"Timed out waiting for SPI char\r\n");
-#endif
-        return -1;
-    }
-#endif
-
-    return -1;
-}
-
-///Read a byte and verify its the value we want
-//0 right
-//-1 error
-uint8_t esp8285_spi_check_data(uint8_t want)
+int8_t esp8285_spi_command(uint8_t cmd, const esp8285_spi_param_t *params, uint32_t params_num,
+    uint8_t sent_param_len_16, uint8_t recv_param_len_16, esp8285_spi_resp_t *resp)
 {
-    uint8_t read = esp8285_spi_read_byte();
+    int8_t ret = esp8285_spi_proto_command(&esp8285_spi_proto, cmd, params, params_num,
+        sent_param_len_16, recv_param_len_16, resp);
 
-    if (read != want)
-    {
-#if ESP8285_SPI_DEBUG
-        mp_printf(MP_PYTHON_PRINTER,"Expected %02X but got %02X\r\n", want, read);
-#endif
-        return -1;
-    }
-    return 0;
-}
-esp8285_spi_params_t *esp8285_spi_wait_response_cmd(uint8_t cmd, uint32_t *num_responses, uint8_t param_len_16)
-{
-    uint32_t num_of_resp = 0;
-
-    esp8285_spi_wait_for_ready();
-
-    gpio_put(cs_num, 0);
-
-    uint64_t tm = time_us_32();
-    while ((time_us_32() - tm) < 1000 * 1000)
-    {
-        if (gpio_get(rdy_num))
-            break;
-        sleep_ms(1);
-    }
-
-    if ((time_us_32() - tm) > 1000 * 1000)
-    {
-#if ESP8285_SPI_DEBUG
-        mp_printf(MP_PYTHON_PRINTER,"ESP32 timed out on SPI select\r\n");
-#endif
-        gpio_put(cs_num, 1);
-        return NULL;
-    }
-
-    if (esp8285_spi_wait_spi_char(START_CMD) != 0)
-    {
-#if ESP8285_SPI_DEBUG
-        mp_printf(MP_PYTHON_PRINTER,"esp8285_spi_wait_spi_char START_CMD error\r\n");
-#endif
-        gpio_put(cs_num, 1);
-        return NULL;
-    }
-
-    if (esp8285_spi_check_data(cmd | REPLY_FLAG) != 0)
-    {
-#if ESP8285_SPI_DEBUG
-        mp_printf(MP_PYTHON_PRINTER,"esp8285_spi_check_data cmd | REPLY_FLAG error\r\n");
-#endif
-        gpio_put(cs_num, 1);
-        return NULL;
-    }
-
-    if (num_responses)
-    {
-        if (esp8285_spi_check_data(*num_responses) != 0)
-        {
-#if ESP8285_SPI_DEBUG
-            mp_printf(MP_PYTHON_PRINTER,"esp8285_spi_check_data num_responses error\r\n");
-#endif
-            gpio_put(cs_num, 1);
-            return NULL;
-        }
-        num_of_resp = *num_responses;
-    }
-    else
-    {
-        num_of_resp = esp8285_spi_read_byte();
-    }
-
-    esp8285_spi_params_t *params_ret = (esp8285_spi_params_t *)malloc(sizeof(esp8285_spi_params_t));
-
-    params_ret->del = delete_esp8285_spi_params;
-    params_ret->params_num = num_of_resp;
-    params_ret->params = (void *)malloc(sizeof(void *) * num_of_resp);
-
-    for (uint32_t i = 0; i < num_of_resp; i++)
-    {
-        params_ret->params[i] = (esp8285_spi_param_t *)malloc(sizeof(esp8285_spi_param_t));
-        params_ret->params[i]->param_len = esp8285_spi_read_byte();
-
-        if (param_len_16)
-        {
-            params_ret->params[i]->param_len <<= 8;
-            params_ret->params[i]->param_len |= esp8285_spi_read_byte();
-        }
-
-#if (ESP8285_SPI_DEBUG >= 2)
-        mp_printf(MP_PYTHON_PRINTER,"\tParameter #%d length is %d\r\n", i, params_ret->params[i]->param_len);
+#if (ESP8285_SPI_DEBUG >= 3)
+    mp_printf(MP_PYTHON_PRINTER,"cmd %02x -> %d, %d params\r\n", cmd, ret, ret == 0 ? resp->params_num : 0);
 #endif
-
-        params_ret->params[i]->param = (uint8_t *)malloc(sizeof(uint8_t) * params_ret->params[i]->param_len);
-        esp8285_spi_read_bytes(params_ret->params[i]->param, params_ret->params[i]->param_len);
-    }
-
-    if (esp8285_spi_check_data(END_CMD) != 0)
-    {
 #if ESP8285_SPI_DEBUG
-        mp_printf(MP_PYTHON_PRINTER,"esp8285_spi_check_data END_CMD error\r\n");
+    if (ret != 0)
+        mp_printf(MP_PYTHON_PRINTER,"%s: cmd %02x failed\r\n", __func__, cmd);
 #endif
-        gpio_put(cs_num, 1);
-        return NULL;
-    }
-
-    gpio_put(cs_num, 1);
-
-    return params_ret;
-}
-esp8285_spi_params_t *esp8285_spi_send_command_get_response(uint8_t cmd, esp8285_spi_params_t *params, uint32_t *num_resp, uint8_t sent_param_len_16, uint8_t recv_param_len_16)
-{
-    uint32_t resp_num;
-
-    if (!num_resp)
-        resp_num = 1;
-    else
-        resp_num = *num_resp;
-
-    esp8285_spi_send_command(cmd, params, sent_param_len_16);
-    return esp8285_spi_wait_response_cmd(cmd, &resp_num, recv_param_len_16);
-}
-static void delete_esp8285_spi_params(void *arg)
-{
-    esp8285_spi_params_t *params = (esp8285_spi_params_t *)arg;
-
-    for (uint8_t i = 0; i < params->params_num; i++)
-    {
-        esp8285_spi_param_t *param = params->params[i];
-        free(param->param);
-        free(param);
-    }
-    free(params->params);
-    free(params);
-}
-
-static esp8285_spi_params_t *esp8285_spi_params_alloc_1param(uint32_t len, uint8_t *buf)
-{
-    esp8285_spi_params_t *ret = (esp8285_spi_params_t *)malloc(sizeof(esp8285_spi_params_t));
-
-    ret->del = delete_esp8285_spi_params;
-
-    ret->params_num = 1;
-    ret->params = (void *)malloc(sizeof(void *) * ret->params_num);
-    ret->params[0] = (esp8285_spi_param_t *)malloc(sizeof(esp8285_spi_param_t));
-    ret->params[0]->param_len = len;
-    ret->params[0]->param = (uint8_t *)malloc(sizeof(uint8_t) * len);
-    memcpy(ret->params[0]->param, buf, len);
 
     return ret;
 }
@@ -452,24 +130,22 @@ int8_t esp8285_spi_start_scan_networks(void)
     mp_printf(MP_PYTHON_PRINTER,"Start scan\r\n");
 #endif
 
-    esp8285_spi_params_t *resp = esp8285_spi_send_command_get_response(START_SCAN_NETWORKS, NULL, NULL, 0, 0);
+    esp8285_spi_resp_t resp;
 
-    if (resp == NULL)
+    if (esp8285_spi_command(START_SCAN_NETWORKS, NULL, 0, 0, 0, &resp) != 0)
     {
         mp_printf(MP_PYTHON_PRINTER,"%s: get resp error!\r\n", __func__);
         return -1;
     }
 
-    if (resp->params[0]->param[0] != 1)
+    if (resp.params_num != 1 || resp.params[0].param_len < 1 || resp.params[0].param[0] != 1)
     {
 #if ESP8285_SPI_DEBUG
         mp_printf(MP_PYTHON_PRINTER,"Failed to start AP scan\r\n");
 #endif
-        resp->del(resp);
         return -1;
     }
 
-    resp->del(resp);
     return 0;
 }
 static void delete_esp8285_spi_aps_list(void *arg)
@@ -483,13 +159,24 @@ static void delete_esp8285_spi_aps_list(void *arg)
     free(aps->aps);
     free(aps);
 }
-esp8285_spi_aps_list_t *esp8285_spi_get_scan_networks(void)
+
+//Send `cmd` with a one byte argument and read back a one byte value
+static int8_t esp8285_spi_get_idx_byte(uint8_t cmd, uint8_t idx, uint8_t *val)
 {
+    esp8285_spi_param_t send = { .param_len = 1, .param = &idx };
+    esp8285_spi_resp_t resp;
 
-    esp8285_spi_send_command(SCAN_NETWORKS, NULL, 0);
-    esp8285_spi_params_t *resp = esp8285_spi_wait_response_cmd(SCAN_NETWORKS, NULL, 0);
+    if (esp8285_spi_command(cmd, &send, 1, 0, 0, &resp) != 0 || resp.params_num < 1 || resp.params[0].param_len < 1)
+        return -1;
+    *val = resp.params[0].param[0];
+    return 0;
+}
 
-    if (resp == NULL)
+esp8285_spi_aps_list_t *esp8285_spi_get_scan_networks(void)
+{
+    esp8285_spi_resp_t resp;
+
+    if (esp8285_spi_command(SCAN_NETWORKS, NULL, 0, 0, 0, &resp) != 0)
     {
 #if ESP8285_SPI_DEBUG
         mp_printf(MP_PYTHON_PRINTER,"%s: get resp error!\r\n", __func__);
@@ -500,38 +187,59 @@ esp8285_spi_aps_list_t *esp8285_spi_get_scan_networks(void)
     esp8285_spi_aps_list_t *aps = (esp8285_spi_aps_list_t *)malloc(sizeof(esp8285_spi_aps_list_t));
     aps->del = delete_esp8285_spi_aps_list;
 
-    aps->aps_num = resp->params_num;
+    aps->aps_num = resp.params_num;
     aps->aps = (void *)malloc(sizeof(void *) * aps->aps_num);
 
+    //copy out the SSIDs first, the per AP queries reuse the frame buffer
     for (uint32_t i = 0; i < aps->aps_num; i++)
     {
-        aps->aps[i] = (esp8285_spi_ap_t *)malloc(sizeof(esp8285_spi_ap_t));
-        memcpy(aps->aps[i]->ssid, resp->params[i]->param, (resp->params[i]->param_len > 32) ? 32 : resp->params[i]->param_len);
-        aps->aps[i]->ssid[resp->params[i]->param_len] = 0;
+        uint32_t len = (resp.params[i].param_len > 32) ? 32 : resp.params[i].param_len;
 
-        uint8_t data = i;
-        esp8285_spi_params_t *send = esp8285_spi_params_alloc_1param(1, &data);
+        aps->aps[i] = (esp8285_spi_ap_t *)malloc(sizeof(esp8285_spi_ap_t));
+        memcpy(aps->aps[i]->ssid, resp.params[i].param, len);
+        aps->aps[i]->ssid[len] = 0;
+    }
 
-        esp8285_spi_params_t *rssi = esp8285_spi_send_command_get_response(GET_IDX_RSSI_CMD, send, NULL, 0, 0);
+    for (uint32_t i = 0; i < aps->aps_num; i++)
+    {
+        uint8_t rssi = 0, encr = 0;
 
-        aps->aps[i]->rssi = (int8_t)(rssi->params[0]->param[0]);
+        esp8285_spi_get_idx_byte(GET_IDX_RSSI_CMD, i, &rssi);
+        esp8285_spi_get_idx_byte(GET_IDX_ENCT_CMD, i, &encr);
+        aps->aps[i]->rssi = (int8_t)rssi;
+        aps->aps[i]->encr = encr;
 #if ESP8285_SPI_DEBUG
-	mp_printf(MP_PYTHON_PRINTER,"\tSSID:%s", aps->aps[i]->ssid);
-        mp_printf(MP_PYTHON_PRINTER,"\t\t\trssi:%02x\r\n", rssi->params[0]->param[0]);
+        mp_printf(MP_PYTHON_PRINTER,"\tSSID:%s", aps->aps[i]->ssid);
+        mp_printf(MP_PYTHON_PRINTER,"\t\t\trssi:%02x\r\n", rssi);
 #endif
-        rssi->del(rssi);
-
-        esp8285_spi_params_t *encr = esp8285_spi_send_command_get_response(GET_IDX_ENCT_CMD, send, NULL, 0, 0);
-        aps->aps[i]->encr = encr->params[0]->param[0];
-        encr->del(encr);
-
-        send->del(send);
     }
-    resp->del(resp);
 
     return aps;
 }
 
+///Bytes the NIC holds for `socket_num`
+//-1 error
+int32_t esp8285_spi_socket_available(uint8_t socket_num)
+{
+    esp8285_spi_param_t send = { .param_len = 1, .param = &socket_num };
+    esp8285_spi_resp_t resp;
+
+    if (esp8285_spi_command(AVAIL_DATA_TCP_CMD, &send, 1, 0, 0, &resp) != 0 || resp.params_num < 1 || resp.params[0].param_len < 2)
+        return -1;
+    return resp.params[0].param[0] | (resp.params[0].param[1] << 8);
+}
+
+///TCP state of `socket_num`, one of esp8285_socket_status_t
+//-1 error
+int8_t esp8285_spi_socket_status(uint8_t socket_num)
+{
+    uint8_t state;
+
+    if (esp8285_spi_get_idx_byte(GET_CLIENT_STATE_TCP_CMD, socket_num, &state) != 0)
+        return -1;
+    return state;
+}
+
 esp8285_spi_aps_list_t *esp8285_spi_scan_networks(void)
 {
     if (esp8285_spi_start_scan_networks() != 0)
@@ -1,4 +1,6 @@
 #include <stdlib.h>
+#include "py/mphal.h"
+#include "extmod/machine_spi.h"
 #include "wifi_spi_io.h"
 #include "hardware/gpio.h"
 
@@ -12,9 +14,19 @@ uint8_t cs_num = 0, rst_num = 0, rdy_num = 0;
 static uint8_t _mosi_num = -1;
 static uint8_t _miso_num = -1;
 static uint8_t _sclk_num = -1;
+static mp_obj_base_t *_spi = NULL;
 
-void esp8285_spi_config_io(uint8_t cs, uint8_t rst, uint8_t rdy, uint8_t mosi, uint8_t miso, uint8_t sclk)
+void esp8285_spi_config_io(uint8_t cs, uint8_t rst, uint8_t rdy, uint8_t mosi, uint8_t miso, uint8_t sclk, mp_obj_base_t *spi)
 {
+    cs_num = cs;
+    rdy_num = rdy;
+    rst_num = rst; //if rst <0, use soft reset
+
+    //the SPI peripheral owns the pins
+    _spi = spi;
+    if (spi != NULL)
+        return;
+
     //clk
     gpio_set_dir(sclk, GPIO_OUT);
     gpio_put(sclk, 0);
@@ -27,10 +39,6 @@ void esp8285_spi_config_io(uint8_t cs, uint8_t rst, uint8_t rdy, uint8_t mosi, u
     _mosi_num = mosi;
     _miso_num = miso;
     _sclk_num = sclk;
-
-    cs_num = cs;
-    rdy_num = rdy;
-    rst_num = rst; //if rst <0, use soft reset
 }
 uint8_t soft_spi_rw(uint8_t data)
 {
@@ -66,53 +74,66 @@ uint8_t soft_spi_rw(uint8_t data)
     }
     return temp;
 }
-void soft_spi_rw_len(uint8_t *send, uint8_t *recv, uint32_t len)
+void soft_spi_rw_len(const uint8_t *send, uint8_t *recv, uint32_t len)
 {
-    if (send == NULL && recv == NULL)
-    {
-        //printf(" buffer is null\r\n");
+    if (send == NULL)
         return;
-    }
 
-#if 0
-    uint32_t i = 0;
-    do
-    {
-        *(recv + i) = soft_spi_rw(*(send + i));
-        i++;
-    } while (--len);
-#else
-
-    uint32_t i = 0;
-    uint8_t *stmp = NULL, sf = 0;
-
-    if (send == NULL)
+    if (recv == NULL)
     {
-        stmp = (uint8_t *)malloc(len * sizeof(uint8_t));
-        // memset(stmp, 'A', len);
-        sf = 1;
+        for (uint32_t i = 0; i < len; i++)
+            soft_spi_rw(send[i]);
     }
     else
-        stmp = send;
+    {
+        for (uint32_t i = 0; i < len; i++)
+            recv[i] = soft_spi_rw(send[i]);
+    }
+}
 
-    if (recv == NULL)
+// select the NIC: wait for it to be idle (rdy low), pull CS and wait for it
+// to acknowledge (rdy high)
+static int8_t esp8285_spi_io_begin(void *ctx)
+{
+    uint32_t tm = time_us_32();
+    while (gpio_get(rdy_num))
     {
-        do
-        {
-            soft_spi_rw(*(stmp + i));
-            i++;
-        } while (--len);
+        if ((time_us_32() - tm) > 10 * 1000 * 1000) //10s
+            return -1;
+        sleep_ms(1);
     }
-    else
+
+    gpio_put(cs_num, 0);
+
+    tm = time_us_32();
+    while (!gpio_get(rdy_num))
     {
-        do
+        if ((time_us_32() - tm) > 1000 * 1000)
         {
-            *(recv + i) = soft_spi_rw(*(stmp + i));
-            i++;
-        } while (--len);
+            gpio_put(cs_num, 1);
+            return -1;
+        }
+        sleep_ms(1);
     }
+    return 0;
+}
+
+static void esp8285_spi_io_end(void *ctx)
+{
+    gpio_put(cs_num, 1);
+}
+
+static void esp8285_spi_io_transfer(void *ctx, const uint8_t *src, uint8_t *dest, uint32_t len)
+{
+    if (_spi != NULL)
+        ((mp_machine_spi_p_t *)_spi->type->protocol)->transfer(_spi, len, src, dest);
+    else
+        soft_spi_rw_len(src, dest, len);
+}
 
-    if (sf)
-        free(stmp);
-#endif
-}
\ No newline at end of file
+const esp8285_spi_transport_t esp8285_spi_io = {
+    .begin = esp8285_spi_io_begin,
+    .end = esp8285_spi_io_end,
+    .transfer = esp8285_spi_io_transfer,
+    .ctx = NULL,
+};
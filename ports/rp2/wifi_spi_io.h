@@ -1,3 +1,13 @@
 #include <stdint.h>
+#include "py/obj.h"
+#include "drivers/esp8266/wifi_spi_proto.h"
 
-extern uint8_t cs_num, rst_num, rdy_num;
\ No newline at end of file
+extern uint8_t cs_num, rst_num, rdy_num;
+
+// Bus the protocol runs on: the SPI peripheral with DMA when `spi` is given,
+// otherwise the bit-banged pins.
+extern const esp8285_spi_transport_t esp8285_spi_io;
+
+void esp8285_spi_config_io(uint8_t cs, uint8_t rst, uint8_t rdy, uint8_t mosi, uint8_t miso, uint8_t sclk, mp_obj_base_t *spi);
+uint8_t soft_spi_rw(uint8_t data);
+void soft_spi_rw_len(const uint8_t *send, uint8_t *recv, uint32_t len);
@@ -66,66 +66,94 @@ STATIC void uart_drain_rx_fifo(machine_uart_obj_t *self) {
         ringbuf_put(&(self->read_buffer), uart_get_hw(self->uart)->dr);
     }
 }
-STATIC void kmp_get_next(const char* targe, int next[])
-{  
-    int targe_Len = strlen(targe);  
-    next[0] = -1;  
-    int k = -1;  
-    int j = 0;  
-    while (j < targe_Len - 1)  
-    {     
-        if (k == -1 || targe[j] == targe[k])  
-        {  
-            ++j;  
-            ++k;   
-            if (targe[j] != targe[k])  
-                next[j] = k;    
-            else   
-                next[j] = next[k];  
-        }  
-        else  
-        {  
-            k = next[k];  
-        }  
-    }  
-}  
-STATIC int kmp_match(char* src,int src_len, const char* targe, int* next)  
-{  
-    int i = 0;  
-    int j = 0;  
-    int sLen = src_len;  
-    int pLen = strlen(targe);  
-    while (i < sLen && j < pLen)  
-    {     
-        if (j == -1 || src[i] == targe[j])  
-        {  
-            i++;  
-            j++;  
-        }  
-        else  
-        {       
-            j = next[j];  
-        }  
-    }  
-    if (j == pLen)  
-        return i - j;  
-    else  
-        return -1;  
-} 
-STATIC uint32_t kmp_find(char* src,uint32_t src_len, const char* tagert)
-{
-	uint32_t index = 0;
-	uint32_t tag_len = strlen(tagert);
-	int* next = (int*)malloc(sizeof(uint32_t) * tag_len);
-	kmp_get_next(tagert,next);
-	index = kmp_match(src,src_len,tagert, next);
-	free(next);
-	return index;
-}
-STATIC uint32_t data_find(uint8_t* src,uint32_t src_len, const char* tagert)
-{
-	return kmp_find((char*)src,src_len,tagert);
+
+void esp8266_match_check(const char* const* patterns, uint8_t count)
+{
+    if (count == 0 || count > ESP8266_MATCH_MAX_PATTERNS) {
+        mp_raise_ValueError(MP_ERROR_TEXT("too many AT response patterns"));
+    }
+    for (uint8_t i = 0; i < count; ++i) {
+        size_t len = strlen(patterns[i]);
+        if (len == 0 || len > ESP8266_MATCH_MAX_LEN) {
+            mp_raise_ValueError(MP_ERROR_TEXT("bad AT response pattern length"));
+        }
+    }
+}
+
+void esp8266_match_init(esp8266_matcher* m, const char* const* patterns, uint8_t count)
+{
+    esp8266_match_check(patterns, count);
+    m->count = count;
+    m->found = 0;
+    for (uint8_t i = 0; i < count; ++i) {
+        const char* pat = patterns[i];
+        uint8_t len = strlen(pat);
+        // fail[j]: length of the longest proper border of pat[0..j]
+        uint8_t k = 0;
+        m->fail[i][0] = 0;
+        for (uint8_t j = 1; j < len; ++j) {
+            while (k > 0 && pat[j] != pat[k]) {
+                k = m->fail[i][k - 1];
+            }
+            if (pat[j] == pat[k]) {
+                ++k;
+            }
+            m->fail[i][j] = k;
+        }
+        m->pattern[i] = pat;
+        m->len[i] = len;
+        m->state[i] = 0;
+    }
+}
+
+// Feed one byte, return the patterns that end at it.
+STATIC uint8_t esp8266_match_step(esp8266_matcher* m, uint8_t c)
+{
+    uint8_t hit = 0;
+    for (uint8_t i = 0; i < m->count; ++i) {
+        const char* pat = m->pattern[i];
+        uint8_t k = m->state[i];
+        while (k > 0 && (uint8_t)pat[k] != c) {
+            k = m->fail[i][k - 1];
+        }
+        if ((uint8_t)pat[k] == c) {
+            ++k;
+        }
+        if (k == m->len[i]) {
+            hit |= 1 << i;
+            k = m->fail[i][k - 1];
+        }
+        m->state[i] = k;
+    }
+    return hit;
+}
+
+int8_t esp8266_match_feed(esp8266_matcher* m, const uint8_t* data, uint32_t len)
+{
+    for (uint32_t i = 0; i < len; ++i) {
+        m->found |= esp8266_match_step(m, data[i]);
+    }
+    for (int8_t i = 0; i < m->count; ++i) {
+        if (m->found & (1 << i)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// One-shot search, return the index of the first `target` in `src` or -1.
+STATIC int32_t data_find(uint8_t* src,uint32_t src_len, const char* target)
+{
+    esp8266_matcher m;
+    esp8266_match_init(&m, &target, 1);
+    for (uint32_t i = 0; i < src_len; ++i) {
+        if (esp8266_match_step(&m, src[i])) {
+            return i + 1 - m.len[0];
+        }
+    }
+    return -1;
 }
+STATIC uint32_t recv_text(esp8266_obj* nic, uint32_t len);
 
 bool kick(esp8266_obj* nic)
 {
@@ -369,39 +397,6 @@ bool get_mqttconn(esp8266_obj* nic, mqttconn_obj* mqttconn)
 	sscanf(cur, "+MQTTCONN:%d,%d,%d,\"%[^\"]\",%d,\"%[^\"]\",%d", &mqttconn->LinkID, &mqttconn->state, &mqttconn->scheme, mqttconn->host, &mqttconn->port, mqttconn->path, &mqttconn->reconnect);
 	return true;
 }
-bool get_mqttsubrecv(esp8266_obj*nic, uint32_t LinkID, mqtt_msg* mqttmsg)
-{
-	char* cur = NULL;
-	int errcode;
-	uint32_t iter = 0;
-	memset(nic->buffer.buffer,0,ESP8266_BUF_SIZE);
-    unsigned long start = mp_hal_ticks_ms();
-	const mp_stream_p_t * uart_stream = mp_get_stream(nic->uart_obj);
-	machine_uart_obj_t *self = MP_OBJ_TO_PTR(nic->uart_obj);
-	while (mp_hal_ticks_ms() - start < 3000) {
-        self->read_lock = true;
-        uart_drain_rx_fifo(self);
-        self->read_lock = false;
-        while(ringbuf_avail(&self->read_buffer) > 0) {
-            uart_stream->read(nic->uart_obj,&nic->buffer.buffer[iter++],1,&errcode);
-        }
-	}
-	cur = strstr((char*)nic->buffer.buffer, "+MQTTSUBRECV");
-	if(cur == NULL)
-	{
-		//mp_printf(MP_PYTHON_PRINTER, "test get_mqttsubrecv none\n");
-		return false;
-	}
-	int LinkID_recv;
-	int len;
-	char topic[255] = {0};
-	char msg[4096] = {0};	
-	sscanf(cur, "+MQTTSUBRECV:%d,\"%[^\"]\",%d,%[^\n]", &LinkID_recv, topic, &len, msg);
-	msg[len] = NULL;
-	mqttmsg->topic = mp_obj_new_str(topic,strlen(topic));
-	mqttmsg->msg = mp_obj_new_str(msg,len);
-	return true;
-}
 bool wifi_softap_get_config(esp8266_obj* nic, softap_config* apconfig)
 {
 	if(0 == qATCWSAP(nic))
@@ -449,334 +444,826 @@ bool esp_send(esp8266_obj* nic,const char* buffer, uint32_t len, uint32_t timeou
 
 bool esp_send_mul(esp8266_obj* nic,char mux_id, const char* buffer, uint32_t len)
 {
-    return sATCIPSENDMultiple(nic,mux_id, buffer, len);
+    uint32_t send_total_len = 0;
+    uint16_t send_len = 0;
+
+    while(send_total_len < len)
+    {
+        send_len = ((len-send_total_len) > ESP8266_MAX_ONCE_SEND)?ESP8266_MAX_ONCE_SEND : (len-send_total_len);
+        if(!sATCIPSENDMultiple(nic,mux_id, buffer+send_total_len, send_len))
+            return false;
+        send_total_len += send_len;
+    }
+    return true;
 }
 
-int esp_recv(esp8266_obj* nic,char* buffer, uint32_t buffer_size, uint32_t* read_len, uint32_t timeout, bool* peer_closed, bool first_time_recv)
+int esp_recv(esp8266_obj* nic,int8_t link, char* buffer, uint32_t buffer_size, uint32_t* read_len, uint32_t timeout, bool* peer_closed)
 {
-    return recvPkg(nic,buffer, buffer_size, read_len, timeout, NULL, peer_closed, first_time_recv);
+    return recvPkg(nic,link, buffer, buffer_size, read_len, timeout, NULL, peer_closed);
 }
 
 uint32_t esp_recv_mul(esp8266_obj* nic,char mux_id, char* buffer, uint32_t buffer_size, uint32_t timeout)
 {
-    char id;
-    uint32_t ret;
-    ret = recvPkg(nic,buffer, buffer_size, NULL, timeout, &id, NULL, false);
-    if (ret > 0 && id == mux_id) {
-        return ret;
-    }
-    return 0;
+    int ret = recvPkg(nic,mux_id - '0', buffer, buffer_size, NULL, timeout, NULL, NULL);
+    return ret > 0 ? ret : 0;
 }
 
 uint32_t esp_recv_mul_id(esp8266_obj* nic,char* coming_mux_id, char* buffer, uint32_t buffer_size, uint32_t timeout)
 {
-    return recvPkg(nic,buffer, buffer_size, NULL, timeout, coming_mux_id, NULL, false);
+    int ret = recvPkg(nic,-1, buffer, buffer_size, NULL, timeout, coming_mux_id, NULL);
+    return ret > 0 ? ret : 0;
 }
-//#include "printf.h"
+
+/*----------------------------------------------------------------------------*/
+// Receive queues, one per link. In multiple connection mode the ESP8266
+// interleaves +IPD frames of all links on the one UART; payload for a link
+// other than the one being read is parked in that link's queue until its
+// socket asks for it.
+
+int8_t esp8266_link_open(esp8266_obj* nic)
+{
+    int8_t links = nic->mux ? ESP8266_MAX_LINKS : 1;
+    for (int8_t i = 0; i < links; ++i) {
+        if (nic->link_used & (1 << i)) {
+            continue;
+        }
+        if (nic->link_rx[i].buffer == NULL) {
+            Buffer_Init(&nic->link_rx[i], m_new(uint8_t, ESP8266_LINK_BUF_SIZE), ESP8266_LINK_BUF_SIZE);
+        }
+        Buffer_Clear(&nic->link_rx[i]);
+        nic->link_used |= 1 << i;
+        nic->ipd.closed &= ~(1 << i);
+        nic->send_failed &= ~(1 << i);
+        return i;
+    }
+    return -1;
+}
+
+void esp8266_link_close(esp8266_obj* nic, int8_t link)
+{
+    if (link < 0 || link >= ESP8266_MAX_LINKS) {
+        return;
+    }
+    nic->link_used &= ~(1 << link);
+    nic->ipd.closed &= ~(1 << link);
+    if (nic->link_rx[link].buffer != NULL) {
+        Buffer_Clear(&nic->link_rx[link]);
+    }
+}
+
 /*----------------------------------------------------------------------------*/
 /* +IPD,<id>,<len>:<data> */
 /* +IPD,<len>:<data> */
-/**
- * 
- * @return -1: parameters error, -2: EOF, -3: timeout, -4:peer closed and no data in buffer
- */
-uint32_t recvPkg(esp8266_obj*nic,char* out_buff, uint32_t out_buff_len, uint32_t *data_len, uint32_t timeout, char* coming_mux_id, bool* peer_closed, bool first_time_recv)
+
+#define ESP8266_IPD_IDLE    (0) // between frames, looking for "+IPD," or "CLOSED"
+#define ESP8266_IPD_HEADER  (1) // collecting "<id>,<len>" up to ':'
+#define ESP8266_IPD_PAYLOAD (2) // inside a frame, `remain` payload bytes left
+#define ESP8266_IPD_MQTT    (3) // inside a +MQTTSUBRECV payload, `remain` bytes left
+
+#define ESP8266_LINK_ANY    (-1) // deliver the first frame of whichever link
+#define ESP8266_LINK_NONE   (-2) // deliver nothing, queue all payload
+#define ESP8266_LINK_QUEUE  (-3) // deliver nothing, queue what fits and leave the rest
+
+STATIC const char ipd_magic[] = "+IPD,";
+STATIC const char closed_magic[] = "CLOSED\r\n";
+
+void esp8266_ipd_reset(esp8266_obj* nic)
 {
-	const mp_stream_p_t * uart_stream = mp_get_stream(nic->uart_obj);
+    memset(&nic->ipd, 0, sizeof(nic->ipd));
+    nic->ipd.link_id = -1;
+}
 
-    uint8_t temp_buff[16];
-    uint8_t temp_buff2[16];
-    uint8_t temp_buff_len = 0;
-    uint8_t temp_buff2_len = 0;
-    uint8_t find_frame_flag_index = 0;
-    static int8_t mux_id = -1;
-    static int16_t frame_len = 0;
-    static int32_t frame_len_sum = 0;//only for single socket TODO:
-    // bool    overflow = false;
-    int ret = 0;
-    uint32_t size = 0;
-	int errcode;
-    mp_uint_t start = 0, start2 = 0;
-    bool no_frame_flag = false;
-    bool new_frame = false;
-    mp_uint_t data_len_in_uart_buff = 0;
-    bool peer_just_closed = false;
-    
-    // parameters check
-    if (out_buff == NULL) {
-        return -1;
+// Return the longest run of readable bytes that is contiguous in the ring
+// buffer. iput is sampled once since the UART IRQ may advance it meanwhile.
+STATIC size_t uart_rx_span(ringbuf_t *r, uint8_t **data)
+{
+    uint16_t iput = r->iput;
+    *data = r->buf + r->iget;
+    return (iput >= r->iget ? iput : r->size) - r->iget;
+}
+
+STATIC void uart_rx_consume(ringbuf_t *r, size_t len)
+{
+    uint32_t iget = r->iget + len;
+    if (iget >= r->size) {
+        iget -= r->size;
     }
-    // init vars
-    memset(temp_buff, 0, sizeof(temp_buff));
-    memset(temp_buff, 0, sizeof(temp_buff2));
-    if(first_time_recv)
-    {
-        frame_len = 0;
-        frame_len_sum = 0;
+    r->iget = iget;
+}
+
+// "<id>,<len>" (multiple connection mode) or "<len>" (single connection mode)
+STATIC bool esp8266_ipd_parse_header(esp8266_ipd_parser *p)
+{
+    uint32_t val[2] = {0, 0};
+    uint8_t n = 0;
+    bool digit = false;
+    for (uint8_t i = 0; i < p->hdr_len; ++i) {
+        char c = p->hdr[i];
+        if (c >= '0' && c <= '9') {
+            val[n] = val[n] * 10 + (c - '0');
+            digit = true;
+        } else if (c == ',' && n == 0 && digit) {
+            n = 1;
+            digit = false;
+        } else {
+            return false;
+        }
     }
+    if (!digit) {
+        return false;
+    }
+    if (n == 1) {
+        if (val[0] >= ESP8266_MAX_LINKS) {
+            return false;
+        }
+        p->link_id = val[0];
+        p->remain = val[1];
+    } else {
+        p->link_id = 0;
+        p->remain = val[0];
+    }
+    return p->remain > 0;
+}
 
-    // required data already in buf, just return data
-    uint32_t buff_size = Buffer_Size(&nic->buffer);
-    if(buff_size >= out_buff_len)
-    {
-        Buffer_Gets(&nic->buffer, (uint8_t*)out_buff, out_buff_len);
-        if(data_len)
-            *data_len = out_buff_len;
-        frame_len_sum -= size;
-        if(frame_len_sum <= 0)
-        {
-            frame_len = 0;
-            frame_len_sum = 0;
-            Buffer_Clear(&nic->buffer);
-            if(*peer_closed)//buffer empty, return EOF
-            {
-                return -2;
+/*----------------------------------------------------------------------------*/
+// Text between frames: split into lines for the URC handlers and matched
+// against the response patterns of the AT command in flight.
+
+#define ESP8266_AT_IDLE     (0) // queue[head] not sent yet
+#define ESP8266_AT_PROMPT   (1) // command sent, waiting for ">" before the payload
+#define ESP8266_AT_RESULT   (2) // waiting for one of the expected patterns
+
+STATIC const char* const at_prompt_expect[] = {">", "ERROR", "link is not valid"};
+
+STATIC const char mqttsubrecv_magic[] = "+MQTTSUBRECV:";
+
+STATIC void esp8266_mqtt_schedule(esp8266_obj* nic);
+
+// +MQTTSUBRECV:<LinkID>,"<topic>",<data_length>,<data>
+// Checked at each ',' of such a line. Once the ',' ending the length is in,
+// the payload is read as exactly that many raw bytes, since it may hold line
+// breaks and be longer than a line, and goes straight into the message pool.
+STATIC void esp8266_mqttsubrecv_header(esp8266_obj* nic, const char* line, uint32_t len)
+{
+    const char* end = line + len - 1;
+    const char* topic = memchr(line, '"', len);
+    if (topic == NULL) {
+        return;
+    }
+    ++topic;
+    const char* topic_end = memchr(topic, '"', end - topic);
+    if (topic_end == NULL || end - topic_end < 2 || topic_end[1] != ',') {
+        return;
+    }
+    const char* cur = topic_end + 2;
+    if (end - cur > 5) {
+        // longer than any payload the pool could take, let the line end
+        return;
+    }
+    uint32_t data_len = 0;
+    while (cur < end && *cur >= '0' && *cur <= '9') {
+        data_len = data_len * 10 + (*cur++ - '0');
+    }
+    if (cur != end || cur == topic_end + 2) {
+        return;
+    }
+    // copied as is, the strings are made when the message is delivered; a
+    // message that does not fit is counted and its payload skipped
+    mqtt_pool_begin(&nic->mqtt_rx, topic, topic_end - topic, data_len);
+    nic->ipd.remain = data_len;
+    nic->ipd.state = ESP8266_IPD_MQTT;
+    // the header is not a response line
+    nic->at.line_len = 0;
+}
+
+STATIC void esp8266_mqttsubrecv_end(esp8266_obj* nic)
+{
+    nic->ipd.state = ESP8266_IPD_IDLE;
+    mqtt_pool_end(&nic->mqtt_rx);
+    esp8266_mqtt_schedule(nic);
+}
+
+STATIC void esp8266_urc_dispatch(esp8266_obj* nic, const char* line, uint32_t len)
+{
+    esp8266_at_engine* at = &nic->at;
+    for (uint8_t i = 0; i < at->urc_count; ++i) {
+        size_t n = strlen(at->urc[i].prefix);
+        if (len >= n && memcmp(line, at->urc[i].prefix, n) == 0) {
+            // must not raise out of the pump, whose bytes are not consumed from
+            // the UART buffer yet; a failing handler loses its line, and its
+            // exception is printed and counted instead
+            nlr_buf_t nlr;
+            if (nlr_push(&nlr) == 0) {
+                at->urc[i].handler(nic, line, len, at->urc[i].arg);
+                nlr_pop();
+            } else {
+                ++at->urc_failed;
+                mp_printf(MICROPY_ERROR_PRINTER, "Uncaught exception in URC handler\n");
+                mp_obj_print_exception(MICROPY_ERROR_PRINTER, MP_OBJ_FROM_PTR(nlr.ret_val));
             }
+            return;
         }
-        return out_buff_len;
     }
-    
-    // read from uart buffer, if not frame start flag, put into nic buffer
-    // and need wait for full frame flag in 200ms(can be fewer), frame format: '+IPD,id,len:data' or '+IPD,len:data'
-    // wait data from uart buffer if not timeout
-    start2 = mp_hal_ticks_ms();
-	machine_uart_obj_t *self = MP_OBJ_TO_PTR(nic->uart_obj);
-    do{
-        self->read_lock = true;
-        uart_drain_rx_fifo(self);
-        self->read_lock = false;
-        if(ringbuf_avail(&self->read_buffer) > 0)
-        {
-            uart_stream->read(nic->uart_obj,temp_buff + temp_buff_len,1,&errcode);
-            if(find_frame_flag_index == 0 && temp_buff[temp_buff_len] == '+'){
-                ++find_frame_flag_index;
-                start = mp_hal_ticks_ms();
-            }
-            else if(find_frame_flag_index == 1 && temp_buff[temp_buff_len] == 'I'){
-                ++find_frame_flag_index;
-            }
-            else if(find_frame_flag_index == 2 && temp_buff[temp_buff_len] == 'P'){
-                ++find_frame_flag_index;
-            }
-            else if(find_frame_flag_index == 3 && temp_buff[temp_buff_len] == 'D'){
-                ++find_frame_flag_index;
+}
+
+STATIC inline void esp8266_at_text(esp8266_obj* nic, char c)
+{
+    esp8266_at_engine* at = &nic->at;
+    if (at->phase != ESP8266_AT_IDLE) {
+        esp8266_match_feed(&at->match, (const uint8_t*)&c, 1);
+    }
+    if (at->urc_count == 0) {
+        return;
+    }
+    if (c == '\n') {
+        uint16_t len = at->line_len;
+        if (!at->line_skip && len > 0) {
+            len -= at->line[len - 1] == '\r';
+            at->line[len] = '\0';
+            esp8266_urc_dispatch(nic, at->line, len);
+        }
+        at->line_len = 0;
+        at->line_skip = false;
+    } else if (at->line_len < sizeof(at->line) - 1) {
+        at->line[at->line_len++] = c;
+        if (c == ',' && at->line_len > sizeof(mqttsubrecv_magic) - 1
+            && memcmp(at->line, mqttsubrecv_magic, sizeof(mqttsubrecv_magic) - 1) == 0) {
+            esp8266_mqttsubrecv_header(nic, at->line, at->line_len);
+            if (nic->ipd.state == ESP8266_IPD_MQTT && nic->ipd.remain == 0) {
+                esp8266_mqttsubrecv_end(nic);
             }
-            else if(find_frame_flag_index == 4 && temp_buff[temp_buff_len] == ','){
-                ++find_frame_flag_index;
+        }
+    } else if (!at->line_skip) {
+        // too long to dispatch, count it and wait for its end
+        ++at->urc_overlong;
+        at->line_skip = true;
+        if (memcmp(at->line, mqttsubrecv_magic, sizeof(mqttsubrecv_magic) - 1) == 0) {
+            ++nic->mqtt_rx.dropped;
+        }
+    }
+}
+
+// Run the bytes waiting in the UART receive ring buffer through the frame
+// parser. Payload of frames for `*link` (any link if it is ESP8266_LINK_ANY,
+// after which it latches to the link of the first frame) is copied straight
+// from the ring buffer into `out`, one contiguous span at a time, and payload
+// that does not fit is left in the ring buffer for the next call. Payload of
+// other links goes to their queues, that of +MQTTSUBRECV messages to the
+// MQTT pool. Bytes outside frames (AT responses) are appended to `text` if
+// given.
+// Returns the number of payload bytes written to `out`.
+STATIC uint32_t esp8266_ipd_pump(esp8266_obj* nic, ringbuf_t *rx, int8_t *link, uint8_t *out, uint32_t out_len, uint8_t *text, uint32_t *text_len, uint32_t text_size)
+{
+    esp8266_ipd_parser *p = &nic->ipd;
+    uint32_t delivered = 0;
+    uint8_t *data;
+    size_t len;
+
+    while ((len = uart_rx_span(rx, &data)) > 0) {
+        if (p->state == ESP8266_IPD_MQTT) {
+            len = MIN(len, p->remain);
+            mqtt_pool_append(&nic->mqtt_rx, data, len);
+            uart_rx_consume(rx, len);
+            p->remain -= len;
+            if (p->remain == 0) {
+                esp8266_mqttsubrecv_end(nic);
             }
-            else if(find_frame_flag_index == 5){
-                    if(temp_buff[temp_buff_len] == ':'){ // '+IPD,3,1452:' or '+IPD,1452:'
-                        temp_buff[temp_buff_len+1] = '\0';
-                        char* index = strstr((char*)temp_buff+5, ",");
-                        if(index){ // '+IPD,3,1452:'
-                            ret = sscanf((char*)temp_buff,"+IPD,%hhd,%hd:",&mux_id,&frame_len);
-                            if (ret!=2 || mux_id < 0 || mux_id > 4 || frame_len<=0) { // format not satisfy, it's data
-                                no_frame_flag = true;
-                            }else{// find frame start flag, although it may also data
-                                new_frame = true;
-                            }
-                        }else{ // '+IPD,1452:'
-                            ret = sscanf((char*)temp_buff,"+IPD,%hd:",&frame_len);
-                            if (ret !=1 || frame_len<=0) { // format not satisfy, it's data
-                                no_frame_flag = true;
-                            }else{// find frame start flag, although it may also data
-                                new_frame = true;
-                                // printk("new frame:%d\r\n", frame_len);
-                            }
-                        }
+            continue;
+        }
+        if (p->state == ESP8266_IPD_PAYLOAD) {
+            len = MIN(len, p->remain);
+            if (*link == ESP8266_LINK_ANY || *link == p->link_id) {
+                if (delivered == out_len) {
+                    break;
+                }
+                *link = p->link_id;
+                len = MIN(len, out_len - delivered);
+                memcpy(out + delivered, data, len);
+                delivered += len;
+            } else if (nic->link_used & (1 << p->link_id)) {
+                uint32_t queued = Buffer_Write(&nic->link_rx[p->link_id], (const uint8_t*)data, len);
+                // during an AT exchange nothing may stall, so an overflow is dropped,
+                // otherwise the rest stays in the UART buffer until its reader catches up
+                if (*link != ESP8266_LINK_NONE) {
+                    if (queued == 0) {
+                        break;
                     }
+                    len = queued;
+                }
             }
-            else{ // not match frame start flag, put into nic buffer
-                no_frame_flag = true;
+            // else: payload for a link nobody has open, drop it
+            uart_rx_consume(rx, len);
+            p->remain -= len;
+            if (p->remain == 0) {
+                p->state = ESP8266_IPD_IDLE;
             }
-            // new frame or data
-            // or wait for frame start flag timeout(300ms, can be fewer), maybe they're data
-            if(new_frame || no_frame_flag || temp_buff_len >= 12 ||
-                (find_frame_flag_index && (mp_hal_ticks_ms() - start > 300) )
-            ) // '+IPD,3,1452:'
-            {
-                if(!new_frame){
-                    if(frame_len_sum > 0){
-                        if(!Buffer_Puts(&nic->buffer, temp_buff, temp_buff_len+1))
-                        {
-                            // overflow = true;
-                            // break;//TODO:
-                        }
-                    }
-                    else{
-                        if(temp_buff[0]=='C'){
-                            memset(temp_buff2, 0, sizeof(temp_buff2));
-                        }
-                        temp_buff2[temp_buff2_len++] = temp_buff[0];
-                        // printk("%c", temp_buff[0]); //TODO: optimize uart overflow, if uart overflow, uncomment this will print some data
-                        // printk("-%d:%s\r\n", temp_buff2_len, temp_buff2);
-                        if(strstr((const char*)temp_buff2, "CLOSED\r\n") != NULL){
-                            // printk("pear closed\r\n");
-                            *peer_closed = true;
-                            peer_just_closed = true;
-                            break;
-                        }
-                    }
-                }else{
-                    frame_len_sum += frame_len;
-                }
-                find_frame_flag_index = 0;
-                temp_buff_len = 0;
-                new_frame = false;
-                no_frame_flag = false;
-                // enough data as required
-                size = Buffer_Size(&nic->buffer);
-                if( size >= out_buff_len) // data enough
-                    break;
-                if(frame_len_sum!=0 && frame_len_sum <= size) // read at least one frame ok
-                {
-                    break;
+            continue;
+        }
+
+        // Frame headers and status lines are short, scan them bytewise up
+        // to the start of the next payload.
+        size_t i = 0;
+        while (i < len && p->state <= ESP8266_IPD_HEADER) {
+            char c = data[i++];
+            if (text && *text_len < text_size) {
+                text[(*text_len)++] = c;
+            }
+            esp8266_at_text(nic, c);
+            if (p->state == ESP8266_IPD_HEADER) {
+                if (c == ':') {
+                    p->state = esp8266_ipd_parse_header(p) ? ESP8266_IPD_PAYLOAD : ESP8266_IPD_IDLE;
+                    // the "+IPD,..." header is not a response line
+                    nic->at.line_len = 0;
+                } else if (p->hdr_len < sizeof(p->hdr)) {
+                    p->hdr[p->hdr_len++] = c;
+                } else {
+                    p->state = ESP8266_IPD_IDLE;
                 }
                 continue;
             }
-            ++temp_buff_len;
-        }
-        if(timeout!=0 && (mp_hal_ticks_ms() - start2 > timeout) && !find_frame_flag_index )
-        {
-            return -3;
+            p->ipd_match = (c == ipd_magic[p->ipd_match]) ? p->ipd_match + 1 : (c == ipd_magic[0]);
+            if (p->ipd_match == sizeof(ipd_magic) - 1) {
+                p->state = ESP8266_IPD_HEADER;
+                p->hdr_len = 0;
+                p->ipd_match = 0;
+                p->closed_match = 0;
+                continue;
+            }
+            if (p->closed_match == 0 && c == closed_magic[0]) {
+                // "<id>,CLOSED" in multiple connection mode, plain "CLOSED" otherwise
+                bool has_id = p->prev[1] == ',' && p->prev[0] >= '0' && p->prev[0] < '0' + ESP8266_MAX_LINKS;
+                p->closed_link = has_id ? p->prev[0] - '0' : 0;
+            }
+            p->closed_match = (c == closed_magic[p->closed_match]) ? p->closed_match + 1 : (c == closed_magic[0]);
+            if (p->closed_match == sizeof(closed_magic) - 1) {
+                p->closed |= 1 << p->closed_link;
+                p->closed_match = 0;
+            }
+            p->prev[0] = p->prev[1];
+            p->prev[1] = c;
         }
-        self->read_lock = true;
-        uart_drain_rx_fifo(self);
-        self->read_lock = false;
-    }while( (timeout || find_frame_flag_index) && (!*peer_closed || ringbuf_avail(&self->read_buffer) > 0) );
-    size = Buffer_Size(&nic->buffer);
-    if( size == 0 && !peer_just_closed && *peer_closed)//peer closed and no data in buffer
-    {
-        frame_len = 0;
-        frame_len_sum = 0;
-        return -4;
+        uart_rx_consume(rx, i);
     }
-    size = size > out_buff_len ? out_buff_len : size;
-    Buffer_Gets(&nic->buffer, (uint8_t*)out_buff, size);
-    if(data_len)
-        *data_len = size;
-    frame_len_sum -= size;
-    if(frame_len_sum <= 0 || peer_just_closed)
-    {
-        frame_len = 0;
-        frame_len_sum = 0;
-        Buffer_Clear(&nic->buffer);
-        if(peer_just_closed)
-        {
-            return -2;
+    return delivered;
+}
+
+/*----------------------------------------------------------------------------*/
+// AT command queue
+
+STATIC const char* const at_send_expect[] = {"SEND OK", "SEND FAIL", "ERROR"};
+STATIC const char* const at_mqttpub_expect[] = {"\r\nOK", "ERROR"};
+STATIC const char* const at_mqttpubraw_expect[] = {"+MQTTPUB:OK", "+MQTTPUB:FAIL", "ERROR"};
+
+STATIC void esp8266_at_write(esp8266_obj* nic, const void* data, uint32_t len)
+{
+    int errcode = 0;
+    const mp_stream_p_t * uart_stream = mp_get_stream(nic->uart_obj);
+    uart_stream->write(nic->uart_obj, data, len, &errcode);
+}
+
+STATIC void esp8266_at_complete(esp8266_obj* nic, int result);
+
+// Send queue[head] if the line is free, complete it once its response is in.
+STATIC void esp8266_at_service(esp8266_obj* nic)
+{
+    esp8266_at_engine* at = &nic->at;
+    while (at->count > 0) {
+        esp8266_at_cmd* c = &at->queue[at->head];
+        if (at->phase == ESP8266_AT_IDLE) {
+            if (c->payload != NULL) {
+                esp8266_match_init(&at->match, at_prompt_expect, MP_ARRAY_SIZE(at_prompt_expect));
+                at->phase = ESP8266_AT_PROMPT;
+            } else {
+                esp8266_match_init(&at->match, c->expect, c->n_expect);
+                at->phase = ESP8266_AT_RESULT;
+            }
+            at->start = mp_hal_ticks_ms();
+            esp8266_at_write(nic, c->cmd, c->cmd_len);
+            return;
+        }
+        int8_t found = esp8266_match_feed(&at->match, NULL, 0);
+        int result;
+        if (found == -1) {
+            if (mp_hal_ticks_ms() - at->start < c->timeout) {
+                return;
+            }
+            result = ESP8266_AT_TIMEOUT;
+        } else if (at->phase == ESP8266_AT_PROMPT) {
+            if (found != 0) {
+                result = ESP8266_AT_FAIL;
+            } else {
+                esp8266_match_init(&at->match, c->expect, c->n_expect);
+                at->phase = ESP8266_AT_RESULT;
+                at->start = mp_hal_ticks_ms();
+                esp8266_at_write(nic, c->payload, c->payload_len);
+                return;
+            }
+        } else {
+            result = found < c->n_ok ? ESP8266_AT_OK : ESP8266_AT_FAIL;
         }
+        esp8266_at_complete(nic, result);
     }
-    return size;
 }
 
-void rx_empty(esp8266_obj* nic) 
+// Remove queue[head] and call its completion callback with `result`.
+STATIC void esp8266_at_complete(esp8266_obj* nic, int result)
+{
+    esp8266_at_engine* at = &nic->at;
+    esp8266_at_cmd* c = &at->queue[at->head];
+    esp8266_at_done done = c->done;
+    void* arg = c->arg;
+    // the payload shares the allocation of the command line
+    m_del(char, c->cmd, c->cmd_len + c->payload_len);
+    memset(c, 0, sizeof(*c));
+    at->head = (at->head + 1) % ESP8266_AT_QUEUE_LEN;
+    --at->count;
+    at->phase = ESP8266_AT_IDLE;
+    if (done != NULL) {
+        done(nic, result, arg);
+    }
+}
+
+// Run esp8266_at_service() unless it is already running further up the stack
+// (a UART write may block and run the event poll hook).
+STATIC void esp8266_at_kick(esp8266_obj* nic)
+{
+    esp8266_at_engine* at = &nic->at;
+    if (at->count == 0 || at->busy) {
+        return;
+    }
+    at->busy = true;
+    nlr_buf_t nlr;
+    if (nlr_push(&nlr) == 0) {
+        esp8266_at_service(nic);
+        nlr_pop();
+        at->busy = false;
+    } else {
+        at->busy = false;
+        nlr_jump(nlr.ret_val);
+    }
+}
+
+void esp8266_at_poll(esp8266_obj* nic)
 {
-	int errcode;
-	char data = 0;
-	const mp_stream_p_t * uart_stream = mp_get_stream(nic->uart_obj);
 	machine_uart_obj_t *self = MP_OBJ_TO_PTR(nic->uart_obj);
+    int8_t link = ESP8266_LINK_NONE;
+    if (nic->at.busy) {
+        return;
+    }
     self->read_lock = true;
     uart_drain_rx_fifo(self);
     self->read_lock = false;
-    while(ringbuf_avail(&self->read_buffer) > 0) {
-        uart_stream->read(nic->uart_obj,&data,1,&errcode); 
+    esp8266_ipd_pump(nic, &self->read_buffer, &link, NULL, 0, NULL, NULL, 0);
+    esp8266_at_kick(nic);
+}
+
+// Move what has arrived into the link queues and the MQTT pool, unless an AT
+// exchange further up the stack is reading the UART.
+STATIC void esp8266_rx_queue(esp8266_obj* nic)
+{
+	machine_uart_obj_t *self = MP_OBJ_TO_PTR(nic->uart_obj);
+    int8_t any = ESP8266_LINK_QUEUE;
+    if (nic->at.busy) {
+        return;
     }
+    self->read_lock = true;
+    uart_drain_rx_fifo(self);
+    self->read_lock = false;
+    esp8266_ipd_pump(nic, &self->read_buffer, &any, NULL, 0, NULL, NULL, 0);
+    esp8266_at_kick(nic);
 }
 
-char* recvString_1(esp8266_obj* nic, const char* target1,uint32_t timeout)
+uint8_t esp8266_link_poll(esp8266_obj* nic, int8_t link)
 {
-	int errcode;
-	uint32_t iter = 0;
-	memset(nic->buffer.buffer,0,ESP8266_BUF_SIZE);
-    unsigned long start = mp_hal_ticks_ms();
-	const mp_stream_p_t * uart_stream = mp_get_stream(nic->uart_obj);
 	machine_uart_obj_t *self = MP_OBJ_TO_PTR(nic->uart_obj);
-    while (mp_hal_ticks_ms() - start < timeout) {
-        self->read_lock = true;
-        uart_drain_rx_fifo(self);
-        self->read_lock = false;
-        while(ringbuf_avail(&self->read_buffer) > 0) {
-            uart_stream->read(nic->uart_obj,&nic->buffer.buffer[iter++],1,&errcode);
+    esp8266_ipd_parser *p = &nic->ipd;
+    uint8_t flags = 0;
+
+    if (link < 0 || link >= ESP8266_MAX_LINKS || !(nic->link_used & (1 << link))) {
+        return ESP8266_LINK_CLOSED;
+    }
+    esp8266_rx_queue(nic);
+
+    // payload the queue had no room for is still waiting in the UART buffer
+    if (Buffer_Size(&nic->link_rx[link]) > 0
+        || (p->state == ESP8266_IPD_PAYLOAD && p->link_id == link && self->read_buffer.iget != self->read_buffer.iput)) {
+        flags |= ESP8266_LINK_READABLE;
+    }
+    if (p->closed & (1 << link)) {
+        flags |= ESP8266_LINK_READABLE | ESP8266_LINK_CLOSED;
+    } else if (nic->at.count < ESP8266_AT_QUEUE_LEN) {
+        flags |= ESP8266_LINK_WRITABLE;
+    }
+    if (nic->send_failed & (1 << link)) {
+        flags |= ESP8266_LINK_FAILED;
+    }
+    return flags;
+}
+
+// Schedule delivery of the pooled messages, unless it is already pending.
+STATIC void esp8266_mqtt_schedule(esp8266_obj* nic)
+{
+    if (nic->mqtt_dispatch != MP_OBJ_NULL && !nic->mqtt_rx.scheduled && mqtt_pool_count(&nic->mqtt_rx) > 0) {
+        nic->mqtt_rx.scheduled = mp_sched_schedule(nic->mqtt_dispatch, nic->mqtt_client);
+    }
+}
+
+uint8_t esp8266_mqtt_poll(esp8266_obj* nic, uint32_t timeout)
+{
+    unsigned long start = mp_hal_ticks_ms();
+    for (;;) {
+        esp8266_rx_queue(nic);
+        if (mqtt_pool_count(&nic->mqtt_rx) > 0 || mp_hal_ticks_ms() - start >= timeout) {
+            break;
         }
-        if (data_find(nic->buffer.buffer,iter,target1) != -1) {
-            return (char*)nic->buffer.buffer;
-        } 
+        MICROPY_EVENT_POLL_HOOK
     }
-    return NULL;
+    // a dispatch the scheduler had no room for is retried here
+    esp8266_mqtt_schedule(nic);
+    return mqtt_pool_count(&nic->mqtt_rx);
 }
 
+bool esp8266_at_flush(esp8266_obj* nic, uint32_t timeout)
+{
+    unsigned long start = mp_hal_ticks_ms();
+    for (;;) {
+        esp8266_at_poll(nic);
+        if (nic->at.count == 0 || nic->at.busy) {
+            return true;
+        }
+        if (mp_hal_ticks_ms() - start >= timeout) {
+            return false;
+        }
+        MICROPY_EVENT_POLL_HOOK
+    }
+}
 
-char* recvString_2(esp8266_obj* nic,char* target1, char* target2, uint32_t timeout, int8_t* find_index)
+void esp8266_at_abort(esp8266_obj* nic)
+{
+    while (nic->at.count > 0 && !nic->at.busy) {
+        esp8266_at_complete(nic, ESP8266_AT_TIMEOUT);
+    }
+}
+
+bool esp8266_at_submit(esp8266_obj* nic, const char* cmd, uint32_t cmd_len, const uint8_t* payload, uint32_t payload_len,
+	const char* const* expect, uint8_t n_expect, uint8_t n_ok, uint32_t timeout, esp8266_at_done done, void* arg)
+{
+    esp8266_at_engine* at = &nic->at;
+    // the patterns are compiled when the command is sent, check them now so
+    // that a bad one can't wedge the queue
+    esp8266_match_check(expect, n_expect);
+    if (at->count == ESP8266_AT_QUEUE_LEN) {
+        return false;
+    }
+    esp8266_at_cmd* c = &at->queue[(at->head + at->count) % ESP8266_AT_QUEUE_LEN];
+    if (payload == NULL) {
+        payload_len = 0;
+    }
+    // one allocation holds the command line followed by its payload
+    char* cmd_copy = m_new(char, cmd_len + payload_len);
+    memcpy(cmd_copy, cmd, cmd_len);
+    if (payload != NULL) {
+        memcpy(cmd_copy + cmd_len, payload, payload_len);
+    }
+    c->cmd = cmd_copy;
+    c->cmd_len = cmd_len;
+    c->payload = payload != NULL ? (uint8_t*)cmd_copy + cmd_len : NULL;
+    c->payload_len = payload_len;
+    for (uint8_t i = 0; i < n_expect; ++i) {
+        c->expect[i] = expect[i];
+    }
+    c->n_expect = n_expect;
+    c->n_ok = n_ok;
+    c->timeout = timeout;
+    c->done = done;
+    c->arg = arg;
+    ++at->count;
+    // start it straight away if nothing is ahead of it
+    esp8266_at_poll(nic);
+    return true;
+}
+
+bool esp8266_urc_register(esp8266_obj* nic, const char* prefix, esp8266_urc_handler handler, void* arg)
+{
+    esp8266_at_engine* at = &nic->at;
+    if (at->urc_count == ESP8266_URC_MAX) {
+        return false;
+    }
+    at->urc[at->urc_count].prefix = prefix;
+    at->urc[at->urc_count].handler = handler;
+    at->urc[at->urc_count].arg = arg;
+    ++at->urc_count;
+    return true;
+}
+
+// A +MQTTSUBRECV line that ends before its header is complete is malformed,
+// the message is lost.
+STATIC void esp8266_mqttsubrecv_urc(esp8266_obj* nic, const char* line, uint32_t len, void* arg)
+{
+    ++nic->mqtt_rx.dropped;
+}
+
+void esp8266_at_init(esp8266_obj* nic)
+{
+    memset(&nic->at, 0, sizeof(nic->at));
+    nic->send_failed = 0;
+    mqtt_pool_init(&nic->mqtt_rx, NULL, 0);
+    nic->mqtt_dispatch = MP_OBJ_NULL;
+    nic->mqtt_client = MP_OBJ_NULL;
+    esp8266_urc_register(nic, "+MQTTSUBRECV:", esp8266_mqttsubrecv_urc, NULL);
+}
+
+STATIC void esp_send_done(esp8266_obj* nic, int result, void* arg)
+{
+    if (result != ESP8266_AT_OK) {
+        nic->send_failed |= 1 << (intptr_t)arg;
+    }
+}
+
+bool esp_send_async(esp8266_obj* nic, int8_t link, const char* buffer, uint32_t len)
+{
+    char cmd[32];
+    int cmd_len;
+    if (nic->mux) {
+        cmd_len = snprintf(cmd, sizeof(cmd), "AT+CIPSEND=%d,%u\r\n", link, (unsigned int)len);
+    } else {
+        cmd_len = snprintf(cmd, sizeof(cmd), "AT+CIPSEND=%u\r\n", (unsigned int)len);
+    }
+    return esp8266_at_submit(nic, cmd, cmd_len, (const uint8_t*)buffer, len,
+        at_send_expect, MP_ARRAY_SIZE(at_send_expect), 1, 10000, esp_send_done, (void*)(intptr_t)link);
+}
+
+bool sMQTTPUBRAW_async(esp8266_obj*nic, uint32_t LinkID, const char* topic, const uint8_t* data, uint32_t len, uint32_t qos, uint32_t retain)
+{
+    char cmd[128];
+    int cmd_len;
+    if (len == 0) {
+        cmd_len = snprintf(cmd, sizeof(cmd), "AT+MQTTPUB=%u,\"%s\",\"\",%u,%u\r\n",
+            (unsigned int)LinkID, topic, (unsigned int)qos, (unsigned int)retain);
+    } else {
+        cmd_len = snprintf(cmd, sizeof(cmd), "AT+MQTTPUBRAW=%u,\"%s\",%u,%u,%u\r\n",
+            (unsigned int)LinkID, topic, (unsigned int)len, (unsigned int)qos, (unsigned int)retain);
+    }
+    if (cmd_len >= sizeof(cmd)) {
+        return false;
+    }
+    if (len == 0) {
+        return esp8266_at_submit(nic, cmd, cmd_len, NULL, 0,
+            at_mqttpub_expect, MP_ARRAY_SIZE(at_mqttpub_expect), 1, 3000, NULL, NULL);
+    }
+    return esp8266_at_submit(nic, cmd, cmd_len, data, len,
+        at_mqttpubraw_expect, MP_ARRAY_SIZE(at_mqttpubraw_expect), 1, 3000, NULL, NULL);
+}
+
+// Read AT response text into nic->buffer from offset `len`, routing any
+// +IPD frames met on the way to their link queues. Returns the new length.
+STATIC uint32_t recv_text(esp8266_obj* nic, uint32_t len)
 {
-	int errcode;
-	uint32_t iter = 0;
-    *find_index = -1;
-	memset(nic->buffer.buffer,0,ESP8266_BUF_SIZE);
-    unsigned int start = mp_hal_ticks_ms();
-	const mp_stream_p_t * uart_stream = mp_get_stream(nic->uart_obj);
 	machine_uart_obj_t *self = MP_OBJ_TO_PTR(nic->uart_obj);
-    while (mp_hal_ticks_ms() - start < timeout) {
+    int8_t link = ESP8266_LINK_NONE;
+    self->read_lock = true;
+    uart_drain_rx_fifo(self);
+    self->read_lock = false;
+    esp8266_ipd_pump(nic, &self->read_buffer, &link, NULL, 0, nic->buffer.buffer, &len, ESP8266_BUF_SIZE - 1);
+    return len;
+}
+
+/**
+ * 
+ * @return -1: parameters error, -2: EOF, -3: timeout, -4:peer closed and no data in buffer
+ */
+int recvPkg(esp8266_obj*nic,int8_t link, char* out_buff, uint32_t out_buff_len, uint32_t *data_len, uint32_t timeout, char* coming_mux_id, bool* peer_closed)
+{
+	machine_uart_obj_t *self = MP_OBJ_TO_PTR(nic->uart_obj);
+    esp8266_ipd_parser *p = &nic->ipd;
+    uint32_t size = 0;
+    mp_uint_t start = mp_hal_ticks_ms();
+
+    // parameters check
+    if (out_buff == NULL || link < ESP8266_LINK_ANY || link >= ESP8266_MAX_LINKS) {
+        return -1;
+    }
+
+    // data queued while other links were being read comes first
+    if (link == ESP8266_LINK_ANY) {
+        for (int8_t i = 0; i < ESP8266_MAX_LINKS; ++i) {
+            if ((nic->link_used & (1 << i)) && Buffer_Size(&nic->link_rx[i]) > 0) {
+                link = i;
+                break;
+            }
+        }
+    }
+    if (link >= 0 && nic->link_rx[link].buffer != NULL) {
+        size = Buffer_Read(&nic->link_rx[link], (uint8_t*)out_buff, out_buff_len);
+    }
+
+    for (;;) {
         self->read_lock = true;
         uart_drain_rx_fifo(self);
         self->read_lock = false;
-        while(ringbuf_avail(&self->read_buffer) > 0 && iter < ESP8266_BUF_SIZE) {
-            uart_stream->read(nic->uart_obj,&nic->buffer.buffer[iter++],1,&errcode);
+        size += esp8266_ipd_pump(nic, &self->read_buffer, &link, (uint8_t*)out_buff + size, out_buff_len - size, NULL, NULL, 0);
+        esp8266_at_kick(nic);
+        if (size == out_buff_len) { // data enough
+            break;
         }
-        if (data_find(nic->buffer.buffer,iter,target1) != -1) {
-            *find_index = 0;
-            return (char*)nic->buffer.buffer;
-        } else if (data_find(nic->buffer.buffer,iter,target2) != -1) {
-            *find_index = 1;
-            return (char*)nic->buffer.buffer;
+        if (size > 0 && (p->state != ESP8266_IPD_PAYLOAD || p->link_id != link)) { // read at least one frame ok
+            break;
+        }
+        if ((link >= 0 ? p->closed & (1 << link) : p->closed) || timeout == 0 || mp_hal_ticks_ms() - start > timeout) {
+            break;
         }
     }
-    return NULL;
+
+    if (data_len) {
+        *data_len = size;
+    }
+    if (coming_mux_id && size > 0) {
+        *coming_mux_id = '0' + link;
+    }
+    uint8_t closed_mask = link >= 0 ? 1 << link : 0;
+    if (p->closed & closed_mask) {
+        if (peer_closed == NULL) {
+            p->closed &= ~closed_mask;
+        } else {
+            *peer_closed = true;
+            if (size == 0) { // buffered data all delivered, now report EOF once
+                p->closed &= ~closed_mask;
+                return -2;
+            }
+        }
+    } else if (size == 0 && peer_closed && *peer_closed) { // peer closed and no data in buffer
+        return -4;
+    }
+    if (size == 0 && timeout != 0) {
+        return -3;
+    }
+    return size;
 }
 
-char* recvString_3(esp8266_obj* nic,char* target1, char* target2,char* target3,uint32_t timeout, int8_t* find_index)
+void rx_empty(esp8266_obj* nic) 
 {
+	machine_uart_obj_t *self = MP_OBJ_TO_PTR(nic->uart_obj);
+    int8_t link = ESP8266_LINK_NONE;
+    // a blocking command must not interleave with queued ones, and those
+    // still queued after every one of them could have timed out are failed
+    if (!esp8266_at_flush(nic, ESP8266_AT_QUEUE_LEN * ESP8266_AT_FLUSH_TIMEOUT)) {
+        esp8266_at_abort(nic);
+    }
+    self->read_lock = true;
+    uart_drain_rx_fifo(self);
+    self->read_lock = false;
+    // stale AT output is dropped, but frames already received are kept
+    esp8266_ipd_pump(nic, &self->read_buffer, &link, NULL, 0, NULL, NULL, 0);
+}
+
 
-	int errcode;
-	uint32_t iter = 0;
-    *find_index = -1;
-	memset(nic->buffer.buffer,0,ESP8266_BUF_SIZE);
+// Read AT response text into nic->buffer until one of the patterns is seen,
+// matching only the bytes each read appends.
+STATIC char* recv_string(esp8266_obj* nic, const char* const* targets, uint8_t count, uint32_t timeout, int8_t* find_index)
+{
+    esp8266_matcher m;
+    uint32_t iter = 0;
+    esp8266_match_init(&m, targets, count);
+    memset(nic->buffer.buffer,0,ESP8266_BUF_SIZE);
     unsigned long start = mp_hal_ticks_ms();
-	const mp_stream_p_t * uart_stream = mp_get_stream(nic->uart_obj);
-	machine_uart_obj_t *self = MP_OBJ_TO_PTR(nic->uart_obj);
     while (mp_hal_ticks_ms() - start < timeout) {
-        self->read_lock = true;
-        uart_drain_rx_fifo(self);
-        self->read_lock = false;
-        while(ringbuf_avail(&self->read_buffer) > 0) {
-            uart_stream->read(nic->uart_obj,&nic->buffer.buffer[iter++],1,&errcode);
-        }
-        if (data_find(nic->buffer.buffer,iter,target1) != -1) {
-            *find_index = 0;
-            return (char*)nic->buffer.buffer;
-        } else if (data_find(nic->buffer.buffer,iter,target2) != -1) {
-            *find_index = 1;
-            return (char*)nic->buffer.buffer;
-        } else if (data_find(nic->buffer.buffer,iter,target3) != -1) {
-            *find_index = 2;
+        uint32_t prev = iter;
+        iter = recv_text(nic, iter);
+        *find_index = esp8266_match_feed(&m, nic->buffer.buffer + prev, iter - prev);
+        if (*find_index != -1) {
             return (char*)nic->buffer.buffer;
         }
     }
     return NULL;
 }
 
+char* recvString_1(esp8266_obj* nic, const char* target1,uint32_t timeout)
+{
+    int8_t find_index;
+    return recv_string(nic, &target1, 1, timeout, &find_index);
+}
+
+
+char* recvString_2(esp8266_obj* nic,char* target1, char* target2, uint32_t timeout, int8_t* find_index)
+{
+    const char* targets[] = {target1, target2};
+    return recv_string(nic, targets, 2, timeout, find_index);
+}
+
+char* recvString_3(esp8266_obj* nic,char* target1, char* target2,char* target3,uint32_t timeout, int8_t* find_index)
+{
+    const char* targets[] = {target1, target2, target3};
+    return recv_string(nic, targets, 3, timeout, find_index);
+}
+
 bool recvFind(esp8266_obj* nic, const char* target, uint32_t timeout)
 {
-    recvString_1(nic, target, timeout);
-    if (data_find(nic->buffer.buffer,ESP8266_BUF_SIZE,target) != -1) {
-        return true;
-    }
-    return false;
+    return recvString_1(nic, target, timeout) != NULL;
 }
 
 bool recvFindAndFilter(esp8266_obj* nic,const char* target, const char* begin, const char* end, char** data, uint32_t timeout)
 {
-    recvString_1(nic,target, timeout);
-    if (data_find(nic->buffer.buffer,ESP8266_BUF_SIZE,target) != -1) {
+    if (recvString_1(nic,target, timeout) != NULL) {
         int32_t index1 = data_find(nic->buffer.buffer,ESP8266_BUF_SIZE,begin);
         int32_t index2 = data_find(nic->buffer.buffer,ESP8266_BUF_SIZE,end);
         if (index1 != -1 && index2 != -1) {
@@ -982,13 +1469,15 @@ bool sATCIPSTARTMultiple(esp8266_obj*nic,char mux_id, char* type, char* addr, ui
     int8_t find_index;
 	itoa(port,port_str ,10);
 	const mp_stream_p_t * uart_stream = mp_get_stream(nic->uart_obj);
+	mp_obj_t IP = netutils_format_ipv4_addr((uint8_t*)addr,NETUTILS_BIG);
+	const char* host = mp_obj_str_get_str(IP);
 	rx_empty(nic);
 	uart_stream->write(nic->uart_obj,cmd,strlen(cmd),&errcode); 
 	uart_stream->write(nic->uart_obj, &mux_id,1,&errcode);
 	uart_stream->write(nic->uart_obj,",\"",strlen(",\""),&errcode);
 	uart_stream->write(nic->uart_obj,type,strlen(type),&errcode);
 	uart_stream->write(nic->uart_obj,"\",\"",strlen("\",\""),&errcode);
-	uart_stream->write(nic->uart_obj,addr,strlen(addr),&errcode);
+	uart_stream->write(nic->uart_obj,host,strlen(host),&errcode);
 	uart_stream->write(nic->uart_obj,"\",",strlen("\","),&errcode);
 	uart_stream->write(nic->uart_obj,port_str,strlen(port_str),&errcode);
 	uart_stream->write(nic->uart_obj,"\r\n",strlen("\r\n"),&errcode);
@@ -1026,10 +1515,10 @@ bool sATCIPSENDMultiple(esp8266_obj* nic,char mux_id, const char* buffer, uint32
 	uart_stream->write(nic->uart_obj, &mux_id,1,&errcode);
 	uart_stream->write(nic->uart_obj,",",strlen(","),&errcode);
 	uart_stream->write(nic->uart_obj,len_str,strlen(len_str),&errcode);
+	uart_stream->write(nic->uart_obj,"\r\n",strlen("\r\n"),&errcode);
     if (recvFind(nic,">", 5000)) {
         rx_empty(nic);
 		uart_stream->write(nic->uart_obj,buffer,len,&errcode);
-		uart_stream->write(nic->uart_obj,"\r\n",strlen("\r\n"),&errcode);
         return recvFind(nic,"SEND OK", 10000);
     }
     return false;
@@ -1086,7 +1575,10 @@ bool sATCIPMUX(esp8266_obj* nic,char mode)
 	uart_stream->write(nic->uart_obj,mode_str,strlen(mode_str),&errcode);
 	uart_stream->write(nic->uart_obj,"\r\n",strlen("\r\n"),&errcode);
     if(recvString_2(nic,"OK", "Link is builded",5000, &find) != NULL && find==0)
+    {
+        nic->mux = mode;
         return true;
+    }
     return false;
 }
 bool sATCIPSERVER(esp8266_obj* nic,char mode, uint32_t port)
@@ -1216,12 +1708,8 @@ bool eINIT(esp8266_obj* nic, int mode)
 	init_flag = init_flag && disableMUX(nic);
 	init_flag = init_flag && sATCIPMODE(nic,0);
 	init_flag = init_flag && setOprToStation(nic, mode);
-    if(mode & SOFTAP_MODE){
-		init_flag = init_flag && enableMUX(nic);
-	}
-	else{
-		init_flag = init_flag && disableMUX(nic);
-	}
+	// multiple connection mode so sockets get a link each
+	init_flag = init_flag && enableMUX(nic);
 	if(!mode & SOFTAP_MODE){
 		init_flag = init_flag && leaveAP(nic);
 	}
@@ -1636,24 +2124,34 @@ bool sMQTTCLEAN(esp8266_obj*nic, uint32_t LinkID)
     }
     return true;
 }
-// bool sMQTTPUBRAW(esp8266_obj*nic, uint32_t LinkID, const char* topic, uint32_t length, uint32_t qos, uint32_t retain)
-// {
-	// int errcode = 0;
-	// const char* cmd = "AT+MQTTPUBRAW=";
-	// char len_str[10] = {0};
-	// itoa(len,len_str ,10);
-	// const mp_stream_p_t * uart_stream = mp_get_stream(nic->uart_obj);
-	// rx_empty(nic);
-    // sprintf(ap_cmd, "AT+MQTTPUB=%d,\"%s\",%d,%d,%d", LinkID, topic, length, qos, retain);
-    // uart_stream->write(nic->uart_obj,ap_cmd, strlen(ap_cmd), &errcode);
-    // uart_stream->write(nic->uart_obj, "\r\n", strlen("\r\n"), &errcode);
-    // if (recvFind(nic,">", 5000)) {
-        // rx_empty(nic);
-		// uart_stream->write(nic->uart_obj,buffer,len,&errcode);
-        // return recvFind(nic,"SEND OK", timeout);
-    // }
-    // return false;
-// }
+bool sMQTTPUBRAW(esp8266_obj*nic, uint32_t LinkID, const char* topic, const uint8_t* data, uint32_t len, uint32_t qos, uint32_t retain)
+{
+    int errcode = 0;
+    int8_t find = -1;
+    const mp_stream_p_t * uart_stream = mp_get_stream(nic->uart_obj);
+    char mqtt_cmd[128];
+
+    if (len == 0)
+    {
+        // MQTTPUBRAW wants at least one byte
+        return sMQTTPUB(nic, LinkID, topic, "", qos, retain);
+    }
+    int cmd_len = snprintf(mqtt_cmd, sizeof(mqtt_cmd), "AT+MQTTPUBRAW=%u,\"%s\",%u,%u,%u\r\n",
+        (unsigned int)LinkID, topic, (unsigned int)len, (unsigned int)qos, (unsigned int)retain);
+    if (cmd_len >= sizeof(mqtt_cmd))
+    {
+        return false;
+    }
+    rx_empty(nic);
+    uart_stream->write(nic->uart_obj, mqtt_cmd, cmd_len, &errcode);
+    if (!recvFind(nic, ">", 5000))
+    {
+        return false;
+    }
+    // the payload goes out of the caller's buffer as is
+    uart_stream->write(nic->uart_obj, data, len, &errcode);
+    return recvString_3(nic, "+MQTTPUB:OK", "+MQTTPUB:FAIL", "ERROR", 3000, &find) != NULL && find == 0;
+}
 //bool setOprToSoftAP(void)
 //{
 //    char mode;
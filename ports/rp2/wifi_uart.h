@@ -36,12 +36,21 @@
 #include "mpconfigboard.h"
 #include "modnetwork.h"
 
-#include "buffer.h"
+#include "drivers/esp8266/buffer.h"
+#include "drivers/esp8266/mqtt_pool.h"
 
 ////////////////////////// config /////////////////////////
 
 #define ESP8266_MAX_ONCE_SEND 2048
 #define ESP8266_BUF_SIZE 4096 
+#define ESP8266_MAX_LINKS 5
+#define ESP8266_LINK_BUF_SIZE 2048
+#define ESP8266_MATCH_MAX_PATTERNS 3
+#define ESP8266_MATCH_MAX_LEN 24
+#define ESP8266_AT_QUEUE_LEN 4
+#define ESP8266_URC_MAX 4
+#define ESP8266_URC_LINE_SIZE 1024
+#define ESP8266_AT_FLUSH_TIMEOUT 10000  // ms, longest timeout of a queued command
 #define MICROPY_UART_NIC 1
 
 //////////////////////////////////////////////////////////
@@ -85,10 +94,105 @@ typedef struct _mqttconn_obj
 	mp_obj_t path;
 	mp_obj_t reconnect;
 }mqttconn_obj;
+/*
+ * Receive state of the +IPD frame parser, kept across recvPkg() calls so a
+ * frame may be split over any number of reads.
+ */
+typedef struct _esp8266_ipd_parser
+{
+	uint8_t state;          // ESP8266_IPD_IDLE/HEADER/PAYLOAD
+	uint8_t ipd_match;      // bytes of "+IPD," matched so far
+	uint8_t closed_match;   // bytes of "CLOSED\r\n" matched so far
+	int8_t closed_link;     // link the "CLOSED" being matched refers to
+	char prev[2];           // last two bytes seen between frames
+	uint8_t hdr_len;
+	char hdr[12];           // "<id>,<len>" or "<len>" following "+IPD,"
+	int8_t link_id;         // link of the frame being received
+	uint32_t remain;        // payload bytes of that frame not yet consumed
+	uint8_t closed;         // links with "CLOSED" seen but not yet reported as EOF
+}esp8266_ipd_parser;
+
+/*
+ * Incremental matcher for up to ESP8266_MATCH_MAX_PATTERNS AT response
+ * strings. Each pattern is a precompiled KMP automaton whose state is kept
+ * across feeds, so only newly received bytes are ever examined.
+ */
+typedef struct _esp8266_matcher
+{
+	uint8_t count;
+	uint8_t found;                                  // patterns seen so far, bit per pattern
+	const char* pattern[ESP8266_MATCH_MAX_PATTERNS];
+	uint8_t len[ESP8266_MATCH_MAX_PATTERNS];
+	uint8_t state[ESP8266_MATCH_MAX_PATTERNS];      // bytes of each pattern matched so far
+	uint8_t fail[ESP8266_MATCH_MAX_PATTERNS][ESP8266_MATCH_MAX_LEN];
+}esp8266_matcher;
+
+/*
+ * Result of a queued AT command, passed to its completion callback.
+ */
+#define ESP8266_AT_OK       (0)
+#define ESP8266_AT_FAIL     (1)     // one of the failure patterns was seen
+#define ESP8266_AT_TIMEOUT  (2)
+
+struct _esp8266_obj;
+typedef void (*esp8266_at_done)(struct _esp8266_obj* nic, int result, void* arg);
+typedef void (*esp8266_urc_handler)(struct _esp8266_obj* nic, const char* line, uint32_t len, void* arg);
+
+typedef struct _esp8266_at_cmd
+{
+	char* cmd;                  // full command line including "\r\n", owned by the queue
+	uint32_t cmd_len;
+	uint8_t* payload;           // sent after the ">" prompt if not NULL, follows cmd in its allocation
+	uint32_t payload_len;       // 0 if payload is NULL
+	const char* expect[ESP8266_MATCH_MAX_PATTERNS];
+	uint8_t n_expect;
+	uint8_t n_ok;               // expect[0..n_ok) mean success, the rest failure
+	uint32_t timeout;
+	esp8266_at_done done;
+	void* arg;
+}esp8266_at_cmd;
+
+/*
+ * Pipelined AT transactions. Commands are queued and sent one at a time,
+ * their responses are matched as the UART is pumped by whoever runs first
+ * (a socket read, a blocking AT helper or the event poll hook), and lines
+ * starting with a registered prefix are handed to their URC handler.
+ */
+typedef struct _esp8266_at_engine
+{
+	esp8266_at_cmd queue[ESP8266_AT_QUEUE_LEN];
+	uint8_t head;
+	uint8_t count;
+	uint8_t phase;              // ESP8266_AT_IDLE/PROMPT/RESULT for queue[head]
+	bool busy;                  // esp8266_at_poll() is running
+	esp8266_matcher match;
+	mp_uint_t start;
+	uint8_t urc_count;
+	struct {
+		const char* prefix;
+		esp8266_urc_handler handler;
+		void* arg;
+	} urc[ESP8266_URC_MAX];
+	uint16_t line_len;
+	bool line_skip;             // line too long to dispatch, wait for its end
+	uint32_t urc_overlong;      // lines not dispatched because they were too long
+	uint32_t urc_failed;        // lines whose handler raised an exception
+	char line[ESP8266_URC_LINE_SIZE];
+}esp8266_at_engine;
+
 typedef struct _esp8266_obj
 {
 	mp_obj_t uart_obj;
 	Buffer_t buffer;
+	esp8266_ipd_parser ipd;
+	bool mux;                               // AT+CIPMUX=1 in effect
+	uint8_t link_used;                      // bitmap of open links
+	Buffer_t link_rx[ESP8266_MAX_LINKS];    // payload waiting for each link's reader
+	uint8_t send_failed;                    // links whose queued send has failed
+	esp8266_at_engine at;
+	mqtt_pool_t mqtt_rx;                    // +MQTTSUBRECV messages not yet delivered
+	mp_obj_t mqtt_dispatch;                 // scheduled to deliver them, MP_OBJ_NULL if none
+	mp_obj_t mqtt_client;                   // argument of mqtt_dispatch
 }esp8266_obj;
 
 /*
@@ -228,8 +332,8 @@ bool unregisterUDP(esp8266_obj* nic);
 /**
  * Create TCP connection in multiple mode. 
  * 
- * @param mux_id - the identifier of this TCP(available value: 0 - 4). 
- * @param addr - the IP or domain name of the target host. 
+ * @param mux_id - the identifier of this TCP(available value: '0' - '4'). 
+ * @param addr - the IP address of the target host. 
  * @param port - the port number of the target host. 
  * @retval true - success.
  * @retval false - failure.
@@ -343,14 +447,15 @@ bool esp_send(esp8266_obj* nic,const char* buffer, uint32_t len, uint32_t timeou
 bool esp_send_mul(esp8266_obj* nic,char mux_id, const char* buffer, uint32_t len);
 
 /**
- * Receive data from TCP or UDP builded already in single mode. 
+ * Receive data from a TCP or UDP link builded already.
  *
+ * @param link - the link to read, 0 in single mode, as returned by esp8266_link_open().
  * @param buffer - the buffer for storing data. 
  * @param buffer_size - the length of the buffer. 
  * @param timeout - the time waiting data. 
  * @return the length of data received actually. 
  */
-int esp_recv(esp8266_obj* nic,char* buffer, uint32_t buffer_size, uint32_t* read_len, uint32_t timeout, bool* peer_closed, bool first_time_recv);
+int esp_recv(esp8266_obj* nic,int8_t link, char* buffer, uint32_t buffer_size, uint32_t* read_len, uint32_t timeout, bool* peer_closed);
 
 /**
  * Receive data from one of TCP or UDP builded already in multiple mode. 
@@ -382,6 +487,105 @@ uint32_t esp_recv_mul_id(esp8266_obj* nic,char* coming_mux_id, char* buffer, uin
  */
 void rx_empty(esp8266_obj* nic);
 
+/*
+ * Forget any partially received +IPD frame.
+ */
+void esp8266_ipd_reset(esp8266_obj* nic);
+
+/*
+ * Claim a free link (always 0 in single mode) and its receive queue.
+ * Return the link id, or -1 if all links are in use.
+ */
+int8_t esp8266_link_open(esp8266_obj* nic);
+
+/*
+ * Release a link and drop whatever is still queued for it.
+ */
+void esp8266_link_close(esp8266_obj* nic, int8_t link);
+
+#define ESP8266_LINK_READABLE (0x01) // payload queued, or EOF pending
+#define ESP8266_LINK_WRITABLE (0x02) // esp_send_async() has room
+#define ESP8266_LINK_CLOSED   (0x04) // peer closed, or link not open
+#define ESP8266_LINK_FAILED   (0x08) // a queued send failed
+
+/*
+ * Take in what the UART has received without blocking and report the state
+ * of `link` as ESP8266_LINK_* flags.
+ */
+uint8_t esp8266_link_poll(esp8266_obj* nic, int8_t link);
+
+/*
+ * Take in what the UART has received until an MQTT message is pooled or
+ * `timeout` ms have passed, and schedule the delivery of what is pooled.
+ * Return the number of messages waiting.
+ */
+uint8_t esp8266_mqtt_poll(esp8266_obj* nic, uint32_t timeout);
+
+/*
+ * Raise ValueError unless there are 1 to ESP8266_MATCH_MAX_PATTERNS patterns,
+ * each 1 to ESP8266_MATCH_MAX_LEN bytes long.
+ */
+void esp8266_match_check(const char* const* patterns, uint8_t count);
+
+/*
+ * Compile `count` patterns into `m`, checked with esp8266_match_check().
+ */
+void esp8266_match_init(esp8266_matcher* m, const char* const* patterns, uint8_t count);
+
+/*
+ * Advance the matcher over `len` new bytes.
+ * Return the index of the first pattern (in init order) seen so far, or -1.
+ */
+int8_t esp8266_match_feed(esp8266_matcher* m, const uint8_t* data, uint32_t len);
+
+/*
+ * Reset the AT engine and register the built-in URC handlers.
+ */
+void esp8266_at_init(esp8266_obj* nic);
+
+/*
+ * Queue an AT command. `cmd` (and `payload`, if any) are copied. The command
+ * completes on the first of `expect` seen, or after `timeout` ms, and `done`
+ * is then called from esp8266_at_poll(); it must not issue blocking commands.
+ * Return false if the queue is full.
+ */
+bool esp8266_at_submit(esp8266_obj* nic, const char* cmd, uint32_t cmd_len, const uint8_t* payload, uint32_t payload_len,
+	const char* const* expect, uint8_t n_expect, uint8_t n_ok, uint32_t timeout, esp8266_at_done done, void* arg);
+
+/*
+ * Advance queued commands and dispatch URCs without blocking.
+ */
+void esp8266_at_poll(esp8266_obj* nic);
+
+/*
+ * Wait up to `timeout` ms until every queued command has completed.
+ * Return false if some are still queued.
+ */
+bool esp8266_at_flush(esp8266_obj* nic, uint32_t timeout);
+
+/*
+ * Complete every queued command with ESP8266_AT_TIMEOUT.
+ */
+void esp8266_at_abort(esp8266_obj* nic);
+
+/*
+ * Call `handler` for each complete response line starting with `prefix`.
+ * Return false if the table is full.
+ */
+bool esp8266_urc_register(esp8266_obj* nic, const char* prefix, esp8266_urc_handler handler, void* arg);
+
+/*
+ * Queue AT+CIPSEND of at most ESP8266_MAX_ONCE_SEND bytes on `link`.
+ * A failure is recorded in nic->send_failed.
+ */
+bool esp_send_async(esp8266_obj* nic, int8_t link, const char* buffer, uint32_t len);
+
+/*
+ * Queue AT+MQTTPUBRAW of `len` bytes of `data`, the result is not reported.
+ * The payload is copied into the queue.
+ */
+bool sMQTTPUBRAW_async(esp8266_obj*nic, uint32_t LinkID, const char* topic, const uint8_t* data, uint32_t len, uint32_t qos, uint32_t retain);
+
 /* 
  * Recvive data from uart and search first target. Return true if target found, false for timeout.
  */
@@ -396,13 +600,14 @@ bool recvFindAndFilter(esp8266_obj* nic,const char* target, const char* begin, c
 /*
  * Receive a package from uart. 
  *
+ * @param link - the link to read, or -1 for whichever link has data first.
  * @param buffer - the buffer storing data. 
  * @param buffer_size - guess what!
- * @param data_len - the length of data actually received(maybe more than buffer_size, the remained data will be abandoned).
+ * @param data_len - the length of data actually received(at most buffer_size, the remained data is kept for the next call).
  * @param timeout - the duration waitting data comming.
- * @param coming_mux_id - in single connection mode, should be NULL and not NULL in multiple. 
+ * @param coming_mux_id - if not NULL, set to the id ('0' - '4') of the link data came from.
  */
-uint32_t recvPkg(esp8266_obj*nic,char* buffer, uint32_t buffer_size, uint32_t *data_len, uint32_t timeout, char* coming_mux_id, bool* peer_closed, bool first_time_recv);
+int recvPkg(esp8266_obj*nic,int8_t link, char* buffer, uint32_t buffer_size, uint32_t *data_len, uint32_t timeout, char* coming_mux_id, bool* peer_closed);
 
 
 bool eAT(esp8266_obj* nic);
@@ -446,6 +651,7 @@ bool sMQTTCONNCFG(esp8266_obj* nic,int LinkID, int keepalive, int disable_clean_
 bool sMQTTCONN(esp8266_obj* nic,int LinkID, const char* host, int port, int reconnect);
 bool qMQTTCONN(esp8266_obj* nic);
 bool sMQTTPUB(esp8266_obj*nic, uint32_t LinkID,  const char* topic,  const char* data, uint32_t qos, uint32_t retain);
+bool sMQTTPUBRAW(esp8266_obj*nic, uint32_t LinkID, const char* topic, const uint8_t* data, uint32_t len, uint32_t qos, uint32_t retain);
 bool qMQTTSUB(esp8266_obj*nic, uint32_t LinkID,  const char* topic, uint32_t qos);
 bool eMQTTSUB_Start(esp8266_obj* nic);
 bool eMQTTSUB_Get(esp8266_obj* nic, bool* end);
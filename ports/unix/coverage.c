@@ -15,6 +15,10 @@
 #include "py/stream.h"
 #include "py/binary.h"
 #include "py/bc.h"
+#include "py/stackctrl.h"
+#include "drivers/esp8266/buffer.h"
+#include "drivers/esp8266/mqtt_pool.h"
+#include "nicloop.h"
 
 // expected output of this file is found in extra_coverage.py.exp
 
@@ -217,6 +221,21 @@ STATIC mp_obj_t extra_coverage(void) {
 
         // calling gc_nbytes with a non-heap pointer
         mp_printf(&mp_plat_print, "%p\n", gc_nbytes(NULL));
+
+        // registering static storage as a root, twice, keeps what it points to
+        static void *root[1];
+        root[0] = gc_alloc(16, 0);
+        mp_printf(&mp_plat_print, "%d %d\n", gc_root_add(root, 1), gc_root_add(root, 1));
+        gc_collect();
+        mp_printf(&mp_plat_print, "%d\n", gc_nbytes(root[0]) != 0);
+        gc_root_remove(root);
+        root[0] = NULL;
+
+        // the high-water mark of a filled stack is its deepest used word
+        static uintptr_t stack[8];
+        mp_stack_fill(stack, stack + 8);
+        stack[5] = 0;
+        mp_printf(&mp_plat_print, "%d\n", (int)((uintptr_t *)mp_stack_high_water(stack, stack + 8) - stack));
     }
 
     // vstr
@@ -587,6 +606,191 @@ STATIC mp_obj_t extra_coverage(void) {
         mp_printf(&mp_plat_print, "%d\n", ringbuf_get16(&ringbuf));
     }
 
+    // Buffer_t (rp2 NIC receive queues)
+    {
+        uint8_t buf[100];
+        uint8_t data[40];
+        Buffer_t buffer;
+
+        mp_printf(&mp_plat_print, "# Buffer_t\n");
+
+        // Size is rounded down to a power of two and all of it is usable.
+        Buffer_Init(&buffer, buf, sizeof(buf));
+        mp_printf(&mp_plat_print, "%d %d %d\n", (int)buffer.maxSize, (int)Buffer_Free(&buffer), (int)Buffer_Size(&buffer));
+
+        // All-or-nothing put/get.
+        for (int i = 0; i < 40; ++i) {
+            data[i] = i;
+        }
+        mp_printf(&mp_plat_print, "%d\n", Buffer_Puts(&buffer, data, 40));
+        mp_printf(&mp_plat_print, "%d\n", Buffer_Puts(&buffer, data, 40));
+        mp_printf(&mp_plat_print, "%d\n", (int)Buffer_Free(&buffer));
+        mp_printf(&mp_plat_print, "%d\n", Buffer_Gets(&buffer, data, 30));
+        mp_printf(&mp_plat_print, "%d\n", data[29]);
+        mp_printf(&mp_plat_print, "%d\n", Buffer_Gets(&buffer, data, 40));
+        mp_printf(&mp_plat_print, "%d\n", (int)Buffer_Size(&buffer));
+
+        // Partial write/read across the wrap point.
+        for (int i = 0; i < 40; ++i) {
+            data[i] = 100 + i;
+        }
+        mp_printf(&mp_plat_print, "%d\n", (int)Buffer_Write(&buffer, data, 40));
+        mp_printf(&mp_plat_print, "%d\n", (int)Buffer_Free(&buffer));
+        mp_printf(&mp_plat_print, "%d\n", (int)Buffer_Read(&buffer, data, 40));
+        mp_printf(&mp_plat_print, "%d %d %d\n", data[0], data[9], data[10]);
+        mp_printf(&mp_plat_print, "%d\n", (int)Buffer_Read(&buffer, data, 40));
+        mp_printf(&mp_plat_print, "%d %d\n", data[0], data[39]);
+        mp_printf(&mp_plat_print, "%d\n", (int)Buffer_Read(&buffer, data, 40));
+
+        // Query finds a pattern that straddles the wrap point.
+        Buffer_Write(&buffer, data, 40);
+        Buffer_Read(&buffer, data, 40);
+        Buffer_Write(&buffer, data, 2);
+        Buffer_Read(&buffer, data, 2);
+        Buffer_Puts(&buffer, (uint8_t *)"xxxxOK\r\n", 9);
+        mp_printf(&mp_plat_print, "%d\n", (int)Buffer_StartPostion(&buffer));
+        mp_printf(&mp_plat_print, "%d\n", (int)Buffer_Query(&buffer, (uint8_t *)"OK\r\n", 4, Buffer_StartPostion(&buffer)));
+        mp_printf(&mp_plat_print, "%d\n", (int)Buffer_Query(&buffer, (uint8_t *)"ERROR", 5, Buffer_StartPostion(&buffer)));
+        mp_printf(&mp_plat_print, "%d\n", (int)Buffer_Size2(&buffer, Buffer_Query(&buffer, (uint8_t *)"OK", 2, Buffer_StartPostion(&buffer))));
+
+        // Clear, then SPSC mode behaves the same from one thread.
+        Buffer_Clear(&buffer);
+        mp_printf(&mp_plat_print, "%d %d\n", (int)Buffer_Size(&buffer), (int)Buffer_Free(&buffer));
+        Buffer_InitSPSC(&buffer, buf, 64);
+        mp_printf(&mp_plat_print, "%d\n", (int)Buffer_Write(&buffer, (uint8_t *)"spsc", 4));
+        mp_printf(&mp_plat_print, "%d\n", (int)Buffer_Read(&buffer, data, 4));
+        mp_printf(&mp_plat_print, "%.*s %d\n", 4, data, (int)Buffer_Size(&buffer));
+    }
+
+    // ESP8285 SPI command frames (rp2 NIC)
+    {
+        static esp8285_spi_proto_t proto;
+        static nicloop_esp8285_t nic;
+        esp8285_spi_transport_t io;
+        nicloop_esp8285_init(&nic, &io);
+        esp8285_spi_resp_t resp;
+        uint8_t buf[8];
+
+        mp_printf(&mp_plat_print, "# esp8285 spi frame\n");
+
+        // Command frames are padded to 4 bytes, too-small buffers are refused.
+        uint8_t idx = 3;
+        esp8285_spi_param_t param = { 1, &idx };
+        uint32_t len = esp8285_spi_frame_build(buf, sizeof(buf), GET_IDX_RSSI_CMD, &param, 1, false);
+        mp_printf(&mp_plat_print, "%d:", (int)len);
+        for (uint32_t i = 0; i < len; ++i) {
+            mp_printf(&mp_plat_print, " %02x", buf[i]);
+        }
+        mp_printf(&mp_plat_print, "\n");
+        mp_printf(&mp_plat_print, "%d\n", (int)esp8285_spi_frame_build(buf, 4, GET_IDX_RSSI_CMD, &param, 1, false));
+
+        // Parsing a partial reply reports how far the frame reaches so far.
+        static const uint8_t reply[] = {
+            0xff, 0xff, 0xff, 0xff, 0xff,
+            START_CMD, SCAN_NETWORKS | REPLY_FLAG, 2,
+            0, 4, 'h', 'o', 'm', 'e',
+            0, 40, '0', '1', '2', '3', '4', '5', '6', '7', '8', '9', '0', '1', '2', '3', '4', '5', '6', '7', '8', '9',
+            '0', '1', '2', '3', '4', '5', '6', '7', '8', '9', '0', '1', '2', '3', '4', '5', '6', '7', '8', '9',
+            END_CMD,
+        };
+        const uint8_t *frame = reply + 5;
+        for (uint32_t n = 0; n < sizeof(reply) - 5; n = esp8285_spi_frame_parse(frame, n, SCAN_NETWORKS, true, &resp)) {
+            mp_printf(&mp_plat_print, "%d ", (int)n);
+        }
+        mp_printf(&mp_plat_print, "%d\n", (int)esp8285_spi_frame_parse(frame, sizeof(reply) - 5, SCAN_NETWORKS, true, &resp));
+        mp_printf(&mp_plat_print, "%d\n", (int)esp8285_spi_frame_parse(frame, sizeof(reply) - 5, GET_IDX_RSSI_CMD, true, &resp));
+
+        // A whole command is one write, then the reply takes a read to find
+        // START and one per parameter it did not already cover.
+        proto.io = &io;
+        nicloop_esp8285_reply(&nic, reply, sizeof(reply));
+        int ret = esp8285_spi_proto_command(&proto, SCAN_NETWORKS, NULL, 0, false, true, &resp);
+        mp_printf(&mp_plat_print, "%d %d %d\n", ret, nic.transfers, (int)nic.cmd_len);
+        mp_printf(&mp_plat_print, "%d %.*s %d %.3s\n", (int)resp.params_num,
+            (int)resp.params[0].param_len, resp.params[0].param,
+            (int)resp.params[1].param_len, resp.params[1].param + 37);
+
+        // A short reply fits in the first read.
+        static const uint8_t reply_rssi[] = { START_CMD, GET_IDX_RSSI_CMD | REPLY_FLAG, 1, 1, 0xc4, END_CMD };
+        nicloop_esp8285_reply(&nic, reply_rssi, sizeof(reply_rssi));
+        ret = esp8285_spi_proto_command(&proto, GET_IDX_RSSI_CMD, &param, 1, false, false, &resp);
+        mp_printf(&mp_plat_print, "%d %d %d\n", ret, nic.transfers, (int8_t)resp.params[0].param[0]);
+
+        // ERR, a silent NIC and a reply to the wrong command all fail.
+        static const uint8_t reply_err[] = { 0xff, ERR_CMD };
+        nicloop_esp8285_reply(&nic, reply_err, sizeof(reply_err));
+        mp_printf(&mp_plat_print, "%d\n", esp8285_spi_proto_command(&proto, GET_IDX_RSSI_CMD, &param, 1, false, false, &resp));
+        nicloop_esp8285_reply(&nic, NULL, 0);
+        ret = esp8285_spi_proto_command(&proto, GET_IDX_RSSI_CMD, &param, 1, false, false, &resp);
+        mp_printf(&mp_plat_print, "%d %d\n", ret, nic.transfers);
+        nicloop_esp8285_reply(&nic, reply_rssi, sizeof(reply_rssi));
+        mp_printf(&mp_plat_print, "%d\n", esp8285_spi_proto_command(&proto, GET_IDX_ENCT_CMD, &param, 1, false, false, &resp));
+    }
+
+    // mqtt pool
+    {
+        static mqtt_pool_t pool;
+        static uint8_t arena[32];
+        const char *topic;
+        size_t topic_len;
+        const uint8_t *data;
+        size_t data_len;
+
+        mp_printf(&mp_plat_print, "# mqtt pool\n");
+
+        // Messages go in back to back until the arena is full.
+        mqtt_pool_init(&pool, arena, sizeof(arena));
+        mp_printf(&mp_plat_print, "%d\n", mqtt_pool_put(&pool, "ab", 2, (const uint8_t *)"0123456789", 10));
+        mp_printf(&mp_plat_print, "%d\n", mqtt_pool_put(&pool, "cd", 2, (const uint8_t *)"0123456789", 10));
+        mp_printf(&mp_plat_print, "%d\n", mqtt_pool_put(&pool, "ef", 2, (const uint8_t *)"0123456789", 10));
+
+        // Popping the oldest frees room at the start, the next one wraps.
+        mqtt_pool_peek(&pool, &topic, &topic_len, &data, &data_len);
+        mp_printf(&mp_plat_print, "%.*s %.*s\n", (int)topic_len, topic, (int)data_len, data);
+        mqtt_pool_pop(&pool);
+        mp_printf(&mp_plat_print, "%d\n", mqtt_pool_put(&pool, "ef", 2, (const uint8_t *)"abcdefghij", 10));
+        mp_printf(&mp_plat_print, "%d %d %d\n", pool.wrapped, pool.arena_head, pool.arena_tail);
+        mqtt_pool_pop(&pool);
+        mqtt_pool_peek(&pool, &topic, &topic_len, &data, &data_len);
+        mp_printf(&mp_plat_print, "%.*s %.*s\n", (int)topic_len, topic, (int)data_len, data);
+        mp_printf(&mp_plat_print, "%d %d %d\n", pool.wrapped, pool.arena_head, pool.arena_tail);
+
+        // Once all slots are taken further messages are dropped.
+        for (int i = 0; i < MQTT_POOL_LEN; ++i) {
+            mqtt_pool_put(&pool, "t", 1, (const uint8_t *)"", 0);
+        }
+        mp_printf(&mp_plat_print, "%d %d %d %d\n", (int)pool.received, (int)pool.dropped, (int)pool.overflow, mqtt_pool_count(&pool));
+
+        // Everything comes out in order, then the pool is empty and reset.
+        while (mqtt_pool_peek(&pool, &topic, &topic_len, &data, &data_len)) {
+            mp_printf(&mp_plat_print, "%.*s:%d ", (int)topic_len, topic, (int)data_len);
+            mqtt_pool_pop(&pool);
+        }
+        mp_printf(&mp_plat_print, "\n");
+        mp_printf(&mp_plat_print, "%d %d %d\n", mqtt_pool_count(&pool), pool.arena_head, pool.arena_tail);
+
+        // A message streamed in shows up once all of its payload is in, one
+        // cut short is dropped and its room given back.
+        mp_printf(&mp_plat_print, "%d\n", mqtt_pool_begin(&pool, "s", 1, 6));
+        mqtt_pool_append(&pool, (const uint8_t *)"a\nb", 3);
+        mp_printf(&mp_plat_print, "%d\n", mqtt_pool_count(&pool));
+        mqtt_pool_append(&pool, (const uint8_t *)"c\nd", 3);
+        mqtt_pool_end(&pool);
+        mqtt_pool_begin(&pool, "s", 1, 4);
+        mqtt_pool_append(&pool, (const uint8_t *)"xy", 2);
+        mqtt_pool_end(&pool);
+        mp_printf(&mp_plat_print, "%d %d %d\n", mqtt_pool_count(&pool), (int)pool.dropped, pool.arena_head);
+        mqtt_pool_peek(&pool, &topic, &topic_len, &data, &data_len);
+        mp_printf(&mp_plat_print, "%d %d %d\n", (int)data_len, data[1], data[5]);
+
+        // A message without room is counted and its payload skipped.
+        mp_printf(&mp_plat_print, "%d\n", mqtt_pool_begin(&pool, "s", 1, 100));
+        mqtt_pool_append(&pool, (const uint8_t *)"xy", 2);
+        mqtt_pool_end(&pool);
+        mp_printf(&mp_plat_print, "%d %d %d\n", mqtt_pool_count(&pool), (int)pool.overflow, pool.arena_head);
+        mqtt_pool_pop(&pool);
+    }
+
     // pairheap
     {
         mp_printf(&mp_plat_print, "# pairheap\n");
@@ -60,6 +60,33 @@ STATIC uint emit_opt = MP_EMIT_OPT_NONE;
 // Heap size of GC heap (if enabled)
 // Make it larger on a 64 bit machine, because pointers are larger.
 long heap_size = 1024 * 1024 * (sizeof(mp_uint_t) / 4);
+
+#if MICROPY_GC_SPLIT_HEAP_AUTO
+// Size the heap can grow to by adding areas, and its size so far.  By default
+// it stays at heap_size; -X heapmax lets it start small and grow on demand.
+long heap_max = 0;
+STATIC long heap_total;
+
+bool gc_try_add_heap(size_t n_bytes) {
+    if ((long)n_bytes >= heap_max) {
+        return false;
+    }
+    // Grow by the initial heap size if there is room, and always by enough
+    // for n_bytes along with the area's own state and allocation tables.
+    long need = n_bytes + n_bytes / 8 + 4096;
+    long size = MIN(MAX(heap_size, need), heap_max - heap_total);
+    if (size < need) {
+        return false;
+    }
+    char *heap = malloc(size);
+    if (heap == NULL) {
+        return false;
+    }
+    gc_add(heap, heap + size);
+    heap_total += size;
+    return true;
+}
+#endif
 #endif
 
 STATIC void stderr_print_strn(void *env, const char *str, size_t len) {
@@ -325,6 +352,12 @@ STATIC void print_help(char **argv) {
         "  heapsize=<n>[w][K|M] -- set the heap size for the GC (default %ld)\n"
         , heap_size);
     impl_opts_cnt++;
+    #if MICROPY_GC_SPLIT_HEAP_AUTO
+    printf(
+        "  heapmax=<n>[w][K|M] -- set the size the GC heap can grow to (default heapsize)\n"
+        );
+    impl_opts_cnt++;
+    #endif
     #endif
 
     if (impl_opts_cnt == 0) {
@@ -337,6 +370,40 @@ STATIC int invalid_args(void) {
     return 1;
 }
 
+#if MICROPY_ENABLE_GC
+// Parse a heap size given as <n>[w][K|M], returning -1 if it is invalid.
+STATIC long parse_heap_size(const char *arg) {
+    char *end;
+    long size = strtol(arg, &end, 0);
+    // Don't bring unneeded libc dependencies like tolower()
+    // If there's 'w' immediately after number, adjust it for
+    // target word size. Note that it should be *before* size
+    // suffix like K or M, to avoid confusion with kilowords,
+    // etc. the size is still in bytes, just can be adjusted
+    // for word size (taking 32bit as baseline).
+    bool word_adjust = false;
+    if ((*end | 0x20) == 'w') {
+        word_adjust = true;
+        end++;
+    }
+    if ((*end | 0x20) == 'k') {
+        size *= 1024;
+    } else if ((*end | 0x20) == 'm') {
+        size *= 1024 * 1024;
+    } else {
+        // Compensate for ++ below
+        --end;
+    }
+    if (*++end != 0) {
+        return -1;
+    }
+    if (word_adjust) {
+        size = size * MP_BYTES_PER_OBJ_WORD / 4;
+    }
+    return size;
+}
+#endif
+
 // Process options which set interpreter init options
 STATIC void pre_process_options(int argc, char **argv) {
     for (int a = 1; a < argc; a++) {
@@ -365,37 +432,18 @@ STATIC void pre_process_options(int argc, char **argv) {
                 #endif
                 #if MICROPY_ENABLE_GC
                 } else if (strncmp(argv[a + 1], "heapsize=", sizeof("heapsize=") - 1) == 0) {
-                    char *end;
-                    heap_size = strtol(argv[a + 1] + sizeof("heapsize=") - 1, &end, 0);
-                    // Don't bring unneeded libc dependencies like tolower()
-                    // If there's 'w' immediately after number, adjust it for
-                    // target word size. Note that it should be *before* size
-                    // suffix like K or M, to avoid confusion with kilowords,
-                    // etc. the size is still in bytes, just can be adjusted
-                    // for word size (taking 32bit as baseline).
-                    bool word_adjust = false;
-                    if ((*end | 0x20) == 'w') {
-                        word_adjust = true;
-                        end++;
-                    }
-                    if ((*end | 0x20) == 'k') {
-                        heap_size *= 1024;
-                    } else if ((*end | 0x20) == 'm') {
-                        heap_size *= 1024 * 1024;
-                    } else {
-                        // Compensate for ++ below
-                        --end;
-                    }
-                    if (*++end != 0) {
-                        goto invalid_arg;
-                    }
-                    if (word_adjust) {
-                        heap_size = heap_size * MP_BYTES_PER_OBJ_WORD / 4;
-                    }
+                    heap_size = parse_heap_size(argv[a + 1] + sizeof("heapsize=") - 1);
                     // If requested size too small, we'll crash anyway
                     if (heap_size < 700) {
                         goto invalid_arg;
                     }
+                #if MICROPY_GC_SPLIT_HEAP_AUTO
+                } else if (strncmp(argv[a + 1], "heapmax=", sizeof("heapmax=") - 1) == 0) {
+                    heap_max = parse_heap_size(argv[a + 1] + sizeof("heapmax=") - 1);
+                    if (heap_max < 0) {
+                        goto invalid_arg;
+                    }
+                #endif
                 #endif
                 } else {
                 invalid_arg:
@@ -458,6 +506,9 @@ MP_NOINLINE int main_(int argc, char **argv) {
     #if MICROPY_ENABLE_GC
     char *heap = malloc(heap_size);
     gc_init(heap, heap + heap_size);
+    #if MICROPY_GC_SPLIT_HEAP_AUTO
+    heap_total = heap_size;
+    #endif
     #endif
 
     #if MICROPY_ENABLE_PYSTACK
@@ -712,6 +763,14 @@ MP_NOINLINE int main_(int argc, char **argv) {
     #if MICROPY_ENABLE_GC && !defined(NDEBUG)
     // We don't really need to free memory since we are about to exit the
     // process, but doing so helps to find memory leaks.
+    #if MICROPY_GC_SPLIT_HEAP_AUTO
+    // each added area starts with its own state, see gc_try_add_heap()
+    for (mp_state_mem_area_t *area = MP_STATE_MEM(area).next; area != NULL;) {
+        mp_state_mem_area_t *next = area->next;
+        free(area);
+        area = next;
+    }
+    #endif
     free(heap);
     #endif
 
@@ -37,6 +37,7 @@
 #include <errno.h>
 #include <poll.h>
 
+#include "py/gc.h"
 #include "py/runtime.h"
 #include "py/stream.h"
 #include "py/obj.h"
@@ -129,6 +130,7 @@ STATIC mp_obj_t poll_register(size_t n_args, const mp_obj_t *args) {
     free_slot->fd = fd;
     free_slot->events = flags;
     free_slot->revents = 0;
+    MP_GC_WRITE_BARRIER(self);
     return mp_const_true;
 }
 MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(poll_register_obj, 2, 3, poll_register);
@@ -221,6 +223,7 @@ STATIC mp_obj_t poll_poll(size_t n_args, const mp_obj_t *args) {
                 t->items[0] = MP_OBJ_NEW_SMALL_INT(entries->fd);
             }
             t->items[1] = MP_OBJ_NEW_SMALL_INT(entries->revents);
+            MP_GC_WRITE_BARRIER(t);
             ret_list->items[ret_i++] = MP_OBJ_FROM_PTR(t);
             if (self->flags & FLAG_ONESHOT) {
                 entries->events = 0;
@@ -237,6 +240,7 @@ STATIC mp_obj_t poll_ipoll(size_t n_args, const mp_obj_t *args) {
 
     if (self->ret_tuple == MP_OBJ_NULL) {
         self->ret_tuple = mp_obj_new_tuple(2, NULL);
+        MP_GC_WRITE_BARRIER(self);
     }
 
     int n_ready = poll_poll_internal(n_args, args);
@@ -268,6 +272,7 @@ STATIC mp_obj_t poll_iternext(mp_obj_t self_in) {
                 t->items[0] = MP_OBJ_NEW_SMALL_INT(entries->fd);
             }
             t->items[1] = MP_OBJ_NEW_SMALL_INT(entries->revents);
+            MP_GC_WRITE_BARRIER(t);
             if (self->flags & FLAG_ONESHOT) {
                 entries->events = 0;
             }
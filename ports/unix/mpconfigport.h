@@ -55,6 +55,8 @@
 #define MICROPY_COMP_TRIPLE_TUPLE_ASSIGN (1)
 #define MICROPY_COMP_RETURN_IF_EXPR (1)
 #define MICROPY_ENABLE_GC           (1)
+#define MICROPY_GC_SPLIT_HEAP       (1)
+#define MICROPY_GC_SPLIT_HEAP_AUTO  (1)
 #define MICROPY_ENABLE_FINALISER    (1)
 #define MICROPY_STACK_CHECK         (1)
 #define MICROPY_MALLOC_USES_ALLOCATED_SIZE (1)
@@ -82,6 +84,18 @@
 #ifndef MICROPY_OPT_CACHE_MAP_LOOKUP_IN_BYTECODE
 #define MICROPY_OPT_CACHE_MAP_LOOKUP_IN_BYTECODE (1)
 #endif
+#ifndef MICROPY_OPT_METHOD_CACHE
+#define MICROPY_OPT_METHOD_CACHE    (1)
+#endif
+#ifndef MICROPY_OPT_INLINE_CACHE
+#define MICROPY_OPT_INLINE_CACHE    (1)
+#endif
+#ifndef MICROPY_OPT_QUICKEN
+#define MICROPY_OPT_QUICKEN         (1)
+#endif
+#ifndef MICROPY_OPT_QSTR_INDEX
+#define MICROPY_OPT_QSTR_INDEX      (1)
+#endif
 #define MICROPY_MODULE_WEAK_LINKS   (1)
 #define MICROPY_CAN_OVERRIDE_BUILTINS (1)
 #define MICROPY_VFS_POSIX_FILE      (1)
@@ -358,6 +372,12 @@ struct _mp_bluetooth_nimble_malloc_t;
 #include <stdio.h>
 #endif
 
+// Start this many helpers for MICROPY_GC_PARALLEL_MARK even if there are not
+// as many other CPUs, so that the parallel mark also runs on a single CPU.
+#ifndef MICROPY_UNIX_GC_MARK_MIN_HELPERS
+#define MICROPY_UNIX_GC_MARK_MIN_HELPERS (0)
+#endif
+
 #if MICROPY_PY_THREAD
 #define MICROPY_BEGIN_ATOMIC_SECTION() (mp_thread_unix_begin_atomic_section(), 0xffffffff)
 #define MICROPY_END_ATOMIC_SECTION(x) (void)x; mp_thread_unix_end_atomic_section()
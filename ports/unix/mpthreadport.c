@@ -38,6 +38,7 @@
 #include <signal.h>
 #include <sched.h>
 #include <semaphore.h>
+#include <unistd.h>
 
 #include "lib/utils/gchelper.h"
 
@@ -282,6 +283,74 @@ void mp_thread_finish(void) {
     mp_thread_unix_end_atomic_section();
 }
 
+#if MICROPY_GC_PARALLEL_MARK
+
+// The helpers sharing the mark phase of a collection.  They are not MicroPython
+// threads: they only ever run gc_mark_worker(), and block all signals so that
+// neither the GC signal nor Ctrl-C is delivered to them.
+bool mp_thread_gc_mark_spin;
+STATIC pthread_mutex_t gc_mark_mutex = PTHREAD_MUTEX_INITIALIZER;
+STATIC pthread_cond_t gc_mark_cond = PTHREAD_COND_INITIALIZER;
+STATIC size_t gc_mark_helpers = 0;
+STATIC size_t gc_mark_running = 0;
+STATIC unsigned int gc_mark_round = 0;
+STATIC bool gc_mark_started = false;
+
+STATIC void *gc_mark_helper(void *arg) {
+    (void)arg;
+    unsigned int round = 0;
+    pthread_mutex_lock(&gc_mark_mutex);
+    for (;;) {
+        while (gc_mark_round == round) {
+            pthread_cond_wait(&gc_mark_cond, &gc_mark_mutex);
+        }
+        round = gc_mark_round;
+        pthread_mutex_unlock(&gc_mark_mutex);
+        gc_mark_worker();
+        pthread_mutex_lock(&gc_mark_mutex);
+        if (--gc_mark_running == 0) {
+            pthread_cond_broadcast(&gc_mark_cond);
+        }
+    }
+    return NULL;
+}
+
+void mp_thread_gc_mark_parallel(void) {
+    pthread_mutex_lock(&gc_mark_mutex);
+    if (!gc_mark_started) {
+        // start the helpers the first time they are needed, no more than
+        // there are other CPUs since idle workers spin, unless more are asked for
+        gc_mark_started = true;
+        long n = MAX(sysconf(_SC_NPROCESSORS_ONLN) - 1, MICROPY_UNIX_GC_MARK_MIN_HELPERS);
+        sigset_t all, old;
+        sigfillset(&all);
+        pthread_sigmask(SIG_SETMASK, &all, &old);
+        for (long i = 0; i < MIN(n, MICROPY_GC_PARALLEL_MARK_WORKERS - 1); ++i) {
+            pthread_t id;
+            if (pthread_create(&id, NULL, gc_mark_helper, NULL) != 0) {
+                break;
+            }
+            pthread_detach(id);
+            ++gc_mark_helpers;
+        }
+        pthread_sigmask(SIG_SETMASK, &old, NULL);
+    }
+    gc_mark_running = gc_mark_helpers;
+    ++gc_mark_round;
+    pthread_cond_broadcast(&gc_mark_cond);
+    pthread_mutex_unlock(&gc_mark_mutex);
+
+    gc_mark_worker();
+
+    pthread_mutex_lock(&gc_mark_mutex);
+    while (gc_mark_running > 0) {
+        pthread_cond_wait(&gc_mark_cond, &gc_mark_mutex);
+    }
+    pthread_mutex_unlock(&gc_mark_mutex);
+}
+
+#endif // MICROPY_GC_PARALLEL_MARK
+
 void mp_thread_mutex_init(mp_thread_mutex_t *mutex) {
     pthread_mutex_init(mutex, NULL);
 }
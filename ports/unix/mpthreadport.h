@@ -25,6 +25,8 @@
  */
 
 #include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
 
 typedef pthread_mutex_t mp_thread_mutex_t;
 
@@ -36,3 +38,40 @@ void mp_thread_gc_others(void);
 // Functions as a port-global lock for any code that must be serialised.
 void mp_thread_unix_begin_atomic_section(void);
 void mp_thread_unix_end_atomic_section(void);
+
+#if MICROPY_GC_PARALLEL_MARK
+extern bool mp_thread_gc_mark_spin;
+
+static inline void mp_thread_gc_mark_pause(void) {
+    // there may be more workers than CPUs, see MICROPY_UNIX_GC_MARK_MIN_HELPERS
+    sched_yield();
+}
+
+static inline void mp_thread_gc_mark_lock(void) {
+    while (__atomic_test_and_set(&mp_thread_gc_mark_spin, __ATOMIC_ACQUIRE)) {
+        mp_thread_gc_mark_pause();
+    }
+}
+
+static inline void mp_thread_gc_mark_unlock(void) {
+    __atomic_clear(&mp_thread_gc_mark_spin, __ATOMIC_RELEASE);
+}
+
+static inline uint8_t mp_thread_gc_mark_fetch_or(uint8_t *ptr, uint8_t bits) {
+    return __atomic_fetch_or(ptr, bits, __ATOMIC_RELAXED);
+}
+#endif
+
+#if MICROPY_GC_TLAB
+static inline void mp_thread_gc_fence(void) {
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+static inline void mp_thread_gc_flag_set(volatile bool *flag) {
+    (void)__atomic_exchange_n(flag, true, __ATOMIC_SEQ_CST);
+}
+
+static inline void mp_thread_gc_flag_clear(volatile bool *flag) {
+    __atomic_store_n(flag, false, __ATOMIC_RELEASE);
+}
+#endif
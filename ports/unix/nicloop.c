@@ -0,0 +1,254 @@
+/*
+ * This file is part of the MicroPython project, http://micropython.org/
+ *
+ * The MIT License (MIT)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <string.h>
+
+#include "py/mperrno.h"
+#include "py/runtime.h"
+#include "drivers/esp8266/buffer.h"
+#include "nicloop.h"
+
+#if MICROPY_PY_THREAD
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+// The nicloop module drives the port-independent parts of the rp2 NIC
+// drivers in drivers/esp8266 against fakes, for benchmarks on the unix port.
+
+#if defined(MICROPY_UNIX_COVERAGE)
+
+STATIC int8_t nicloop_esp8285_begin(void *ctx) {
+    (void)ctx;
+    return 0;
+}
+
+STATIC void nicloop_esp8285_end(void *ctx) {
+    (void)ctx;
+}
+
+STATIC void nicloop_esp8285_transfer(void *ctx, const uint8_t *src, uint8_t *dest, uint32_t len) {
+    nicloop_esp8285_t *nic = ctx;
+    nic->transfers++;
+    if (dest == NULL) {
+        nic->cmd_len = MIN(len, sizeof(nic->cmd));
+        memcpy(nic->cmd, src, nic->cmd_len);
+        if (nic->echo) {
+            nic->cmd[1] |= REPLY_FLAG;
+            nic->reply = nic->cmd;
+            nic->reply_len = nic->cmd_len;
+            nic->pos = 0;
+        }
+        return;
+    }
+    if (nic->echo) {
+        // the filler comes before each reply
+        size_t n = 0;
+        if (nic->pos < nic->filler) {
+            n = MIN(len, nic->filler - nic->pos);
+            memset(dest, 0xff, n);
+            nic->pos += n;
+        }
+        size_t at = nic->pos - nic->filler;
+        size_t m = at < nic->reply_len ? MIN(len - n, nic->reply_len - at) : 0;
+        memcpy(dest + n, nic->reply + at, m);
+        memset(dest + n + m, 0xff, len - n - m);
+        nic->pos += m;
+        return;
+    }
+    for (uint32_t i = 0; i < len; ++i) {
+        dest[i] = nic->pos < nic->reply_len ? nic->reply[nic->pos++] : 0xff;
+    }
+}
+
+void nicloop_esp8285_init(nicloop_esp8285_t *nic, esp8285_spi_transport_t *io) {
+    memset(nic, 0, sizeof(*nic));
+    io->begin = nicloop_esp8285_begin;
+    io->end = nicloop_esp8285_end;
+    io->transfer = nicloop_esp8285_transfer;
+    io->ctx = nic;
+}
+
+void nicloop_esp8285_reply(nicloop_esp8285_t *nic, const uint8_t *reply, size_t len) {
+    nic->echo = false;
+    nic->reply = reply;
+    nic->reply_len = len;
+    nic->pos = 0;
+    nic->transfers = 0;
+}
+
+void nicloop_esp8285_echo(nicloop_esp8285_t *nic, size_t filler) {
+    nic->echo = true;
+    nic->filler = filler;
+    nic->reply = NULL;
+    nic->reply_len = 0;
+    nic->pos = 0;
+    nic->transfers = 0;
+}
+
+// spi_echo(n, size, filler): send n commands each carrying a size-byte
+// parameter to a loopback ESP8285 that answers after filler bytes, check each
+// reply and return the number of bus transfers taken.
+STATIC mp_obj_t nicloop_spi_echo(mp_obj_t n_in, mp_obj_t size_in, mp_obj_t filler_in) {
+    static esp8285_spi_proto_t proto;
+    static nicloop_esp8285_t nic;
+    static esp8285_spi_transport_t io;
+    static uint8_t data[ESP8285_SPI_FRAME_SIZE];
+    mp_int_t n = mp_obj_get_int(n_in);
+    size_t size = mp_obj_get_int(size_in);
+    size_t filler = mp_obj_get_int(filler_in);
+    if (size > ESP8285_SPI_FRAME_SIZE - 8 || filler > ESP8285_SPI_FRAME_SIZE / 2) {
+        mp_raise_ValueError(NULL);
+    }
+    nicloop_esp8285_init(&nic, &io);
+    nicloop_esp8285_echo(&nic, filler);
+    proto.io = &io;
+    for (size_t i = 0; i < size; ++i) {
+        data[i] = i * 7;
+    }
+    esp8285_spi_param_t param = { size, data };
+    esp8285_spi_resp_t resp;
+    for (mp_int_t i = 0; i < n; ++i) {
+        data[0] = i;
+        if (esp8285_spi_proto_command(&proto, SEND_DATA_TCP_CMD, &param, 1, true, true, &resp) != 0
+            || resp.params_num != 1 || resp.params[0].param_len != size
+            || memcmp(resp.params[0].param, data, size) != 0) {
+            mp_raise_msg(&mp_type_RuntimeError, MP_ERROR_TEXT("bad reply"));
+        }
+    }
+    return MP_OBJ_NEW_SMALL_INT(nic.transfers);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_3(nicloop_spi_echo_obj, nicloop_spi_echo);
+
+// The byte at stream offset i of the ring benchmarks; it repeats only every
+// 64k bytes, so a slip of a whole buffer length shows up.
+static inline uint8_t nicloop_ring_byte(uint32_t i) {
+    return i ^ (i >> 8);
+}
+
+typedef struct _nicloop_ring_t {
+    Buffer_t buffer;
+    uint32_t nbytes;
+    uint32_t chunk;
+} nicloop_ring_t;
+
+STATIC uint32_t nicloop_ring_put(nicloop_ring_t *ring, uint8_t *data, uint32_t pos) {
+    uint32_t len = MIN(ring->chunk, ring->nbytes - pos);
+    for (uint32_t i = 0; i < len; ++i) {
+        data[i] = nicloop_ring_byte(pos + i);
+    }
+    return Buffer_Write(&ring->buffer, data, len);
+}
+
+STATIC bool nicloop_ring_get(nicloop_ring_t *ring, uint8_t *data, uint32_t *pos) {
+    uint32_t len = Buffer_Read(&ring->buffer, data, MIN(ring->chunk, ring->nbytes - *pos));
+    bool ok = true;
+    for (uint32_t i = 0; i < len; ++i) {
+        ok &= data[i] == nicloop_ring_byte(*pos + i);
+    }
+    *pos += len;
+    return ok;
+}
+
+#if MICROPY_PY_THREAD
+// Producer side of the SPSC benchmark, like the UART IRQ filling the receive
+// queue while another core drains it.
+STATIC void *nicloop_ring_producer(void *arg) {
+    nicloop_ring_t *ring = arg;
+    uint8_t data[ESP8285_SPI_FRAME_SIZE];
+    for (uint32_t pos = 0; pos < ring->nbytes;) {
+        uint32_t len = nicloop_ring_put(ring, data, pos);
+        if (len == 0) {
+            sched_yield();
+        }
+        pos += len;
+    }
+    return NULL;
+}
+#endif
+
+// ring(nbytes, chunk, spsc): stream nbytes through a 4k Buffer_t in pieces of
+// up to chunk bytes and check them on the way out.  With spsc false one thread
+// alternately fills and drains the queue, with spsc true a producer thread
+// fills it while the caller drains it.  Return the number of bytes moved.
+STATIC mp_obj_t nicloop_ring(mp_obj_t nbytes_in, mp_obj_t chunk_in, mp_obj_t spsc_in) {
+    static uint8_t storage[4096];
+    nicloop_ring_t ring;
+    uint8_t data[ESP8285_SPI_FRAME_SIZE];
+    ring.nbytes = mp_obj_get_int(nbytes_in);
+    ring.chunk = mp_obj_get_int(chunk_in);
+    if (ring.chunk == 0 || ring.chunk > sizeof(data)) {
+        mp_raise_ValueError(NULL);
+    }
+    uint32_t pos = 0;
+    bool ok = true;
+    if (!mp_obj_is_true(spsc_in)) {
+        Buffer_Init(&ring.buffer, storage, sizeof(storage));
+        for (uint32_t put = 0; ok && pos < ring.nbytes;) {
+            put += nicloop_ring_put(&ring, data, put);
+            ok = nicloop_ring_get(&ring, data, &pos);
+        }
+    } else {
+        #if MICROPY_PY_THREAD
+        Buffer_InitSPSC(&ring.buffer, storage, sizeof(storage));
+        pthread_t producer;
+        if (pthread_create(&producer, NULL, nicloop_ring_producer, &ring) != 0) {
+            mp_raise_OSError(MP_EAGAIN);
+        }
+        // keep draining after a mismatch so the producer can finish
+        while (pos < ring.nbytes) {
+            uint32_t prev = pos;
+            ok &= nicloop_ring_get(&ring, data, &pos);
+            if (pos == prev) {
+                sched_yield();
+            }
+        }
+        pthread_join(producer, NULL);
+        #else
+        mp_raise_ValueError(NULL);
+        #endif
+    }
+    if (!ok) {
+        mp_raise_msg(&mp_type_RuntimeError, MP_ERROR_TEXT("bad data"));
+    }
+    return mp_obj_new_int_from_uint(pos);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_3(nicloop_ring_obj, nicloop_ring);
+
+STATIC const mp_rom_map_elem_t mp_module_nicloop_globals_table[] = {
+    { MP_ROM_QSTR(MP_QSTR___name__), MP_ROM_QSTR(MP_QSTR_nicloop) },
+    { MP_ROM_QSTR(MP_QSTR_spi_echo), MP_ROM_PTR(&nicloop_spi_echo_obj) },
+    { MP_ROM_QSTR(MP_QSTR_ring), MP_ROM_PTR(&nicloop_ring_obj) },
+};
+
+STATIC MP_DEFINE_CONST_DICT(mp_module_nicloop_globals, mp_module_nicloop_globals_table);
+
+const mp_obj_module_t mp_module_nicloop = {
+    .base = { &mp_type_module },
+    .globals = (mp_obj_dict_t *)&mp_module_nicloop_globals,
+};
+
+MP_REGISTER_MODULE(MP_QSTR_nicloop, mp_module_nicloop, MICROPY_UNIX_COVERAGE);
+
+#endif // defined(MICROPY_UNIX_COVERAGE)
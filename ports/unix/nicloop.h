@@ -0,0 +1,30 @@
+#ifndef MICROPY_INCLUDED_UNIX_NICLOOP_H
+#define MICROPY_INCLUDED_UNIX_NICLOOP_H
+
+#include "drivers/esp8266/wifi_spi_proto.h"
+
+// Fake ESP8285 on the other end of the SPI frame protocol, for the tests and
+// benchmarks of the coverage build.  It keeps the last command frame and
+// clocks out a canned reply, or in loopback mode echoes each command frame
+// back as its reply after some filler.  Bus transfers are counted.
+typedef struct _nicloop_esp8285_t {
+    uint8_t cmd[ESP8285_SPI_FRAME_SIZE];
+    size_t cmd_len;
+    const uint8_t *reply;
+    size_t reply_len;
+    size_t pos;
+    bool echo;
+    size_t filler;
+    int transfers;
+} nicloop_esp8285_t;
+
+// Set up `io` to talk to `nic`.
+void nicloop_esp8285_init(nicloop_esp8285_t *nic, esp8285_spi_transport_t *io);
+
+// Answer the next commands with `reply`, or with filler only if it is NULL.
+void nicloop_esp8285_reply(nicloop_esp8285_t *nic, const uint8_t *reply, size_t len);
+
+// Answer each command with itself as the reply, after `filler` bytes of 0xff.
+void nicloop_esp8285_echo(nicloop_esp8285_t *nic, size_t filler);
+
+#endif // MICROPY_INCLUDED_UNIX_NICLOOP_H
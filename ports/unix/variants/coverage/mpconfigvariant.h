@@ -32,9 +32,18 @@
 
 #define MICROPY_DEBUG_PARSE_RULE_NAME  (1)
 #define MICROPY_OPT_MATH_FACTORIAL     (1)
+#define MICROPY_OPT_INLINE_CACHE_STATS (1)
 #define MICROPY_FLOAT_HIGH_QUALITY_HASH (1)
 #define MICROPY_ENABLE_SCHEDULER       (1)
+#define MICROPY_GC_PARALLEL_MARK       (1)
+#define MICROPY_UNIX_GC_MARK_MIN_HELPERS (1)
+#define MICROPY_GC_INCREMENTAL         (1)
+#define MICROPY_GC_ALLOC_PROFILE       (1)
+#define MICROPY_GC_COMPACT             (1)
+#define MICROPY_GC_ROOTS               (1)
+#define MICROPY_GC_FINALISER_QUEUE     (1)
 #define MICROPY_READER_VFS             (1)
+#define MICROPY_STACK_HIGH_WATER       (1)
 #define MICROPY_REPL_EMACS_WORDS_MOVE  (1)
 #define MICROPY_REPL_EMACS_EXTRA_WORDS_MOVE (1)
 #define MICROPY_WARNINGS_CATEGORY      (1)
@@ -19,5 +19,6 @@ MICROPY_VFS_FAT = 1
 MICROPY_VFS_LFS1 = 1
 MICROPY_VFS_LFS2 = 1
 
-SRC_C += coverage.c
+SRC_C += coverage.c nicloop.c
+SRC_C += drivers/esp8266/buffer.c drivers/esp8266/wifi_spi_proto.c drivers/esp8266/mqtt_pool.c
 SRC_CXX += coveragecpp.cpp
@@ -32,3 +32,4 @@
 // 91 is a magic number proposed by @dpgeorge, which make pystone run ~ at tie
 // with CPython 3.4.
 #define MICROPY_MODULE_DICT_SIZE (91)
+#define MICROPY_OPT_MAP_COMPACT (1)
@@ -56,6 +56,10 @@
 #define MICROPY_STREAMS_NON_BLOCK   (0)
 #define MICROPY_OPT_COMPUTED_GOTO   (0)
 #define MICROPY_OPT_CACHE_MAP_LOOKUP_IN_BYTECODE (0)
+#define MICROPY_OPT_METHOD_CACHE    (0)
+#define MICROPY_OPT_INLINE_CACHE    (0)
+#define MICROPY_OPT_QUICKEN         (0)
+#define MICROPY_OPT_QSTR_INDEX      (0)
 #define MICROPY_CAN_OVERRIDE_BUILTINS (0)
 #define MICROPY_BUILTIN_METHOD_CHECK_SELF_ARG (0)
 #define MICROPY_CPYTHON_COMPAT      (0)
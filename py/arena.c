@@ -0,0 +1,74 @@
+/*
+ * This file is part of the MicroPython project, http://micropython.org/
+ *
+ * The MIT License (MIT)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "py/arena.h"
+
+void *mp_arena_alloc(mp_arena_t *arena, size_t n_bytes) {
+    n_bytes = (n_bytes + sizeof(mp_uint_t) - 1) & ~(sizeof(mp_uint_t) - 1);
+    mp_arena_chunk_t *chunk = arena->chunk;
+
+    if (chunk != NULL && chunk->used + n_bytes > chunk->alloc) {
+        // not enough room at end of the chunk so try to grow it in place
+        if (m_renew_maybe(byte, chunk, sizeof(mp_arena_chunk_t) + chunk->alloc,
+            sizeof(mp_arena_chunk_t) + chunk->alloc + n_bytes, false) != NULL) {
+            chunk->alloc += n_bytes;
+        } else {
+            // could not grow it; shrink it to fit what is used and start another
+            mp_arena_trim(arena);
+            chunk = NULL;
+        }
+    }
+
+    if (chunk == NULL) {
+        size_t alloc = MAX(arena->chunk_size, n_bytes);
+        chunk = (mp_arena_chunk_t *)m_new(byte, sizeof(mp_arena_chunk_t) + alloc);
+        chunk->prev = arena->chunk;
+        chunk->alloc = alloc;
+        chunk->used = 0;
+        arena->chunk = chunk;
+    }
+
+    byte *ret = chunk->data + chunk->used;
+    chunk->used += n_bytes;
+    return ret;
+}
+
+void mp_arena_trim(mp_arena_t *arena) {
+    mp_arena_chunk_t *chunk = arena->chunk;
+    if (chunk != NULL && chunk->used < chunk->alloc) {
+        (void)m_renew_maybe(byte, chunk, sizeof(mp_arena_chunk_t) + chunk->alloc,
+            sizeof(mp_arena_chunk_t) + chunk->used, false);
+        chunk->alloc = chunk->used;
+    }
+}
+
+void mp_arena_free(mp_arena_t *arena) {
+    mp_arena_chunk_t *chunk = arena->chunk;
+    while (chunk != NULL) {
+        mp_arena_chunk_t *prev = chunk->prev;
+        m_del(byte, chunk, sizeof(mp_arena_chunk_t) + chunk->alloc);
+        chunk = prev;
+    }
+    arena->chunk = NULL;
+}
@@ -0,0 +1,63 @@
+/*
+ * This file is part of the MicroPython project, http://micropython.org/
+ *
+ * The MIT License (MIT)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef MICROPY_INCLUDED_PY_ARENA_H
+#define MICROPY_INCLUDED_PY_ARENA_H
+
+#include "py/mpconfig.h"
+#include "py/misc.h"
+
+// An arena serves many small allocations from a few chunks of heap, each
+// taken from the end of the current chunk, and frees them all at once.  The
+// chunks are linked from the arena, which must therefore be in memory that
+// the GC scans, like the C stack or an object.
+
+typedef struct _mp_arena_chunk_t {
+    struct _mp_arena_chunk_t *prev;
+    size_t alloc;
+    size_t used;
+    byte data[];
+} mp_arena_chunk_t;
+
+typedef struct _mp_arena_t {
+    mp_arena_chunk_t *chunk;
+    size_t chunk_size;
+} mp_arena_t;
+
+// Start an empty arena, that takes chunks of at least chunk_size bytes.
+static inline void mp_arena_init(mp_arena_t *arena, size_t chunk_size) {
+    arena->chunk = NULL;
+    arena->chunk_size = chunk_size;
+}
+
+// Allocate n_bytes, word aligned; raises MemoryError if there is no room.
+void *mp_arena_alloc(mp_arena_t *arena, size_t n_bytes);
+
+// Give the unused end of the current chunk back to the heap.
+void mp_arena_trim(mp_arena_t *arena);
+
+// Free all that was allocated from the arena, leaving it empty.
+void mp_arena_free(mp_arena_t *arena);
+
+#endif // MICROPY_INCLUDED_PY_ARENA_H
@@ -123,8 +123,10 @@ void mp_setup_code_state(mp_code_state_t *code_state, size_t n_args, size_t n_kw
     code_state->prev = NULL;
     #endif
 
-    #if MICROPY_PY_SYS_SETTRACE
+    #if MICROPY_PY_SYS_SETTRACE || MICROPY_GC_ALLOC_PROFILE
     code_state->prev_state = NULL;
+    #endif
+    #if MICROPY_PY_SYS_SETTRACE
     code_state->frame = NULL;
     #endif
 
@@ -209,8 +209,10 @@ typedef struct _mp_code_state_t {
     #if MICROPY_STACKLESS
     struct _mp_code_state_t *prev;
     #endif
-    #if MICROPY_PY_SYS_SETTRACE
+    #if MICROPY_PY_SYS_SETTRACE || MICROPY_GC_ALLOC_PROFILE
     struct _mp_code_state_t *prev_state;
+    #endif
+    #if MICROPY_PY_SYS_SETTRACE
     struct _mp_obj_frame_t *frame;
     #endif
     // Variable-length
@@ -147,4 +147,13 @@
 #define MP_BC_IMPORT_FROM                   (MP_BC_BASE_QSTR_O + 0x0c) // qstr
 #define MP_BC_IMPORT_STAR                   (MP_BC_BASE_BYTE_E + 0x09)
 
+// Opcodes written over the generic ones by the VM as code runs, when
+// MICROPY_OPT_QUICKEN is enabled; the compiler never emits them.  Each has the
+// same size as the opcode it replaces.
+#define MP_BC_QUICK_BINARY_OP_SMALL_INT     (MP_BC_BASE_RESERVED + 0x02) // 10 ops
+#define MP_BC_QUICK_LOAD_SUBSCR_LIST        (MP_BC_BASE_RESERVED + 0x0c)
+#define MP_BC_QUICK_STORE_SUBSCR_LIST       (MP_BC_BASE_RESERVED + 0x0d)
+
+#define MP_BC_QUICK_BINARY_OP_SMALL_INT_NUM (10)
+
 #endif // MICROPY_INCLUDED_PY_BC0_H
@@ -157,6 +157,7 @@ STATIC const emit_inline_asm_method_table_t *emit_asm_table[] = {
 // elements in this struct are ordered to make it compact
 typedef struct _compiler_t {
     qstr source_file;
+    mp_arena_t *arena; // that of the parse tree, for what is freed with it
 
     uint8_t is_repl;
     uint8_t pass; // holds enum type pass_kind_t
@@ -240,7 +241,7 @@ STATIC void compile_decrease_except_level(compiler_t *comp) {
 }
 
 STATIC scope_t *scope_new_and_link(compiler_t *comp, scope_kind_t kind, mp_parse_node_t pn, uint emit_options) {
-    scope_t *scope = scope_new(kind, pn, comp->source_file, emit_options);
+    scope_t *scope = scope_new(comp->arena, kind, pn, comp->source_file, emit_options);
     scope->parent = comp->scope_cur;
     scope->next = NULL;
     if (comp->scope_head == NULL) {
@@ -3493,6 +3494,7 @@ mp_raw_code_t *mp_compile_to_raw_code(mp_parse_tree_t *parse_tree, qstr source_f
     compiler_t *comp = &comp_state;
 
     comp->source_file = source_file;
+    comp->arena = &parse_tree->arena;
     comp->is_repl = is_repl;
     comp->break_label = INVALID_LABEL;
     comp->continue_label = INVALID_LABEL;
@@ -3506,7 +3508,7 @@ mp_raw_code_t *mp_compile_to_raw_code(mp_parse_tree_t *parse_tree, qstr source_f
     scope_t *module_scope = scope_new_and_link(comp, SCOPE_MODULE, parse_tree->root, emit_opt);
 
     // create standard emitter; it's used at least for MP_PASS_SCOPE
-    emit_t *emit_bc = emit_bc_new();
+    emit_t *emit_bc = emit_bc_new(comp->arena);
 
     // compile pass 1
     comp->emit = emit_bc;
@@ -3544,7 +3546,7 @@ mp_raw_code_t *mp_compile_to_raw_code(mp_parse_tree_t *parse_tree, qstr source_f
     }
 
     // set max number of labels now that it's calculated
-    emit_bc_set_max_num_labels(emit_bc, max_num_labels);
+    emit_bc_set_max_num_labels(emit_bc, comp->arena, max_num_labels);
 
     // compile pass 2 and 3
     #if MICROPY_EMIT_NATIVE
@@ -3586,7 +3588,7 @@ mp_raw_code_t *mp_compile_to_raw_code(mp_parse_tree_t *parse_tree, qstr source_f
                 case MP_EMIT_OPT_NATIVE_PYTHON:
                 case MP_EMIT_OPT_VIPER:
                     if (emit_native == NULL) {
-                        emit_native = NATIVE_EMITTER(new)(&comp->compile_error, &comp->next_label, max_num_labels);
+                        emit_native = NATIVE_EMITTER(new)(comp->arena, &comp->compile_error, &comp->next_label, max_num_labels);
                     }
                     comp->emit_method_table = NATIVE_EMITTER_TABLE;
                     comp->emit = emit_native;
@@ -3627,7 +3629,6 @@ mp_raw_code_t *mp_compile_to_raw_code(mp_parse_tree_t *parse_tree, qstr source_f
 
     // free the emitters
 
-    emit_bc_free(emit_bc);
     #if MICROPY_EMIT_NATIVE
     if (emit_native != NULL) {
         NATIVE_EMITTER(free)(emit_native);
@@ -3639,9 +3640,6 @@ mp_raw_code_t *mp_compile_to_raw_code(mp_parse_tree_t *parse_tree, qstr source_f
     }
     #endif
 
-    // free the parse tree
-    mp_parse_tree_clear(parse_tree);
-
     // free the scopes
     mp_raw_code_t *outer_raw_code = module_scope->raw_code;
     for (scope_t *s = module_scope; s;) {
@@ -3650,6 +3648,9 @@ mp_raw_code_t *mp_compile_to_raw_code(mp_parse_tree_t *parse_tree, qstr source_f
         s = next;
     }
 
+    // free the parse tree, and with it the emitters and scopes
+    mp_parse_tree_clear(parse_tree);
+
     if (comp->compile_error != MP_OBJ_NULL) {
         nlr_raise(comp->compile_error);
     } else {
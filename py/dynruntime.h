@@ -67,6 +67,11 @@ static inline void *m_realloc_dyn(void *ptr, size_t new_num_bytes) {
     return mp_fun_table.realloc_(ptr, new_num_bytes, true);
 }
 
+// An arena must be kept where the GC sees it, for example in an object.
+#define mp_arena_alloc(arena, n)        (mp_fun_table.arena_alloc((arena), (n)))
+#define mp_arena_trim(arena)            (mp_fun_table.arena_trim((arena)))
+#define mp_arena_free(arena)            (mp_fun_table.arena_free((arena)))
+
 /******************************************************************************/
 // Printing
 
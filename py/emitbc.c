@@ -75,19 +75,17 @@ struct _emit_t {
     mp_uint_t *const_table;
 };
 
-emit_t *emit_bc_new(void) {
-    emit_t *emit = m_new0(emit_t, 1);
+// The emitter only lives as long as the compilation, and is freed with the
+// arena it is allocated from.
+emit_t *emit_bc_new(mp_arena_t *arena) {
+    emit_t *emit = mp_arena_alloc(arena, sizeof(emit_t));
+    memset(emit, 0, sizeof(emit_t));
     return emit;
 }
 
-void emit_bc_set_max_num_labels(emit_t *emit, mp_uint_t max_num_labels) {
+void emit_bc_set_max_num_labels(emit_t *emit, mp_arena_t *arena, mp_uint_t max_num_labels) {
     emit->max_num_labels = max_num_labels;
-    emit->label_offsets = m_new(mp_uint_t, emit->max_num_labels);
-}
-
-void emit_bc_free(emit_t *emit) {
-    m_del(mp_uint_t, emit->label_offsets, emit->max_num_labels);
-    m_del_obj(emit_t, emit);
+    emit->label_offsets = mp_arena_alloc(arena, max_num_labels * sizeof(mp_uint_t));
 }
 
 typedef byte *(*emit_allocator_t)(emit_t *emit, int nbytes);
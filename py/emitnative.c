@@ -255,26 +255,27 @@ STATIC void emit_native_global_exc_entry(emit_t *emit);
 STATIC void emit_native_global_exc_exit(emit_t *emit);
 STATIC void emit_native_load_const_obj(emit_t *emit, mp_obj_t obj);
 
-emit_t *EXPORT_FUN(new)(mp_obj_t * error_slot, uint *label_slot, mp_uint_t max_num_labels) {
-    emit_t *emit = m_new0(emit_t, 1);
+emit_t *EXPORT_FUN(new)(mp_arena_t * arena, mp_obj_t * error_slot, uint *label_slot, mp_uint_t max_num_labels) {
+    // emit and emit->as are freed with the arena, the rest by EXPORT_FUN(free)
+    emit_t *emit = mp_arena_alloc(arena, sizeof(emit_t));
+    memset(emit, 0, sizeof(emit_t));
     emit->error_slot = error_slot;
     emit->label_slot = label_slot;
     emit->stack_info_alloc = 8;
     emit->stack_info = m_new(stack_info_t, emit->stack_info_alloc);
     emit->exc_stack_alloc = 8;
     emit->exc_stack = m_new(exc_stack_entry_t, emit->exc_stack_alloc);
-    emit->as = m_new0(ASM_T, 1);
+    emit->as = mp_arena_alloc(arena, sizeof(ASM_T));
+    memset(emit->as, 0, sizeof(ASM_T));
     mp_asm_base_init(&emit->as->base, max_num_labels);
     return emit;
 }
 
 void EXPORT_FUN(free)(emit_t * emit) {
     mp_asm_base_deinit(&emit->as->base, false);
-    m_del_obj(ASM_T, emit->as);
     m_del(exc_stack_entry_t, emit->exc_stack, emit->exc_stack_alloc);
     m_del(vtype_kind_t, emit->local_vtype, emit->local_vtype_alloc);
     m_del(stack_info_t, emit->stack_info, emit->stack_info_alloc);
-    m_del_obj(emit_t, emit);
 }
 
 STATIC void emit_call_with_imm_arg(emit_t *emit, mp_fun_kind_t fun_kind, mp_int_t arg_val, int arg_reg);
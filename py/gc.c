@@ -32,6 +32,26 @@
 #include "py/gc.h"
 #include "py/runtime.h"
 
+#if MICROPY_GC_INCREMENTAL || MICROPY_GC_GENERATIONAL
+#include "py/mphal.h"
+#endif
+
+#if MICROPY_GC_ALLOC_PROFILE
+#include "py/bc.h"
+#endif
+
+#if MICROPY_GC_COMPACT
+#include "py/binary.h"
+#include "py/objarray.h"
+#include "py/objlist.h"
+#include "py/objstr.h"
+#include "py/objtype.h"
+#endif
+
+#if MICROPY_OPT_METHOD_CACHE
+#include "py/objtype.h"
+#endif
+
 #if MICROPY_ENABLE_GC
 
 #if MICROPY_DEBUG_VERBOSE // print debugging info
@@ -75,15 +95,23 @@
 #define ATB_3_IS_FREE(a) (((a) & ATB_MASK_3) == 0)
 
 #define BLOCK_SHIFT(block) (2 * ((block) & (BLOCKS_PER_ATB - 1)))
-#define ATB_GET_KIND(block) ((MP_STATE_MEM(gc_alloc_table_start)[(block) / BLOCKS_PER_ATB] >> BLOCK_SHIFT(block)) & 3)
-#define ATB_ANY_TO_FREE(block) do { MP_STATE_MEM(gc_alloc_table_start)[(block) / BLOCKS_PER_ATB] &= (~(AT_MARK << BLOCK_SHIFT(block))); } while (0)
-#define ATB_FREE_TO_HEAD(block) do { MP_STATE_MEM(gc_alloc_table_start)[(block) / BLOCKS_PER_ATB] |= (AT_HEAD << BLOCK_SHIFT(block)); } while (0)
-#define ATB_FREE_TO_TAIL(block) do { MP_STATE_MEM(gc_alloc_table_start)[(block) / BLOCKS_PER_ATB] |= (AT_TAIL << BLOCK_SHIFT(block)); } while (0)
-#define ATB_HEAD_TO_MARK(block) do { MP_STATE_MEM(gc_alloc_table_start)[(block) / BLOCKS_PER_ATB] |= (AT_MARK << BLOCK_SHIFT(block)); } while (0)
-#define ATB_MARK_TO_HEAD(block) do { MP_STATE_MEM(gc_alloc_table_start)[(block) / BLOCKS_PER_ATB] &= (~(AT_TAIL << BLOCK_SHIFT(block))); } while (0)
-
-#define BLOCK_FROM_PTR(ptr) (((byte *)(ptr) - MP_STATE_MEM(gc_pool_start)) / BYTES_PER_BLOCK)
-#define PTR_FROM_BLOCK(block) (((block) * BYTES_PER_BLOCK + (uintptr_t)MP_STATE_MEM(gc_pool_start)))
+#define ATB_GET_KIND(area, block) (((area)->gc_alloc_table_start[(block) / BLOCKS_PER_ATB] >> BLOCK_SHIFT(block)) & 3)
+#define ATB_ANY_TO_FREE(area, block) do { (area)->gc_alloc_table_start[(block) / BLOCKS_PER_ATB] &= (~(AT_MARK << BLOCK_SHIFT(block))); } while (0)
+#define ATB_FREE_TO_HEAD(area, block) do { (area)->gc_alloc_table_start[(block) / BLOCKS_PER_ATB] |= (AT_HEAD << BLOCK_SHIFT(block)); } while (0)
+#define ATB_FREE_TO_TAIL(area, block) do { (area)->gc_alloc_table_start[(block) / BLOCKS_PER_ATB] |= (AT_TAIL << BLOCK_SHIFT(block)); } while (0)
+#define ATB_HEAD_TO_MARK(area, block) do { (area)->gc_alloc_table_start[(block) / BLOCKS_PER_ATB] |= (AT_MARK << BLOCK_SHIFT(block)); } while (0)
+#define ATB_MARK_TO_HEAD(area, block) do { (area)->gc_alloc_table_start[(block) / BLOCKS_PER_ATB] &= (~(AT_TAIL << BLOCK_SHIFT(block))); } while (0)
+
+#if MICROPY_GC_INCREMENTAL
+// Outside of a collection all heads are unmarked, during an incremental one
+// the program also sees marked heads.
+#define ATB_IS_HEAD(area, block) ((ATB_GET_KIND(area, block) & AT_HEAD) != 0)
+#else
+#define ATB_IS_HEAD(area, block) (ATB_GET_KIND(area, block) == AT_HEAD)
+#endif
+
+#define BLOCK_FROM_PTR(area, ptr) (((byte *)(ptr) - (area)->gc_pool_start) / BYTES_PER_BLOCK)
+#define PTR_FROM_BLOCK(area, block) (((block) * BYTES_PER_BLOCK + (uintptr_t)(area)->gc_pool_start))
 #define ATB_FROM_BLOCK(bl) ((bl) / BLOCKS_PER_ATB)
 
 #if MICROPY_ENABLE_FINALISER
@@ -92,9 +120,68 @@
 
 #define BLOCKS_PER_FTB (8)
 
-#define FTB_GET(block) ((MP_STATE_MEM(gc_finaliser_table_start)[(block) / BLOCKS_PER_FTB] >> ((block) & 7)) & 1)
-#define FTB_SET(block) do { MP_STATE_MEM(gc_finaliser_table_start)[(block) / BLOCKS_PER_FTB] |= (1 << ((block) & 7)); } while (0)
-#define FTB_CLEAR(block) do { MP_STATE_MEM(gc_finaliser_table_start)[(block) / BLOCKS_PER_FTB] &= (~(1 << ((block) & 7))); } while (0)
+#define FTB_GET(area, block) (((area)->gc_finaliser_table_start[(block) / BLOCKS_PER_FTB] >> ((block) & 7)) & 1)
+#define FTB_SET(area, block) do { (area)->gc_finaliser_table_start[(block) / BLOCKS_PER_FTB] |= (1 << ((block) & 7)); } while (0)
+#define FTB_CLEAR(area, block) do { (area)->gc_finaliser_table_start[(block) / BLOCKS_PER_FTB] &= (~(1 << ((block) & 7))); } while (0)
+#endif
+
+#if MICROPY_GC_GENERATIONAL
+// young table, one bit per block: set on the head of a block allocated since
+// the last collection, and of an old one that a young collection traces
+#define BLOCKS_PER_YTB (8)
+
+#define YTB_GET(area, block) (((area)->gc_young_table_start[(block) / BLOCKS_PER_YTB] >> ((block) & 7)) & 1)
+#define YTB_SET(area, block) do { (area)->gc_young_table_start[(block) / BLOCKS_PER_YTB] |= (1 << ((block) & 7)); } while (0)
+#define YTB_CLEAR(area, block) do { (area)->gc_young_table_start[(block) / BLOCKS_PER_YTB] &= (~(1 << ((block) & 7))); } while (0)
+#define YTB_BYTE_LEN(area) (((area)->gc_alloc_table_byte_len * BLOCKS_PER_ATB + BLOCKS_PER_YTB - 1) / BLOCKS_PER_YTB)
+
+// changed table, laid out like the young table: set on the head of an old
+// block changed since the last young collection, or that a root pointed to at
+// the last collection, which the next young collection traces
+#define CTB_GET(area, block) (((area)->gc_changed_table_start[(block) / BLOCKS_PER_YTB] >> ((block) & 7)) & 1)
+#define CTB_SET(area, block) do { (area)->gc_changed_table_start[(block) / BLOCKS_PER_YTB] |= (1 << ((block) & 7)); } while (0)
+#define CTB_CLEAR(area, block) do { (area)->gc_changed_table_start[(block) / BLOCKS_PER_YTB] &= (~(1 << ((block) & 7))); } while (0)
+#endif
+
+#if MICROPY_GC_COMPACT
+// RTB = reference table byte, laid out like the ATB: for the head of a chain
+// the pointers to it a compaction found, 0, 1, or 2 for more or for one from
+// a root
+#define RTB_GET(area, block) (((area)->gc_ref_table_start[(block) / BLOCKS_PER_ATB] >> BLOCK_SHIFT(block)) & 3)
+#define RTB_SET(area, block, n) do { byte *rtb = &(area)->gc_ref_table_start[(block) / BLOCKS_PER_ATB]; *rtb = (*rtb & ~(3 << BLOCK_SHIFT(block))) | ((n) << BLOCK_SHIFT(block)); } while (0)
+#endif
+
+#if MICROPY_GC_PARALLEL_MARK && !MICROPY_PY_THREAD
+#error MICROPY_GC_PARALLEL_MARK requires MICROPY_PY_THREAD
+#endif
+
+#if MICROPY_GC_GENERATIONAL && !MICROPY_ENABLE_SCHEDULER
+#error MICROPY_GC_GENERATIONAL requires MICROPY_ENABLE_SCHEDULER
+#endif
+
+#if MICROPY_GC_GENERATIONAL && MICROPY_GC_INCREMENTAL
+#error MICROPY_GC_GENERATIONAL cannot be combined with MICROPY_GC_INCREMENTAL
+#endif
+
+#if MICROPY_GC_INCREMENTAL && !MICROPY_ENABLE_SCHEDULER
+#error MICROPY_GC_INCREMENTAL requires MICROPY_ENABLE_SCHEDULER
+#endif
+
+#if MICROPY_GC_TLAB && !(MICROPY_PY_THREAD && !MICROPY_PY_THREAD_GIL)
+#error MICROPY_GC_TLAB requires MICROPY_PY_THREAD without MICROPY_PY_THREAD_GIL
+#endif
+
+#if MICROPY_GC_TLAB && (MICROPY_GC_INCREMENTAL || MICROPY_GC_GENERATIONAL || MICROPY_GC_ALLOC_PROFILE)
+// these keep state for each allocation that only the GC lock protects
+#error MICROPY_GC_TLAB cannot be combined with MICROPY_GC_INCREMENTAL, MICROPY_GC_GENERATIONAL or MICROPY_GC_ALLOC_PROFILE
+#endif
+
+#if MICROPY_GC_FINALISER_QUEUE && !(MICROPY_ENABLE_FINALISER && MICROPY_ENABLE_SCHEDULER)
+#error MICROPY_GC_FINALISER_QUEUE requires MICROPY_ENABLE_FINALISER and MICROPY_ENABLE_SCHEDULER
+#endif
+
+#if MICROPY_GC_ALLOC_PROFILE && MICROPY_GC_ALLOC_PROFILE_SITES > 255
+#error MICROPY_GC_ALLOC_PROFILE_SITES must fit in the byte of the site table
 #endif
 
 #if MICROPY_PY_THREAD && !MICROPY_PY_THREAD_GIL
@@ -105,49 +192,228 @@
 #define GC_EXIT()
 #endif
 
+#if MICROPY_GC_SPLIT_HEAP
+#define NEXT_AREA(area) ((area)->next)
+#else
+#define NEXT_AREA(area) (NULL)
+#endif
+
+#if MICROPY_GC_INCREMENTAL
+enum {
+    GC_PHASE_IDLE,
+    GC_PHASE_MARK,
+    GC_PHASE_SWEEP,
+};
+
+// During the first collection driven by allocation, do a slice each time
+// this many blocks have been allocated; later ones adapt it, see
+// gc_collect_step().
+#define GC_INC_SLICE_BLOCKS (32)
+#endif
+
+#if MICROPY_GC_FREE_LISTS
+// Free runs are listed by size class: 1, 2, 3, 4 to 7, and 8 or more blocks.
+// The lists live outside the heap and are only hints: a run may since have
+// been taken by the ATB scan or by gc_realloc() growing in place, so it is
+// checked against the ATB before use and dropped if it is no longer free.
+#define GC_FREE_CLASS(n) ((n) <= 3 ? (n) - 1 : (n) < 8 ? 3 : 4)
+
+// List a free run, to be taken next or, with last set, after the others.
+STATIC void gc_free_list_push(mp_state_mem_area_t *area, size_t block, size_t n_blocks, bool last) {
+    mp_gc_free_list_t *fl = &area->gc_free_list[GC_FREE_CLASS(n_blocks)];
+    if (fl->len < MICROPY_GC_FREE_LIST_LEN) {
+        size_t i = fl->len;
+        if (last) {
+            memmove(&fl->run[1], &fl->run[0], fl->len * sizeof(fl->run[0]));
+            i = 0;
+        }
+        fl->run[i].block = block;
+        fl->run[i].n_blocks = n_blocks;
+        fl->len += 1;
+    }
+}
+
+// Take n_blocks from the first listed run big enough for them, newest first,
+// and list what is left of it.  Return the first block, or -1 if none fits.
+STATIC size_t gc_free_list_take(mp_state_mem_area_t *area, size_t n_blocks) {
+    for (size_t c = GC_FREE_CLASS(n_blocks); c < MP_GC_FREE_CLASSES; c++) {
+        mp_gc_free_list_t *fl = &area->gc_free_list[c];
+        for (size_t j = fl->len; j > 0; j--) {
+            size_t block = fl->run[j - 1].block;
+            size_t n_free = fl->run[j - 1].n_blocks;
+            if (n_free < n_blocks) {
+                continue;
+            }
+            size_t bl = 0;
+            while (bl < n_blocks && ATB_GET_KIND(area, block + bl) == AT_FREE) {
+                bl++;
+            }
+            if (bl == n_blocks && n_free > n_blocks && GC_FREE_CLASS(n_free - n_blocks) == c) {
+                // what is left stays in this class
+                fl->run[j - 1].block = block + n_blocks;
+                fl->run[j - 1].n_blocks = n_free - n_blocks;
+                return block;
+            }
+            fl->len -= 1;
+            fl->run[j - 1] = fl->run[fl->len];
+            if (bl < n_blocks) {
+                // partly taken since it was listed, keep what is free after that
+                do {
+                    bl++;
+                } while (bl < n_free && ATB_GET_KIND(area, block + bl) != AT_FREE);
+                if (bl < n_free) {
+                    gc_free_list_push(area, block + bl, n_free - bl, false);
+                }
+                continue;
+            }
+            if (n_free > n_blocks) {
+                gc_free_list_push(area, block + n_blocks, n_free - n_blocks, false);
+            }
+            return block;
+        }
+    }
+    return (size_t)-1;
+}
+
+// List the free runs of an area, as many as fit.  The lists are filled from
+// the top of the area down so that the lowest runs are taken first.
+STATIC void gc_free_list_rebuild(mp_state_mem_area_t *area) {
+    for (size_t c = 0; c < MP_GC_FREE_CLASSES; c++) {
+        area->gc_free_list[c].len = 0;
+    }
+    size_t n_free = 0;
+    for (size_t block = area->gc_alloc_table_byte_len * BLOCKS_PER_ATB; block > 0;) {
+        if ((block & (BLOCKS_PER_ATB - 1)) == 0 && area->gc_alloc_table_start[ATB_FROM_BLOCK(block) - 1] == 0) {
+            // four free blocks at once
+            n_free += BLOCKS_PER_ATB;
+            block -= BLOCKS_PER_ATB;
+            continue;
+        }
+        block -= 1;
+        if (ATB_GET_KIND(area, block) == AT_FREE) {
+            n_free += 1;
+        } else if (n_free > 0) {
+            gc_free_list_push(area, block + 1, n_free, false);
+            n_free = 0;
+        }
+    }
+    if (n_free > 0) {
+        gc_free_list_push(area, 0, n_free, false);
+    }
+}
+#endif
+
 // TODO waste less memory; currently requires that all entries in alloc_table have a corresponding block in pool
-void gc_init(void *start, void *end) {
+STATIC void gc_setup_area(mp_state_mem_area_t *area, void *start, void *end) {
     // align end pointer on block boundary
     end = (void *)((uintptr_t)end & (~(BYTES_PER_BLOCK - 1)));
     DEBUG_printf("Initializing GC heap: %p..%p = " UINT_FMT " bytes\n", start, end, (byte *)end - (byte *)start);
 
-    // calculate parameters for GC (T=total, A=alloc table, F=finaliser table, P=pool; all in bytes):
-    // T = A + F + P
+    // calculate parameters for GC (T=total, A=alloc table, F=finaliser table, Y=young table,
+    // C=changed table, S=site table, R=reference table, P=pool; all in bytes):
+    // T = A + F + Y + C + S + R + P
     //     F = A * BLOCKS_PER_ATB / BLOCKS_PER_FTB
+    //     Y = C = A * BLOCKS_PER_ATB / BLOCKS_PER_YTB
+    //     S = A * BLOCKS_PER_ATB
+    //     R = A
     //     P = A * BLOCKS_PER_ATB * BYTES_PER_BLOCK
-    // => T = A * (1 + BLOCKS_PER_ATB / BLOCKS_PER_FTB + BLOCKS_PER_ATB * BYTES_PER_BLOCK)
+    // => T = A * (1 + BLOCKS_PER_ATB / BLOCKS_PER_FTB + 2 * BLOCKS_PER_ATB / BLOCKS_PER_YTB + BLOCKS_PER_ATB + 1 + BLOCKS_PER_ATB * BYTES_PER_BLOCK)
+    // where the tables not enabled are left out
     size_t total_byte_len = (byte *)end - (byte *)start;
+    size_t bits_per_atb_byte = MP_BITS_PER_BYTE + MP_BITS_PER_BYTE * BLOCKS_PER_ATB * BYTES_PER_BLOCK;
     #if MICROPY_ENABLE_FINALISER
-    MP_STATE_MEM(gc_alloc_table_byte_len) = total_byte_len * MP_BITS_PER_BYTE / (MP_BITS_PER_BYTE + MP_BITS_PER_BYTE * BLOCKS_PER_ATB / BLOCKS_PER_FTB + MP_BITS_PER_BYTE * BLOCKS_PER_ATB * BYTES_PER_BLOCK);
-    #else
-    MP_STATE_MEM(gc_alloc_table_byte_len) = total_byte_len / (1 + MP_BITS_PER_BYTE / 2 * BYTES_PER_BLOCK);
+    bits_per_atb_byte += MP_BITS_PER_BYTE * BLOCKS_PER_ATB / BLOCKS_PER_FTB;
+    #endif
+    #if MICROPY_GC_GENERATIONAL
+    bits_per_atb_byte += 2 * MP_BITS_PER_BYTE * BLOCKS_PER_ATB / BLOCKS_PER_YTB;
+    #endif
+    #if MICROPY_GC_ALLOC_PROFILE
+    bits_per_atb_byte += MP_BITS_PER_BYTE * BLOCKS_PER_ATB;
     #endif
+    #if MICROPY_GC_COMPACT
+    bits_per_atb_byte += MP_BITS_PER_BYTE;
+    #endif
+    area->gc_alloc_table_byte_len = total_byte_len * MP_BITS_PER_BYTE / bits_per_atb_byte;
 
-    MP_STATE_MEM(gc_alloc_table_start) = (byte *)start;
+    area->gc_alloc_table_start = (byte *)start;
+    byte *table_end = area->gc_alloc_table_start + area->gc_alloc_table_byte_len;
 
     #if MICROPY_ENABLE_FINALISER
-    size_t gc_finaliser_table_byte_len = (MP_STATE_MEM(gc_alloc_table_byte_len) * BLOCKS_PER_ATB + BLOCKS_PER_FTB - 1) / BLOCKS_PER_FTB;
-    MP_STATE_MEM(gc_finaliser_table_start) = MP_STATE_MEM(gc_alloc_table_start) + MP_STATE_MEM(gc_alloc_table_byte_len);
+    size_t gc_finaliser_table_byte_len = (area->gc_alloc_table_byte_len * BLOCKS_PER_ATB + BLOCKS_PER_FTB - 1) / BLOCKS_PER_FTB;
+    area->gc_finaliser_table_start = table_end;
+    table_end += gc_finaliser_table_byte_len;
     #endif
 
-    size_t gc_pool_block_len = MP_STATE_MEM(gc_alloc_table_byte_len) * BLOCKS_PER_ATB;
-    MP_STATE_MEM(gc_pool_start) = (byte *)end - gc_pool_block_len * BYTES_PER_BLOCK;
-    MP_STATE_MEM(gc_pool_end) = end;
+    #if MICROPY_GC_GENERATIONAL
+    size_t gc_young_table_byte_len = YTB_BYTE_LEN(area);
+    area->gc_young_table_start = table_end;
+    table_end += gc_young_table_byte_len;
+    area->gc_changed_table_start = table_end;
+    table_end += gc_young_table_byte_len;
+    #endif
 
-    #if MICROPY_ENABLE_FINALISER
-    assert(MP_STATE_MEM(gc_pool_start) >= MP_STATE_MEM(gc_finaliser_table_start) + gc_finaliser_table_byte_len);
+    #if MICROPY_GC_ALLOC_PROFILE
+    size_t gc_site_table_byte_len = area->gc_alloc_table_byte_len * BLOCKS_PER_ATB;
+    area->gc_site_table_start = table_end;
+    table_end += gc_site_table_byte_len;
+    #endif
+
+    #if MICROPY_GC_COMPACT
+    area->gc_ref_table_start = table_end;
+    table_end += area->gc_alloc_table_byte_len;
+    #endif
+
+    size_t gc_pool_block_len = area->gc_alloc_table_byte_len * BLOCKS_PER_ATB;
+    area->gc_pool_start = (byte *)end - gc_pool_block_len * BYTES_PER_BLOCK;
+    area->gc_pool_end = end;
+
+    assert(area->gc_pool_start >= table_end);
+
+    // clear ATBs, and the other tables after them
+    memset(area->gc_alloc_table_start, 0, table_end - area->gc_alloc_table_start);
+
+    // set last free ATB indexes to start of heap
+    area->gc_last_free_atb_index = 0;
+    area->gc_last_free_run_atb_index = 0;
+
+    #if MICROPY_GC_TLAB
+    area->gc_tlab_block = 0;
+    #endif
+
+    #if MICROPY_GC_FREE_LISTS
+    // the whole pool is one free run
+    gc_free_list_rebuild(area);
     #endif
 
-    // clear ATBs
-    memset(MP_STATE_MEM(gc_alloc_table_start), 0, MP_STATE_MEM(gc_alloc_table_byte_len));
+    #if MICROPY_GC_SPLIT_HEAP
+    area->next = NULL;
+    #endif
 
+    DEBUG_printf("GC layout:\n");
+    DEBUG_printf("  alloc table at %p, length " UINT_FMT " bytes, " UINT_FMT " blocks\n", area->gc_alloc_table_start, area->gc_alloc_table_byte_len, area->gc_alloc_table_byte_len * BLOCKS_PER_ATB);
     #if MICROPY_ENABLE_FINALISER
-    // clear FTBs
-    memset(MP_STATE_MEM(gc_finaliser_table_start), 0, gc_finaliser_table_byte_len);
+    DEBUG_printf("  finaliser table at %p, length " UINT_FMT " bytes, " UINT_FMT " blocks\n", area->gc_finaliser_table_start, gc_finaliser_table_byte_len, gc_finaliser_table_byte_len * BLOCKS_PER_FTB);
+    #endif
+    #if MICROPY_GC_GENERATIONAL
+    DEBUG_printf("  young table at %p, length " UINT_FMT " bytes, " UINT_FMT " blocks\n", area->gc_young_table_start, gc_young_table_byte_len, gc_young_table_byte_len * BLOCKS_PER_YTB);
+    DEBUG_printf("  changed table at %p, length " UINT_FMT " bytes, " UINT_FMT " blocks\n", area->gc_changed_table_start, gc_young_table_byte_len, gc_young_table_byte_len * BLOCKS_PER_YTB);
     #endif
+    #if MICROPY_GC_ALLOC_PROFILE
+    DEBUG_printf("  site table at %p, length " UINT_FMT " bytes, " UINT_FMT " blocks\n", area->gc_site_table_start, gc_site_table_byte_len, gc_site_table_byte_len);
+    #endif
+    #if MICROPY_GC_COMPACT
+    DEBUG_printf("  reference table at %p, length " UINT_FMT " bytes, " UINT_FMT " blocks\n", area->gc_ref_table_start, area->gc_alloc_table_byte_len, area->gc_alloc_table_byte_len * BLOCKS_PER_ATB);
+    #endif
+    DEBUG_printf("  pool at %p, length " UINT_FMT " bytes, " UINT_FMT " blocks\n", area->gc_pool_start, gc_pool_block_len * BYTES_PER_BLOCK, gc_pool_block_len);
+}
+
+void gc_init(void *start, void *end) {
+    gc_setup_area(&MP_STATE_MEM(area), start, end);
 
-    // set last free ATB index to start of heap
-    MP_STATE_MEM(gc_last_free_atb_index) = 0;
+    #if MICROPY_GC_SPLIT_HEAP
+    MP_STATE_MEM(gc_lowest_ptr) = MP_STATE_MEM(area).gc_pool_start;
+    MP_STATE_MEM(gc_highest_ptr) = MP_STATE_MEM(area).gc_pool_end;
+    #endif
 
     // unlock the GC
     MP_STATE_THREAD(gc_lock_depth) = 0;
@@ -161,18 +427,99 @@ void gc_init(void *start, void *end) {
     MP_STATE_MEM(gc_alloc_amount) = 0;
     #endif
 
+    #if MICROPY_GC_INCREMENTAL
+    // by default collect all at once; the first incremental collection
+    // starts when half the heap has been allocated
+    MP_STATE_MEM(gc_phase) = GC_PHASE_IDLE;
+    MP_STATE_MEM(gc_slicing) = 0;
+    MP_STATE_MEM(gc_slice_us) = 0;
+    MP_STATE_MEM(gc_step_due) = false;
+    MP_STATE_MEM(gc_inc_alloc) = 0;
+    MP_STATE_MEM(gc_inc_trigger) = MP_STATE_MEM(area).gc_alloc_table_byte_len * BLOCKS_PER_ATB / 2;
+    MP_STATE_MEM(gc_inc_interval) = GC_INC_SLICE_BLOCKS;
+    MP_STATE_MEM(gc_pause_max) = 0;
+    MP_STATE_MEM(gc_pause_total) = 0;
+    MP_STATE_MEM(gc_pause_count) = 0;
+    #endif
+
+    #if MICROPY_GC_GENERATIONAL
+    // by default a young collection is due when an eighth of the heap has
+    // been allocated since the last collection
+    MP_STATE_MEM(gc_minor) = false;
+    MP_STATE_MEM(gc_step_due) = false;
+    MP_STATE_MEM(gc_young) = 0;
+    MP_STATE_MEM(gc_nursery) = MP_STATE_MEM(area).gc_alloc_table_byte_len * BLOCKS_PER_ATB / 8;
+    MP_STATE_MEM(gc_nursery_shift) = 0;
+    MP_STATE_MEM(gc_minor_count) = 0;
+    MP_STATE_MEM(gc_minor_max) = 0;
+    MP_STATE_MEM(gc_minor_total) = 0;
+    #endif
+
+    #if MICROPY_GC_ROOTS
+    MP_STATE_MEM(gc_roots_len) = 0;
+    #endif
+
+    #if MICROPY_GC_FINALISER_QUEUE
+    memset(MP_STATE_MEM(gc_fin_queue), 0, sizeof(MP_STATE_MEM(gc_fin_queue)));
+    MP_STATE_MEM(gc_fin_idx) = 0;
+    MP_STATE_MEM(gc_fin_len) = 0;
+    MP_STATE_MEM(gc_fin_due) = false;
+    MP_STATE_MEM(gc_fin_sweep_all) = false;
+    MP_STATE_MEM(gc_fin_max) = 0;
+    MP_STATE_MEM(gc_fin_run) = 0;
+    MP_STATE_MEM(gc_fin_full) = 0;
+    #endif
+
+    #if MICROPY_GC_ALLOC_PROFILE
+    MP_STATE_MEM(gc_sites_len) = 0;
+    MP_STATE_MEM(gc_site_ip) = NULL;
+    MP_STATE_MEM(gc_site_last) = 0;
+    #endif
+
     #if MICROPY_PY_THREAD && !MICROPY_PY_THREAD_GIL
     mp_thread_mutex_init(&MP_STATE_MEM(gc_mutex));
     #endif
 
-    DEBUG_printf("GC layout:\n");
-    DEBUG_printf("  alloc table at %p, length " UINT_FMT " bytes, " UINT_FMT " blocks\n", MP_STATE_MEM(gc_alloc_table_start), MP_STATE_MEM(gc_alloc_table_byte_len), MP_STATE_MEM(gc_alloc_table_byte_len) * BLOCKS_PER_ATB);
-    #if MICROPY_ENABLE_FINALISER
-    DEBUG_printf("  finaliser table at %p, length " UINT_FMT " bytes, " UINT_FMT " blocks\n", MP_STATE_MEM(gc_finaliser_table_start), gc_finaliser_table_byte_len, gc_finaliser_table_byte_len * BLOCKS_PER_FTB);
+    #if MICROPY_GC_TLAB
+    // the calling thread claims a TLAB on its first small allocation
+    MP_STATE_MEM(gc_tlabs) = NULL;
+    MP_STATE_MEM(gc_tlab_stop) = false;
+    MP_STATE_THREAD(gc_tlab).area = NULL;
+    MP_STATE_THREAD(gc_tlab).block = MP_STATE_THREAD(gc_tlab).end = 0;
+    MP_STATE_THREAD(gc_tlab).busy = false;
     #endif
-    DEBUG_printf("  pool at %p, length " UINT_FMT " bytes, " UINT_FMT " blocks\n", MP_STATE_MEM(gc_pool_start), gc_pool_block_len * BYTES_PER_BLOCK, gc_pool_block_len);
 }
 
+#if MICROPY_GC_SPLIT_HEAP
+void gc_add(void *start, void *end) {
+    // the area's own state goes at the start of the memory it describes
+    void *area_start = (void *)(((uintptr_t)start + sizeof(mp_uint_t) - 1) & ~(sizeof(mp_uint_t) - 1));
+    mp_state_mem_area_t *area = (mp_state_mem_area_t *)area_start;
+    start = (byte *)area_start + sizeof(mp_state_mem_area_t);
+    if ((byte *)end <= (byte *)start + BYTES_PER_BLOCK * BLOCKS_PER_ATB) {
+        // too small to hold any blocks
+        return;
+    }
+
+    gc_setup_area(area, start, end);
+
+    // append it to the chain; blocks are found from the pointer, not the order
+    GC_ENTER();
+    mp_state_mem_area_t *prev = &MP_STATE_MEM(area);
+    while (prev->next != NULL) {
+        prev = prev->next;
+    }
+    prev->next = area;
+    if (area->gc_pool_start < MP_STATE_MEM(gc_lowest_ptr)) {
+        MP_STATE_MEM(gc_lowest_ptr) = area->gc_pool_start;
+    }
+    if (area->gc_pool_end > MP_STATE_MEM(gc_highest_ptr)) {
+        MP_STATE_MEM(gc_highest_ptr) = area->gc_pool_end;
+    }
+    GC_EXIT();
+}
+#endif
+
 void gc_lock(void) {
     // This does not need to be atomic or have the GC mutex because:
     // - each thread has its own gc_lock_depth so there are no races between threads;
@@ -191,12 +538,41 @@ bool gc_is_locked(void) {
 }
 
 // ptr should be of type void*
-#define VERIFY_PTR(ptr) ( \
+#define VERIFY_PTR(area, ptr) ( \
     ((uintptr_t)(ptr) & (BYTES_PER_BLOCK - 1)) == 0          /* must be aligned on a block */ \
-    && ptr >= (void *)MP_STATE_MEM(gc_pool_start)        /* must be above start of pool */ \
-    && ptr < (void *)MP_STATE_MEM(gc_pool_end)           /* must be below end of pool */ \
+    && ptr >= (void *)(area)->gc_pool_start        /* must be above start of pool */ \
+    && ptr < (void *)(area)->gc_pool_end           /* must be below end of pool */ \
     )
 
+// Return the heap area holding ptr, or NULL if ptr does not point to a block.
+static inline mp_state_mem_area_t *gc_get_ptr_area(const void *ptr) {
+    #if MICROPY_GC_SPLIT_HEAP
+    // most words traced are not heap pointers, reject them before the walk
+    if (((uintptr_t)(ptr) & (BYTES_PER_BLOCK - 1)) != 0
+        || ptr < (void *)MP_STATE_MEM(gc_lowest_ptr) || ptr >= (void *)MP_STATE_MEM(gc_highest_ptr)) {
+        return NULL;
+    }
+    for (mp_state_mem_area_t *area = &MP_STATE_MEM(area); area != NULL; area = area->next) {
+        if (ptr >= (void *)area->gc_pool_start && ptr < (void *)area->gc_pool_end) {
+            return area;
+        }
+    }
+    return NULL;
+    #else
+    mp_state_mem_area_t *area = &MP_STATE_MEM(area);
+    return VERIFY_PTR(area, ptr) ? area : NULL;
+    #endif
+}
+
+// The GC stack of each mark worker, and the area of each block on it.
+#if MICROPY_GC_PARALLEL_MARK
+#define GC_BLOCK_STACK(id) ((id) == 0 ? MP_STATE_MEM(gc_stack) : MP_STATE_MEM(gc_mark_stack)[(id) - 1])
+#define GC_AREA_STACK(id) ((id) == 0 ? MP_STATE_MEM(gc_area_stack) : MP_STATE_MEM(gc_mark_area_stack)[(id) - 1])
+#else
+#define GC_BLOCK_STACK(id) (MP_STATE_MEM(gc_stack))
+#define GC_AREA_STACK(id) (MP_STATE_MEM(gc_area_stack))
+#endif
+
 #ifndef TRACE_MARK
 #if DEBUG_PRINT
 #define TRACE_MARK(block, ptr) DEBUG_printf("gc_mark(%p)\n", ptr)
@@ -205,11 +581,65 @@ bool gc_is_locked(void) {
 #endif
 #endif
 
-// Take the given block as the topmost block on the stack. Check all it's
-// children: mark the unmarked child blocks and put those newly marked
-// blocks on the stack. When all children have been checked, pop off the
-// topmost block on the stack and repeat with that one.
-STATIC void gc_mark_subtree(size_t block) {
+// Mark the block if it is an unmarked head, and return whether it was.
+static inline bool gc_mark_head(mp_state_mem_area_t *area, size_t block) {
+    if (ATB_GET_KIND(area, block) != AT_HEAD) {
+        return false;
+    }
+    #if MICROPY_GC_GENERATIONAL
+    if (MP_STATE_MEM(gc_minor) && !YTB_GET(area, block)) {
+        // old blocks are kept by a young collection, and not traced
+        return false;
+    }
+    #endif
+    #if MICROPY_GC_PARALLEL_MARK
+    // Other workers may be marking blocks that share this ATB, and this one
+    // too.  HEAD to MARK only sets the upper bit, whoever sets it owns the block.
+    byte bit = (AT_MARK & ~AT_HEAD) << BLOCK_SHIFT(block);
+    return !(mp_thread_gc_mark_fetch_or(&area->gc_alloc_table_start[ATB_FROM_BLOCK(block)], bit) & bit);
+    #else
+    ATB_HEAD_TO_MARK(area, block);
+    return true;
+    #endif
+}
+
+#if MICROPY_GC_PARALLEL_MARK
+// If some workers are idle and the shared pool is empty, move the bottom half
+// of this worker's stack, the blocks nearest the roots, to the pool for them
+// to take.  Return the new stack depth.
+STATIC size_t gc_mark_share(size_t id, size_t sp) {
+    if (MP_STATE_MEM(gc_mark_idle) == 0 || MP_STATE_MEM(gc_mark_pool_len) != 0) {
+        return sp;
+    }
+    MICROPY_GC_STACK_ENTRY_TYPE *stack = GC_BLOCK_STACK(id);
+    mp_thread_gc_mark_lock();
+    size_t len = MP_STATE_MEM(gc_mark_pool_len);
+    size_t n = MIN(sp / 2, MICROPY_ALLOC_GC_STACK_SIZE - len);
+    memcpy(&MP_STATE_MEM(gc_mark_pool)[len], stack, n * sizeof(*stack));
+    #if MICROPY_GC_SPLIT_HEAP
+    memcpy(&MP_STATE_MEM(gc_mark_pool_area)[len], GC_AREA_STACK(id), n * sizeof(mp_state_mem_area_t *));
+    #endif
+    MP_STATE_MEM(gc_mark_pool_len) = len + n;
+    mp_thread_gc_mark_unlock();
+    memmove(stack, stack + n, (sp - n) * sizeof(*stack));
+    #if MICROPY_GC_SPLIT_HEAP
+    memmove(GC_AREA_STACK(id), GC_AREA_STACK(id) + n, (sp - n) * sizeof(mp_state_mem_area_t *));
+    #endif
+    return sp - n;
+}
+#endif
+
+#if !MICROPY_GC_INCREMENTAL || MICROPY_GC_PARALLEL_MARK
+// Take the given block as the topmost block on the stack of mark worker id
+// (always 0 without MICROPY_GC_PARALLEL_MARK). Check all it's children: mark
+// the unmarked child blocks and put those newly marked blocks on the stack.
+// When all children have been checked, pop off the topmost block on the stack
+// and repeat with that one.
+STATIC void gc_mark_subtree(mp_state_mem_area_t *area, size_t block, size_t id) {
+    MICROPY_GC_STACK_ENTRY_TYPE *stack = GC_BLOCK_STACK(id);
+    #if MICROPY_GC_SPLIT_HEAP
+    mp_state_mem_area_t **area_stack = GC_AREA_STACK(id);
+    #endif
     // Start with the block passed in the argument.
     size_t sp = 0;
     for (;;) {
@@ -217,21 +647,24 @@ STATIC void gc_mark_subtree(size_t block) {
         size_t n_blocks = 0;
         do {
             n_blocks += 1;
-        } while (ATB_GET_KIND(block + n_blocks) == AT_TAIL);
+        } while (ATB_GET_KIND(area, block + n_blocks) == AT_TAIL);
 
         // check this block's children
-        void **ptrs = (void **)PTR_FROM_BLOCK(block);
+        void **ptrs = (void **)PTR_FROM_BLOCK(area, block);
         for (size_t i = n_blocks * BYTES_PER_BLOCK / sizeof(void *); i > 0; i--, ptrs++) {
             void *ptr = *ptrs;
-            if (VERIFY_PTR(ptr)) {
+            mp_state_mem_area_t *ptr_area = gc_get_ptr_area(ptr);
+            if (ptr_area != NULL) {
                 // Mark and push this pointer
-                size_t childblock = BLOCK_FROM_PTR(ptr);
-                if (ATB_GET_KIND(childblock) == AT_HEAD) {
-                    // an unmarked head, mark it, and push it on gc stack
+                size_t childblock = BLOCK_FROM_PTR(ptr_area, ptr);
+                if (gc_mark_head(ptr_area, childblock)) {
+                    // an unmarked head, now marked, push it on gc stack
                     TRACE_MARK(childblock, ptr);
-                    ATB_HEAD_TO_MARK(childblock);
                     if (sp < MICROPY_ALLOC_GC_STACK_SIZE) {
-                        MP_STATE_MEM(gc_stack)[sp++] = childblock;
+                        #if MICROPY_GC_SPLIT_HEAP
+                        area_stack[sp] = ptr_area;
+                        #endif
+                        stack[sp++] = childblock;
                     } else {
                         MP_STATE_MEM(gc_stack_overflow) = 1;
                     }
@@ -244,198 +677,1703 @@ STATIC void gc_mark_subtree(size_t block) {
             break; // No, stack is empty, we're done.
         }
 
+        #if MICROPY_GC_PARALLEL_MARK
+        if (sp > 1) {
+            sp = gc_mark_share(id, sp);
+        }
+        #endif
+
         // pop the next block off the stack
-        block = MP_STATE_MEM(gc_stack)[--sp];
+        block = stack[--sp];
+        #if MICROPY_GC_SPLIT_HEAP
+        area = area_stack[sp];
+        #endif
+    }
+}
+#endif
+
+#if MICROPY_GC_PARALLEL_MARK
+void gc_mark_worker(void) {
+    mp_thread_gc_mark_lock();
+    size_t id = MP_STATE_MEM(gc_mark_workers);
+    if (id < MICROPY_GC_PARALLEL_MARK_WORKERS) {
+        MP_STATE_MEM(gc_mark_workers) = id + 1;
+    }
+    mp_thread_gc_mark_unlock();
+    if (id >= MICROPY_GC_PARALLEL_MARK_WORKERS) {
+        return;
+    }
+
+    // Take blocks from the pool until it is empty and every worker is idle;
+    // only a worker that is still tracing can put more in the pool.
+    bool idle = false;
+    for (;;) {
+        if (idle && MP_STATE_MEM(gc_mark_pool_len) == 0 && MP_STATE_MEM(gc_mark_idle) != MP_STATE_MEM(gc_mark_workers)) {
+            mp_thread_gc_mark_pause();
+            continue;
+        }
+        mp_thread_gc_mark_lock();
+        size_t len = MP_STATE_MEM(gc_mark_pool_len);
+        if (len > 0) {
+            size_t block = MP_STATE_MEM(gc_mark_pool)[len - 1];
+            #if MICROPY_GC_SPLIT_HEAP
+            mp_state_mem_area_t *area = MP_STATE_MEM(gc_mark_pool_area)[len - 1];
+            #else
+            mp_state_mem_area_t *area = &MP_STATE_MEM(area);
+            #endif
+            MP_STATE_MEM(gc_mark_pool_len) = len - 1;
+            if (idle) {
+                MP_STATE_MEM(gc_mark_idle) -= 1;
+                idle = false;
+            }
+            mp_thread_gc_mark_unlock();
+            gc_mark_subtree(area, block, id);
+        } else {
+            if (!idle) {
+                MP_STATE_MEM(gc_mark_idle) += 1;
+                idle = true;
+            }
+            bool done = MP_STATE_MEM(gc_mark_idle) == MP_STATE_MEM(gc_mark_workers);
+            mp_thread_gc_mark_unlock();
+            if (done) {
+                return;
+            }
+        }
+    }
+}
+#endif
+
+#if MICROPY_GC_INCREMENTAL
+// Blocks at most this long are traced in one go.
+#define GC_INC_SMALL_BLOCKS (4)
+
+// Set in gc_stack_pos for a block whose marked children are traced again too.
+#define GC_INC_RETRACE_OWNED ((size_t)1 << (sizeof(size_t) * MP_BITS_PER_BYTE - 1))
+
+// Queue a marked block, to be traced by gc_inc_trace() from its start.
+static inline void gc_inc_push(mp_state_mem_area_t *area, size_t block, size_t pos) {
+    size_t sp = MP_STATE_MEM(gc_sp);
+    if (sp < MICROPY_ALLOC_GC_STACK_SIZE) {
+        #if MICROPY_GC_SPLIT_HEAP
+        MP_STATE_MEM(gc_area_stack)[sp] = area;
+        #endif
+        MP_STATE_MEM(gc_stack)[sp] = block;
+        MP_STATE_MEM(gc_stack_pos)[sp] = pos;
+        MP_STATE_MEM(gc_sp) = sp + 1;
+    } else if (area != MP_STATE_MEM(gc_walk_area) || block < MP_STATE_MEM(gc_walk_block)) {
+        // not ahead of a walk in progress, so another walk must find it
+        MP_STATE_MEM(gc_stack_overflow) = 1;
+    }
+}
+
+// Mark and queue the unmarked children of the given block.
+STATIC void gc_inc_scan(mp_state_mem_area_t *area, size_t block) {
+    // work out number of consecutive blocks in the chain starting with this one
+    size_t n_blocks = 0;
+    do {
+        n_blocks += 1;
+    } while (ATB_GET_KIND(area, block + n_blocks) == AT_TAIL);
+
+    void **ptrs = (void **)PTR_FROM_BLOCK(area, block);
+    for (size_t i = n_blocks * WORDS_PER_BLOCK; i > 0; i--, ptrs++) {
+        void *ptr = *ptrs;
+        mp_state_mem_area_t *ptr_area = gc_get_ptr_area(ptr);
+        if (ptr_area != NULL) {
+            size_t childblock = BLOCK_FROM_PTR(ptr_area, ptr);
+            if (gc_mark_head(ptr_area, childblock)) {
+                TRACE_MARK(childblock, ptr);
+                gc_inc_push(ptr_area, childblock, 0);
+            }
+        }
+    }
+}
+
+// Trace the queued blocks for about n_words words.  A large block is traced
+// depth first: it is left at its first unmarked child, which is marked and
+// queued above it.  So the queue does not grow with the size of a block, and
+// it can be traced over many calls.
+STATIC void gc_inc_trace(size_t n_words) {
+    while (MP_STATE_MEM(gc_sp) > 0) {
+        size_t sp = MP_STATE_MEM(gc_sp) - 1;
+        #if MICROPY_GC_SPLIT_HEAP
+        mp_state_mem_area_t *area = MP_STATE_MEM(gc_area_stack)[sp];
+        #else
+        mp_state_mem_area_t *area = &MP_STATE_MEM(area);
+        #endif
+        size_t block = MP_STATE_MEM(gc_stack)[sp];
+        size_t owned = MP_STATE_MEM(gc_stack_pos)[sp] & GC_INC_RETRACE_OWNED;
+        size_t pos = MP_STATE_MEM(gc_stack_pos)[sp] & ~GC_INC_RETRACE_OWNED;
+        // a queued block may have been freed since it was marked
+        if (ATB_GET_KIND(area, block) != AT_MARK) {
+            MP_STATE_MEM(gc_sp) = sp;
+            continue;
+        }
+        if (pos == 0 && !owned) {
+            size_t n_blocks = 1;
+            while (n_blocks <= GC_INC_SMALL_BLOCKS && ATB_GET_KIND(area, block + n_blocks) == AT_TAIL) {
+                n_blocks += 1;
+            }
+            if (n_blocks <= GC_INC_SMALL_BLOCKS) {
+                // a small block is traced in one go, and leaves the queue
+                // before its children join it, so that a long chain of them
+                // does not fill the queue
+                MP_STATE_MEM(gc_sp) = sp;
+                gc_inc_scan(area, block);
+                n_words -= MIN(n_words, n_blocks * WORDS_PER_BLOCK);
+                if (n_words == 0) {
+                    return;
+                }
+                continue;
+            }
+        }
+        void **ptrs = (void **)PTR_FROM_BLOCK(area, block);
+        for (;;) {
+            if (n_words == 0) {
+                MP_STATE_MEM(gc_stack_pos)[sp] = pos | owned;
+                return;
+            }
+            if (pos % WORDS_PER_BLOCK == 0 && pos > 0
+                && ATB_GET_KIND(area, block + pos / WORDS_PER_BLOCK) != AT_TAIL) {
+                // end of the chain
+                MP_STATE_MEM(gc_sp) = sp;
+                break;
+            }
+            n_words -= 1;
+            void *ptr = ptrs[pos++];
+            mp_state_mem_area_t *ptr_area = gc_get_ptr_area(ptr);
+            if (ptr_area != NULL) {
+                size_t childblock = BLOCK_FROM_PTR(ptr_area, ptr);
+                if (gc_mark_head(ptr_area, childblock)
+                    || (owned && ATB_GET_KIND(ptr_area, childblock) == AT_MARK)) {
+                    TRACE_MARK(childblock, ptr);
+                    MP_STATE_MEM(gc_stack_pos)[sp] = pos | owned;
+                    gc_inc_push(ptr_area, childblock, 0);
+                    break;
+                }
+            }
+        }
+    }
+}
+
+// Queue remembered blocks to be traced again, with the blocks they own, as
+// far as there is room.
+STATIC void gc_inc_rescan(void) {
+    size_t len = MP_STATE_MEM(gc_remember_len);
+    while (len > 0 && MP_STATE_MEM(gc_sp) < MICROPY_ALLOC_GC_STACK_SIZE) {
+        len -= 1;
+        #if MICROPY_GC_SPLIT_HEAP
+        mp_state_mem_area_t *area = MP_STATE_MEM(gc_remember_area)[len];
+        #else
+        mp_state_mem_area_t *area = &MP_STATE_MEM(area);
+        #endif
+        size_t block = MP_STATE_MEM(gc_remember)[len];
+        if (ATB_GET_KIND(area, block) == AT_MARK) {
+            gc_inc_push(area, block, GC_INC_RETRACE_OWNED);
+        }
+    }
+    MP_STATE_MEM(gc_remember_len) = len;
+}
+
+// Trace the queued blocks and, if the queue overflowed, walk the heap for
+// marked blocks to trace again; to finish the mark, trace the remembered
+// blocks again too.  Stop when there is nothing left to trace, returning
+// true, or when budget_us (if not 0) has passed since start.
+STATIC bool gc_inc_mark(mp_uint_t start, mp_uint_t budget_us, bool finish) {
+    for (size_t n = 1;; n++) {
+        if (budget_us != 0 && (n & 31) == 0 && mp_hal_ticks_us() - start >= budget_us) {
+            return false;
+        }
+        if (MP_STATE_MEM(gc_sp) > 0) {
+            gc_inc_trace(WORDS_PER_BLOCK * 8);
+            continue;
+        }
+        mp_state_mem_area_t *area = MP_STATE_MEM(gc_walk_area);
+        if (area == NULL) {
+            if (finish && MP_STATE_MEM(gc_remember_len) > 0) {
+                gc_inc_rescan();
+                continue;
+            }
+            if (!MP_STATE_MEM(gc_stack_overflow)) {
+                return true;
+            }
+            // some marked blocks may have unmarked children, walk them all
+            MP_STATE_MEM(gc_stack_overflow) = 0;
+            area = &MP_STATE_MEM(area);
+            MP_STATE_MEM(gc_walk_area) = area;
+            MP_STATE_MEM(gc_walk_block) = 0;
+        }
+        size_t block = MP_STATE_MEM(gc_walk_block)++;
+        if (block >= area->gc_alloc_table_byte_len * BLOCKS_PER_ATB) {
+            MP_STATE_MEM(gc_walk_area) = NEXT_AREA(area);
+            MP_STATE_MEM(gc_walk_block) = 0;
+        } else if (ATB_GET_KIND(area, block) == AT_MARK) {
+            gc_inc_push(area, block, 0);
+        }
     }
 }
 
+STATIC void gc_pause_end(void) {
+    mp_uint_t t = mp_hal_ticks_us() - MP_STATE_MEM(gc_pause_start);
+    if (t > MP_STATE_MEM(gc_pause_max)) {
+        MP_STATE_MEM(gc_pause_max) = t;
+    }
+    MP_STATE_MEM(gc_pause_total) += t;
+    MP_STATE_MEM(gc_pause_count) += 1;
+}
+
+// A collection is complete: the next starts when half the blocks it left
+// free have been allocated.
+STATIC void gc_inc_cycle_end(void) {
+    MP_STATE_MEM(gc_inc_trigger) = MP_STATE_MEM(gc_inc_free) / 2;
+    MP_STATE_MEM(gc_inc_alloc) = 0;
+}
+
+#else
+
 STATIC void gc_deal_with_stack_overflow(void) {
     while (MP_STATE_MEM(gc_stack_overflow)) {
         MP_STATE_MEM(gc_stack_overflow) = 0;
 
         // scan entire memory looking for blocks which have been marked but not their children
-        for (size_t block = 0; block < MP_STATE_MEM(gc_alloc_table_byte_len) * BLOCKS_PER_ATB; block++) {
-            // trace (again) if mark bit set
-            if (ATB_GET_KIND(block) == AT_MARK) {
-                gc_mark_subtree(block);
+        for (mp_state_mem_area_t *area = &MP_STATE_MEM(area); area != NULL; area = NEXT_AREA(area)) {
+            for (size_t block = 0; block < area->gc_alloc_table_byte_len * BLOCKS_PER_ATB; block++) {
+                // trace (again) if mark bit set
+                if (ATB_GET_KIND(area, block) == AT_MARK) {
+                    gc_mark_subtree(area, block, 0);
+                }
+            }
+        }
+    }
+}
+#endif
+
+// Blocks from the given one on have been freed: move the indexes that the
+// search for free blocks starts from back to them, if they are past them.
+static inline void gc_last_free_lower(mp_state_mem_area_t *area, size_t block) {
+    if (block / BLOCKS_PER_ATB < area->gc_last_free_atb_index) {
+        area->gc_last_free_atb_index = block / BLOCKS_PER_ATB;
+    }
+    // a run of them may start at the block before
+    size_t run = (block - (block > 0)) / BLOCKS_PER_ATB;
+    if (run < area->gc_last_free_run_atb_index) {
+        area->gc_last_free_run_atb_index = run;
+    }
+}
+
+// Sweep one block.  free_tail says whether the tail blocks met next belong to
+// an unmarked chain, and is updated at each head.
+static inline void gc_sweep_block(mp_state_mem_area_t *area, size_t block, int *free_tail) {
+    switch (ATB_GET_KIND(area, block)) {
+        case AT_HEAD:
+            #if MICROPY_ENABLE_FINALISER
+            if (FTB_GET(area, block)) {
+                mp_obj_base_t *obj = (mp_obj_base_t *)PTR_FROM_BLOCK(area, block);
+                if (obj->type != NULL) {
+                    // if the object has a type then see if it has a __del__ method
+                    mp_obj_t dest[2];
+                    mp_load_method_maybe(MP_OBJ_FROM_PTR(obj), MP_QSTR___del__, dest);
+                    if (dest[0] != MP_OBJ_NULL) {
+                        // load_method returned a method, execute it in a protected environment
+                        #if MICROPY_ENABLE_SCHEDULER
+                        mp_sched_lock();
+                        #endif
+                        mp_call_function_1_protected(dest[0], dest[1]);
+                        #if MICROPY_ENABLE_SCHEDULER
+                        mp_sched_unlock();
+                        #endif
+                    }
+                }
+                // clear finaliser flag
+                FTB_CLEAR(area, block);
+            }
+            #endif
+            #if MICROPY_GC_GENERATIONAL
+            YTB_CLEAR(area, block);
+            CTB_CLEAR(area, block);
+            #endif
+            *free_tail = 1;
+            DEBUG_printf("gc_sweep(%p)\n", (void *)PTR_FROM_BLOCK(area, block));
+            #if MICROPY_PY_GC_COLLECT_RETVAL
+            MP_STATE_MEM(gc_collected)++;
+            #endif
+            // fall through to free the head
+            MP_FALLTHROUGH
+
+        case AT_TAIL:
+            if (*free_tail) {
+                ATB_ANY_TO_FREE(area, block);
+                #if CLEAR_ON_SWEEP
+                memset((void *)PTR_FROM_BLOCK(area, block), 0, BYTES_PER_BLOCK);
+                #endif
             }
+            break;
+
+        case AT_MARK:
+            ATB_MARK_TO_HEAD(area, block);
+            *free_tail = 0;
+            break;
+    }
+    #if MICROPY_GC_INCREMENTAL
+    if (ATB_GET_KIND(area, block) == AT_FREE) {
+        MP_STATE_MEM(gc_inc_free)++;
+    }
+    #endif
+}
+
+// An area has been swept: allocation can look at all of it again.
+STATIC void gc_sweep_area_end(mp_state_mem_area_t *area) {
+    #if MICROPY_GC_FREE_LISTS
+    gc_free_list_rebuild(area);
+    #endif
+    area->gc_last_free_atb_index = 0;
+    area->gc_last_free_run_atb_index = 0;
+    #if MICROPY_GC_TLAB
+    area->gc_tlab_block = 0;
+    #endif
+    #if MICROPY_GC_ALLOC_PROFILE
+    // the bytecode of the last site looked up may be gone
+    MP_STATE_MEM(gc_site_ip) = NULL;
+    #endif
+}
+
+STATIC void gc_sweep(void) {
+    #if MICROPY_PY_GC_COLLECT_RETVAL
+    MP_STATE_MEM(gc_collected) = 0;
+    #endif
+    #if MICROPY_GC_INCREMENTAL
+    MP_STATE_MEM(gc_inc_free) = 0;
+    #endif
+    for (mp_state_mem_area_t *area = &MP_STATE_MEM(area); area != NULL; area = NEXT_AREA(area)) {
+        // free unmarked heads and their tails
+        int free_tail = 0;
+        for (size_t block = 0; block < area->gc_alloc_table_byte_len * BLOCKS_PER_ATB; block++) {
+            gc_sweep_block(area, block, &free_tail);
         }
+        gc_sweep_area_end(area);
+    }
+}
+
+#if MICROPY_GC_GENERATIONAL
+// Sweep the blocks in the young table, found a byte of it at a time: free the
+// unmarked ones and promote the marked ones, which stay where they are.
+// Return the number promoted.
+STATIC size_t gc_sweep_young(void) {
+    size_t kept = 0;
+    #if MICROPY_PY_GC_COLLECT_RETVAL
+    MP_STATE_MEM(gc_collected) = 0;
+    #endif
+    #if MICROPY_GC_ALLOC_PROFILE
+    MP_STATE_MEM(gc_site_ip) = NULL;
+    #endif
+    for (mp_state_mem_area_t *area = &MP_STATE_MEM(area); area != NULL; area = NEXT_AREA(area)) {
+        byte *ytb = area->gc_young_table_start;
+        for (size_t i = 0, len = YTB_BYTE_LEN(area); i < len; i++) {
+            byte y = ytb[i];
+            if (y == 0) {
+                continue;
+            }
+            ytb[i] = 0;
+            for (size_t block = i * BLOCKS_PER_YTB; y != 0; block++, y >>= 1) {
+                if (!(y & 1)) {
+                    continue;
+                }
+                int free_tail = 0;
+                kept += ATB_GET_KIND(area, block) == AT_MARK;
+                gc_sweep_block(area, block, &free_tail);
+                if (free_tail) {
+                    size_t end_block = block + 1;
+                    while (ATB_GET_KIND(area, end_block) == AT_TAIL) {
+                        gc_sweep_block(area, end_block++, &free_tail);
+                    }
+                    #if MICROPY_GC_FREE_LISTS
+                    gc_free_list_push(area, block, end_block - block, true);
+                    #endif
+                    gc_last_free_lower(area, block);
+                }
+            }
+        }
+    }
+    return kept;
+}
+
+// Tracing the survivors is most of the work of a young collection.  While many
+// of the blocks allocated survive, double the nursery to give them longer to
+// die in, up to half the heap; while few do, halve it again, down to the size
+// set.
+STATIC void gc_nursery_adapt(size_t kept) {
+    size_t young = MP_STATE_MEM(gc_young);
+    unsigned int shift = MP_STATE_MEM(gc_nursery_shift);
+    if (kept * 8 > young) {
+        size_t total = 0;
+        for (mp_state_mem_area_t *area = &MP_STATE_MEM(area); area != NULL; area = NEXT_AREA(area)) {
+            total += area->gc_alloc_table_byte_len * BLOCKS_PER_ATB;
+        }
+        if (MP_STATE_MEM(gc_nursery) << (shift + 1) <= total / 2) {
+            MP_STATE_MEM(gc_nursery_shift) = shift + 1;
+        }
+    } else if (kept * 32 < young && shift > 0) {
+        MP_STATE_MEM(gc_nursery_shift) = shift - 1;
+    }
+}
+#endif
+
+#if MICROPY_GC_INCREMENTAL
+// Sweep on from where the last slice stopped.  Stop when the whole heap has
+// been swept, returning true, or when budget_us (if not 0) has passed since
+// start.
+STATIC bool gc_inc_sweep(mp_uint_t start, mp_uint_t budget_us) {
+    mp_state_mem_area_t *area = MP_STATE_MEM(gc_walk_area);
+    size_t block = MP_STATE_MEM(gc_walk_block);
+    int free_tail = MP_STATE_MEM(gc_sweep_free_tail);
+    for (size_t n = 1; area != NULL; n++) {
+        if (block == area->gc_alloc_table_byte_len * BLOCKS_PER_ATB) {
+            gc_sweep_area_end(area);
+            area = NEXT_AREA(area);
+            block = 0;
+            free_tail = 0;
+            continue;
+        }
+        if (budget_us != 0 && (n & 255) == 0 && mp_hal_ticks_us() - start >= budget_us) {
+            break;
+        }
+        gc_sweep_block(area, block++, &free_tail);
+    }
+    MP_STATE_MEM(gc_walk_area) = area;
+    MP_STATE_MEM(gc_walk_block) = block;
+    MP_STATE_MEM(gc_sweep_free_tail) = free_tail;
+    if (area != NULL) {
+        return false;
+    }
+    MP_STATE_MEM(gc_phase) = GC_PHASE_IDLE;
+    gc_inc_cycle_end();
+    return true;
+}
+
+// Blocks start to end of a chain were just taken from the free ones.  Keep
+// an incremental sweep from freeing them: mark the head if the sweep has not
+// reached it yet, and keep the tails if the sweep is among them.
+static inline void gc_inc_keep(mp_state_mem_area_t *area, size_t start, size_t end) {
+    if (MP_STATE_MEM(gc_phase) != GC_PHASE_SWEEP) {
+        return;
+    }
+    mp_state_mem_area_t *walk_area = MP_STATE_MEM(gc_walk_area);
+    if (area == walk_area) {
+        if (start >= MP_STATE_MEM(gc_walk_block)) {
+            ATB_HEAD_TO_MARK(area, start);
+        } else if (end >= MP_STATE_MEM(gc_walk_block)) {
+            MP_STATE_MEM(gc_sweep_free_tail) = 0;
+        }
+        return;
+    }
+    // areas after the one being swept have not been swept yet
+    for (mp_state_mem_area_t *a = walk_area; a != NULL; a = NEXT_AREA(a)) {
+        if (a == area) {
+            ATB_HEAD_TO_MARK(area, start);
+            break;
+        }
+    }
+}
+#endif
+
+#if MICROPY_GC_GENERATIONAL
+// Trace the blocks that the given one points to, for a young collection: the
+// young ones, and the old ones too, though only as far as the young blocks
+// they point to.  This finds the young blocks held in a list's items or a
+// dict's table, when given the list or the dict.
+STATIC void gc_young_trace(mp_state_mem_area_t *area, size_t block) {
+    size_t n_blocks = 0;
+    do {
+        n_blocks += 1;
+    } while (ATB_GET_KIND(area, block + n_blocks) == AT_TAIL);
+    void **ptrs = (void **)PTR_FROM_BLOCK(area, block);
+    for (size_t i = n_blocks * BYTES_PER_BLOCK / sizeof(void *); i > 0; i--, ptrs++) {
+        void *ptr = *ptrs;
+        mp_state_mem_area_t *ptr_area = gc_get_ptr_area(ptr);
+        if (ptr_area != NULL) {
+            size_t childblock = BLOCK_FROM_PTR(ptr_area, ptr);
+            if (!YTB_GET(ptr_area, childblock) && ATB_GET_KIND(ptr_area, childblock) == AT_HEAD) {
+                // old, traced like a young one and then promoted again
+                YTB_SET(ptr_area, childblock);
+            }
+            if (gc_mark_head(ptr_area, childblock)) {
+                gc_mark_subtree(ptr_area, childblock, 0);
+            }
+        }
+    }
+}
+
+// A root points to this block.  The code holding the root may be changing it
+// without a write barrier, young or old (like the VM does to a frame on the
+// heap), so it is traced by gc_young_trace(), and marked changed so that the
+// next young collection traces it again.
+STATIC void gc_young_root(mp_state_mem_area_t *area, size_t block) {
+    size_t kind = ATB_GET_KIND(area, block);
+    if (kind == AT_HEAD) {
+        YTB_SET(area, block);
+        ATB_HEAD_TO_MARK(area, block);
+        gc_young_trace(area, block);
+    } else if (kind != AT_MARK) {
+        // not a block
+        return;
+    }
+    CTB_SET(area, block);
+}
+
+// Trace from the blocks marked changed, before the roots mark them again,
+// scanning the changed table a byte at a time.
+STATIC void gc_young_trace_changed(void) {
+    for (mp_state_mem_area_t *area = &MP_STATE_MEM(area); area != NULL; area = NEXT_AREA(area)) {
+        byte *ctb = area->gc_changed_table_start;
+        for (size_t i = 0, len = YTB_BYTE_LEN(area); i < len; i++) {
+            byte c = ctb[i];
+            if (c == 0) {
+                continue;
+            }
+            ctb[i] = 0;
+            for (size_t block = i * BLOCKS_PER_YTB; c != 0; block++, c >>= 1) {
+                if (c & 1) {
+                    gc_young_trace(area, block);
+                }
+            }
+        }
+    }
+}
+#endif
+
+#if MICROPY_GC_COMPACT
+// Count a pointer, at any alignment, into a chain of blocks.  One from a root
+// pins the chain.
+STATIC void gc_compact_ref(const void *ptr, bool root) {
+    for (mp_state_mem_area_t *area = &MP_STATE_MEM(area); area != NULL; area = NEXT_AREA(area)) {
+        if ((const byte *)ptr >= area->gc_pool_start && (const byte *)ptr < area->gc_pool_end) {
+            size_t block = BLOCK_FROM_PTR(area, ptr);
+            byte kind;
+            while ((kind = ATB_GET_KIND(area, block)) == AT_TAIL) {
+                block--;
+            }
+            if (kind != AT_FREE) {
+                RTB_SET(area, block, root ? 2 : MIN(RTB_GET(area, block) + 1, 2));
+            }
+            return;
+        }
+    }
+}
+
+// Marking is complete: count the pointers in the marked blocks.
+STATIC void gc_compact_count(void) {
+    for (mp_state_mem_area_t *area = &MP_STATE_MEM(area); area != NULL; area = NEXT_AREA(area)) {
+        size_t end_block = area->gc_alloc_table_byte_len * BLOCKS_PER_ATB;
+        bool marked = false;
+        for (size_t block = 0; block < end_block; block++) {
+            byte kind = ATB_GET_KIND(area, block);
+            if (kind != AT_TAIL) {
+                marked = kind == AT_MARK;
+            }
+            if (marked) {
+                void **ptrs = (void **)PTR_FROM_BLOCK(area, block);
+                for (size_t i = 0; i < WORDS_PER_BLOCK; i++) {
+                    gc_compact_ref(ptrs[i], false);
+                }
+            }
+        }
+    }
+}
+
+// If obj is an object with a buffer of its own, return the field pointing to
+// it and the least size it has, else NULL.  The checks keep a buffer of raw
+// data that merely starts like such an object from being taken for one.
+STATIC void **gc_compact_field(mp_obj_base_t *obj, size_t *n_bytes) {
+    const mp_obj_type_t *type = obj->type;
+    mp_map_t *map = NULL;
+    if (type == &mp_type_list) {
+        mp_obj_list_t *o = (mp_obj_list_t *)obj;
+        if (o->len > o->alloc) {
+            return NULL;
+        }
+        *n_bytes = o->alloc * sizeof(mp_obj_t);
+        return (void **)&o->items;
+    } else if (type == &mp_type_dict
+               #if MICROPY_PY_COLLECTIONS_ORDEREDDICT
+               || type == &mp_type_ordereddict
+               #endif
+               ) {
+        map = &((mp_obj_dict_t *)obj)->map;
+    #if MICROPY_PY_BUILTINS_BYTEARRAY || MICROPY_PY_ARRAY
+    } else if (0
+               #if MICROPY_PY_BUILTINS_BYTEARRAY
+               || type == &mp_type_bytearray
+               #endif
+               #if MICROPY_PY_ARRAY
+               || type == &mp_type_array
+               #endif
+               ) {
+        // not memoryview, whose items are another object's
+        mp_obj_array_t *o = (mp_obj_array_t *)obj;
+        *n_bytes = (o->len + o->free) * mp_binary_get_size('@', o->typecode, NULL);
+        return (void **)&o->items;
+    #endif
+    } else if (type == &mp_type_str || type == &mp_type_bytes) {
+        mp_obj_str_t *o = (mp_obj_str_t *)obj;
+        *n_bytes = o->len + 1;
+        return (void **)&o->data;
+    } else {
+        // An instance of a class defined in Python, with a table of members.
+        // The type of an object of a native module may be on the heap too,
+        // inside the block holding the module's data.
+        mp_state_mem_area_t *area = gc_get_ptr_area(type);
+        if (area == NULL) {
+            return NULL;
+        }
+        size_t block = BLOCK_FROM_PTR(area, type);
+        if ((const void *)PTR_FROM_BLOCK(area, block) != type || !ATB_IS_HEAD(area, block)
+            || type->base.type != &mp_type_type || !mp_obj_is_instance_type(type)) {
+            return NULL;
+        }
+        map = &((mp_obj_instance_t *)obj)->members;
+    }
+    if (map->is_fixed || map->used > map->alloc) {
+        return NULL;
+    }
+    *n_bytes = map->alloc * sizeof(mp_map_elem_t);
+    return (void **)&map->table;
+}
+
+// Return the lowest run of n_blocks free blocks below the given one, or the
+// block itself if there is none.
+STATIC size_t gc_compact_find(mp_state_mem_area_t *area, size_t block, size_t n_blocks) {
+    // all blocks below the last free ATB index are in use
+    size_t to = area->gc_last_free_atb_index * BLOCKS_PER_ATB;
+    while (to < block && ATB_GET_KIND(area, to) != AT_FREE) {
+        to++;
+    }
+    area->gc_last_free_atb_index = to / BLOCKS_PER_ATB;
+    for (size_t n_free = 0; to + n_free < block;) {
+        if (ATB_GET_KIND(area, to + n_free) != AT_FREE) {
+            to += n_free + 1;
+            n_free = 0;
+        } else if (++n_free == n_blocks) {
+            return to;
+        }
+    }
+    return block;
+}
+
+// Move a buffer to a lower run of free blocks.
+STATIC void gc_compact_move(mp_state_mem_area_t *area, size_t block, size_t to, size_t n_blocks) {
+    memcpy((void *)PTR_FROM_BLOCK(area, to), (void *)PTR_FROM_BLOCK(area, block), n_blocks * BYTES_PER_BLOCK);
+    ATB_FREE_TO_HEAD(area, to);
+    ATB_ANY_TO_FREE(area, block);
+    for (size_t bl = 1; bl < n_blocks; bl++) {
+        ATB_FREE_TO_TAIL(area, to + bl);
+        ATB_ANY_TO_FREE(area, block + bl);
+    }
+    // nothing else is to move it again
+    RTB_SET(area, to, 2);
+    #if MICROPY_ENABLE_FINALISER
+    if (FTB_GET(area, block)) {
+        FTB_CLEAR(area, block);
+        FTB_SET(area, to);
+    }
+    #endif
+    #if MICROPY_GC_GENERATIONAL
+    if (YTB_GET(area, block)) {
+        YTB_CLEAR(area, block);
+        YTB_SET(area, to);
+    }
+    if (CTB_GET(area, block)) {
+        CTB_CLEAR(area, block);
+        CTB_SET(area, to);
+    }
+    #endif
+    #if MICROPY_GC_ALLOC_PROFILE
+    area->gc_site_table_start[to] = area->gc_site_table_start[block];
+    #endif
+}
+
+// The heap has been swept: move each buffer that only the field of its
+// object points to into the lowest run of free blocks below it that fits it.
+STATIC void gc_compact_heap(void) {
+    for (mp_state_mem_area_t *area = &MP_STATE_MEM(area); area != NULL; area = NEXT_AREA(area)) {
+        size_t end_block = area->gc_alloc_table_byte_len * BLOCKS_PER_ATB;
+        for (size_t block = 0; block < end_block; block++) {
+            if (ATB_GET_KIND(area, block) != AT_HEAD) {
+                continue;
+            }
+            size_t n_bytes;
+            void **field = gc_compact_field((mp_obj_base_t *)PTR_FROM_BLOCK(area, block), &n_bytes);
+            if (field == NULL) {
+                continue;
+            }
+            mp_state_mem_area_t *buf_area = gc_get_ptr_area(*field);
+            if (buf_area == NULL) {
+                continue;
+            }
+            size_t buf = BLOCK_FROM_PTR(buf_area, *field);
+            if (*field != (void *)PTR_FROM_BLOCK(buf_area, buf)
+                || ATB_GET_KIND(buf_area, buf) != AT_HEAD || RTB_GET(buf_area, buf) != 1) {
+                // not the start of a buffer, or not its only pointer
+                continue;
+            }
+            size_t n_blocks = 1;
+            while (ATB_GET_KIND(buf_area, buf + n_blocks) == AT_TAIL) {
+                n_blocks++;
+            }
+            if (n_blocks * BYTES_PER_BLOCK < n_bytes) {
+                continue;
+            }
+            size_t to = gc_compact_find(buf_area, buf, n_blocks);
+            if (to == buf) {
+                continue;
+            }
+            gc_compact_move(buf_area, buf, to, n_blocks);
+            DEBUG_printf("gc_compact(%p -> %p)\n", *field, (void *)PTR_FROM_BLOCK(buf_area, to));
+            *field = (void *)PTR_FROM_BLOCK(buf_area, to);
+            MP_STATE_MEM(gc_compact_moved) += 1;
+        }
+    }
+    for (mp_state_mem_area_t *area = &MP_STATE_MEM(area); area != NULL; area = NEXT_AREA(area)) {
+        gc_sweep_area_end(area);
+    }
+}
+#endif
+
+#if MICROPY_GC_FINALISER_QUEUE
+// Marking is complete: queue the unmarked objects that have a __del__ method,
+// and mark them and what they point to, which their finaliser may use.  The
+// finalisers of those that do not fit are run by the sweep.
+STATIC void gc_fin_queue_dead(void) {
+    if (MP_STATE_MEM(gc_fin_sweep_all)) {
+        return;
+    }
+    #if MICROPY_GC_PARALLEL_MARK
+    // the mark workers are done, this thread traces on its own
+    MP_STATE_MEM(gc_mark_idle) = 0;
+    #endif
+    for (mp_state_mem_area_t *area = &MP_STATE_MEM(area); area != NULL; area = NEXT_AREA(area)) {
+        size_t end_block = area->gc_alloc_table_byte_len * BLOCKS_PER_ATB;
+        for (size_t i = 0; i * BLOCKS_PER_FTB < end_block; i++) {
+            byte ftb = area->gc_finaliser_table_start[i];
+            for (size_t block = i * BLOCKS_PER_FTB; ftb != 0; block++, ftb >>= 1) {
+                if (!(ftb & 1) || ATB_GET_KIND(area, block) != AT_HEAD) {
+                    continue;
+                }
+                #if MICROPY_GC_GENERATIONAL
+                if (MP_STATE_MEM(gc_minor) && !YTB_GET(area, block)) {
+                    // old, kept by a young collection
+                    continue;
+                }
+                #endif
+                mp_obj_base_t *obj = (mp_obj_base_t *)PTR_FROM_BLOCK(area, block);
+                if (obj->type == NULL) {
+                    continue;
+                }
+                mp_obj_t dest[2];
+                mp_load_method_maybe(MP_OBJ_FROM_PTR(obj), MP_QSTR___del__, dest);
+                if (dest[0] == MP_OBJ_NULL) {
+                    continue;
+                }
+                size_t len = MP_STATE_MEM(gc_fin_len);
+                if (len == MICROPY_GC_FINALISER_QUEUE_LEN) {
+                    MP_STATE_MEM(gc_fin_full) += 1;
+                    continue;
+                }
+                MP_STATE_MEM(gc_fin_queue)[(MP_STATE_MEM(gc_fin_idx) + len) % MICROPY_GC_FINALISER_QUEUE_LEN] = obj;
+                MP_STATE_MEM(gc_fin_len) = ++len;
+                if (len > MP_STATE_MEM(gc_fin_max)) {
+                    MP_STATE_MEM(gc_fin_max) = len;
+                }
+                // it is finalised once, from the queue
+                FTB_CLEAR(area, block);
+                #if MICROPY_GC_COMPACT
+                if (MP_STATE_MEM(gc_compacting)) {
+                    // the queue points to it
+                    gc_compact_ref(obj, true);
+                }
+                #endif
+                gc_mark_head(area, block);
+                #if MICROPY_GC_INCREMENTAL
+                gc_inc_push(area, block, 0);
+                gc_inc_trace((size_t)-1);
+                #else
+                gc_mark_subtree(area, block, 0);
+                #endif
+            }
+        }
+    }
+    #if MICROPY_GC_INCREMENTAL
+    gc_inc_mark(0, 0, true);
+    #else
+    gc_deal_with_stack_overflow();
+    #endif
+}
+
+// Ask the scheduler to run the queued finalisers, if there are any.  Called
+// without the GC lock.
+STATIC void gc_fin_schedule(void) {
+    if (MP_STATE_MEM(gc_fin_len) > 0 && !MP_STATE_MEM(gc_fin_due)) {
+        mp_sched_gc_finalisers();
+    }
+}
+
+void gc_run_finalisers(size_t n) {
+    for (; n > 0; n--) {
+        GC_ENTER();
+        size_t len = MP_STATE_MEM(gc_fin_len);
+        if (len == 0) {
+            GC_EXIT();
+            return;
+        }
+        size_t idx = MP_STATE_MEM(gc_fin_idx);
+        mp_obj_base_t *obj = MP_STATE_MEM(gc_fin_queue)[idx];
+        MP_STATE_MEM(gc_fin_queue)[idx] = NULL;
+        MP_STATE_MEM(gc_fin_idx) = (idx + 1) % MICROPY_GC_FINALISER_QUEUE_LEN;
+        MP_STATE_MEM(gc_fin_len) = len - 1;
+        MP_STATE_MEM(gc_fin_run) += 1;
+        GC_EXIT();
+        // obj is only held by this stack now, and is freed by a later
+        // collection
+        mp_obj_t dest[2];
+        mp_load_method_maybe(MP_OBJ_FROM_PTR(obj), MP_QSTR___del__, dest);
+        if (dest[0] != MP_OBJ_NULL) {
+            // the scheduler must not start another one part way through
+            mp_sched_lock();
+            mp_call_function_1_protected(dest[0], dest[1]);
+            mp_sched_unlock();
+        }
+    }
+    gc_fin_schedule();
+}
+#endif
+
+#if MICROPY_GC_ROOTS
+bool gc_root_add(void **ptrs, size_t len) {
+    GC_ENTER();
+    size_t n = MP_STATE_MEM(gc_roots_len);
+    size_t i = 0;
+    while (i < n && MP_STATE_MEM(gc_roots)[i].ptrs != ptrs) {
+        i++;
+    }
+    bool added = i < MICROPY_GC_ROOTS_LEN;
+    if (added) {
+        // storage added again keeps its entry
+        MP_STATE_MEM(gc_roots)[i].ptrs = ptrs;
+        MP_STATE_MEM(gc_roots)[i].len = len;
+        MP_STATE_MEM(gc_roots_len) = MAX(n, i + 1);
+    }
+    GC_EXIT();
+    return added;
+}
+
+void gc_root_remove(void **ptrs) {
+    GC_ENTER();
+    size_t n = MP_STATE_MEM(gc_roots_len);
+    for (size_t i = 0; i < n; i++) {
+        if (MP_STATE_MEM(gc_roots)[i].ptrs == ptrs) {
+            MP_STATE_MEM(gc_roots)[i] = MP_STATE_MEM(gc_roots)[n - 1];
+            MP_STATE_MEM(gc_roots_len) = n - 1;
+            break;
+        }
+    }
+    GC_EXIT();
+}
+#endif
+
+#if MICROPY_GC_TLAB
+// Give back what is left of a TLAB.  The GC lock must be held.
+STATIC void gc_tlab_retire(mp_gc_tlab_t *tlab) {
+    if (tlab->block == tlab->end) {
+        return;
+    }
+    mp_state_mem_area_t *area = tlab->area;
+    for (size_t bl = tlab->block; bl < tlab->end; bl++) {
+        ATB_ANY_TO_FREE(area, bl);
+    }
+    gc_last_free_lower(area, tlab->block);
+    #if MICROPY_GC_FREE_LISTS
+    gc_free_list_push(area, tlab->block, tlab->end - tlab->block, true);
+    #endif
+    tlab->block = tlab->end = 0;
+}
+
+// Stop all threads carving from their TLABs, waiting for those doing so, and
+// give back what is left of each, so that a collection only sees objects.
+// The GC lock must be held; gc_collect_end() lets them go on.
+STATIC void gc_tlab_stop_all(void) {
+    mp_thread_gc_flag_set(&MP_STATE_MEM(gc_tlab_stop));
+    for (mp_gc_tlab_t *tlab = MP_STATE_MEM(gc_tlabs); tlab != NULL; tlab = tlab->next) {
+        while (tlab->busy) {
+        }
+        gc_tlab_retire(tlab);
+    }
+    mp_thread_gc_fence();
+}
+
+// Take a block off the front of a TLAB, or return NULL if it is empty or a
+// collection has stopped it.  The blocks of a TLAB are already heads, so no
+// table changes.  This does not take the GC lock: busy and gc_tlab_stop are
+// set and read in opposite orders here and in gc_tlab_stop_all(), so one of
+// them sees the other.
+STATIC void *gc_tlab_carve(mp_gc_tlab_t *tlab) {
+    void *ret_ptr = NULL;
+    mp_thread_gc_flag_set(&tlab->busy);
+    if (!MP_STATE_MEM(gc_tlab_stop) && tlab->block < tlab->end) {
+        ret_ptr = (void *)PTR_FROM_BLOCK(tlab->area, tlab->block);
+        tlab->block += 1;
+    }
+    mp_thread_gc_flag_clear(&tlab->busy);
+    return ret_ptr;
+}
+
+// Claim a new TLAB: the first run from the area's TLAB cursor of at least a
+// quarter of MICROPY_GC_TLAB_BLOCKS free blocks, up to all of them; smaller
+// holes are left to gc_alloc().  The cursor only moves on, until a sweep, so
+// that claims do not each scan the heap from its start.  The GC lock must be
+// held.
+STATIC bool gc_tlab_claim(mp_gc_tlab_t *tlab) {
+    for (mp_state_mem_area_t *area = &MP_STATE_MEM(area); area != NULL; area = NEXT_AREA(area)) {
+        size_t n_total = area->gc_alloc_table_byte_len * BLOCKS_PER_ATB;
+        size_t n_free = 0;
+        size_t block = area->gc_tlab_block;
+        for (; block < n_total && n_free < MICROPY_GC_TLAB_BLOCKS; block++) {
+            if (ATB_GET_KIND(area, block) == AT_FREE) {
+                n_free++;
+            } else if (n_free >= MICROPY_GC_TLAB_BLOCKS / 4) {
+                break;
+            } else {
+                n_free = 0;
+            }
+        }
+        area->gc_tlab_block = block;
+        if (n_free >= MICROPY_GC_TLAB_BLOCKS / 4) {
+            tlab->area = area;
+            tlab->block = block - n_free;
+            tlab->end = block;
+            for (size_t bl = tlab->block; bl < block; bl++) {
+                ATB_FREE_TO_HEAD(area, bl);
+            }
+            #if MICROPY_GC_ALLOC_THRESHOLD
+            MP_STATE_MEM(gc_alloc_amount) += n_free;
+            #endif
+            return true;
+        }
+    }
+    return false;
+}
+
+// Take a block from the calling thread's TLAB, first swapping what is left of
+// it for a new one if needed.  Return NULL if there is no room for one, for
+// the caller to allocate as usual, collecting if need be.
+STATIC void *gc_tlab_alloc(void) {
+    mp_gc_tlab_t *tlab = &MP_STATE_THREAD(gc_tlab);
+    void *ret_ptr = gc_tlab_carve(tlab);
+    if (ret_ptr != NULL) {
+        return ret_ptr;
+    }
+    GC_ENTER();
+    if (tlab->area == NULL) {
+        // the thread's first TLAB
+        tlab->next = MP_STATE_MEM(gc_tlabs);
+        MP_STATE_MEM(gc_tlabs) = tlab;
+        tlab->area = &MP_STATE_MEM(area);
+    }
+    gc_tlab_retire(tlab);
+    bool claimed = gc_tlab_claim(tlab);
+    GC_EXIT();
+    return claimed ? gc_tlab_carve(tlab) : NULL;
+}
+
+void gc_tlab_release(void) {
+    mp_gc_tlab_t *tlab = &MP_STATE_THREAD(gc_tlab);
+    if (tlab->area == NULL) {
+        return;
+    }
+    GC_ENTER();
+    gc_tlab_retire(tlab);
+    for (mp_gc_tlab_t **t = &MP_STATE_MEM(gc_tlabs); *t != NULL; t = &(*t)->next) {
+        if (*t == tlab) {
+            *t = tlab->next;
+            break;
+        }
+    }
+    tlab->area = NULL;
+    GC_EXIT();
+}
+#endif
+
+void gc_collect_start(void) {
+    GC_ENTER();
+    MP_STATE_THREAD(gc_lock_depth)++;
+    #if MICROPY_GC_TLAB
+    gc_tlab_stop_all();
+    #endif
+    #if MICROPY_GC_ALLOC_THRESHOLD
+    MP_STATE_MEM(gc_alloc_amount) = 0;
+    #endif
+    #if MICROPY_GC_INCREMENTAL
+    MP_STATE_MEM(gc_pause_start) = mp_hal_ticks_us();
+    if (MP_STATE_MEM(gc_phase) != GC_PHASE_IDLE && !MP_STATE_MEM(gc_slicing)) {
+        // the slices did not keep up, do them more often
+        MP_STATE_MEM(gc_inc_interval) = MAX(MP_STATE_MEM(gc_inc_interval) / 2, 1);
+    }
+    if (MP_STATE_MEM(gc_phase) == GC_PHASE_SWEEP) {
+        // the marks of the last collection must be cleared first
+        gc_inc_sweep(0, 0);
+    }
+    if (MP_STATE_MEM(gc_phase) != GC_PHASE_MARK) {
+        MP_STATE_MEM(gc_sp) = 0;
+        MP_STATE_MEM(gc_remember_len) = 0;
+        MP_STATE_MEM(gc_walk_area) = NULL;
+        MP_STATE_MEM(gc_stack_overflow) = 0;
+    }
+    #else
+    MP_STATE_MEM(gc_stack_overflow) = 0;
+    #endif
+    #if MICROPY_GC_PARALLEL_MARK
+    MP_STATE_MEM(gc_mark_pool_len) = 0;
+    #endif
+
+    #if MICROPY_GC_GENERATIONAL
+    if (MP_STATE_MEM(gc_minor)) {
+        gc_young_trace_changed();
+    } else {
+        // All that survives a full collection is promoted.  The roots mark
+        // what they point to changed again, see gc_collect_root().
+        for (mp_state_mem_area_t *area = &MP_STATE_MEM(area); area != NULL; area = NEXT_AREA(area)) {
+            memset(area->gc_young_table_start, 0, YTB_BYTE_LEN(area));
+            memset(area->gc_changed_table_start, 0, YTB_BYTE_LEN(area));
+        }
+    }
+    #endif
+
+    #if MICROPY_GC_COMPACT
+    #if MICROPY_GC_GENERATIONAL
+    if (MP_STATE_MEM(gc_minor)) {
+        // a young collection does not see all the pointers to a buffer
+        MP_STATE_MEM(gc_compacting) = false;
+    }
+    #endif
+    if (MP_STATE_MEM(gc_compacting)) {
+        for (mp_state_mem_area_t *area = &MP_STATE_MEM(area); area != NULL; area = NEXT_AREA(area)) {
+            memset(area->gc_ref_table_start, 0, area->gc_alloc_table_byte_len);
+        }
+    }
+    #endif
+
+    // Trace root pointers.  This relies on the root pointers being organised
+    // correctly in the mp_state_ctx structure.  We scan nlr_top, dict_locals,
+    // dict_globals, then the root pointer section of mp_state_vm.
+    void **ptrs = (void **)(void *)&mp_state_ctx;
+    size_t root_start = offsetof(mp_state_ctx_t, thread.dict_locals);
+    size_t root_end = offsetof(mp_state_ctx_t, vm.qstr_last_chunk);
+    gc_collect_root(ptrs + root_start / sizeof(void *), (root_end - root_start) / sizeof(void *));
+
+    #if MICROPY_GC_ROOTS
+    // Trace the storage registered with gc_root_add().
+    for (size_t i = 0; i < MP_STATE_MEM(gc_roots_len); i++) {
+        gc_collect_root(MP_STATE_MEM(gc_roots)[i].ptrs, MP_STATE_MEM(gc_roots)[i].len);
+    }
+    #endif
+
+    #if MICROPY_GC_FINALISER_QUEUE
+    // Trace the objects waiting for their finaliser.
+    gc_collect_root(MP_STATE_MEM(gc_fin_queue), MICROPY_GC_FINALISER_QUEUE_LEN);
+    #endif
+
+    #if MICROPY_ENABLE_PYSTACK
+    // Trace root pointers from the Python stack.
+    ptrs = (void **)(void *)MP_STATE_THREAD(pystack_start);
+    gc_collect_root(ptrs, (MP_STATE_THREAD(pystack_cur) - MP_STATE_THREAD(pystack_start)) / sizeof(void *));
+    #endif
+}
+
+void gc_collect_root(void **ptrs, size_t len) {
+    #if MICROPY_GC_COMPACT && MICROPY_PY_THREAD && !MICROPY_PY_THREAD_GIL
+    if (MP_STATE_MEM(gc_compacting) && mp_thread_get_state() != MP_STATE_MEM(gc_compact_thread)) {
+        // other threads run on once their roots are traced, and may be
+        // using any buffer
+        MP_STATE_MEM(gc_compacting) = false;
+    }
+    #endif
+    for (size_t i = 0; i < len; i++) {
+        void *ptr = ptrs[i];
+        #if MICROPY_GC_COMPACT
+        if (MP_STATE_MEM(gc_compacting)) {
+            // what a root points into stays in place
+            gc_compact_ref(ptr, true);
+        }
+        #endif
+        mp_state_mem_area_t *area = gc_get_ptr_area(ptr);
+        if (area != NULL) {
+            size_t block = BLOCK_FROM_PTR(area, ptr);
+            #if MICROPY_GC_GENERATIONAL
+            if (MP_STATE_MEM(gc_minor)) {
+                gc_young_root(area, block);
+                continue;
+            }
+            if (ATB_GET_KIND(area, block) & AT_HEAD) {
+                // it may be an object that gc_alloc() collected for, which
+                // its caller goes on filling in without a write barrier
+                CTB_SET(area, block);
+            }
+            #endif
+            if (gc_mark_head(area, block)) {
+                // An unmarked head, now marked: mark all its children
+                TRACE_MARK(block, ptr);
+                #if MICROPY_GC_INCREMENTAL
+                // they are traced by gc_collect_end() or by later slices,
+                // right away if there is no room and no hurry
+                if (MP_STATE_MEM(gc_sp) == MICROPY_ALLOC_GC_STACK_SIZE && !MP_STATE_MEM(gc_slicing)) {
+                    gc_inc_trace((size_t)-1);
+                }
+                gc_inc_push(area, block, 0);
+                #else
+                #if MICROPY_GC_PARALLEL_MARK
+                // while the pool has room the mark workers trace it later
+                if (MP_STATE_MEM(gc_mark_pool_len) < MICROPY_ALLOC_GC_STACK_SIZE) {
+                    #if MICROPY_GC_SPLIT_HEAP
+                    MP_STATE_MEM(gc_mark_pool_area)[MP_STATE_MEM(gc_mark_pool_len)] = area;
+                    #endif
+                    MP_STATE_MEM(gc_mark_pool)[MP_STATE_MEM(gc_mark_pool_len)++] = block;
+                    continue;
+                }
+                #endif
+                gc_mark_subtree(area, block, 0);
+                #endif
+            }
+            #if MICROPY_GC_INCREMENTAL
+            else if (MP_STATE_MEM(gc_phase) == GC_PHASE_MARK && ATB_GET_KIND(area, block) == AT_MARK) {
+                // marked earlier in this collection, the root may have changed since
+                gc_inc_scan(area, block);
+            }
+            #endif
+        }
+    }
+}
+
+void gc_collect_end(void) {
+    #if MICROPY_OPT_METHOD_CACHE
+    // types that are swept may have entries in the method caches
+    mp_obj_type_method_cache_invalidate();
+    #endif
+    #if MICROPY_GC_INCREMENTAL
+    if (MP_STATE_MEM(gc_phase) == GC_PHASE_IDLE && MP_STATE_MEM(gc_slicing)) {
+        // the roots are marked, slices trace the rest
+        MP_STATE_MEM(gc_phase) = GC_PHASE_MARK;
+        MP_STATE_MEM(gc_remarks) = 0;
+        MP_STATE_MEM(gc_inc_slices) = 0;
+        gc_pause_end();
+        MP_STATE_THREAD(gc_lock_depth)--;
+        GC_EXIT();
+        return;
+    }
+    #if MICROPY_GC_PARALLEL_MARK
+    if (MP_STATE_MEM(gc_phase) == GC_PHASE_IDLE) {
+        // a collection all at once: hand the marked roots to the mark workers
+        size_t sp = MP_STATE_MEM(gc_sp);
+        memcpy(MP_STATE_MEM(gc_mark_pool), MP_STATE_MEM(gc_stack), sp * sizeof(MP_STATE_MEM(gc_stack)[0]));
+        #if MICROPY_GC_SPLIT_HEAP
+        memcpy(MP_STATE_MEM(gc_mark_pool_area), MP_STATE_MEM(gc_area_stack), sp * sizeof(mp_state_mem_area_t *));
+        #endif
+        MP_STATE_MEM(gc_mark_pool_len) = sp;
+        MP_STATE_MEM(gc_sp) = 0;
+    }
+    #endif
+    #endif
+    #if MICROPY_GC_PARALLEL_MARK
+    if (MP_STATE_MEM(gc_mark_pool_len) > 0) {
+        MP_STATE_MEM(gc_mark_workers) = 0;
+        MP_STATE_MEM(gc_mark_idle) = 0;
+        mp_thread_gc_mark_parallel();
+    }
+    #endif
+    #if MICROPY_GC_INCREMENTAL
+    if (MP_STATE_MEM(gc_slicing)) {
+        // What was allocated during the mark is traced now, which may take
+        // long: past the budget, go back to slices and finish again later,
+        // giving up on that after a few tries.
+        if (!gc_inc_mark(MP_STATE_MEM(gc_pause_start), MP_STATE_MEM(gc_slicing), true)
+            && ++MP_STATE_MEM(gc_remarks) < 4) {
+            gc_pause_end();
+            MP_STATE_THREAD(gc_lock_depth)--;
+            GC_EXIT();
+            return;
+        }
+        gc_inc_mark(0, 0, true);
+        #if MICROPY_GC_FINALISER_QUEUE
+        gc_fin_queue_dead();
+        #endif
+        // marking is complete, slices sweep the heap
+        MP_STATE_MEM(gc_phase) = GC_PHASE_SWEEP;
+        MP_STATE_MEM(gc_walk_area) = &MP_STATE_MEM(area);
+        MP_STATE_MEM(gc_walk_block) = 0;
+        MP_STATE_MEM(gc_sweep_free_tail) = 0;
+        MP_STATE_MEM(gc_inc_free) = 0;
+        #if MICROPY_PY_GC_COLLECT_RETVAL
+        MP_STATE_MEM(gc_collected) = 0;
+        #endif
+        gc_pause_end();
+        MP_STATE_THREAD(gc_lock_depth)--;
+        GC_EXIT();
+        #if MICROPY_GC_FINALISER_QUEUE
+        gc_fin_schedule();
+        #endif
+        return;
+    }
+    gc_inc_mark(0, 0, true);
+    MP_STATE_MEM(gc_phase) = GC_PHASE_IDLE;
+    #else
+    gc_deal_with_stack_overflow();
+    #endif
+    #if MICROPY_GC_FINALISER_QUEUE
+    gc_fin_queue_dead();
+    #endif
+    #if MICROPY_GC_COMPACT
+    if (MP_STATE_MEM(gc_compacting)) {
+        gc_compact_count();
+    }
+    #endif
+    #if MICROPY_GC_GENERATIONAL
+    if (MP_STATE_MEM(gc_minor)) {
+        gc_nursery_adapt(gc_sweep_young());
+        MP_STATE_MEM(gc_minor) = false;
+    } else {
+        gc_sweep();
     }
-}
-
-STATIC void gc_sweep(void) {
-    #if MICROPY_PY_GC_COLLECT_RETVAL
-    MP_STATE_MEM(gc_collected) = 0;
+    MP_STATE_MEM(gc_young) = 0;
+    #else
+    gc_sweep();
     #endif
-    // free unmarked heads and their tails
-    int free_tail = 0;
-    for (size_t block = 0; block < MP_STATE_MEM(gc_alloc_table_byte_len) * BLOCKS_PER_ATB; block++) {
-        switch (ATB_GET_KIND(block)) {
-            case AT_HEAD:
-                #if MICROPY_ENABLE_FINALISER
-                if (FTB_GET(block)) {
-                    mp_obj_base_t *obj = (mp_obj_base_t *)PTR_FROM_BLOCK(block);
-                    if (obj->type != NULL) {
-                        // if the object has a type then see if it has a __del__ method
-                        mp_obj_t dest[2];
-                        mp_load_method_maybe(MP_OBJ_FROM_PTR(obj), MP_QSTR___del__, dest);
-                        if (dest[0] != MP_OBJ_NULL) {
-                            // load_method returned a method, execute it in a protected environment
-                            #if MICROPY_ENABLE_SCHEDULER
-                            mp_sched_lock();
-                            #endif
-                            mp_call_function_1_protected(dest[0], dest[1]);
-                            #if MICROPY_ENABLE_SCHEDULER
-                            mp_sched_unlock();
-                            #endif
-                        }
-                    }
-                    // clear finaliser flag
-                    FTB_CLEAR(block);
-                }
-                #endif
-                free_tail = 1;
-                DEBUG_printf("gc_sweep(%p)\n", (void *)PTR_FROM_BLOCK(block));
-                #if MICROPY_PY_GC_COLLECT_RETVAL
-                MP_STATE_MEM(gc_collected)++;
-                #endif
-                // fall through to free the head
-                MP_FALLTHROUGH
-
-            case AT_TAIL:
-                if (free_tail) {
-                    ATB_ANY_TO_FREE(block);
-                    #if CLEAR_ON_SWEEP
-                    memset((void *)PTR_FROM_BLOCK(block), 0, BYTES_PER_BLOCK);
-                    #endif
-                }
-                break;
-
-            case AT_MARK:
-                ATB_MARK_TO_HEAD(block);
-                free_tail = 0;
-                break;
-        }
+    #if MICROPY_GC_COMPACT
+    if (MP_STATE_MEM(gc_compacting)) {
+        gc_compact_heap();
     }
+    #endif
+    #if MICROPY_GC_INCREMENTAL
+    gc_inc_cycle_end();
+    gc_pause_end();
+    #endif
+    #if MICROPY_GC_TLAB
+    MP_STATE_MEM(gc_tlab_stop) = false;
+    #endif
+    MP_STATE_THREAD(gc_lock_depth)--;
+    GC_EXIT();
+    #if MICROPY_GC_FINALISER_QUEUE
+    gc_fin_schedule();
+    #endif
 }
 
-void gc_collect_start(void) {
+void gc_sweep_all(void) {
     GC_ENTER();
     MP_STATE_THREAD(gc_lock_depth)++;
-    #if MICROPY_GC_ALLOC_THRESHOLD
-    MP_STATE_MEM(gc_alloc_amount) = 0;
+    #if MICROPY_GC_TLAB
+    gc_tlab_stop_all();
+    #endif
+    #if MICROPY_GC_INCREMENTAL
+    // drop the marks of any collection under way
+    if (MP_STATE_MEM(gc_phase) == GC_PHASE_SWEEP) {
+        gc_inc_sweep(0, 0);
+    } else if (MP_STATE_MEM(gc_phase) == GC_PHASE_MARK) {
+        gc_sweep();
+    }
+    MP_STATE_MEM(gc_phase) = GC_PHASE_IDLE;
+    MP_STATE_MEM(gc_slicing) = 0;
+    MP_STATE_MEM(gc_sp) = 0;
+    MP_STATE_MEM(gc_remember_len) = 0;
+    MP_STATE_MEM(gc_walk_area) = NULL;
+    MP_STATE_MEM(gc_pause_start) = mp_hal_ticks_us();
+    #endif
+    #if MICROPY_GC_GENERATIONAL
+    MP_STATE_MEM(gc_minor) = false;
     #endif
     MP_STATE_MEM(gc_stack_overflow) = 0;
+    #if MICROPY_GC_PARALLEL_MARK
+    MP_STATE_MEM(gc_mark_pool_len) = 0;
+    #endif
+    #if MICROPY_GC_FINALISER_QUEUE
+    // the queued objects are finalised by the sweep, with all the others
+    for (size_t n = MP_STATE_MEM(gc_fin_len); n > 0; n--) {
+        size_t idx = MP_STATE_MEM(gc_fin_idx);
+        void *ptr = MP_STATE_MEM(gc_fin_queue)[idx];
+        mp_state_mem_area_t *area = gc_get_ptr_area(ptr);
+        FTB_SET(area, BLOCK_FROM_PTR(area, ptr));
+        MP_STATE_MEM(gc_fin_queue)[idx] = NULL;
+        MP_STATE_MEM(gc_fin_idx) = (idx + 1) % MICROPY_GC_FINALISER_QUEUE_LEN;
+    }
+    MP_STATE_MEM(gc_fin_len) = 0;
+    MP_STATE_MEM(gc_fin_sweep_all) = true;
+    #endif
+    gc_collect_end();
+}
 
-    // Trace root pointers.  This relies on the root pointers being organised
-    // correctly in the mp_state_ctx structure.  We scan nlr_top, dict_locals,
-    // dict_globals, then the root pointer section of mp_state_vm.
-    void **ptrs = (void **)(void *)&mp_state_ctx;
-    size_t root_start = offsetof(mp_state_ctx_t, thread.dict_locals);
-    size_t root_end = offsetof(mp_state_ctx_t, vm.qstr_last_chunk);
-    gc_collect_root(ptrs + root_start / sizeof(void *), (root_end - root_start) / sizeof(void *));
-
-    #if MICROPY_ENABLE_PYSTACK
-    // Trace root pointers from the Python stack.
-    ptrs = (void **)(void *)MP_STATE_THREAD(pystack_start);
-    gc_collect_root(ptrs, (MP_STATE_THREAD(pystack_cur) - MP_STATE_THREAD(pystack_start)) / sizeof(void *));
+#if MICROPY_GC_COMPACT
+size_t gc_compact(void) {
+    GC_ENTER();
+    MP_STATE_MEM(gc_compact_moved) = 0;
+    MP_STATE_MEM(gc_compacting) = true;
+    #if MICROPY_PY_THREAD && !MICROPY_PY_THREAD_GIL
+    MP_STATE_MEM(gc_compact_thread) = mp_thread_get_state();
     #endif
+    GC_EXIT();
+    gc_collect();
+    GC_ENTER();
+    MP_STATE_MEM(gc_compacting) = false;
+    size_t moved = MP_STATE_MEM(gc_compact_moved);
+    GC_EXIT();
+    return moved;
 }
+#endif
 
-void gc_collect_root(void **ptrs, size_t len) {
-    for (size_t i = 0; i < len; i++) {
-        void *ptr = ptrs[i];
-        if (VERIFY_PTR(ptr)) {
-            size_t block = BLOCK_FROM_PTR(ptr);
-            if (ATB_GET_KIND(block) == AT_HEAD) {
-                // An unmarked head: mark it, and mark all its children
-                TRACE_MARK(block, ptr);
-                ATB_HEAD_TO_MARK(block);
-                gc_mark_subtree(block);
-            }
+#if MICROPY_GC_INCREMENTAL
+bool gc_collect_step(mp_uint_t budget_us) {
+    if (MP_STATE_THREAD(gc_lock_depth) > 0) {
+        return false;
+    }
+    if (budget_us == 0) {
+        budget_us = 1;
+    }
+    GC_ENTER();
+    uint8_t phase = MP_STATE_MEM(gc_phase);
+    if (phase == GC_PHASE_IDLE
+        || (phase == GC_PHASE_MARK && MP_STATE_MEM(gc_sp) == 0
+            && !MP_STATE_MEM(gc_stack_overflow) && MP_STATE_MEM(gc_walk_area) == NULL)) {
+        // Start a collection by marking the roots, or finish its mark by
+        // going over the roots and what changed during it again.  These steps
+        // take time in proportion to the roots and those changes, not to the
+        // heap.
+        GC_EXIT();
+        MP_STATE_MEM(gc_slicing) = budget_us;
+        gc_collect();
+        MP_STATE_MEM(gc_slicing) = 0;
+        return false;
+    }
+    MP_STATE_THREAD(gc_lock_depth)++;
+    mp_uint_t start = mp_hal_ticks_us();
+    MP_STATE_MEM(gc_pause_start) = start;
+    bool done = false;
+    MP_STATE_MEM(gc_inc_slices) += 1;
+    if (phase == GC_PHASE_MARK) {
+        if (MP_STATE_MEM(gc_remember_len) > MICROPY_GC_INCREMENTAL_REMEMBER / 2) {
+            // make room, before the write barrier has to
+            gc_inc_rescan();
         }
+        gc_inc_mark(start, budget_us, false);
+    } else if (gc_inc_sweep(start, budget_us)) {
+        // Pace the next collection so that, after it starts, its slices are
+        // paid for twice over by allocating half the blocks left free.
+        done = true;
+        MP_STATE_MEM(gc_inc_interval) = MAX(MP_STATE_MEM(gc_inc_free) / 4 / MP_STATE_MEM(gc_inc_slices), 1);
     }
+    gc_pause_end();
+    MP_STATE_THREAD(gc_lock_depth)--;
+    GC_EXIT();
+    return done;
 }
 
-void gc_collect_end(void) {
-    gc_deal_with_stack_overflow();
-    gc_sweep();
-    MP_STATE_MEM(gc_last_free_atb_index) = 0;
-    MP_STATE_THREAD(gc_lock_depth)--;
+void gc_write_barrier(const void *ptr) {
+    // until marked, an object is traced with what it holds at that time
+    if (MP_STATE_MEM(gc_phase) != GC_PHASE_MARK) {
+        return;
+    }
+    GC_ENTER();
+    mp_state_mem_area_t *area = gc_get_ptr_area(ptr);
+    if (area != NULL) {
+        size_t block = BLOCK_FROM_PTR(area, ptr);
+        if (ATB_GET_KIND(area, block) == AT_MARK) {
+            size_t len = MP_STATE_MEM(gc_remember_len);
+            for (size_t i = 0; i < len; i++) {
+                if (MP_STATE_MEM(gc_remember)[i] == block
+                    #if MICROPY_GC_SPLIT_HEAP
+                    && MP_STATE_MEM(gc_remember_area)[i] == area
+                    #endif
+                    ) {
+                    GC_EXIT();
+                    return;
+                }
+            }
+            if (len == MICROPY_GC_INCREMENTAL_REMEMBER) {
+                gc_inc_rescan();
+                len = MP_STATE_MEM(gc_remember_len);
+                if (len == MICROPY_GC_INCREMENTAL_REMEMBER) {
+                    // no room either, trace all marked blocks again instead
+                    MP_STATE_MEM(gc_stack_overflow) = 1;
+                    len = 0;
+                }
+            }
+            #if MICROPY_GC_SPLIT_HEAP
+            MP_STATE_MEM(gc_remember_area)[len] = area;
+            #endif
+            MP_STATE_MEM(gc_remember)[len] = block;
+            MP_STATE_MEM(gc_remember_len) = len + 1;
+        }
+    }
     GC_EXIT();
 }
+#endif
 
-void gc_sweep_all(void) {
+#if MICROPY_GC_GENERATIONAL
+void gc_collect_young(void) {
+    if (MP_STATE_THREAD(gc_lock_depth) > 0 || !MP_STATE_MEM(gc_auto_collect_enabled)) {
+        return;
+    }
+    mp_uint_t start = mp_hal_ticks_us();
+    MP_STATE_MEM(gc_minor) = true;
+    gc_collect();
+    mp_uint_t t = mp_hal_ticks_us() - start;
+    if (t > MP_STATE_MEM(gc_minor_max)) {
+        MP_STATE_MEM(gc_minor_max) = t;
+    }
+    MP_STATE_MEM(gc_minor_total) += t;
+    MP_STATE_MEM(gc_minor_count) += 1;
+}
+
+void gc_write_barrier(const void *ptr) {
+    // the blocks a young collection traces are taken as they are
+    if (MP_STATE_MEM(gc_minor)) {
+        return;
+    }
     GC_ENTER();
-    MP_STATE_THREAD(gc_lock_depth)++;
-    MP_STATE_MEM(gc_stack_overflow) = 0;
-    gc_collect_end();
+    mp_state_mem_area_t *area = gc_get_ptr_area(ptr);
+    if (area != NULL) {
+        size_t block = BLOCK_FROM_PTR(area, ptr);
+        if (!YTB_GET(area, block) && ATB_GET_KIND(area, block) == AT_HEAD) {
+            // an old block, traced by the next young collection
+            CTB_SET(area, block);
+        }
+    }
+    GC_EXIT();
 }
+#endif
 
 void gc_info(gc_info_t *info) {
     GC_ENTER();
-    info->total = MP_STATE_MEM(gc_pool_end) - MP_STATE_MEM(gc_pool_start);
+    info->total = 0;
     info->used = 0;
     info->free = 0;
     info->max_free = 0;
     info->num_1block = 0;
     info->num_2block = 0;
     info->max_block = 0;
-    bool finish = false;
-    for (size_t block = 0, len = 0, len_free = 0; !finish;) {
-        size_t kind = ATB_GET_KIND(block);
-        switch (kind) {
-            case AT_FREE:
-                info->free += 1;
-                len_free += 1;
-                len = 0;
-                break;
-
-            case AT_HEAD:
-                info->used += 1;
-                len = 1;
-                break;
+    for (mp_state_mem_area_t *area = &MP_STATE_MEM(area); area != NULL; area = NEXT_AREA(area)) {
+        info->total += area->gc_pool_end - area->gc_pool_start;
+        bool finish = false;
+        for (size_t block = 0, len = 0, len_free = 0; !finish;) {
+            size_t kind = ATB_GET_KIND(area, block);
+            switch (kind) {
+                case AT_FREE:
+                    info->free += 1;
+                    len_free += 1;
+                    len = 0;
+                    break;
+
+                case AT_HEAD:
+                #if MICROPY_GC_INCREMENTAL
+                case AT_MARK:
+                #endif
+                    info->used += 1;
+                    len = 1;
+                    break;
+
+                case AT_TAIL:
+                    info->used += 1;
+                    len += 1;
+                    break;
+
+                #if !MICROPY_GC_INCREMENTAL
+                case AT_MARK:
+                    // shouldn't happen
+                    break;
+                #endif
+            }
 
-            case AT_TAIL:
-                info->used += 1;
-                len += 1;
-                break;
+            block++;
+            finish = (block == area->gc_alloc_table_byte_len * BLOCKS_PER_ATB);
+            // Get next block type if possible
+            if (!finish) {
+                kind = ATB_GET_KIND(area, block);
+                #if MICROPY_GC_INCREMENTAL
+                if (kind == AT_MARK) {
+                    kind = AT_HEAD;
+                }
+                #endif
+            }
 
-            case AT_MARK:
-                // shouldn't happen
-                break;
+            if (finish || kind == AT_FREE || kind == AT_HEAD) {
+                if (len == 1) {
+                    info->num_1block += 1;
+                } else if (len == 2) {
+                    info->num_2block += 1;
+                }
+                if (len > info->max_block) {
+                    info->max_block = len;
+                }
+                if (finish || kind == AT_HEAD) {
+                    if (len_free > info->max_free) {
+                        info->max_free = len_free;
+                    }
+                    len_free = 0;
+                }
+            }
         }
+    }
+
+    info->used *= BYTES_PER_BLOCK;
+    info->free *= BYTES_PER_BLOCK;
+    GC_EXIT();
+}
 
-        block++;
-        finish = (block == MP_STATE_MEM(gc_alloc_table_byte_len) * BLOCKS_PER_ATB);
-        // Get next block type if possible
-        if (!finish) {
-            kind = ATB_GET_KIND(block);
+#if MICROPY_GC_ALLOC_PROFILE
+// Types that gc_profile() knows objects of, besides those on the heap.
+STATIC const mp_obj_type_t *const gc_profile_types[] = {
+    &mp_type_type,
+    &mp_type_object,
+    &mp_type_str,
+    &mp_type_bytes,
+    #if MICROPY_PY_BUILTINS_BYTEARRAY
+    &mp_type_bytearray,
+    #endif
+    #if MICROPY_PY_ARRAY
+    &mp_type_array,
+    #endif
+    #if MICROPY_LONGINT_IMPL != MICROPY_LONGINT_IMPL_NONE
+    &mp_type_int,
+    #endif
+    #if MICROPY_PY_BUILTINS_FLOAT
+    &mp_type_float,
+    #endif
+    &mp_type_tuple,
+    &mp_type_list,
+    &mp_type_dict,
+    #if MICROPY_PY_BUILTINS_SET
+    &mp_type_set,
+    #endif
+    &mp_type_fun_bc,
+    &mp_type_gen_instance,
+    &mp_type_module,
+};
+
+// Return the type of the object in the given block, if it is one of a type
+// that can be told safely, otherwise NULL.
+STATIC const mp_obj_type_t *gc_profile_type(mp_state_mem_area_t *area, size_t block) {
+    const void *type = *(const void **)PTR_FROM_BLOCK(area, block);
+    mp_state_mem_area_t *type_area = gc_get_ptr_area(type);
+    if (type_area != NULL) {
+        // a class defined in Python, also on the heap
+        size_t type_block = BLOCK_FROM_PTR(type_area, type);
+        if ((void *)PTR_FROM_BLOCK(type_area, type_block) == type && ATB_IS_HEAD(type_area, type_block)
+            && ((const mp_obj_base_t *)type)->type == &mp_type_type) {
+            return type;
+        }
+        return NULL;
+    }
+    for (size_t i = 0; i < MP_ARRAY_SIZE(gc_profile_types); i++) {
+        if (type == gc_profile_types[i]) {
+            return type;
         }
+    }
+    return NULL;
+}
 
-        if (finish || kind == AT_FREE || kind == AT_HEAD) {
-            if (len == 1) {
-                info->num_1block += 1;
-            } else if (len == 2) {
-                info->num_2block += 1;
+void gc_profile(gc_profile_entry_t *types, size_t n_types, gc_profile_entry_t *sites) {
+    memset(types, 0, n_types * sizeof(gc_profile_entry_t));
+    memset(sites, 0, (MICROPY_GC_ALLOC_PROFILE_SITES + 1) * sizeof(gc_profile_entry_t));
+    size_t len = 1;
+    GC_ENTER();
+    for (mp_state_mem_area_t *area = &MP_STATE_MEM(area); area != NULL; area = NEXT_AREA(area)) {
+        size_t end_block = area->gc_alloc_table_byte_len * BLOCKS_PER_ATB;
+        for (size_t block = 0; block < end_block; block++) {
+            if (!ATB_IS_HEAD(area, block)) {
+                continue;
             }
-            if (len > info->max_block) {
-                info->max_block = len;
+            size_t n_blocks = 1;
+            while (block + n_blocks < end_block && ATB_GET_KIND(area, block + n_blocks) == AT_TAIL) {
+                n_blocks++;
             }
-            if (finish || kind == AT_HEAD) {
-                if (len_free > info->max_free) {
-                    info->max_free = len_free;
+            size_t n_bytes = n_blocks * BYTES_PER_BLOCK;
+
+            // by type, entry 0 for the unknown ones and those that do not fit
+            const mp_obj_type_t *type = gc_profile_type(area, block);
+            size_t i = 0;
+            if (type != NULL) {
+                i = 1;
+                while (i < len && types[i].key != type) {
+                    i++;
+                }
+                if (i == len) {
+                    if (len < n_types) {
+                        types[len++].key = type;
+                    } else {
+                        i = 0;
+                    }
                 }
-                len_free = 0;
             }
+            types[i].count += 1;
+            types[i].n_bytes += n_bytes;
+
+            // by allocation site
+            gc_profile_entry_t *site = &sites[area->gc_site_table_start[block]];
+            site->count += 1;
+            site->n_bytes += n_bytes;
         }
     }
-
-    info->used *= BYTES_PER_BLOCK;
-    info->free *= BYTES_PER_BLOCK;
     GC_EXIT();
 }
 
+// Return the allocation site of a block allocated now: the number of the
+// source line of the running bytecode in gc_sites, added if it is new, or 0
+// if no bytecode is running or there is no room for it.
+STATIC byte gc_alloc_site(void) {
+    const mp_code_state_t *code_state = MP_STATE_THREAD(current_code_state);
+    if (code_state == NULL) {
+        return 0;
+    }
+    if (code_state->ip == MP_STATE_MEM(gc_site_ip)) {
+        return MP_STATE_MEM(gc_site_last);
+    }
+
+    // work out the source line, like the VM does for a traceback
+    const byte *ip = code_state->fun_bc->bytecode;
+    MP_BC_PRELUDE_SIG_DECODE(ip);
+    MP_BC_PRELUDE_SIZE_DECODE(ip);
+    const byte *bytecode_start = ip + n_info + n_cell;
+    #if !MICROPY_PERSISTENT_CODE
+    bytecode_start = MP_ALIGN(bytecode_start, sizeof(mp_uint_t));
+    #endif
+    size_t bc = code_state->ip - bytecode_start;
+    #if MICROPY_PERSISTENT_CODE
+    qstr block_name = ip[0] | (ip[1] << 8);
+    qstr source_file = ip[2] | (ip[3] << 8);
+    ip += 4;
+    #else
+    qstr block_name = mp_decode_uint_value(ip);
+    ip = mp_decode_uint_skip(ip);
+    qstr source_file = mp_decode_uint_value(ip);
+    ip = mp_decode_uint_skip(ip);
+    #endif
+    size_t line = mp_bytecode_get_source_line(ip, bc);
+
+    byte site = 0;
+    size_t len = MP_STATE_MEM(gc_sites_len);
+    for (size_t i = 0; i < len; i++) {
+        mp_gc_alloc_site_t *s = &MP_STATE_MEM(gc_sites)[i];
+        if (s->line == line && s->source_file == source_file && s->block_name == block_name) {
+            site = i + 1;
+            break;
+        }
+    }
+    if (site == 0 && len < MICROPY_GC_ALLOC_PROFILE_SITES) {
+        mp_gc_alloc_site_t *s = &MP_STATE_MEM(gc_sites)[len];
+        s->source_file = source_file;
+        s->block_name = block_name;
+        s->line = line;
+        MP_STATE_MEM(gc_sites_len) = len + 1;
+        site = len + 1;
+    }
+    MP_STATE_MEM(gc_site_ip) = code_state->ip;
+    MP_STATE_MEM(gc_site_last) = site;
+    return site;
+}
+#endif
+
 void *gc_alloc(size_t n_bytes, unsigned int alloc_flags) {
     bool has_finaliser = alloc_flags & GC_ALLOC_FLAG_HAS_FINALISER;
     size_t n_blocks = ((n_bytes + BYTES_PER_BLOCK - 1) & (~(BYTES_PER_BLOCK - 1))) / BYTES_PER_BLOCK;
@@ -451,6 +2389,50 @@ void *gc_alloc(size_t n_bytes, unsigned int alloc_flags) {
         return NULL;
     }
 
+    #if MICROPY_GC_TLAB
+    if (n_blocks == 1 && !has_finaliser) {
+        void *ret_ptr = gc_tlab_alloc();
+        if (ret_ptr != NULL) {
+            #if MICROPY_GC_CONSERVATIVE_CLEAR
+            memset((byte *)ret_ptr, 0, BYTES_PER_BLOCK);
+            #else
+            memset((byte *)ret_ptr + n_bytes, 0, BYTES_PER_BLOCK - n_bytes);
+            #endif
+            return ret_ptr;
+        }
+    }
+    #endif
+
+    #if MICROPY_GC_INCREMENTAL
+    if (MP_STATE_MEM(gc_slice_us) != 0 && MP_STATE_MEM(gc_auto_collect_enabled)) {
+        // Pace the collection by allocation: start one when enough has been
+        // allocated since the last, then do a slice every few blocks.  What
+        // a large allocation leaves over brings the next slices forward.
+        // Slices are run by the scheduler, not here, so that they do not
+        // see objects that the caller is still filling in.
+        size_t n = MP_STATE_MEM(gc_inc_alloc) + n_blocks;
+        size_t every = MP_STATE_MEM(gc_phase) == GC_PHASE_IDLE ? MP_STATE_MEM(gc_inc_trigger) : MP_STATE_MEM(gc_inc_interval);
+        if (n >= every) {
+            MP_STATE_MEM(gc_inc_alloc) = MIN(n - every, 4 * every);
+            mp_sched_gc_step();
+        } else {
+            MP_STATE_MEM(gc_inc_alloc) = n;
+        }
+    }
+    #endif
+
+    #if MICROPY_GC_GENERATIONAL
+    if (MP_STATE_MEM(gc_nursery) != 0 && MP_STATE_MEM(gc_auto_collect_enabled)) {
+        // Collect the young generation when the nursery is full.  This is
+        // run by the scheduler, not here, where the caller may be changing
+        // old objects that it has not yet passed to the write barrier.
+        MP_STATE_MEM(gc_young) += n_blocks;
+        if (MP_STATE_MEM(gc_young) >= MP_STATE_MEM(gc_nursery) << MP_STATE_MEM(gc_nursery_shift) && !MP_STATE_MEM(gc_step_due)) {
+            mp_sched_gc_step();
+        }
+    }
+    #endif
+
     GC_ENTER();
 
     size_t i;
@@ -468,23 +2450,62 @@ void *gc_alloc(size_t n_bytes, unsigned int alloc_flags) {
     }
     #endif
 
+    mp_state_mem_area_t *area;
+    #if MICROPY_GC_SPLIT_HEAP_AUTO
+    bool added = false;
+    #endif
+    #if MICROPY_GC_COMPACT
+    bool compacted = false;
+    #endif
     for (;;) {
 
-        // look for a run of n_blocks available blocks
-        n_free = 0;
-        for (i = MP_STATE_MEM(gc_last_free_atb_index); i < MP_STATE_MEM(gc_alloc_table_byte_len); i++) {
-            byte a = MP_STATE_MEM(gc_alloc_table_start)[i];
-            // *FORMAT-OFF*
-            if (ATB_0_IS_FREE(a)) { if (++n_free >= n_blocks) { i = i * BLOCKS_PER_ATB + 0; goto found; } } else { n_free = 0; }
-            if (ATB_1_IS_FREE(a)) { if (++n_free >= n_blocks) { i = i * BLOCKS_PER_ATB + 1; goto found; } } else { n_free = 0; }
-            if (ATB_2_IS_FREE(a)) { if (++n_free >= n_blocks) { i = i * BLOCKS_PER_ATB + 2; goto found; } } else { n_free = 0; }
-            if (ATB_3_IS_FREE(a)) { if (++n_free >= n_blocks) { i = i * BLOCKS_PER_ATB + 3; goto found; } } else { n_free = 0; }
-            // *FORMAT-ON*
+        for (area = &MP_STATE_MEM(area); area != NULL; area = NEXT_AREA(area)) {
+            #if MICROPY_GC_FREE_LISTS
+            start_block = gc_free_list_take(area, n_blocks);
+            if (start_block != (size_t)-1) {
+                end_block = start_block + n_blocks - 1;
+                goto found_listed;
+            }
+            #endif
+
+            // look for a run of n_blocks available blocks
+            n_free = 0;
+            i = area->gc_last_free_atb_index;
+            if (n_blocks > 1 && i < area->gc_last_free_run_atb_index) {
+                i = area->gc_last_free_run_atb_index;
+            }
+            for (; i < area->gc_alloc_table_byte_len; i++) {
+                byte a = area->gc_alloc_table_start[i];
+                // *FORMAT-OFF*
+                if (ATB_0_IS_FREE(a)) { if (++n_free >= n_blocks) { i = i * BLOCKS_PER_ATB + 0; goto found; } } else { n_free = 0; }
+                if (ATB_1_IS_FREE(a)) { if (++n_free >= n_blocks) { i = i * BLOCKS_PER_ATB + 1; goto found; } } else { n_free = 0; }
+                if (ATB_2_IS_FREE(a)) { if (++n_free >= n_blocks) { i = i * BLOCKS_PER_ATB + 2; goto found; } } else { n_free = 0; }
+                if (ATB_3_IS_FREE(a)) { if (++n_free >= n_blocks) { i = i * BLOCKS_PER_ATB + 3; goto found; } } else { n_free = 0; }
+                // *FORMAT-ON*
+            }
         }
 
         GC_EXIT();
         // nothing found!
         if (collected) {
+            #if MICROPY_GC_COMPACT
+            // still no room after a collection, close up the free space
+            if (!compacted && MP_STATE_MEM(gc_auto_collect_enabled)) {
+                compacted = true;
+                if (gc_compact() > 0) {
+                    GC_ENTER();
+                    continue;
+                }
+            }
+            #endif
+            #if MICROPY_GC_SPLIT_HEAP_AUTO
+            // still no room after a collection, ask the port for a new area
+            if (!added && gc_try_add_heap(n_bytes)) {
+                added = true;
+                GC_ENTER();
+                continue;
+            }
+            #endif
             return NULL;
         }
         DEBUG_printf("gc_alloc(" UINT_FMT "): no free mem, triggering GC\n", n_bytes);
@@ -505,21 +2526,39 @@ found:
     // before this one.  Also, whenever we free or shink a block we must check
     // if this index needs adjusting (see gc_realloc and gc_free).
     if (n_free == 1) {
-        MP_STATE_MEM(gc_last_free_atb_index) = (i + 1) / BLOCKS_PER_ATB;
+        area->gc_last_free_atb_index = (i + 1) / BLOCKS_PER_ATB;
+    } else if (n_free == 2) {
+        // likewise, there is no run of two free blocks before this one
+        area->gc_last_free_run_atb_index = start_block / BLOCKS_PER_ATB;
     }
 
+    #if MICROPY_GC_FREE_LISTS
+found_listed:
+    #endif
     // mark first block as used head
-    ATB_FREE_TO_HEAD(start_block);
+    ATB_FREE_TO_HEAD(area, start_block);
 
     // mark rest of blocks as used tail
     // TODO for a run of many blocks can make this more efficient
     for (size_t bl = start_block + 1; bl <= end_block; bl++) {
-        ATB_FREE_TO_TAIL(bl);
+        ATB_FREE_TO_TAIL(area, bl);
     }
 
+    #if MICROPY_GC_INCREMENTAL
+    gc_inc_keep(area, start_block, end_block);
+    #endif
+
+    #if MICROPY_GC_GENERATIONAL
+    YTB_SET(area, start_block);
+    #endif
+
+    #if MICROPY_GC_ALLOC_PROFILE
+    area->gc_site_table_start[start_block] = gc_alloc_site();
+    #endif
+
     // get pointer to first block
     // we must create this pointer before unlocking the GC so a collection can find it
-    void *ret_ptr = (void *)(MP_STATE_MEM(gc_pool_start) + start_block * BYTES_PER_BLOCK);
+    void *ret_ptr = (void *)(area->gc_pool_start + start_block * BYTES_PER_BLOCK);
     DEBUG_printf("gc_alloc(%p)\n", ret_ptr);
 
     #if MICROPY_GC_ALLOC_THRESHOLD
@@ -546,7 +2585,7 @@ found:
         ((mp_obj_base_t *)ret_ptr)->type = NULL;
         // set mp_obj flag only if it has a finaliser
         GC_ENTER();
-        FTB_SET(start_block);
+        FTB_SET(area, start_block);
         GC_EXIT();
     }
     #else
@@ -586,24 +2625,45 @@ void gc_free(void *ptr) {
         GC_EXIT();
     } else {
         // get the GC block number corresponding to this pointer
-        assert(VERIFY_PTR(ptr));
-        size_t block = BLOCK_FROM_PTR(ptr);
-        assert(ATB_GET_KIND(block) == AT_HEAD);
+        #if MICROPY_GC_SPLIT_HEAP
+        mp_state_mem_area_t *area = gc_get_ptr_area(ptr);
+        assert(area != NULL);
+        #else
+        assert(VERIFY_PTR(&MP_STATE_MEM(area), ptr));
+        mp_state_mem_area_t *area = &MP_STATE_MEM(area);
+        #endif
+        size_t block = BLOCK_FROM_PTR(area, ptr);
+        assert(ATB_IS_HEAD(area, block));
 
         #if MICROPY_ENABLE_FINALISER
-        FTB_CLEAR(block);
+        FTB_CLEAR(area, block);
         #endif
 
-        // set the last_free pointer to this block if it's earlier in the heap
-        if (block / BLOCKS_PER_ATB < MP_STATE_MEM(gc_last_free_atb_index)) {
-            MP_STATE_MEM(gc_last_free_atb_index) = block / BLOCKS_PER_ATB;
-        }
+        #if MICROPY_GC_GENERATIONAL
+        YTB_CLEAR(area, block);
+        CTB_CLEAR(area, block);
+        #endif
+
+        #if MICROPY_GC_ALLOC_PROFILE
+        MP_STATE_MEM(gc_site_ip) = NULL;
+        #endif
+
+        // set the last_free pointers to this block if it's earlier in the heap
+        gc_last_free_lower(area, block);
 
         // free head and all of its tail blocks
+        #if MICROPY_GC_FREE_LISTS
+        size_t start_block = block;
+        #endif
         do {
-            ATB_ANY_TO_FREE(block);
+            ATB_ANY_TO_FREE(area, block);
             block += 1;
-        } while (ATB_GET_KIND(block) == AT_TAIL);
+        } while (ATB_GET_KIND(area, block) == AT_TAIL);
+
+        #if MICROPY_GC_FREE_LISTS
+        // reused after the runs already listed, which are lower in the heap
+        gc_free_list_push(area, start_block, block - start_block, true);
+        #endif
 
         GC_EXIT();
 
@@ -615,14 +2675,15 @@ void gc_free(void *ptr) {
 
 size_t gc_nbytes(const void *ptr) {
     GC_ENTER();
-    if (VERIFY_PTR(ptr)) {
-        size_t block = BLOCK_FROM_PTR(ptr);
-        if (ATB_GET_KIND(block) == AT_HEAD) {
+    mp_state_mem_area_t *area = gc_get_ptr_area(ptr);
+    if (area != NULL) {
+        size_t block = BLOCK_FROM_PTR(area, ptr);
+        if (ATB_IS_HEAD(area, block)) {
             // work out number of consecutive blocks in the chain starting with this on
             size_t n_blocks = 0;
             do {
                 n_blocks += 1;
-            } while (ATB_GET_KIND(block + n_blocks) == AT_TAIL);
+            } while (ATB_GET_KIND(area, block + n_blocks) == AT_TAIL);
             GC_EXIT();
             return n_blocks * BYTES_PER_BLOCK;
         }
@@ -633,6 +2694,17 @@ size_t gc_nbytes(const void *ptr) {
     return 0;
 }
 
+// Return whether ptr points anywhere inside the heap, to any byte of a block;
+// unlike the checks above it doesn't need ptr to be the start of a block.
+bool gc_is_heap_ptr(const void *ptr) {
+    for (mp_state_mem_area_t *area = &MP_STATE_MEM(area); area != NULL; area = NEXT_AREA(area)) {
+        if (ptr >= (void *)area->gc_pool_start && ptr < (void *)area->gc_pool_end) {
+            return true;
+        }
+    }
+    return false;
+}
+
 #if 0
 // old, simple realloc that didn't expand memory in place
 void *gc_realloc(void *ptr, mp_uint_t n_bytes) {
@@ -645,7 +2717,7 @@ void *gc_realloc(void *ptr, mp_uint_t n_bytes) {
             has_finaliser = false;
         } else {
             #if MICROPY_ENABLE_FINALISER
-            has_finaliser = FTB_GET(BLOCK_FROM_PTR((mp_uint_t)ptr));
+            has_finaliser = FTB_GET(area, BLOCK_FROM_PTR(area, (mp_uint_t)ptr));
             #else
             has_finaliser = false;
             #endif
@@ -683,9 +2755,15 @@ void *gc_realloc(void *ptr_in, size_t n_bytes, bool allow_move) {
     GC_ENTER();
 
     // get the GC block number corresponding to this pointer
-    assert(VERIFY_PTR(ptr));
-    size_t block = BLOCK_FROM_PTR(ptr);
-    assert(ATB_GET_KIND(block) == AT_HEAD);
+    #if MICROPY_GC_SPLIT_HEAP
+    mp_state_mem_area_t *area = gc_get_ptr_area(ptr);
+    assert(area != NULL);
+    #else
+    assert(VERIFY_PTR(&MP_STATE_MEM(area), ptr));
+    mp_state_mem_area_t *area = &MP_STATE_MEM(area);
+    #endif
+    size_t block = BLOCK_FROM_PTR(area, ptr);
+    assert(ATB_IS_HEAD(area, block));
 
     // compute number of new blocks that are requested
     size_t new_blocks = (n_bytes + BYTES_PER_BLOCK - 1) / BYTES_PER_BLOCK;
@@ -698,9 +2776,9 @@ void *gc_realloc(void *ptr_in, size_t n_bytes, bool allow_move) {
     // efficiently shrink it (see below for shrinking code).
     size_t n_free = 0;
     size_t n_blocks = 1; // counting HEAD block
-    size_t max_block = MP_STATE_MEM(gc_alloc_table_byte_len) * BLOCKS_PER_ATB;
+    size_t max_block = area->gc_alloc_table_byte_len * BLOCKS_PER_ATB;
     for (size_t bl = block + n_blocks; bl < max_block; bl++) {
-        byte block_type = ATB_GET_KIND(bl);
+        byte block_type = ATB_GET_KIND(area, bl);
         if (block_type == AT_TAIL) {
             n_blocks++;
             continue;
@@ -726,13 +2804,11 @@ void *gc_realloc(void *ptr_in, size_t n_bytes, bool allow_move) {
     if (new_blocks < n_blocks) {
         // free unneeded tail blocks
         for (size_t bl = block + new_blocks, count = n_blocks - new_blocks; count > 0; bl++, count--) {
-            ATB_ANY_TO_FREE(bl);
+            ATB_ANY_TO_FREE(area, bl);
         }
 
-        // set the last_free pointer to end of this block if it's earlier in the heap
-        if ((block + new_blocks) / BLOCKS_PER_ATB < MP_STATE_MEM(gc_last_free_atb_index)) {
-            MP_STATE_MEM(gc_last_free_atb_index) = (block + new_blocks) / BLOCKS_PER_ATB;
-        }
+        // set the last_free pointers to end of this block if it's earlier in the heap
+        gc_last_free_lower(area, block + new_blocks);
 
         GC_EXIT();
 
@@ -747,10 +2823,14 @@ void *gc_realloc(void *ptr_in, size_t n_bytes, bool allow_move) {
     if (new_blocks <= n_blocks + n_free) {
         // mark few more blocks as used tail
         for (size_t bl = block + n_blocks; bl < block + new_blocks; bl++) {
-            assert(ATB_GET_KIND(bl) == AT_FREE);
-            ATB_FREE_TO_TAIL(bl);
+            assert(ATB_GET_KIND(area, bl) == AT_FREE);
+            ATB_FREE_TO_TAIL(area, bl);
         }
 
+        #if MICROPY_GC_INCREMENTAL
+        gc_inc_keep(area, block, block + new_blocks - 1);
+        #endif
+
         GC_EXIT();
 
         #if MICROPY_GC_CONSERVATIVE_CLEAR
@@ -769,7 +2849,7 @@ void *gc_realloc(void *ptr_in, size_t n_bytes, bool allow_move) {
     }
 
     #if MICROPY_ENABLE_FINALISER
-    bool ftb_state = FTB_GET(block);
+    bool ftb_state = FTB_GET(area, block);
     #else
     bool ftb_state = false;
     #endif
@@ -803,134 +2883,154 @@ void gc_dump_info(void) {
         (uint)info.total, (uint)info.used, (uint)info.free);
     mp_printf(&mp_plat_print, " No. of 1-blocks: %u, 2-blocks: %u, max blk sz: %u, max free sz: %u\n",
         (uint)info.num_1block, (uint)info.num_2block, (uint)info.max_block, (uint)info.max_free);
+    #if MICROPY_GC_INCREMENTAL
+    if (MP_STATE_MEM(gc_slice_us) != 0) {
+        mp_printf(&mp_plat_print, " No. of pauses: %u, max pause: %u us, total: %u us\n",
+            (uint)MP_STATE_MEM(gc_pause_count), (uint)MP_STATE_MEM(gc_pause_max), (uint)MP_STATE_MEM(gc_pause_total));
+    }
+    #endif
+    #if MICROPY_GC_GENERATIONAL
+    if (MP_STATE_MEM(gc_minor_count) != 0) {
+        mp_printf(&mp_plat_print, " No. of young collections: %u, max pause: %u us, total: %u us\n",
+            (uint)MP_STATE_MEM(gc_minor_count), (uint)MP_STATE_MEM(gc_minor_max), (uint)MP_STATE_MEM(gc_minor_total));
+    }
+    #endif
+    #if MICROPY_GC_FINALISER_QUEUE
+    if (MP_STATE_MEM(gc_fin_max) != 0) {
+        mp_printf(&mp_plat_print, " Finalisers queued: %u, max: %u, run: %u, run by sweep: %u\n",
+            (uint)MP_STATE_MEM(gc_fin_len), (uint)MP_STATE_MEM(gc_fin_max), (uint)MP_STATE_MEM(gc_fin_run), (uint)MP_STATE_MEM(gc_fin_full));
+    }
+    #endif
 }
 
 void gc_dump_alloc_table(void) {
     GC_ENTER();
     static const size_t DUMP_BYTES_PER_LINE = 64;
-    #if !EXTENSIVE_HEAP_PROFILING
-    // When comparing heap output we don't want to print the starting
-    // pointer of the heap because it changes from run to run.
-    mp_printf(&mp_plat_print, "GC memory layout; from %p:", MP_STATE_MEM(gc_pool_start));
-    #endif
-    for (size_t bl = 0; bl < MP_STATE_MEM(gc_alloc_table_byte_len) * BLOCKS_PER_ATB; bl++) {
-        if (bl % DUMP_BYTES_PER_LINE == 0) {
-            // a new line of blocks
-            {
-                // check if this line contains only free blocks
-                size_t bl2 = bl;
-                while (bl2 < MP_STATE_MEM(gc_alloc_table_byte_len) * BLOCKS_PER_ATB && ATB_GET_KIND(bl2) == AT_FREE) {
-                    bl2++;
-                }
-                if (bl2 - bl >= 2 * DUMP_BYTES_PER_LINE) {
-                    // there are at least 2 lines containing only free blocks, so abbreviate their printing
-                    mp_printf(&mp_plat_print, "\n       (%u lines all free)", (uint)(bl2 - bl) / DUMP_BYTES_PER_LINE);
-                    bl = bl2 & (~(DUMP_BYTES_PER_LINE - 1));
-                    if (bl >= MP_STATE_MEM(gc_alloc_table_byte_len) * BLOCKS_PER_ATB) {
-                        // got to end of heap
-                        break;
-                    }
-                }
-            }
-            // print header for new line of blocks
-            // (the cast to uint32_t is for 16-bit ports)
-            // mp_printf(&mp_plat_print, "\n%05x: ", (uint)(PTR_FROM_BLOCK(bl) & (uint32_t)0xfffff));
-            mp_printf(&mp_plat_print, "\n%05x: ", (uint)((bl * BYTES_PER_BLOCK) & (uint32_t)0xfffff));
-        }
-        int c = ' ';
-        switch (ATB_GET_KIND(bl)) {
-            case AT_FREE:
-                c = '.';
-                break;
-            /* this prints out if the object is reachable from BSS or STACK (for unix only)
-            case AT_HEAD: {
-                c = 'h';
-                void **ptrs = (void**)(void*)&mp_state_ctx;
-                mp_uint_t len = offsetof(mp_state_ctx_t, vm.stack_top) / sizeof(mp_uint_t);
-                for (mp_uint_t i = 0; i < len; i++) {
-                    mp_uint_t ptr = (mp_uint_t)ptrs[i];
-                    if (VERIFY_PTR(ptr) && BLOCK_FROM_PTR(ptr) == bl) {
-                        c = 'B';
-                        break;
+    for (mp_state_mem_area_t *area = &MP_STATE_MEM(area); area != NULL; area = NEXT_AREA(area)) {
+        #if !EXTENSIVE_HEAP_PROFILING
+        // When comparing heap output we don't want to print the starting
+        // pointer of the heap because it changes from run to run.
+        mp_printf(&mp_plat_print, "GC memory layout; from %p:", area->gc_pool_start);
+        #endif
+        for (size_t bl = 0; bl < area->gc_alloc_table_byte_len * BLOCKS_PER_ATB; bl++) {
+            if (bl % DUMP_BYTES_PER_LINE == 0) {
+                // a new line of blocks
+                {
+                    // check if this line contains only free blocks
+                    size_t bl2 = bl;
+                    while (bl2 < area->gc_alloc_table_byte_len * BLOCKS_PER_ATB && ATB_GET_KIND(area, bl2) == AT_FREE) {
+                        bl2++;
                     }
-                }
-                if (c == 'h') {
-                    ptrs = (void**)&c;
-                    len = ((mp_uint_t)MP_STATE_THREAD(stack_top) - (mp_uint_t)&c) / sizeof(mp_uint_t);
-                    for (mp_uint_t i = 0; i < len; i++) {
-                        mp_uint_t ptr = (mp_uint_t)ptrs[i];
-                        if (VERIFY_PTR(ptr) && BLOCK_FROM_PTR(ptr) == bl) {
-                            c = 'S';
+                    if (bl2 - bl >= 2 * DUMP_BYTES_PER_LINE) {
+                        // there are at least 2 lines containing only free blocks, so abbreviate their printing
+                        mp_printf(&mp_plat_print, "\n       (%u lines all free)", (uint)(bl2 - bl) / DUMP_BYTES_PER_LINE);
+                        bl = bl2 & (~(DUMP_BYTES_PER_LINE - 1));
+                        if (bl >= area->gc_alloc_table_byte_len * BLOCKS_PER_ATB) {
+                            // got to end of heap
                             break;
                         }
                     }
                 }
-                break;
+                // print header for new line of blocks
+                // (the cast to uint32_t is for 16-bit ports)
+                // mp_printf(&mp_plat_print, "\n%05x: ", (uint)(PTR_FROM_BLOCK(area, bl) & (uint32_t)0xfffff));
+                mp_printf(&mp_plat_print, "\n%05x: ", (uint)((bl * BYTES_PER_BLOCK) & (uint32_t)0xfffff));
             }
-            */
-            /* this prints the uPy object type of the head block */
-            case AT_HEAD: {
-                void **ptr = (void **)(MP_STATE_MEM(gc_pool_start) + bl * BYTES_PER_BLOCK);
-                if (*ptr == &mp_type_tuple) {
-                    c = 'T';
-                } else if (*ptr == &mp_type_list) {
-                    c = 'L';
-                } else if (*ptr == &mp_type_dict) {
-                    c = 'D';
-                } else if (*ptr == &mp_type_str || *ptr == &mp_type_bytes) {
-                    c = 'S';
-                }
-                #if MICROPY_PY_BUILTINS_BYTEARRAY
-                else if (*ptr == &mp_type_bytearray) {
-                    c = 'A';
-                }
-                #endif
-                #if MICROPY_PY_ARRAY
-                else if (*ptr == &mp_type_array) {
-                    c = 'A';
-                }
-                #endif
-                #if MICROPY_PY_BUILTINS_FLOAT
-                else if (*ptr == &mp_type_float) {
-                    c = 'F';
-                }
-                #endif
-                else if (*ptr == &mp_type_fun_bc) {
-                    c = 'B';
-                } else if (*ptr == &mp_type_module) {
-                    c = 'M';
-                } else {
+            int c = ' ';
+            switch (ATB_GET_KIND(area, bl)) {
+                case AT_FREE:
+                    c = '.';
+                    break;
+                /* this prints out if the object is reachable from BSS or STACK (for unix only)
+                case AT_HEAD: {
                     c = 'h';
-                    #if 0
-                    // This code prints "Q" for qstr-pool data, and "q" for qstr-str
-                    // data.  It can be useful to see how qstrs are being allocated,
-                    // but is disabled by default because it is very slow.
-                    for (qstr_pool_t *pool = MP_STATE_VM(last_pool); c == 'h' && pool != NULL; pool = pool->prev) {
-                        if ((qstr_pool_t *)ptr == pool) {
-                            c = 'Q';
+                    void **ptrs = (void**)(void*)&mp_state_ctx;
+                    mp_uint_t len = offsetof(mp_state_ctx_t, vm.stack_top) / sizeof(mp_uint_t);
+                    for (mp_uint_t i = 0; i < len; i++) {
+                        mp_uint_t ptr = (mp_uint_t)ptrs[i];
+                        if (VERIFY_PTR(area, ptr) && BLOCK_FROM_PTR(area, ptr) == bl) {
+                            c = 'B';
                             break;
                         }
-                        for (const byte **q = pool->qstrs, **q_top = pool->qstrs + pool->len; q < q_top; q++) {
-                            if ((const byte *)ptr == *q) {
-                                c = 'q';
+                    }
+                    if (c == 'h') {
+                        ptrs = (void**)&c;
+                        len = ((mp_uint_t)MP_STATE_THREAD(stack_top) - (mp_uint_t)&c) / sizeof(mp_uint_t);
+                        for (mp_uint_t i = 0; i < len; i++) {
+                            mp_uint_t ptr = (mp_uint_t)ptrs[i];
+                            if (VERIFY_PTR(area, ptr) && BLOCK_FROM_PTR(area, ptr) == bl) {
+                                c = 'S';
                                 break;
                             }
                         }
                     }
+                    break;
+                }
+                */
+                /* this prints the uPy object type of the head block */
+                case AT_HEAD: {
+                    void **ptr = (void **)(area->gc_pool_start + bl * BYTES_PER_BLOCK);
+                    if (*ptr == &mp_type_tuple) {
+                        c = 'T';
+                    } else if (*ptr == &mp_type_list) {
+                        c = 'L';
+                    } else if (*ptr == &mp_type_dict) {
+                        c = 'D';
+                    } else if (*ptr == &mp_type_str || *ptr == &mp_type_bytes) {
+                        c = 'S';
+                    }
+                    #if MICROPY_PY_BUILTINS_BYTEARRAY
+                    else if (*ptr == &mp_type_bytearray) {
+                        c = 'A';
+                    }
+                    #endif
+                    #if MICROPY_PY_ARRAY
+                    else if (*ptr == &mp_type_array) {
+                        c = 'A';
+                    }
                     #endif
+                    #if MICROPY_PY_BUILTINS_FLOAT
+                    else if (*ptr == &mp_type_float) {
+                        c = 'F';
+                    }
+                    #endif
+                    else if (*ptr == &mp_type_fun_bc) {
+                        c = 'B';
+                    } else if (*ptr == &mp_type_module) {
+                        c = 'M';
+                    } else {
+                        c = 'h';
+                        #if 0
+                        // This code prints "Q" for qstr-pool data, and "q" for qstr-str
+                        // data.  It can be useful to see how qstrs are being allocated,
+                        // but is disabled by default because it is very slow.
+                        for (qstr_pool_t *pool = MP_STATE_VM(last_pool); c == 'h' && pool != NULL; pool = pool->prev) {
+                            if ((qstr_pool_t *)ptr == pool) {
+                                c = 'Q';
+                                break;
+                            }
+                            for (const byte **q = pool->qstrs, **q_top = pool->qstrs + pool->len; q < q_top; q++) {
+                                if ((const byte *)ptr == *q) {
+                                    c = 'q';
+                                    break;
+                                }
+                            }
+                        }
+                        #endif
+                    }
+                    break;
                 }
-                break;
+                case AT_TAIL:
+                    c = '=';
+                    break;
+                case AT_MARK:
+                    c = 'm';
+                    break;
             }
-            case AT_TAIL:
-                c = '=';
-                break;
-            case AT_MARK:
-                c = 'm';
-                break;
+            mp_printf(&mp_plat_print, "%c", c);
         }
-        mp_printf(&mp_plat_print, "%c", c);
+        mp_print_str(&mp_plat_print, "\n");
     }
-    mp_print_str(&mp_plat_print, "\n");
     GC_EXIT();
 }
 
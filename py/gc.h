@@ -29,8 +29,21 @@
 #include <stdbool.h>
 #include <stddef.h>
 
+#include "py/mpconfig.h"
+
 void gc_init(void *start, void *end);
 
+#if MICROPY_GC_SPLIT_HEAP
+// Add memory to the heap as a new area; can be called any time after gc_init.
+void gc_add(void *start, void *end);
+
+#if MICROPY_GC_SPLIT_HEAP_AUTO
+// A port with MICROPY_GC_SPLIT_HEAP_AUTO must implement this: try to gc_add
+// an area with room for at least n_bytes, and return whether it did.
+bool gc_try_add_heap(size_t n_bytes);
+#endif
+#endif
+
 // These lock/unlock functions can be nested.
 // They can be used to prevent the GC from allocating/freeing.
 void gc_lock(void);
@@ -43,9 +56,66 @@ void gc_collect_start(void);
 void gc_collect_root(void **ptrs, size_t len);
 void gc_collect_end(void);
 
+#if MICROPY_GC_PARALLEL_MARK
+// Trace marked blocks until none are left; run by each thread or core taking
+// part in the mark phase, see mp_thread_gc_mark_parallel().
+void gc_mark_worker(void);
+#endif
+
 // Use this function to sweep the whole heap and run all finalisers
 void gc_sweep_all(void);
 
+#if MICROPY_GC_INCREMENTAL
+// Do up to budget_us of work on the current incremental collection, starting
+// one if none is under way, and return whether this completed a collection.
+bool gc_collect_step(mp_uint_t budget_us);
+#endif
+
+#if MICROPY_GC_GENERATIONAL
+// Collect the blocks allocated since the last young collection, promoting
+// those that survive; run by the scheduler once the nursery is full.
+void gc_collect_young(void);
+#endif
+
+#if MICROPY_GC_INCREMENTAL || MICROPY_GC_GENERATIONAL
+// While an incremental collection is marking, the heap objects it has traced
+// are not looked at again unless they are passed to this function, and
+// likewise a young collection only looks at the old objects passed to it
+// and those the roots point to.
+// It must be called on an existing heap object after storing a heap pointer
+// into it, or into a block only it points to (like a list's items or a
+// dict's table).
+void gc_write_barrier(const void *ptr);
+#define MP_GC_WRITE_BARRIER(ptr) gc_write_barrier(ptr)
+#else
+#define MP_GC_WRITE_BARRIER(ptr) (void)0
+#endif
+
+#if MICROPY_GC_COMPACT
+// Collect, then move the buffers of lists, dicts, arrays, str, bytes and
+// instances down the heap into the free blocks below them; return how many
+// were moved.
+size_t gc_compact(void);
+#endif
+
+#if MICROPY_GC_ROOTS
+// Trace the len words at ptrs, static storage outside mp_state_ctx, as roots;
+// return false if there is no room for more.  Remove them before the storage
+// is used for anything else.
+bool gc_root_add(void **ptrs, size_t len);
+void gc_root_remove(void **ptrs);
+#endif
+
+#if MICROPY_GC_FINALISER_QUEUE
+// Run up to n of the finalisers that collections queued, oldest first.
+void gc_run_finalisers(size_t n);
+#endif
+
+#if MICROPY_GC_TLAB
+// Give back the calling thread's TLAB, before its state goes away.
+void gc_tlab_release(void);
+#endif
+
 enum {
     GC_ALLOC_FLAG_HAS_FINALISER = 1,
 };
@@ -53,6 +123,7 @@ enum {
 void *gc_alloc(size_t n_bytes, unsigned int alloc_flags);
 void gc_free(void *ptr); // does not call finaliser
 size_t gc_nbytes(const void *ptr);
+bool gc_is_heap_ptr(const void *ptr);
 void *gc_realloc(void *ptr, size_t n_bytes, bool allow_move);
 
 typedef struct _gc_info_t {
@@ -69,4 +140,18 @@ void gc_info(gc_info_t *info);
 void gc_dump_info(void);
 void gc_dump_alloc_table(void);
 
+#if MICROPY_GC_ALLOC_PROFILE
+typedef struct _gc_profile_entry_t {
+    const void *key;
+    size_t count;
+    size_t n_bytes;
+} gc_profile_entry_t;
+
+// Count the allocated blocks and their bytes by type and by allocation site.
+// types has room for n_types types, types[0] being for blocks whose type is
+// not known (or not an object), and sites for MICROPY_GC_ALLOC_PROFILE_SITES
+// + 1 sites, indexed by site number (see MP_STATE_MEM(gc_sites)).
+void gc_profile(gc_profile_entry_t *types, size_t n_types, gc_profile_entry_t *sites);
+#endif
+
 #endif // MICROPY_INCLUDED_PY_GC_H
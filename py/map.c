@@ -65,13 +65,55 @@ STATIC size_t get_hash_alloc_greater_or_equal_to(size_t x) {
 /******************************************************************************/
 /* map                                                                        */
 
+#if MICROPY_OPT_MAP_COMPACT
+
+// A map that isn't a fixed array keeps its entries dense, in the order they
+// were added.  Deleted entries stay, with MP_OBJ_SENTINEL keys, until the table
+// is rebuilt.  After the alloc entries the table holds the number of entries
+// filled so far, including deleted ones, then the hash of each entry, then for
+// maps of more than MAP_LINEAR_MAX entries an index.  The index is a hash table
+// of entry positions plus one (zero is an empty slot), with Robin Hood probing
+// on the hashes of the entries.  Smaller maps are searched linearly.
+#define MAP_LINEAR_MAX (8)
+#define MAP_IS_ARRAY(map) ((map)->is_fixed && (map)->is_ordered)
+#define MAP_FILL(table, alloc) (*(size_t *)&(table)[alloc])
+#define MAP_HASHES(table, alloc) ((uint32_t *)(&MAP_FILL(table, alloc) + 1))
+#define MAP_INDEX(table, alloc) (MAP_HASHES(table, alloc) + (alloc))
+
+// Number of slots in the index for alloc entries, keeping it at most 2/3 full
+STATIC size_t map_index_size(size_t alloc) {
+    if (alloc <= MAP_LINEAR_MAX) {
+        return 0;
+    }
+    size_t n = 16;
+    while (n < alloc + alloc / 2) {
+        n *= 2;
+    }
+    return n;
+}
+
+STATIC size_t map_table_nbytes(size_t alloc) {
+    return alloc * sizeof(mp_map_elem_t) + sizeof(size_t) + (alloc + map_index_size(alloc)) * sizeof(uint32_t);
+}
+
+#define MAP_TABLE_NEW(alloc) ((mp_map_elem_t *)m_new0(byte, map_table_nbytes(alloc)))
+#define MAP_TABLE_DEL(table, alloc) m_del(byte, (table), map_table_nbytes(alloc))
+
+#else
+
+#define MAP_IS_ARRAY(map) ((map)->is_ordered)
+#define MAP_TABLE_NEW(alloc) m_new0(mp_map_elem_t, (alloc))
+#define MAP_TABLE_DEL(table, alloc) m_del(mp_map_elem_t, (table), (alloc))
+
+#endif
+
 void mp_map_init(mp_map_t *map, size_t n) {
     if (n == 0) {
         map->alloc = 0;
         map->table = NULL;
     } else {
         map->alloc = n;
-        map->table = m_new0(mp_map_elem_t, map->alloc);
+        map->table = MAP_TABLE_NEW(map->alloc);
     }
     map->used = 0;
     map->all_keys_are_qstrs = 1;
@@ -91,14 +133,14 @@ void mp_map_init_fixed_table(mp_map_t *map, size_t n, const mp_obj_t *table) {
 // Differentiate from mp_map_clear() - semantics is different
 void mp_map_deinit(mp_map_t *map) {
     if (!map->is_fixed) {
-        m_del(mp_map_elem_t, map->table, map->alloc);
+        MAP_TABLE_DEL(map->table, map->alloc);
     }
     map->used = map->alloc = 0;
 }
 
 void mp_map_clear(mp_map_t *map) {
     if (!map->is_fixed) {
-        m_del(mp_map_elem_t, map->table, map->alloc);
+        MAP_TABLE_DEL(map->table, map->alloc);
     }
     map->alloc = 0;
     map->used = 0;
@@ -107,6 +149,212 @@ void mp_map_clear(mp_map_t *map) {
     map->table = NULL;
 }
 
+#if MICROPY_OPT_MAP_COMPACT
+
+STATIC uint32_t map_hash(mp_obj_t key) {
+    // fast path for common case of qstr
+    if (mp_obj_is_qstr(key)) {
+        return qstr_hash(MP_OBJ_QSTR_VALUE(key));
+    } else {
+        return MP_OBJ_SMALL_INT_VALUE(mp_unary_op(MP_UNARY_OP_HASH, key));
+    }
+}
+
+// Add the entry at pos, with the given hash, to the index.  Along the probe
+// sequence an entry further from its home slot takes the place of one nearer
+// to its own, which keeps the longest probe sequences short.
+STATIC void map_index_insert(uint32_t *index, size_t mask, const uint32_t *hashes, size_t pos, uint32_t hash) {
+    uint32_t p = pos + 1;
+    size_t dist = 0;
+    size_t i = hash & mask;
+    while (index[i] != 0) {
+        size_t d = (i - (hashes[index[i] - 1] & mask)) & mask;
+        if (d < dist) {
+            uint32_t t = index[i];
+            index[i] = p;
+            p = t;
+            dist = d;
+        }
+        i = (i + 1) & mask;
+        ++dist;
+    }
+    index[i] = p;
+}
+
+// Return the live entry with the given key and hash, or NULL.  A small map
+// searched with compare_only_ptrs doesn't need a valid hash.
+STATIC mp_map_elem_t *map_find(mp_map_t *map, mp_obj_t index, uint32_t hash, bool compare_only_ptrs) {
+    const uint32_t *hashes = MAP_HASHES(map->table, map->alloc);
+    size_t index_size = map_index_size(map->alloc);
+    if (index_size == 0) {
+        for (size_t pos = 0, fill = MAP_FILL(map->table, map->alloc); pos < fill; ++pos) {
+            mp_obj_t key = map->table[pos].key;
+            if (key == index || (!compare_only_ptrs && hashes[pos] == hash
+                                 && key != MP_OBJ_SENTINEL && mp_obj_equal(key, index))) {
+                return &map->table[pos];
+            }
+        }
+        return NULL;
+    }
+    const uint32_t *idx = MAP_INDEX(map->table, map->alloc);
+    size_t mask = index_size - 1;
+    for (size_t i = hash & mask, dist = 0;; i = (i + 1) & mask, ++dist) {
+        uint32_t p = idx[i];
+        if (p == 0) {
+            return NULL;
+        }
+        uint32_t h = hashes[p - 1];
+        if (h == hash) {
+            mp_obj_t key = map->table[p - 1].key;
+            if (key == index || (!compare_only_ptrs && key != MP_OBJ_SENTINEL && mp_obj_equal(key, index))) {
+                return &map->table[p - 1];
+            }
+        } else if (((i - (h & mask)) & mask) < dist) {
+            // this entry is nearer its home slot than the key would be, so
+            // the key would have taken its place
+            return NULL;
+        }
+    }
+}
+
+// Replace the table with one holding just the live entries, growing it if
+// they fill at least half of it.
+STATIC void mp_map_rehash(mp_map_t *map) {
+    size_t old_alloc = map->alloc;
+    size_t new_alloc = old_alloc;
+    if (2 * map->used >= old_alloc) {
+        new_alloc = get_hash_alloc_greater_or_equal_to(old_alloc + 1);
+    }
+    DEBUG_printf("mp_map_rehash(%p): " UINT_FMT " -> " UINT_FMT "\n", map, old_alloc, new_alloc);
+    mp_map_elem_t *old_table = map->table;
+    mp_map_elem_t *new_table = MAP_TABLE_NEW(new_alloc);
+    // If we reach this point, table resizing succeeded, now we can edit the old map.
+    map->alloc = new_alloc;
+    map->all_keys_are_qstrs = 1;
+    map->table = new_table;
+    if (old_table != NULL) {
+        const uint32_t *old_hashes = MAP_HASHES(old_table, old_alloc);
+        uint32_t *hashes = MAP_HASHES(new_table, new_alloc);
+        uint32_t *index = MAP_INDEX(new_table, new_alloc);
+        size_t index_size = map_index_size(new_alloc);
+        size_t fill = 0;
+        for (size_t i = 0; i < MAP_FILL(old_table, old_alloc); i++) {
+            if (old_table[i].key != MP_OBJ_NULL && old_table[i].key != MP_OBJ_SENTINEL) {
+                new_table[fill] = old_table[i];
+                hashes[fill] = old_hashes[i];
+                if (index_size != 0) {
+                    map_index_insert(index, index_size - 1, hashes, fill, hashes[fill]);
+                }
+                if (!mp_obj_is_qstr(old_table[i].key)) {
+                    map->all_keys_are_qstrs = 0;
+                }
+                ++fill;
+            }
+        }
+        MAP_FILL(new_table, new_alloc) = fill;
+        MAP_TABLE_DEL(old_table, old_alloc);
+    }
+}
+
+STATIC MP_NOINLINE mp_map_elem_t *mp_map_compact_lookup(mp_map_t *map, mp_obj_t index, mp_map_lookup_kind_t lookup_kind, bool compare_only_ptrs) {
+    if (map->alloc == 0) {
+        if (lookup_kind == MP_MAP_LOOKUP_ADD_IF_NOT_FOUND) {
+            mp_map_rehash(map);
+        } else {
+            return NULL;
+        }
+    }
+
+    // a small map of qstrs is searched without working out the hash
+    bool have_hash = !compare_only_ptrs || map_index_size(map->alloc) != 0;
+    uint32_t hash = have_hash ? map_hash(index) : 0;
+    mp_map_elem_t *elem = map_find(map, index, hash, compare_only_ptrs);
+    if (elem != NULL) {
+        if (lookup_kind == MP_MAP_LOOKUP_REMOVE_IF_FOUND) {
+            // delete the entry, keeping its value so that caller can access it if needed
+            map->used--;
+            elem->key = MP_OBJ_SENTINEL;
+        }
+        return elem;
+    }
+    if (lookup_kind != MP_MAP_LOOKUP_ADD_IF_NOT_FOUND) {
+        return NULL;
+    }
+
+    // append a new entry
+    if (!have_hash) {
+        hash = map_hash(index);
+    }
+    if (MAP_FILL(map->table, map->alloc) == map->alloc) {
+        mp_map_rehash(map);
+    }
+    size_t pos = MAP_FILL(map->table, map->alloc)++;
+    uint32_t *hashes = MAP_HASHES(map->table, map->alloc);
+    hashes[pos] = hash;
+    size_t index_size = map_index_size(map->alloc);
+    if (index_size != 0) {
+        map_index_insert(MAP_INDEX(map->table, map->alloc), index_size - 1, hashes, pos, hash);
+    }
+    map->used += 1;
+    elem = &map->table[pos];
+    elem->key = index;
+    elem->value = MP_OBJ_NULL;
+    if (!mp_obj_is_qstr(index)) {
+        map->all_keys_are_qstrs = 0;
+    }
+    return elem;
+}
+
+void mp_map_copy_table(mp_map_t *dest, const mp_map_t *src) {
+    assert(dest->alloc == src->alloc && dest->used == 0);
+    if (MAP_IS_ARRAY(src)) {
+        for (size_t i = 0; i < src->used; i++) {
+            mp_map_lookup(dest, src->table[i].key, MP_MAP_LOOKUP_ADD_IF_NOT_FOUND)->value = src->table[i].value;
+        }
+    } else if (src->alloc != 0) {
+        memcpy(dest->table, src->table, map_table_nbytes(src->alloc));
+        dest->used = src->used;
+        dest->all_keys_are_qstrs = src->all_keys_are_qstrs;
+    }
+}
+
+// Return the last live entry of a map that isn't a fixed array, or NULL if it
+// is empty.  Deleted entries at the end of the table are dropped on the way,
+// so popping the entries of a map one at a time from the end is linear.
+mp_map_elem_t *mp_map_last(mp_map_t *map) {
+    assert(!MAP_IS_ARRAY(map));
+    if (map->alloc == 0) {
+        return NULL;
+    }
+    size_t fill = MAP_FILL(map->table, map->alloc);
+    const uint32_t *hashes = MAP_HASHES(map->table, map->alloc);
+    uint32_t *idx = MAP_INDEX(map->table, map->alloc);
+    size_t index_size = map_index_size(map->alloc);
+    while (fill > 0 && map->table[fill - 1].key == MP_OBJ_SENTINEL) {
+        --fill;
+        if (index_size != 0) {
+            // take the entry out of the index, moving back those after it
+            // that aren't in their home slot
+            size_t mask = index_size - 1;
+            size_t i = hashes[fill] & mask;
+            while (idx[i] != fill + 1) {
+                i = (i + 1) & mask;
+            }
+            for (size_t j = (i + 1) & mask; idx[j] != 0 && (hashes[idx[j] - 1] & mask) != j; j = (j + 1) & mask) {
+                idx[i] = idx[j];
+                i = j;
+            }
+            idx[i] = 0;
+        }
+        map->table[fill].key = MP_OBJ_NULL;
+        map->table[fill].value = MP_OBJ_NULL;
+    }
+    MAP_FILL(map->table, map->alloc) = fill;
+    return fill > 0 ? &map->table[fill - 1] : NULL;
+}
+
+#else
+
 STATIC void mp_map_rehash(mp_map_t *map) {
     size_t old_alloc = map->alloc;
     size_t new_alloc = get_hash_alloc_greater_or_equal_to(map->alloc + 1);
@@ -126,12 +374,15 @@ STATIC void mp_map_rehash(mp_map_t *map) {
     m_del(mp_map_elem_t, old_table, old_alloc);
 }
 
+#endif
+
 // MP_MAP_LOOKUP behaviour:
 //  - returns NULL if not found, else the slot it was found in with key,value non-null
 // MP_MAP_LOOKUP_ADD_IF_NOT_FOUND behaviour:
 //  - returns slot, with key non-null and value=MP_OBJ_NULL if it was added
 // MP_MAP_LOOKUP_REMOVE_IF_FOUND behaviour:
-//  - returns NULL if not found, else the slot if was found in with key null and value non-null
+//  - returns NULL if not found, else the slot if was found in with value non-null, and key
+//    null, or MP_OBJ_SENTINEL if MICROPY_OPT_MAP_COMPACT is enabled
 mp_map_elem_t *mp_map_lookup(mp_map_t *map, mp_obj_t index, mp_map_lookup_kind_t lookup_kind) {
     // If the map is a fixed array then we must only be called for a lookup
     assert(!map->is_fixed || lookup_kind == MP_MAP_LOOKUP);
@@ -156,7 +407,7 @@ mp_map_elem_t *mp_map_lookup(mp_map_t *map, mp_obj_t index, mp_map_lookup_kind_t
     }
 
     // if the map is an ordered array then we must do a brute force linear search
-    if (map->is_ordered) {
+    if (MAP_IS_ARRAY(map)) {
         for (mp_map_elem_t *elem = &map->table[0], *top = &map->table[map->used]; elem < top; elem++) {
             if (elem->key == index || (!compare_only_ptrs && mp_obj_equal(elem->key, index))) {
                 #if MICROPY_PY_COLLECTIONS_ORDEREDDICT
@@ -196,6 +447,20 @@ mp_map_elem_t *mp_map_lookup(mp_map_t *map, mp_obj_t index, mp_map_lookup_kind_t
         #endif
     }
 
+    #if MICROPY_OPT_MAP_COMPACT
+    if (compare_only_ptrs && lookup_kind == MP_MAP_LOOKUP && map->alloc <= MAP_LINEAR_MAX) {
+        // fast path for the common case of finding a qstr in a small map, such
+        // as the members of an instance
+        for (size_t pos = 0, fill = map->alloc ? MAP_FILL(map->table, map->alloc) : 0; pos < fill; ++pos) {
+            if (map->table[pos].key == index) {
+                return &map->table[pos];
+            }
+        }
+        return NULL;
+    }
+    return mp_map_compact_lookup(map, index, lookup_kind, compare_only_ptrs);
+    #else
+
     // map is a hash table (not an ordered array), so do a hash lookup
 
     if (map->alloc == 0) {
@@ -283,6 +548,7 @@ mp_map_elem_t *mp_map_lookup(mp_map_t *map, mp_obj_t index, mp_map_lookup_kind_t
             }
         }
     }
+    #endif
 }
 
 /******************************************************************************/
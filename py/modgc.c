@@ -27,19 +27,38 @@
 #include "py/mpstate.h"
 #include "py/obj.h"
 #include "py/gc.h"
+#include "py/runtime.h"
 
 #if MICROPY_PY_GC && MICROPY_ENABLE_GC
 
-// collect(): run a garbage collection
-STATIC mp_obj_t py_gc_collect(void) {
+// collect([budget_us]): run a garbage collection, or with MICROPY_GC_INCREMENTAL
+// work on an incremental one for up to budget_us and return whether that
+// completed it
+STATIC mp_obj_t py_gc_collect(size_t n_args, const mp_obj_t *args) {
+    #if MICROPY_GC_INCREMENTAL
+    if (n_args > 0) {
+        mp_int_t budget = mp_obj_get_int(args[0]);
+        if (budget <= 0) {
+            mp_raise_ValueError(NULL);
+        }
+        return mp_obj_new_bool(gc_collect_step(budget));
+    }
+    #else
+    (void)n_args;
+    (void)args;
+    #endif
     gc_collect();
+    #if MICROPY_GC_FINALISER_QUEUE
+    // finalise what was found dead before returning, as without the queue
+    gc_run_finalisers((size_t)-1);
+    #endif
     #if MICROPY_PY_GC_COLLECT_RETVAL
     return MP_OBJ_NEW_SMALL_INT(MP_STATE_MEM(gc_collected));
     #else
     return mp_const_none;
     #endif
 }
-MP_DEFINE_CONST_FUN_OBJ_0(gc_collect_obj, py_gc_collect);
+MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(gc_collect_obj, 0, MICROPY_GC_INCREMENTAL, py_gc_collect);
 
 // disable(): disable the garbage collector
 STATIC mp_obj_t gc_disable(void) {
@@ -95,6 +114,66 @@ STATIC mp_obj_t gc_threshold(size_t n_args, const mp_obj_t *args) {
 MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(gc_threshold_obj, 0, 1, gc_threshold);
 #endif
 
+#if MICROPY_GC_INCREMENTAL
+// incremental([budget_us]): get or set the time budget of the slices of
+// collection done as memory is allocated; 0 collects all at once
+STATIC mp_obj_t gc_incremental(size_t n_args, const mp_obj_t *args) {
+    if (n_args == 0) {
+        return mp_obj_new_int_from_uint(MP_STATE_MEM(gc_slice_us));
+    }
+    mp_int_t val = mp_obj_get_int(args[0]);
+    if (val < 0) {
+        mp_raise_ValueError(NULL);
+    }
+    MP_STATE_MEM(gc_slice_us) = val;
+    return mp_const_none;
+}
+MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(gc_incremental_obj, 0, 1, gc_incremental);
+#endif
+
+#if MICROPY_GC_GENERATIONAL
+// nursery([n_bytes]): get or set how much is allocated between collections
+// of the young generation; 0 only collects everything at once
+STATIC mp_obj_t gc_nursery(size_t n_args, const mp_obj_t *args) {
+    if (n_args == 0) {
+        return mp_obj_new_int_from_uint(MP_STATE_MEM(gc_nursery) * MICROPY_BYTES_PER_GC_BLOCK);
+    }
+    mp_int_t val = mp_obj_get_int(args[0]);
+    if (val < 0) {
+        mp_raise_ValueError(NULL);
+    }
+    MP_STATE_MEM(gc_nursery) = (val + MICROPY_BYTES_PER_GC_BLOCK - 1) / MICROPY_BYTES_PER_GC_BLOCK;
+    MP_STATE_MEM(gc_nursery_shift) = 0;
+    return mp_const_none;
+}
+MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(gc_nursery_obj, 0, 1, gc_nursery);
+#endif
+
+#if MICROPY_GC_FINALISER_QUEUE
+// finalisers(): return the number of objects waiting for their finaliser, the
+// most there have been, the finalisers run from the queue and those run by
+// the sweep as the queue was full
+STATIC mp_obj_t gc_finalisers(void) {
+    mp_obj_t items[] = {
+        mp_obj_new_int_from_uint(MP_STATE_MEM(gc_fin_len)),
+        mp_obj_new_int_from_uint(MP_STATE_MEM(gc_fin_max)),
+        mp_obj_new_int_from_uint(MP_STATE_MEM(gc_fin_run)),
+        mp_obj_new_int_from_uint(MP_STATE_MEM(gc_fin_full)),
+    };
+    return mp_obj_new_tuple(MP_ARRAY_SIZE(items), items);
+}
+MP_DEFINE_CONST_FUN_OBJ_0(gc_finalisers_obj, gc_finalisers);
+#endif
+
+#if MICROPY_GC_COMPACT
+// compact(): collect, then move buffers down the heap to join up its free
+// blocks; return how many were moved
+STATIC mp_obj_t py_gc_compact(void) {
+    return mp_obj_new_int_from_uint(gc_compact());
+}
+MP_DEFINE_CONST_FUN_OBJ_0(gc_compact_obj, py_gc_compact);
+#endif
+
 STATIC const mp_rom_map_elem_t mp_module_gc_globals_table[] = {
     { MP_ROM_QSTR(MP_QSTR___name__), MP_ROM_QSTR(MP_QSTR_gc) },
     { MP_ROM_QSTR(MP_QSTR_collect), MP_ROM_PTR(&gc_collect_obj) },
@@ -106,6 +185,18 @@ STATIC const mp_rom_map_elem_t mp_module_gc_globals_table[] = {
     #if MICROPY_GC_ALLOC_THRESHOLD
     { MP_ROM_QSTR(MP_QSTR_threshold), MP_ROM_PTR(&gc_threshold_obj) },
     #endif
+    #if MICROPY_GC_INCREMENTAL
+    { MP_ROM_QSTR(MP_QSTR_incremental), MP_ROM_PTR(&gc_incremental_obj) },
+    #endif
+    #if MICROPY_GC_GENERATIONAL
+    { MP_ROM_QSTR(MP_QSTR_nursery), MP_ROM_PTR(&gc_nursery_obj) },
+    #endif
+    #if MICROPY_GC_FINALISER_QUEUE
+    { MP_ROM_QSTR(MP_QSTR_finalisers), MP_ROM_PTR(&gc_finalisers_obj) },
+    #endif
+    #if MICROPY_GC_COMPACT
+    { MP_ROM_QSTR(MP_QSTR_compact), MP_ROM_PTR(&gc_compact_obj) },
+    #endif
 };
 
 STATIC MP_DEFINE_CONST_DICT(mp_module_gc_globals, mp_module_gc_globals_table);
@@ -140,6 +140,66 @@ STATIC mp_obj_t mp_micropython_heap_locked(void) {
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_0(mp_micropython_heap_locked_obj, mp_micropython_heap_locked);
 #endif
+
+#if MICROPY_GC_ALLOC_PROFILE
+// Number of types told apart by heap_snapshot(), the others are counted as None.
+#define HEAP_SNAPSHOT_TYPES (32)
+
+STATIC mp_obj_t heap_snapshot_totals(const gc_profile_entry_t *e) {
+    mp_obj_t items[2] = { mp_obj_new_int_from_uint(e->count), mp_obj_new_int_from_uint(e->n_bytes) };
+    return mp_obj_new_tuple(2, items);
+}
+
+// heap_snapshot(): return two dicts of (count, bytes) of the allocated blocks,
+// by type and by allocation site, (file, line, function) or None if unknown.
+STATIC mp_obj_t mp_micropython_heap_snapshot(void) {
+    gc_profile_entry_t *types = m_new(gc_profile_entry_t, HEAP_SNAPSHOT_TYPES);
+    gc_profile_entry_t *sites = m_new(gc_profile_entry_t, MICROPY_GC_ALLOC_PROFILE_SITES + 1);
+    gc_profile(types, HEAP_SNAPSHOT_TYPES, sites);
+
+    mp_obj_t by_type = mp_obj_new_dict(0);
+    for (size_t i = 0; i < HEAP_SNAPSHOT_TYPES; i++) {
+        if (types[i].count != 0) {
+            mp_obj_t key = i == 0 ? mp_const_none : MP_OBJ_FROM_PTR(types[i].key);
+            mp_obj_dict_store(by_type, key, heap_snapshot_totals(&types[i]));
+        }
+    }
+    mp_obj_t by_site = mp_obj_new_dict(0);
+    for (size_t i = 0; i <= MICROPY_GC_ALLOC_PROFILE_SITES; i++) {
+        if (sites[i].count != 0) {
+            mp_obj_t key = mp_const_none;
+            if (i != 0) {
+                const mp_gc_alloc_site_t *site = &MP_STATE_MEM(gc_sites)[i - 1];
+                mp_obj_t items[3] = {
+                    MP_OBJ_NEW_QSTR(site->source_file),
+                    MP_OBJ_NEW_SMALL_INT(site->line),
+                    MP_OBJ_NEW_QSTR(site->block_name),
+                };
+                key = mp_obj_new_tuple(3, items);
+            }
+            mp_obj_dict_store(by_site, key, heap_snapshot_totals(&sites[i]));
+        }
+    }
+    m_del(gc_profile_entry_t, types, HEAP_SNAPSHOT_TYPES);
+    m_del(gc_profile_entry_t, sites, MICROPY_GC_ALLOC_PROFILE_SITES + 1);
+
+    mp_obj_t items[2] = { by_type, by_site };
+    return mp_obj_new_tuple(2, items);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_0(mp_micropython_heap_snapshot_obj, mp_micropython_heap_snapshot);
+#endif
+#endif
+
+#if MICROPY_OPT_INLINE_CACHE_STATS
+STATIC mp_obj_t mp_micropython_inline_cache_stats(void) {
+    mp_obj_t items[3] = {
+        mp_obj_new_int_from_uint(MP_STATE_VM(inline_cache_hits)),
+        mp_obj_new_int_from_uint(MP_STATE_VM(inline_cache_poly_hits)),
+        mp_obj_new_int_from_uint(MP_STATE_VM(inline_cache_misses)),
+    };
+    return mp_obj_new_tuple(3, items);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_0(mp_micropython_inline_cache_stats_obj, mp_micropython_inline_cache_stats);
 #endif
 
 #if MICROPY_ENABLE_EMERGENCY_EXCEPTION_BUF && (MICROPY_EMERGENCY_EXCEPTION_BUF_SIZE == 0)
@@ -182,6 +242,9 @@ STATIC const mp_rom_map_elem_t mp_module_micropython_globals_table[] = {
     #if MICROPY_PY_MICROPYTHON_STACK_USE
     { MP_ROM_QSTR(MP_QSTR_stack_use), MP_ROM_PTR(&mp_micropython_stack_use_obj) },
     #endif
+    #if MICROPY_OPT_INLINE_CACHE_STATS
+    { MP_ROM_QSTR(MP_QSTR_inline_cache_stats), MP_ROM_PTR(&mp_micropython_inline_cache_stats_obj) },
+    #endif
     #if MICROPY_ENABLE_EMERGENCY_EXCEPTION_BUF && (MICROPY_EMERGENCY_EXCEPTION_BUF_SIZE == 0)
     { MP_ROM_QSTR(MP_QSTR_alloc_emergency_exception_buf), MP_ROM_PTR(&mp_alloc_emergency_exception_buf_obj) },
     #endif
@@ -194,6 +257,9 @@ STATIC const mp_rom_map_elem_t mp_module_micropython_globals_table[] = {
     #if MICROPY_PY_MICROPYTHON_HEAP_LOCKED
     { MP_ROM_QSTR(MP_QSTR_heap_locked), MP_ROM_PTR(&mp_micropython_heap_locked_obj) },
     #endif
+    #if MICROPY_GC_ALLOC_PROFILE
+    { MP_ROM_QSTR(MP_QSTR_heap_snapshot), MP_ROM_PTR(&mp_micropython_heap_snapshot_obj) },
+    #endif
     #endif
     #if MICROPY_KBD_EXCEPTION
     { MP_ROM_QSTR(MP_QSTR_kbd_intr), MP_ROM_PTR(&mp_micropython_kbd_intr_obj) },
@@ -28,6 +28,7 @@
 #include <string.h>
 
 #include "py/runtime.h"
+#include "py/gc.h"
 #include "py/stackctrl.h"
 
 #if MICROPY_PY_THREAD
@@ -174,6 +175,26 @@ STATIC void *thread_entry(void *args_in) {
     // The GC starts off unlocked on this thread.
     ts.gc_lock_depth = 0;
 
+    #if MICROPY_GC_ALLOC_PROFILE
+    // no bytecode is running on this thread yet
+    ts.current_code_state = NULL;
+    #endif
+
+    #if MICROPY_GC_TLAB
+    // The thread claims a TLAB on its first small allocation.
+    ts.gc_tlab.area = NULL;
+    ts.gc_tlab.block = ts.gc_tlab.end = 0;
+    ts.gc_tlab.busy = false;
+    #endif
+
+    #if MICROPY_OPT_METHOD_CACHE
+    // The thread starts with an empty method cache.
+    memset(ts.method_cache, 0, sizeof(ts.method_cache));
+    #endif
+    #if MICROPY_OPT_INLINE_CACHE
+    memset(ts.inline_cache, 0, sizeof(ts.inline_cache));
+    #endif
+
     // set locals and globals from the calling context
     mp_locals_set(args->dict_locals);
     mp_globals_set(args->dict_globals);
@@ -210,6 +231,10 @@ STATIC void *thread_entry(void *args_in) {
 
     DEBUG_printf("[thread] finish ts=%p\n", &ts);
 
+    #if MICROPY_GC_TLAB
+    gc_tlab_release();
+    #endif
+
     // signal that we are finished
     mp_thread_finish();
 
@@ -143,6 +143,136 @@
 #define MICROPY_GC_STACK_ENTRY_TYPE size_t
 #endif
 
+// Whether to share the mark phase of a collection between several threads or
+// cores.  The port provides the helpers and the lock through
+// mp_thread_gc_mark_parallel() and friends, see py/mpthread.h.
+#ifndef MICROPY_GC_PARALLEL_MARK
+#define MICROPY_GC_PARALLEL_MARK (0)
+#endif
+
+// Most threads or cores, including the collecting one, that take part in the
+// mark phase.  Each one but the first has a GC stack of its own.
+#ifndef MICROPY_GC_PARALLEL_MARK_WORKERS
+#define MICROPY_GC_PARALLEL_MARK_WORKERS (2)
+#endif
+
+// Whether gc_alloc() first looks for space in lists of free runs of blocks,
+// kept by size class and rebuilt on each collection, before scanning the ATB.
+#ifndef MICROPY_GC_FREE_LISTS
+#define MICROPY_GC_FREE_LISTS (0)
+#endif
+
+// Number of free runs each size class can hold.
+#ifndef MICROPY_GC_FREE_LIST_LEN
+#define MICROPY_GC_FREE_LIST_LEN (16)
+#endif
+
+// Whether each thread takes one-block objects from a run of blocks of its
+// own, its TLAB, without taking the GC lock.  Needs threads without the GIL,
+// and the port's barriers mp_thread_gc_fence() and friends, see
+// py/mpthread.h.
+#ifndef MICROPY_GC_TLAB
+#define MICROPY_GC_TLAB (0)
+#endif
+
+// Most blocks in a TLAB.
+#ifndef MICROPY_GC_TLAB_BLOCKS
+#define MICROPY_GC_TLAB_BLOCKS (64)
+#endif
+
+// Whether the heap can be made of several areas, the first given to gc_init()
+// and the others added later with gc_add().
+#ifndef MICROPY_GC_SPLIT_HEAP
+#define MICROPY_GC_SPLIT_HEAP (0)
+#endif
+
+// Whether gc_alloc() asks the port for a new heap area, through
+// gc_try_add_heap(), when a collection did not free enough memory.
+#ifndef MICROPY_GC_SPLIT_HEAP_AUTO
+#define MICROPY_GC_SPLIT_HEAP_AUTO (0)
+#endif
+
+// Whether the GC can collect incrementally, in slices of bounded time driven
+// by allocation (run by the scheduler, which must be enabled) or by
+// gc.collect(budget_us), instead of all at once.  Code storing a heap pointer
+// into an existing heap object must then call MP_GC_WRITE_BARRIER on that
+// object, see py/gc.h.
+#ifndef MICROPY_GC_INCREMENTAL
+#define MICROPY_GC_INCREMENTAL (0)
+#endif
+
+// Number of objects changed during an incremental mark that are remembered
+// for a rescan; when full, they are rescanned at once to make room.
+#ifndef MICROPY_GC_INCREMENTAL_REMEMBER
+#define MICROPY_GC_INCREMENTAL_REMEMBER (64)
+#endif
+
+// Whether the GC keeps a young generation: objects allocated since the last
+// collection, collected on their own (run by the scheduler, which must be
+// enabled) each time the nursery is full, with the survivors promoted in
+// place.  Code storing a heap pointer into an existing heap object must then
+// call MP_GC_WRITE_BARRIER on that object, see py/gc.h.  Takes two bits per
+// block of heap.  Cannot be combined with MICROPY_GC_INCREMENTAL.
+#ifndef MICROPY_GC_GENERATIONAL
+#define MICROPY_GC_GENERATIONAL (0)
+#endif
+
+// Whether the GC records the allocation site of each block, the source line
+// of the bytecode running at the time, for micropython.heap_snapshot().  This
+// takes a byte per block of heap.
+#ifndef MICROPY_GC_ALLOC_PROFILE
+#define MICROPY_GC_ALLOC_PROFILE (0)
+#endif
+
+// Number of distinct allocation sites recorded (at most 255); the blocks
+// allocated from further sites are counted with those not allocated from
+// bytecode.
+#ifndef MICROPY_GC_ALLOC_PROFILE_SITES
+#define MICROPY_GC_ALLOC_PROFILE_SITES (64)
+#endif
+
+// Whether the GC can close up the free space between blocks by moving
+// buffers down the heap (the items of lists and arrays, the tables of dicts
+// and of the members of instances, the data of str and bytes): on
+// gc.compact(), and when gc_alloc() finds no room even after a collection.
+// A buffer only moves when the field of its object is the one pointer to it
+// the collection finds, so one handed to hardware must also be pointed to
+// from memory the GC scans.  This takes another 2 bits per block of heap.
+#ifndef MICROPY_GC_COMPACT
+#define MICROPY_GC_COMPACT (0)
+#endif
+
+// Whether C code can register static storage outside mp_state_ctx that holds
+// object pointers, to be traced as roots, with gc_root_add().
+#ifndef MICROPY_GC_ROOTS
+#define MICROPY_GC_ROOTS (0)
+#endif
+
+// Number of regions of storage that can be registered as roots.
+#ifndef MICROPY_GC_ROOTS_LEN
+#define MICROPY_GC_ROOTS_LEN (8)
+#endif
+
+// Whether a collection queues the dead objects that have a __del__ method,
+// keeping them and what they point to alive, instead of running it during the
+// sweep; the scheduler then runs the queued finalisers a few at a time, and
+// gc.collect() all of them before it returns.  Needs MICROPY_ENABLE_FINALISER
+// and MICROPY_ENABLE_SCHEDULER.
+#ifndef MICROPY_GC_FINALISER_QUEUE
+#define MICROPY_GC_FINALISER_QUEUE (0)
+#endif
+
+// Most objects in the finaliser queue; the finalisers of those that do not
+// fit are run by the sweep.
+#ifndef MICROPY_GC_FINALISER_QUEUE_LEN
+#define MICROPY_GC_FINALISER_QUEUE_LEN (16)
+#endif
+
+// Number of queued finalisers the scheduler runs in one go.
+#ifndef MICROPY_GC_FINALISER_BATCH
+#define MICROPY_GC_FINALISER_BATCH (4)
+#endif
+
 // Be conservative and always clear to zero newly (re)allocated memory in the GC.
 // This helps eliminate stray pointers that hold on to memory that's no longer
 // used.  It decreases performance due to unnecessary memory clearing.
@@ -497,6 +627,70 @@
 #define MICROPY_OPT_CACHE_MAP_LOOKUP_IN_BYTECODE (0)
 #endif
 
+// Whether to cache, per thread, where attributes of user classes are found in
+// their MRO, so that repeated method lookups on instances of the same class
+// take one probe of a small table instead of a map lookup per base class.
+// Uses MICROPY_OPT_METHOD_CACHE_SIZE entries of 5 words in each thread's state,
+// and a copy of the locals dict of each class created.
+#ifndef MICROPY_OPT_METHOD_CACHE
+#define MICROPY_OPT_METHOD_CACHE (0)
+#endif
+
+// Number of entries in the method cache, must be a power of 2
+#ifndef MICROPY_OPT_METHOD_CACHE_SIZE
+#define MICROPY_OPT_METHOD_CACHE_SIZE (32)
+#endif
+
+// Whether LOAD_ATTR and LOAD_METHOD bytecodes on instances of user classes
+// cache, per thread and per bytecode site, what they load from the class for
+// up to MICROPY_OPT_INLINE_CACHE_WAYS types.  A site whose cache holds the type
+// of the instance then only has to check the instance's own members.  The
+// caches are invalidated along with the method cache, which this requires.
+#ifndef MICROPY_OPT_INLINE_CACHE
+#define MICROPY_OPT_INLINE_CACHE (0)
+#endif
+
+// Number of sites in the inline caches of a thread, must be a power of 2
+#ifndef MICROPY_OPT_INLINE_CACHE_SIZE
+#define MICROPY_OPT_INLINE_CACHE_SIZE (64)
+#endif
+
+// Number of types cached for each site
+#ifndef MICROPY_OPT_INLINE_CACHE_WAYS
+#define MICROPY_OPT_INLINE_CACHE_WAYS (2)
+#endif
+
+// Whether to count hits and misses of the inline caches, for
+// micropython.inline_cache_stats()
+#ifndef MICROPY_OPT_INLINE_CACHE_STATS
+#define MICROPY_OPT_INLINE_CACHE_STATS (0)
+#endif
+
+// Whether the VM rewrites, as code runs, the opcodes of binary ops on small ints
+// and of subscripts of lists into versions specialised for those operands.  A
+// specialised op whose operands change is rewritten back.  Only bytecode in the
+// heap is rewritten, and it can't be used with sys.settrace.
+#ifndef MICROPY_OPT_QUICKEN
+#define MICROPY_OPT_QUICKEN (0)
+#endif
+
+// Whether to keep a hash table of all qstrs, so that finding an interned string
+// doesn't scan every qstr pool.  Uses 8 bytes of heap per slot, with up to 4
+// slots per qstr, including those in ROM.
+#ifndef MICROPY_OPT_QSTR_INDEX
+#define MICROPY_OPT_QSTR_INDEX (0)
+#endif
+
+// Whether maps, other than fixed tables in ROM, keep their entries in the order
+// they were added, with the hash of each cached next to it and a separate index
+// searched with Robin Hood probing.  Makes every dict ordered.  Uses 10 to 16
+// more bytes of heap per entry, 4 for the hash and 6 to 12 for the index, e.g.
+// a 700-entry dict on x86-64 takes 26.5k instead of 16k.  The larger tables are
+// also harder to fit in a fragmented heap.
+#ifndef MICROPY_OPT_MAP_COMPACT
+#define MICROPY_OPT_MAP_COMPACT (0)
+#endif
+
 // Whether to use fast versions of bitwise operations (and, or, xor) when the
 // arguments are both positive.  Increases Thumb2 code size by about 250 bytes.
 #ifndef MICROPY_OPT_MPZ_BITWISE
@@ -583,6 +777,14 @@
 #define MICROPY_STACK_CHECK (0)
 #endif
 
+// Whether a port can fill the unused part of a C stack with a pattern, with
+// mp_stack_fill(), and later find the deepest the stack has been used, with
+// mp_stack_high_water(), to trace only that much of the stack of a thread
+// it cannot stop.
+#ifndef MICROPY_STACK_HIGH_WATER
+#define MICROPY_STACK_HIGH_WATER (0)
+#endif
+
 // Whether to have an emergency exception buffer
 #ifndef MICROPY_ENABLE_EMERGENCY_EXCEPTION_BUF
 #define MICROPY_ENABLE_EMERGENCY_EXCEPTION_BUF (0)
@@ -1716,6 +1918,9 @@ typedef double mp_float_t;
 #if MICROPY_COMP_CONST
 #error "MICROPY_PY_SYS_SETTRACE requires MICROPY_COMP_CONST to be disabled"
 #endif
+#if MICROPY_OPT_QUICKEN
+#error "MICROPY_PY_SYS_SETTRACE requires MICROPY_OPT_QUICKEN to be disabled"
+#endif
 #endif
 
 #endif // MICROPY_INCLUDED_PY_MPCONFIG_H
@@ -62,12 +62,41 @@ typedef struct _mp_sched_item_t {
     mp_obj_t arg;
 } mp_sched_item_t;
 
-// This structure hold information about the memory allocation system.
-typedef struct _mp_state_mem_t {
-    #if MICROPY_MEM_STATS
-    size_t total_bytes_allocated;
-    size_t current_bytes_allocated;
-    size_t peak_bytes_allocated;
+#if MICROPY_GC_FREE_LISTS
+// Runs of free blocks of one size class, see gc_alloc().
+#define MP_GC_FREE_CLASSES (5)
+typedef struct _mp_gc_free_list_t {
+    size_t len;
+    struct {
+        size_t block;
+        size_t n_blocks;
+    } run[MICROPY_GC_FREE_LIST_LEN];
+} mp_gc_free_list_t;
+#endif
+
+#if MICROPY_GC_ROOTS
+// Static storage holding object pointers, see gc_root_add().
+typedef struct _mp_gc_root_t {
+    void **ptrs;
+    size_t len;
+} mp_gc_root_t;
+#endif
+
+#if MICROPY_GC_ALLOC_PROFILE
+// A source line blocks were allocated from, see micropython.heap_snapshot().
+typedef struct _mp_gc_alloc_site_t {
+    qstr source_file;
+    qstr block_name;
+    size_t line;
+} mp_gc_alloc_site_t;
+#endif
+
+// One contiguous area of the heap: its allocation, finaliser, young, site and
+// reference tables and the pool of blocks they describe.  Block numbers are
+// relative to the area.
+typedef struct _mp_state_mem_area_t {
+    #if MICROPY_GC_SPLIT_HEAP
+    struct _mp_state_mem_area_t *next;
     #endif
 
     byte *gc_alloc_table_start;
@@ -75,11 +104,180 @@ typedef struct _mp_state_mem_t {
     #if MICROPY_ENABLE_FINALISER
     byte *gc_finaliser_table_start;
     #endif
+    #if MICROPY_GC_GENERATIONAL
+    byte *gc_young_table_start;
+    byte *gc_changed_table_start;
+    #endif
+    #if MICROPY_GC_ALLOC_PROFILE
+    byte *gc_site_table_start;
+    #endif
+    #if MICROPY_GC_COMPACT
+    byte *gc_ref_table_start;
+    #endif
     byte *gc_pool_start;
     byte *gc_pool_end;
 
+    size_t gc_last_free_atb_index;
+    // no run of two or more free blocks starts before this ATB index
+    size_t gc_last_free_run_atb_index;
+
+    #if MICROPY_GC_TLAB
+    // Where the next TLAB is looked for, see gc_alloc().
+    size_t gc_tlab_block;
+    #endif
+
+    #if MICROPY_GC_FREE_LISTS
+    mp_gc_free_list_t gc_free_list[MP_GC_FREE_CLASSES];
+    #endif
+} mp_state_mem_area_t;
+
+#if MICROPY_GC_TLAB
+// A thread's TLAB: the blocks from block up to end of area, each allocated as
+// a head, that the thread carves objects off the front of, see gc_alloc().
+// The TLABs of all threads are listed through next.
+typedef struct _mp_gc_tlab_t {
+    struct _mp_gc_tlab_t *next;
+    mp_state_mem_area_t *area;
+    size_t block;
+    size_t end;
+    volatile bool busy;
+} mp_gc_tlab_t;
+#endif
+
+// This structure hold information about the memory allocation system.
+typedef struct _mp_state_mem_t {
+    #if MICROPY_MEM_STATS
+    size_t total_bytes_allocated;
+    size_t current_bytes_allocated;
+    size_t peak_bytes_allocated;
+    #endif
+
+    // The first heap area, given to gc_init().
+    mp_state_mem_area_t area;
+
+    #if MICROPY_GC_SPLIT_HEAP
+    // Lowest and highest addresses over the pools of all areas.
+    byte *gc_lowest_ptr;
+    byte *gc_highest_ptr;
+    #endif
+
     int gc_stack_overflow;
     MICROPY_GC_STACK_ENTRY_TYPE gc_stack[MICROPY_ALLOC_GC_STACK_SIZE];
+    #if MICROPY_GC_SPLIT_HEAP
+    // The area of each block on gc_stack, and likewise below.
+    mp_state_mem_area_t *gc_area_stack[MICROPY_ALLOC_GC_STACK_SIZE];
+    #endif
+
+    #if MICROPY_GC_PARALLEL_MARK
+    // Blocks marked but not yet traced, shared by the mark workers, and the
+    // stacks of all workers but the one using gc_stack.
+    MICROPY_GC_STACK_ENTRY_TYPE gc_mark_pool[MICROPY_ALLOC_GC_STACK_SIZE];
+    MICROPY_GC_STACK_ENTRY_TYPE gc_mark_stack[MICROPY_GC_PARALLEL_MARK_WORKERS - 1][MICROPY_ALLOC_GC_STACK_SIZE];
+    #if MICROPY_GC_SPLIT_HEAP
+    mp_state_mem_area_t *gc_mark_pool_area[MICROPY_ALLOC_GC_STACK_SIZE];
+    mp_state_mem_area_t *gc_mark_area_stack[MICROPY_GC_PARALLEL_MARK_WORKERS - 1][MICROPY_ALLOC_GC_STACK_SIZE];
+    #endif
+    volatile size_t gc_mark_pool_len;
+    volatile uint8_t gc_mark_workers;
+    volatile uint8_t gc_mark_idle;
+    #endif
+
+    #if MICROPY_GC_INCREMENTAL
+    // State of an incremental collection, see gc_collect_step().  Between
+    // slices of the mark, gc_stack holds gc_sp blocks marked but not fully
+    // traced, each as far as the word at gc_stack_pos.  gc_slicing is the
+    // budget of the step under way, 0 outside one.
+    uint8_t gc_phase;
+    uint8_t gc_remarks;
+    mp_uint_t gc_slicing;
+    size_t gc_sp;
+    size_t gc_stack_pos[MICROPY_ALLOC_GC_STACK_SIZE];
+    // Marked blocks changed since, to be traced again.
+    size_t gc_remember_len;
+    MICROPY_GC_STACK_ENTRY_TYPE gc_remember[MICROPY_GC_INCREMENTAL_REMEMBER];
+    #if MICROPY_GC_SPLIT_HEAP
+    mp_state_mem_area_t *gc_remember_area[MICROPY_GC_INCREMENTAL_REMEMBER];
+    #endif
+    // Position of the sweep, or of the walk tracing marked blocks again after
+    // gc_stack overflowed; the area is NULL when not walking.
+    mp_state_mem_area_t *gc_walk_area;
+    size_t gc_walk_block;
+    int gc_sweep_free_tail;
+    // Time budget of allocation-driven slices, 0 to collect all at once, and
+    // whether the scheduler is to run one.
+    mp_uint_t gc_slice_us;
+    bool gc_step_due;
+    // Blocks allocated and not yet paid for by a slice, how many start the
+    // next cycle, how many pay for a slice, the free blocks counted by the
+    // sweep and the slices done in this cycle.
+    size_t gc_inc_alloc;
+    size_t gc_inc_trigger;
+    size_t gc_inc_interval;
+    size_t gc_inc_free;
+    size_t gc_inc_slices;
+    // Pause statistics, in microseconds.
+    mp_uint_t gc_pause_start;
+    mp_uint_t gc_pause_max;
+    mp_uint_t gc_pause_total;
+    size_t gc_pause_count;
+    #endif
+
+    #if MICROPY_GC_GENERATIONAL
+    // State of the young generation, see gc_collect_young().  gc_minor is set
+    // during a young collection, gc_young counts the blocks allocated since
+    // the last collection and gc_nursery how many start a young one, doubled
+    // gc_nursery_shift times, which gc_step_due asks the scheduler for.
+    bool gc_minor;
+    bool gc_step_due;
+    uint8_t gc_nursery_shift;
+    size_t gc_young;
+    size_t gc_nursery;
+    // Young collection statistics, pauses in microseconds.
+    size_t gc_minor_count;
+    mp_uint_t gc_minor_max;
+    mp_uint_t gc_minor_total;
+    #endif
+
+    #if MICROPY_GC_ALLOC_PROFILE
+    // Allocation sites, numbered from 1 in the site table (0 is for blocks
+    // not allocated from bytecode), and the last one looked up.
+    mp_gc_alloc_site_t gc_sites[MICROPY_GC_ALLOC_PROFILE_SITES];
+    size_t gc_sites_len;
+    const byte *gc_site_ip;
+    byte gc_site_last;
+    #endif
+
+    #if MICROPY_GC_ROOTS
+    mp_gc_root_t gc_roots[MICROPY_GC_ROOTS_LEN];
+    size_t gc_roots_len;
+    #endif
+
+    #if MICROPY_GC_FINALISER_QUEUE
+    // Dead objects waiting for their finaliser, a ring of gc_fin_len from
+    // gc_fin_idx traced as roots, with unused entries NULL; whether the
+    // scheduler is to run some; and whether gc_sweep_all() is under way, when
+    // the sweep runs them all.
+    void *gc_fin_queue[MICROPY_GC_FINALISER_QUEUE_LEN];
+    size_t gc_fin_idx;
+    size_t gc_fin_len;
+    bool gc_fin_due;
+    bool gc_fin_sweep_all;
+    // Statistics: the most objects queued at once, the finalisers run from
+    // the queue, and those run by the sweep as the queue was full.
+    size_t gc_fin_max;
+    size_t gc_fin_run;
+    size_t gc_fin_full;
+    #endif
+
+    #if MICROPY_GC_COMPACT
+    // Buffers moved by the compaction under way, which gc_compact_thread
+    // started.
+    size_t gc_compact_moved;
+    bool gc_compacting;
+    #if MICROPY_PY_THREAD && !MICROPY_PY_THREAD_GIL
+    void *gc_compact_thread;
+    #endif
+    #endif
 
     // This variable controls auto garbage collection.  If set to 0 then the
     // GC won't automatically run when gc_alloc can't find enough blocks.  But
@@ -91,8 +289,6 @@ typedef struct _mp_state_mem_t {
     size_t gc_alloc_threshold;
     #endif
 
-    size_t gc_last_free_atb_index;
-
     #if MICROPY_PY_GC_COLLECT_RETVAL
     size_t gc_collected;
     #endif
@@ -101,6 +297,12 @@ typedef struct _mp_state_mem_t {
     // This is a global mutex used to make the GC thread-safe.
     mp_thread_mutex_t gc_mutex;
     #endif
+
+    #if MICROPY_GC_TLAB
+    // The TLABs of the threads, and whether a collection has stopped them.
+    mp_gc_tlab_t *gc_tlabs;
+    volatile bool gc_tlab_stop;
+    #endif
 } mp_state_mem_t;
 
 // This structure hold runtime and VM information.  It includes a section
@@ -115,6 +317,10 @@ typedef struct _mp_state_vm_t {
 
     qstr_pool_t *last_pool;
 
+    #if MICROPY_OPT_QSTR_INDEX
+    qstr_index_t *qstr_index;
+    #endif
+
     // non-heap memory for creating an exception if we can't allocate RAM
     mp_obj_exception_t mp_emergency_exception_obj;
 
@@ -227,6 +433,17 @@ typedef struct _mp_state_vm_t {
     mp_int_t mp_emergency_exception_buf_size;
     #endif
 
+    #if MICROPY_OPT_METHOD_CACHE
+    // incremented to invalidate the method caches of all threads
+    size_t method_cache_epoch;
+    #endif
+
+    #if MICROPY_OPT_INLINE_CACHE_STATS
+    size_t inline_cache_hits;
+    size_t inline_cache_poly_hits;
+    size_t inline_cache_misses;
+    #endif
+
     #if MICROPY_ENABLE_SCHEDULER
     volatile int16_t sched_state;
     uint8_t sched_len;
@@ -239,6 +456,35 @@ typedef struct _mp_state_vm_t {
     #endif
 } mp_state_vm_t;
 
+#if MICROPY_OPT_METHOD_CACHE
+// An entry of a thread's method cache: attr of instances of type is found in
+// the locals dict of found_type (NULL if in none of the MRO) with value value.
+// The entry is valid only while epoch equals the global method cache epoch.
+typedef struct _mp_method_cache_entry_t {
+    const mp_obj_type_t *type;
+    qstr attr;
+    const mp_obj_type_t *found_type;
+    mp_obj_t value;
+    size_t epoch;
+} mp_method_cache_entry_t;
+#endif
+
+#if MICROPY_OPT_INLINE_CACHE
+// The inline cache of a bytecode site of a thread: loading the attribute from
+// an instance of type gives value, bound to self, or to the instance if self
+// is MP_OBJ_SENTINEL.  Most recently filled ways come first.  The cache is
+// valid only while epoch equals the global method cache epoch.
+typedef struct _mp_inline_cache_t {
+    const byte *site;
+    size_t epoch;
+    struct {
+        const mp_obj_type_t *type;
+        mp_obj_t value;
+        mp_obj_t self;
+    } way[MICROPY_OPT_INLINE_CACHE_WAYS];
+} mp_inline_cache_t;
+#endif
+
 // This structure holds state that is specific to a given thread.
 // Everything in this structure is scanned for root pointers.
 typedef struct _mp_state_thread_t {
@@ -258,6 +504,18 @@ typedef struct _mp_state_thread_t {
     // Locking of the GC is done per thread.
     uint16_t gc_lock_depth;
 
+    #if MICROPY_GC_TLAB
+    mp_gc_tlab_t gc_tlab;
+    #endif
+
+    #if MICROPY_OPT_METHOD_CACHE
+    mp_method_cache_entry_t method_cache[MICROPY_OPT_METHOD_CACHE_SIZE];
+    #endif
+
+    #if MICROPY_OPT_INLINE_CACHE
+    mp_inline_cache_t inline_cache[MICROPY_OPT_INLINE_CACHE_SIZE];
+    #endif
+
     ////////////////////////////////////////////////////////////
     // START ROOT POINTER SECTION
     // Everything that needs GC scanning must start here, and
@@ -272,6 +530,8 @@ typedef struct _mp_state_thread_t {
     #if MICROPY_PY_SYS_SETTRACE
     mp_obj_t prof_trace_callback;
     bool prof_callback_is_executing;
+    #endif
+    #if MICROPY_PY_SYS_SETTRACE || MICROPY_GC_ALLOC_PROFILE
     struct _mp_code_state_t *current_code_state;
     #endif
 } mp_state_thread_t;
@@ -49,6 +49,28 @@ void mp_thread_mutex_unlock(mp_thread_mutex_t *mutex);
 
 #endif // MICROPY_PY_THREAD
 
+#if MICROPY_GC_PARALLEL_MARK
+// Run gc_mark_worker() on the port's helper threads or cores as well as on the
+// calling thread, and return once all of them have finished.
+void mp_thread_gc_mark_parallel(void);
+// A spinlock for the mark workers, and an atomic fetch-or on an ATB.
+void mp_thread_gc_mark_lock(void);
+void mp_thread_gc_mark_unlock(void);
+uint8_t mp_thread_gc_mark_fetch_or(uint8_t *ptr, uint8_t bits);
+// Called by an idle worker between looks at the shared pool, to give the
+// bus, a hyperthread or the CPU to the workers that still have blocks.
+void mp_thread_gc_mark_pause(void);
+#endif
+
+#if MICROPY_GC_TLAB
+// A full memory barrier, and setting a flag with a full barrier and clearing
+// it with a release one, for threads taking blocks from their TLAB without
+// the GC lock.
+void mp_thread_gc_fence(void);
+void mp_thread_gc_flag_set(volatile bool *flag);
+void mp_thread_gc_flag_clear(volatile bool *flag);
+#endif
+
 #if MICROPY_PY_THREAD && MICROPY_PY_THREAD_GIL
 #include "py/mpstate.h"
 #define MP_THREAD_GIL_ENTER() mp_thread_mutex_lock(&MP_STATE_VM(gil_mutex), 1)
@@ -342,6 +342,9 @@ const mp_fun_table_t mp_fun_table = {
     &mp_stream_readinto_obj,
     &mp_stream_unbuffered_readline_obj,
     &mp_stream_write_obj,
+    mp_arena_alloc,
+    mp_arena_trim,
+    mp_arena_free,
 };
 
 #endif // MICROPY_EMIT_NATIVE
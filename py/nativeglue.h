@@ -27,6 +27,7 @@
 #define MICROPY_INCLUDED_PY_NATIVEGLUE_H
 
 #include <stdarg.h>
+#include "py/arena.h"
 #include "py/obj.h"
 #include "py/persistentcode.h"
 #include "py/stream.h"
@@ -170,6 +171,9 @@ typedef struct _mp_fun_table_t {
     const mp_obj_fun_builtin_var_t *stream_readinto_obj;
     const mp_obj_fun_builtin_var_t *stream_unbuffered_readline_obj;
     const mp_obj_fun_builtin_var_t *stream_write_obj;
+    void *(*arena_alloc)(mp_arena_t *arena, size_t n_bytes);
+    void (*arena_trim)(mp_arena_t *arena);
+    void (*arena_free)(mp_arena_t *arena);
 } mp_fun_table_t;
 
 extern const mp_fun_table_t mp_fun_table;
@@ -29,6 +29,7 @@
 #include <assert.h>
 #include <stdint.h>
 
+#include "py/gc.h"
 #include "py/runtime.h"
 #include "py/binary.h"
 #include "py/objstr.h"
@@ -375,6 +376,7 @@ STATIC mp_obj_t array_append(mp_obj_t self_in, mp_obj_t arg) {
     // only update length/free if set succeeded
     self->len++;
     self->free--;
+    MP_GC_WRITE_BARRIER(self);
     return mp_const_none; // return None, as per CPython
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_2(array_append_obj, array_append);
@@ -406,6 +408,7 @@ STATIC mp_obj_t array_extend(mp_obj_t self_in, mp_obj_t arg_in) {
     // extend
     mp_seq_copy((byte *)self->items + self->len * sz, arg_bufinfo.buf, len * sz, byte);
     self->len += len;
+    MP_GC_WRITE_BARRIER(self);
 
     return mp_const_none;
 }
@@ -493,6 +496,7 @@ STATIC mp_obj_t array_subscr(mp_obj_t self_in, mp_obj_t index_in, mp_obj_t value
                 }
                 o->free -= len_adj;
                 o->len += len_adj;
+                MP_GC_WRITE_BARRIER(o);
                 return mp_const_none;
                 #else
                 return MP_OBJ_NULL; // op not supported
@@ -534,6 +538,7 @@ STATIC mp_obj_t array_subscr(mp_obj_t self_in, mp_obj_t index_in, mp_obj_t value
             } else {
                 // store
                 mp_binary_set_val_array(o->typecode & TYPECODE_MASK, o->items, index, value);
+                MP_GC_WRITE_BARRIER(o);
                 return mp_const_none;
             }
         }
@@ -24,6 +24,7 @@
  * THE SOFTWARE.
  */
 
+#include "py/gc.h"
 #include "py/obj.h"
 
 typedef struct _mp_obj_cell_t {
@@ -39,6 +40,7 @@ mp_obj_t mp_obj_cell_get(mp_obj_t self_in) {
 void mp_obj_cell_set(mp_obj_t self_in, mp_obj_t obj) {
     mp_obj_cell_t *self = MP_OBJ_TO_PTR(self_in);
     self->obj = obj;
+    MP_GC_WRITE_BARRIER(self);
 }
 
 #if MICROPY_ERROR_REPORTING == MICROPY_ERROR_REPORTING_DETAILED
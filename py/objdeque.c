@@ -30,6 +30,7 @@
 #include "py/mpconfig.h"
 #if MICROPY_PY_COLLECTIONS_DEQUE
 
+#include "py/gc.h"
 #include "py/runtime.h"
 
 typedef struct _mp_obj_deque_t {
@@ -107,6 +108,7 @@ STATIC mp_obj_t mp_obj_deque_append(mp_obj_t self_in, mp_obj_t arg) {
 
     self->items[self->i_put] = arg;
     self->i_put = new_i_put;
+    MP_GC_WRITE_BARRIER(self);
 
     if (self->i_get == new_i_put) {
         if (++self->i_get == self->alloc) {
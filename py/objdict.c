@@ -28,6 +28,7 @@
 #include <string.h>
 #include <assert.h>
 
+#include "py/gc.h"
 #include "py/runtime.h"
 #include "py/builtin.h"
 #include "py/objtype.h"
@@ -243,11 +244,15 @@ mp_obj_t mp_obj_dict_copy(mp_obj_t self_in) {
     mp_obj_t other_out = mp_obj_new_dict(self->map.alloc);
     mp_obj_dict_t *other = MP_OBJ_TO_PTR(other_out);
     other->base.type = self->base.type;
-    other->map.used = self->map.used;
-    other->map.all_keys_are_qstrs = self->map.all_keys_are_qstrs;
     other->map.is_fixed = 0;
     other->map.is_ordered = self->map.is_ordered;
+    #if MICROPY_OPT_MAP_COMPACT
+    mp_map_copy_table(&other->map, &self->map);
+    #else
+    other->map.used = self->map.used;
+    other->map.all_keys_are_qstrs = self->map.all_keys_are_qstrs;
     memcpy(other->map.table, self->map.table, self->map.alloc * sizeof(mp_map_elem_t));
+    #endif
     return other_out;
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_1(dict_copy_obj, mp_obj_dict_copy);
@@ -304,6 +309,7 @@ STATIC mp_obj_t dict_get_helper(size_t n_args, const mp_obj_t *args, mp_map_look
         }
         if (lookup_kind == MP_MAP_LOOKUP_ADD_IF_NOT_FOUND) {
             elem->value = value;
+            MP_GC_WRITE_BARRIER(self);
         }
     } else {
         value = elem->value;
@@ -336,6 +342,10 @@ STATIC mp_obj_t dict_popitem(mp_obj_t self_in) {
     if (self->map.used == 0) {
         mp_raise_msg(&mp_type_KeyError, MP_ERROR_TEXT("popitem(): dictionary is empty"));
     }
+    #if MICROPY_OPT_MAP_COMPACT
+    // entries are in the order they were added, so pop the last like CPython
+    mp_map_elem_t *next = mp_map_last(&self->map);
+    #else
     size_t cur = 0;
     #if MICROPY_PY_COLLECTIONS_ORDEREDDICT
     if (self->map.is_ordered) {
@@ -343,6 +353,7 @@ STATIC mp_obj_t dict_popitem(mp_obj_t self_in) {
     }
     #endif
     mp_map_elem_t *next = dict_iter_next(self, &cur);
+    #endif
     assert(next);
     self->map.used--;
     mp_obj_t items[] = {next->key, next->value};
@@ -371,6 +382,7 @@ STATIC mp_obj_t dict_update(size_t n_args, const mp_obj_t *args, mp_map_t *kwarg
                 mp_map_elem_t *elem = NULL;
                 while ((elem = dict_iter_next((mp_obj_dict_t *)MP_OBJ_TO_PTR(args[1]), &cur)) != NULL) {
                     mp_map_lookup(&self->map, elem->key, MP_MAP_LOOKUP_ADD_IF_NOT_FOUND)->value = elem->value;
+                    MP_GC_WRITE_BARRIER(self);
                 }
             }
         } else {
@@ -388,6 +400,7 @@ STATIC mp_obj_t dict_update(size_t n_args, const mp_obj_t *args, mp_map_t *kwarg
                     mp_raise_ValueError(MP_ERROR_TEXT("dict update sequence has wrong length"));
                 } else {
                     mp_map_lookup(&self->map, key, MP_MAP_LOOKUP_ADD_IF_NOT_FOUND)->value = value;
+                    MP_GC_WRITE_BARRIER(self);
                 }
             }
         }
@@ -397,6 +410,7 @@ STATIC mp_obj_t dict_update(size_t n_args, const mp_obj_t *args, mp_map_t *kwarg
     for (size_t i = 0; i < kwargs->alloc; i++) {
         if (mp_map_slot_is_filled(kwargs, i)) {
             mp_map_lookup(&self->map, kwargs->table[i].key, MP_MAP_LOOKUP_ADD_IF_NOT_FOUND)->value = kwargs->table[i].value;
+            MP_GC_WRITE_BARRIER(self);
         }
     }
 
@@ -627,6 +641,7 @@ mp_obj_t mp_obj_dict_store(mp_obj_t self_in, mp_obj_t key, mp_obj_t value) {
     mp_obj_dict_t *self = MP_OBJ_TO_PTR(self_in);
     mp_ensure_not_fixed(self);
     mp_map_lookup(&self->map, key, MP_MAP_LOOKUP_ADD_IF_NOT_FOUND)->value = value;
+    MP_GC_WRITE_BARRIER(self);
     return self_in;
 }
 
@@ -620,6 +620,7 @@ void mp_obj_exception_add_traceback(mp_obj_t self_in, qstr file, size_t line, qs
     tb_data[0] = file;
     tb_data[1] = line;
     tb_data[2] = block;
+    MP_GC_WRITE_BARRIER(self);
 }
 
 void mp_obj_exception_get_traceback(mp_obj_t self_in, size_t *n, size_t **values) {
@@ -28,6 +28,7 @@
 #include <stdlib.h>
 #include <assert.h>
 
+#include "py/gc.h"
 #include "py/runtime.h"
 #include "py/bc.h"
 #include "py/objstr.h"
@@ -202,6 +203,9 @@ mp_vm_return_kind_t mp_obj_gen_resume(mp_obj_t self_in, mp_obj_t send_value, mp_
 
     mp_globals_set(self->code_state.old_globals);
 
+    // the frame has been running, with its stores unseen by the GC
+    MP_GC_WRITE_BARRIER(self);
+
     // Mark as not running
     self->pend_exc = mp_const_none;
 
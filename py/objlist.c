@@ -27,6 +27,7 @@
 #include <string.h>
 #include <assert.h>
 
+#include "py/gc.h"
 #include "py/objlist.h"
 #include "py/runtime.h"
 #include "py/stackctrl.h"
@@ -221,6 +222,7 @@ STATIC mp_obj_t list_subscr(mp_obj_t self_in, mp_obj_t index, mp_obj_t value) {
                 // TODO: apply allocation policy re: alloc_size
             }
             self->len += len_adj;
+            MP_GC_WRITE_BARRIER(self);
             return mp_const_none;
         }
         #endif
@@ -242,6 +244,7 @@ mp_obj_t mp_obj_list_append(mp_obj_t self_in, mp_obj_t arg) {
         mp_seq_clear(self->items, self->len + 1, self->alloc, sizeof(*self->items));
     }
     self->items[self->len++] = arg;
+    MP_GC_WRITE_BARRIER(self);
     return mp_const_none; // return None, as per CPython
 }
 
@@ -260,6 +263,7 @@ STATIC mp_obj_t list_extend(mp_obj_t self_in, mp_obj_t arg_in) {
 
         memcpy(self->items + self->len, arg->items, sizeof(mp_obj_t) * arg->len);
         self->len += arg->len;
+        MP_GC_WRITE_BARRIER(self);
     } else {
         list_extend_from_iter(self_in, arg_in);
     }
@@ -392,6 +396,7 @@ STATIC mp_obj_t list_insert(mp_obj_t self_in, mp_obj_t idx, mp_obj_t obj) {
         self->items[i] = self->items[i - 1];
     }
     self->items[index] = obj;
+    MP_GC_WRITE_BARRIER(self);
 
     return mp_const_none;
 }
@@ -500,6 +505,7 @@ void mp_obj_list_store(mp_obj_t self_in, mp_obj_t index, mp_obj_t value) {
     mp_obj_list_t *self = MP_OBJ_TO_PTR(self_in);
     size_t i = mp_get_index(self->base.type, self->len, index, false);
     self->items[i] = value;
+    MP_GC_WRITE_BARRIER(self);
 }
 
 /******************************************************************************/
@@ -26,6 +26,7 @@
 
 #include <stdlib.h>
 
+#include "py/gc.h"
 #include "py/objtype.h"
 #include "py/runtime.h"
 
@@ -74,6 +75,7 @@ STATIC mp_obj_t object___setattr__(mp_obj_t self_in, mp_obj_t attr, mp_obj_t val
 
     mp_obj_instance_t *self = MP_OBJ_TO_PTR(self_in);
     mp_map_lookup(&self->members, attr, MP_MAP_LOOKUP_ADD_IF_NOT_FOUND)->value = value;
+    MP_GC_WRITE_BARRIER(self);
     return mp_const_none;
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_3(object___setattr___obj, object___setattr__);
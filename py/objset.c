@@ -28,6 +28,7 @@
 #include <string.h>
 #include <assert.h>
 
+#include "py/gc.h"
 #include "py/runtime.h"
 #include "py/builtin.h"
 
@@ -159,6 +160,7 @@ STATIC mp_obj_t set_add(mp_obj_t self_in, mp_obj_t item) {
     check_set(self_in);
     mp_obj_set_t *self = MP_OBJ_TO_PTR(self_in);
     mp_set_lookup(&self->set, item, MP_MAP_LOOKUP_ADD_IF_NOT_FOUND);
+    MP_GC_WRITE_BARRIER(self);
     return mp_const_none;
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_2(set_add_obj, set_add);
@@ -255,6 +257,7 @@ STATIC mp_obj_t set_intersect_int(mp_obj_t self_in, mp_obj_t other, bool update)
         self->set.alloc = out->set.alloc;
         self->set.used = out->set.used;
         self->set.table = out->set.table;
+        MP_GC_WRITE_BARRIER(self);
     }
 
     return update ? mp_const_none : MP_OBJ_FROM_PTR(out);
@@ -385,6 +388,7 @@ STATIC mp_obj_t set_symmetric_difference_update(mp_obj_t self_in, mp_obj_t other
     mp_obj_t next;
     while ((next = mp_iternext(iter)) != MP_OBJ_STOP_ITERATION) {
         mp_set_lookup(&self->set, next, MP_MAP_LOOKUP_ADD_IF_NOT_FOUND_OR_REMOVE_IF_FOUND);
+        MP_GC_WRITE_BARRIER(self);
     }
     return mp_const_none;
 }
@@ -402,6 +406,7 @@ STATIC void set_update_int(mp_obj_set_t *self, mp_obj_t other_in) {
     mp_obj_t next;
     while ((next = mp_iternext(iter)) != MP_OBJ_STOP_ITERATION) {
         mp_set_lookup(&self->set, next, MP_MAP_LOOKUP_ADD_IF_NOT_FOUND);
+        MP_GC_WRITE_BARRIER(self);
     }
 }
 
@@ -592,6 +597,7 @@ void mp_obj_set_store(mp_obj_t self_in, mp_obj_t item) {
     mp_check_self(mp_obj_is_type(self_in, &mp_type_set));
     mp_obj_set_t *self = MP_OBJ_TO_PTR(self_in);
     mp_set_lookup(&self->set, item, MP_MAP_LOOKUP_ADD_IF_NOT_FOUND);
+    MP_GC_WRITE_BARRIER(self);
 }
 
 #endif // MICROPY_PY_BUILTINS_SET
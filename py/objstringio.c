@@ -28,6 +28,7 @@
 #include <stdio.h>
 #include <string.h>
 
+#include "py/gc.h"
 #include "py/objstr.h"
 #include "py/objstringio.h"
 #include "py/runtime.h"
@@ -106,6 +107,8 @@ STATIC mp_uint_t stringio_write(mp_obj_t o_in, const void *buf, mp_uint_t size,
     if (new_pos > o->vstr->len) {
         o->vstr->len = new_pos;
     }
+    // the buffer may have been replaced
+    MP_GC_WRITE_BARRIER(o);
     return size;
 }
 
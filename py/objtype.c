@@ -30,6 +30,7 @@
 #include <string.h>
 #include <assert.h>
 
+#include "py/gc.h"
 #include "py/objtype.h"
 #include "py/runtime.h"
 
@@ -89,6 +90,7 @@ STATIC mp_obj_t native_base_init_wrapper(size_t n_args, const mp_obj_t *args) {
     const mp_obj_type_t *native_base = NULL;
     instance_count_native_bases(self->base.type, &native_base);
     self->subobj[0] = native_base->make_new(native_base, n_args - 1, 0, args + 1);
+    MP_GC_WRITE_BARRIER(self);
     return mp_const_none;
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(native_base_init_wrapper_obj, 1, MP_OBJ_FUN_ARGS_MAX, native_base_init_wrapper);
@@ -131,13 +133,44 @@ struct class_lookup_data {
     size_t meth_offset;
     mp_obj_t *dest;
     bool is_type;
+    #if MICROPY_OPT_METHOD_CACHE
+    // where the attribute was found, and whether a native type was visited
+    const mp_obj_type_t *found_type;
+    mp_obj_t found_value;
+    bool native_seen;
+    #endif
 };
 
-STATIC void mp_obj_class_lookup(struct class_lookup_data *lookup, const mp_obj_type_t *type) {
+STATIC void class_lookup_convert(struct class_lookup_data *lookup, const mp_obj_type_t *type, mp_obj_t value) {
+    if (lookup->is_type) {
+        // If we look up a class method, we need to return original type for which we
+        // do a lookup, not a (base) type in which we found the class method.
+        const mp_obj_type_t *org_type = (const mp_obj_type_t *)lookup->obj;
+        mp_convert_member_lookup(MP_OBJ_NULL, org_type, value, lookup->dest);
+    } else {
+        mp_obj_instance_t *obj = lookup->obj;
+        mp_obj_t obj_obj;
+        if (obj != NULL && mp_obj_is_native_type(type) && type != &mp_type_object /* object is not a real type */) {
+            // If we're dealing with native base class, then it applies to native sub-object
+            obj_obj = obj->subobj[0];
+        } else {
+            obj_obj = MP_OBJ_FROM_PTR(obj);
+        }
+        mp_convert_member_lookup(obj_obj, type, value, lookup->dest);
+    }
+}
+
+STATIC void class_lookup_mro(struct class_lookup_data *lookup, const mp_obj_type_t *type) {
     assert(lookup->dest[0] == MP_OBJ_NULL);
     assert(lookup->dest[1] == MP_OBJ_NULL);
     for (;;) {
         DEBUG_printf("mp_obj_class_lookup: Looking up %s in %s\n", qstr_str(lookup->attr), qstr_str(type->name));
+        #if MICROPY_OPT_METHOD_CACHE
+        if (mp_obj_is_native_type(type)) {
+            // the result may depend on the native sub-object, so can't be cached
+            lookup->native_seen = true;
+        }
+        #endif
         // Optimize special method lookup for native types
         // This avoids extra method_name => slot lookup. On the other hand,
         // this should not be applied to class types, as will result in extra
@@ -157,22 +190,11 @@ STATIC void mp_obj_class_lookup(struct class_lookup_data *lookup, const mp_obj_t
             mp_map_t *locals_map = &type->locals_dict->map;
             mp_map_elem_t *elem = mp_map_lookup(locals_map, MP_OBJ_NEW_QSTR(lookup->attr), MP_MAP_LOOKUP);
             if (elem != NULL) {
-                if (lookup->is_type) {
-                    // If we look up a class method, we need to return original type for which we
-                    // do a lookup, not a (base) type in which we found the class method.
-                    const mp_obj_type_t *org_type = (const mp_obj_type_t *)lookup->obj;
-                    mp_convert_member_lookup(MP_OBJ_NULL, org_type, elem->value, lookup->dest);
-                } else {
-                    mp_obj_instance_t *obj = lookup->obj;
-                    mp_obj_t obj_obj;
-                    if (obj != NULL && mp_obj_is_native_type(type) && type != &mp_type_object /* object is not a real type */) {
-                        // If we're dealing with native base class, then it applies to native sub-object
-                        obj_obj = obj->subobj[0];
-                    } else {
-                        obj_obj = MP_OBJ_FROM_PTR(obj);
-                    }
-                    mp_convert_member_lookup(obj_obj, type, elem->value, lookup->dest);
-                }
+                #if MICROPY_OPT_METHOD_CACHE
+                lookup->found_type = type;
+                lookup->found_value = elem->value;
+                #endif
+                class_lookup_convert(lookup, type, elem->value);
                 #if DEBUG_PRINT
                 DEBUG_printf("mp_obj_class_lookup: Returning: ");
                 mp_obj_print_helper(MICROPY_DEBUG_PRINTER, lookup->dest[0], PRINT_REPR);
@@ -213,7 +235,7 @@ STATIC void mp_obj_class_lookup(struct class_lookup_data *lookup, const mp_obj_t
                     // Not a "real" type
                     continue;
                 }
-                mp_obj_class_lookup(lookup, bt);
+                class_lookup_mro(lookup, bt);
                 if (lookup->dest[0] != MP_OBJ_NULL) {
                     return;
                 }
@@ -233,6 +255,49 @@ STATIC void mp_obj_class_lookup(struct class_lookup_data *lookup, const mp_obj_t
     }
 }
 
+#if MICROPY_OPT_METHOD_CACHE
+
+// Invalidate the method caches of all threads.  This must be done after the
+// locals dict of a class is changed, and before the sweep of a collection
+// because the address of a freed type may be reused by a new one.
+void mp_obj_type_method_cache_invalidate(void) {
+    ++MP_STATE_VM(method_cache_epoch);
+}
+
+// Look up in the calling thread's method cache, falling back to a search of the
+// MRO.  Only searches that visit no native type are cached, they depend on the
+// type alone and not on a native sub-object or its attr method.
+STATIC void mp_obj_class_lookup(struct class_lookup_data *lookup, const mp_obj_type_t *type) {
+    size_t epoch = MP_STATE_VM(method_cache_epoch);
+    mp_method_cache_entry_t *e = &MP_STATE_THREAD(method_cache)[
+        (((uintptr_t)type >> 4) ^ lookup->attr) & (MICROPY_OPT_METHOD_CACHE_SIZE - 1)];
+    if (e->type == type && e->attr == lookup->attr && e->epoch == epoch) {
+        lookup->native_seen = false;
+        if (e->found_type != NULL) {
+            class_lookup_convert(lookup, e->found_type, e->value);
+        }
+        return;
+    }
+    lookup->found_type = NULL;
+    lookup->found_value = MP_OBJ_NULL;
+    lookup->native_seen = false;
+    class_lookup_mro(lookup, type);
+    if (!lookup->native_seen) {
+        e->type = type;
+        e->attr = lookup->attr;
+        e->found_type = lookup->found_type;
+        e->value = lookup->found_value;
+        // the epoch read before the search, in case the class was changed during it
+        e->epoch = epoch;
+    }
+}
+
+#else
+
+#define mp_obj_class_lookup class_lookup_mro
+
+#endif
+
 STATIC void instance_print(const mp_print_t *print, mp_obj_t self_in, mp_print_kind_t kind) {
     mp_obj_instance_t *self = MP_OBJ_TO_PTR(self_in);
     qstr meth = (kind == PRINT_STR) ? MP_QSTR___str__ : MP_QSTR___repr__;
@@ -361,6 +426,7 @@ mp_obj_t mp_obj_instance_make_new(const mp_obj_type_t *self, size_t n_args, size
     // (constructed) by the Python __init__() method then construct it now.
     if (native_base != NULL && o->subobj[0] == MP_OBJ_FROM_PTR(&native_base_init_wrapper_obj)) {
         o->subobj[0] = native_base->make_new(native_base, n_args, n_kw, args);
+        MP_GC_WRITE_BARRIER(o);
     }
 
     return MP_OBJ_FROM_PTR(o);
@@ -595,6 +661,10 @@ STATIC void mp_obj_instance_load_attr(mp_obj_t self_in, qstr attr, mp_obj_t *des
         dest[0] = mp_obj_dict_copy(MP_OBJ_FROM_PTR(&dict));
         mp_obj_dict_t *dest_dict = MP_OBJ_TO_PTR(dest[0]);
         dest_dict->map.is_fixed = 1;
+        #if MICROPY_OPT_MAP_COMPACT
+        // a fixed ordered map is taken to be an array, which this table isn't
+        dest_dict->map.is_ordered = 0;
+        #endif
         return;
     }
     #endif
@@ -670,6 +740,37 @@ STATIC void mp_obj_instance_load_attr(mp_obj_t self_in, qstr attr, mp_obj_t *des
     }
 }
 
+#if MICROPY_OPT_INLINE_CACHE
+// Load attr of the instance self_in, which is known not to be among its
+// members, into dest as mp_load_method_maybe() does.  Returns true if what is
+// loaded depends only on the type of the instance: it's then dest[0] from the
+// locals dict of a class in the MRO, bound to dest[1] which may be self_in.
+bool mp_obj_instance_load_class_attr(mp_obj_t self_in, qstr attr, mp_obj_t *dest) {
+    mp_obj_instance_t *self = MP_OBJ_TO_PTR(self_in);
+    dest[0] = MP_OBJ_NULL;
+    dest[1] = MP_OBJ_NULL;
+    if (attr == MP_QSTR___class__ || attr == MP_QSTR___dict__
+        || (self->base.type->flags & MP_TYPE_FLAG_HAS_SPECIAL_ACCESSORS)) {
+        mp_load_method_maybe(self_in, attr, dest);
+        return false;
+    }
+    struct class_lookup_data lookup = {
+        .obj = self,
+        .attr = attr,
+        .meth_offset = 0,
+        .dest = dest,
+        .is_type = false,
+    };
+    mp_obj_class_lookup(&lookup, self->base.type);
+    if (dest[0] == MP_OBJ_NULL) {
+        // not in the class, try __getattr__
+        mp_obj_instance_load_attr(self_in, attr, dest);
+        return false;
+    }
+    return !lookup.native_seen;
+}
+#endif
+
 STATIC bool mp_obj_instance_store_attr(mp_obj_t self_in, qstr attr, mp_obj_t value) {
     mp_obj_instance_t *self = MP_OBJ_TO_PTR(self_in);
 
@@ -789,6 +890,7 @@ skip_special_accessors:
     } else {
         // store attribute
         mp_map_lookup(&self->members, MP_OBJ_NEW_QSTR(attr), MP_MAP_LOOKUP_ADD_IF_NOT_FOUND)->value = value;
+        MP_GC_WRITE_BARRIER(self);
         return true;
     }
 }
@@ -1024,6 +1126,9 @@ STATIC void type_attr(mp_obj_t self_in, qstr attr, mp_obj_t *dest) {
                 dest[0] = mp_obj_dict_copy(MP_OBJ_FROM_PTR(dict));
                 mp_obj_dict_t *dict_copy = MP_OBJ_TO_PTR(dest[0]);
                 dict_copy->map.is_fixed = 1;
+                #if MICROPY_OPT_MAP_COMPACT
+                dict_copy->map.is_ordered = 0;
+                #endif
             }
             return;
         }
@@ -1066,6 +1171,9 @@ STATIC void type_attr(mp_obj_t self_in, qstr attr, mp_obj_t *dest) {
                 // delete attribute
                 mp_map_elem_t *elem = mp_map_lookup(locals_map, MP_OBJ_NEW_QSTR(attr), MP_MAP_LOOKUP_REMOVE_IF_FOUND);
                 if (elem != NULL) {
+                    #if MICROPY_OPT_METHOD_CACHE
+                    mp_obj_type_method_cache_invalidate();
+                    #endif
                     dest[0] = MP_OBJ_NULL; // indicate success
                 }
             } else {
@@ -1085,6 +1193,10 @@ STATIC void type_attr(mp_obj_t self_in, qstr attr, mp_obj_t *dest) {
                 // store attribute
                 mp_map_elem_t *elem = mp_map_lookup(locals_map, MP_OBJ_NEW_QSTR(attr), MP_MAP_LOOKUP_ADD_IF_NOT_FOUND);
                 elem->value = dest[1];
+                MP_GC_WRITE_BARRIER(self->locals_dict);
+                #if MICROPY_OPT_METHOD_CACHE
+                mp_obj_type_method_cache_invalidate();
+                #endif
                 dest[0] = MP_OBJ_NULL; // indicate success
             }
         }
@@ -1110,7 +1222,14 @@ mp_obj_t mp_obj_new_type(qstr name, mp_obj_t bases_tuple, mp_obj_t locals_dict)
         mp_raise_TypeError(NULL);
     }
 
+    #if MICROPY_OPT_METHOD_CACHE
+    // The method cache is only invalidated when the class's attributes are
+    // changed through the class, so it needs a locals dict that no one else
+    // (the caller of type(), a metaclass, locals() in the body) can change.
+    locals_dict = mp_obj_dict_copy(locals_dict);
+    #else
     // TODO might need to make a copy of locals_dict; at least that's how CPython does it
+    #endif
 
     // Basic validation of base classes
     uint16_t base_flags = MP_TYPE_FLAG_EQ_NOT_REFLEXIVE
@@ -54,4 +54,14 @@ mp_obj_t mp_obj_instance_make_new(const mp_obj_type_t *self_in, size_t n_args, s
 // this needs to be exposed for mp_getiter
 mp_obj_t mp_obj_instance_getiter(mp_obj_t self_in, mp_obj_iter_buf_t *iter_buf);
 
+#if MICROPY_OPT_METHOD_CACHE
+// this needs to be exposed for the GC to call before a sweep
+void mp_obj_type_method_cache_invalidate(void);
+#endif
+
+#if MICROPY_OPT_INLINE_CACHE
+// this needs to be exposed for the inline caches of the VM
+bool mp_obj_instance_load_class_attr(mp_obj_t self_in, qstr attr, mp_obj_t *dest);
+#endif
+
 #endif // MICROPY_INCLUDED_PY_OBJTYPE_H
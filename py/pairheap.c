@@ -24,6 +24,7 @@
  * THE SOFTWARE.
  */
 
+#include "py/gc.h"
 #include "py/pairheap.h"
 
 // The mp_pairheap_t.next pointer can take one of the following values:
@@ -35,6 +36,9 @@
 #define NEXT_IS_RIGHTMOST_PARENT(next) ((uintptr_t)(next) & 1)
 #define NEXT_GET_RIGHTMOST_PARENT(next) ((void *)((uintptr_t)(next) & ~1))
 
+// Nodes are linked to others as the heap changes, a GC collecting incrementally
+// must be told of each node changed, see MP_GC_WRITE_BARRIER.
+
 // O(1), stable
 mp_pairheap_t *mp_pairheap_meld(mp_pairheap_lt_t lt, mp_pairheap_t *heap1, mp_pairheap_t *heap2) {
     if (heap1 == NULL) {
@@ -51,6 +55,8 @@ mp_pairheap_t *mp_pairheap_meld(mp_pairheap_lt_t lt, mp_pairheap_t *heap1, mp_pa
         }
         heap1->child_last = heap2;
         heap2->next = NEXT_MAKE_RIGHTMOST_PARENT(heap1);
+        MP_GC_WRITE_BARRIER(heap1);
+        MP_GC_WRITE_BARRIER(heap2);
         return heap1;
     } else {
         heap1->next = heap2->child;
@@ -59,6 +65,8 @@ mp_pairheap_t *mp_pairheap_meld(mp_pairheap_lt_t lt, mp_pairheap_t *heap1, mp_pa
             heap2->child_last = heap1;
             heap1->next = NEXT_MAKE_RIGHTMOST_PARENT(heap2);
         }
+        MP_GC_WRITE_BARRIER(heap1);
+        MP_GC_WRITE_BARRIER(heap2);
         return heap2;
     }
 }
@@ -115,6 +123,7 @@ mp_pairheap_t *mp_pairheap_delete(mp_pairheap_lt_t lt, mp_pairheap_t *heap, mp_p
             parent->child = node->next;
         }
         node->next = NULL;
+        MP_GC_WRITE_BARRIER(parent);
         return heap;
     } else if (node == parent->child) {
         mp_pairheap_t *child = node->child;
@@ -137,11 +146,14 @@ mp_pairheap_t *mp_pairheap_delete(mp_pairheap_lt_t lt, mp_pairheap_t *heap, mp_p
             node = n;
         } else {
             n->next = node;
+            MP_GC_WRITE_BARRIER(n);
         }
     }
     node->next = next;
     if (NEXT_IS_RIGHTMOST_PARENT(next)) {
         parent->child_last = node;
     }
+    MP_GC_WRITE_BARRIER(node);
+    MP_GC_WRITE_BARRIER(parent);
     return heap;
 }
@@ -214,15 +214,6 @@ typedef struct _rule_stack_t {
     size_t arg_i; // this dictates the maximum nodes in a "list" of things
 } rule_stack_t;
 
-typedef struct _mp_parse_chunk_t {
-    size_t alloc;
-    union {
-        size_t used;
-        struct _mp_parse_chunk_t *next;
-    } union_;
-    byte data[];
-} mp_parse_chunk_t;
-
 typedef struct _parser_t {
     size_t rule_stack_alloc;
     size_t rule_stack_top;
@@ -235,7 +226,6 @@ typedef struct _parser_t {
     mp_lexer_t *lexer;
 
     mp_parse_tree_t tree;
-    mp_parse_chunk_t *cur_chunk;
 
     #if MICROPY_COMP_CONST
     mp_map_t consts;
@@ -251,44 +241,8 @@ STATIC const uint16_t *get_rule_arg(uint8_t r_id) {
 }
 
 STATIC void *parser_alloc(parser_t *parser, size_t num_bytes) {
-    // use a custom memory allocator to store parse nodes sequentially in large chunks
-
-    mp_parse_chunk_t *chunk = parser->cur_chunk;
-
-    if (chunk != NULL && chunk->union_.used + num_bytes > chunk->alloc) {
-        // not enough room at end of previously allocated chunk so try to grow
-        mp_parse_chunk_t *new_data = (mp_parse_chunk_t *)m_renew_maybe(byte, chunk,
-            sizeof(mp_parse_chunk_t) + chunk->alloc,
-            sizeof(mp_parse_chunk_t) + chunk->alloc + num_bytes, false);
-        if (new_data == NULL) {
-            // could not grow existing memory; shrink it to fit previous
-            (void)m_renew_maybe(byte, chunk, sizeof(mp_parse_chunk_t) + chunk->alloc,
-                sizeof(mp_parse_chunk_t) + chunk->union_.used, false);
-            chunk->alloc = chunk->union_.used;
-            chunk->union_.next = parser->tree.chunk;
-            parser->tree.chunk = chunk;
-            chunk = NULL;
-        } else {
-            // could grow existing memory
-            chunk->alloc += num_bytes;
-        }
-    }
-
-    if (chunk == NULL) {
-        // no previous chunk, allocate a new chunk
-        size_t alloc = MICROPY_ALLOC_PARSE_CHUNK_INIT;
-        if (alloc < num_bytes) {
-            alloc = num_bytes;
-        }
-        chunk = (mp_parse_chunk_t *)m_new(byte, sizeof(mp_parse_chunk_t) + alloc);
-        chunk->alloc = alloc;
-        chunk->union_.used = 0;
-        parser->cur_chunk = chunk;
-    }
-
-    byte *ret = chunk->data + chunk->union_.used;
-    chunk->union_.used += num_bytes;
-    return ret;
+    // store parse nodes sequentially in large chunks
+    return mp_arena_alloc(&parser->tree.arena, num_bytes);
 }
 
 STATIC void push_rule(parser_t *parser, size_t src_line, uint8_t rule_id, size_t arg_i) {
@@ -846,8 +800,7 @@ mp_parse_tree_t mp_parse(mp_lexer_t *lex, mp_parse_input_kind_t input_kind) {
 
     parser.lexer = lex;
 
-    parser.tree.chunk = NULL;
-    parser.cur_chunk = NULL;
+    mp_arena_init(&parser.tree.arena, MICROPY_ALLOC_PARSE_CHUNK_INIT);
 
     #if MICROPY_COMP_CONST
     mp_map_init(&parser.consts, 0);
@@ -1129,16 +1082,8 @@ mp_parse_tree_t mp_parse(mp_lexer_t *lex, mp_parse_input_kind_t input_kind) {
     mp_map_deinit(&parser.consts);
     #endif
 
-    // truncate final chunk and link into chain of chunks
-    if (parser.cur_chunk != NULL) {
-        (void)m_renew_maybe(byte, parser.cur_chunk,
-            sizeof(mp_parse_chunk_t) + parser.cur_chunk->alloc,
-            sizeof(mp_parse_chunk_t) + parser.cur_chunk->union_.used,
-            false);
-        parser.cur_chunk->alloc = parser.cur_chunk->union_.used;
-        parser.cur_chunk->union_.next = parser.tree.chunk;
-        parser.tree.chunk = parser.cur_chunk;
-    }
+    // truncate final chunk
+    mp_arena_trim(&parser.tree.arena);
 
     if (
         lex->tok_kind != MP_TOKEN_END // check we are at the end of the token stream
@@ -1177,12 +1122,7 @@ mp_parse_tree_t mp_parse(mp_lexer_t *lex, mp_parse_input_kind_t input_kind) {
 }
 
 void mp_parse_tree_clear(mp_parse_tree_t *tree) {
-    mp_parse_chunk_t *chunk = tree->chunk;
-    while (chunk != NULL) {
-        mp_parse_chunk_t *next = chunk->union_.next;
-        m_del(byte, chunk, sizeof(mp_parse_chunk_t) + chunk->alloc);
-        chunk = next;
-    }
+    mp_arena_free(&tree->arena);
 }
 
 #endif // MICROPY_ENABLE_COMPILER
@@ -29,6 +29,7 @@
 #include <stddef.h>
 #include <stdint.h>
 
+#include "py/arena.h"
 #include "py/obj.h"
 
 struct _mp_lexer_t;
@@ -94,9 +95,11 @@ typedef enum {
     MP_PARSE_EVAL_INPUT,
 } mp_parse_input_kind_t;
 
+// The nodes of the tree are allocated from its arena, which the compiler also
+// uses for what it only needs until it clears the tree.
 typedef struct _mp_parse_t {
     mp_parse_node_t root;
-    struct _mp_parse_chunk_t *chunk;
+    mp_arena_t arena;
 } mp_parse_tree_t;
 
 // the parser will raise an exception if an error occurred
@@ -6,6 +6,7 @@ list(APPEND MICROPY_INC_CORE "${MICROPY_DIR}")
 
 # All py/ source files
 set(MICROPY_SOURCE_PY
+    ${MICROPY_PY_DIR}/arena.c
     ${MICROPY_PY_DIR}/argcheck.c
     ${MICROPY_PY_DIR}/asmarm.c
     ${MICROPY_PY_DIR}/asmbase.c
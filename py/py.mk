@@ -64,6 +64,7 @@ PY_CORE_O_BASENAME = $(addprefix py/,\
 	malloc.o \
 	gc.o \
 	pystack.o \
+	arena.o \
 	qstr.o \
 	vstr.o \
 	mpprint.o \
@@ -85,13 +85,16 @@
 // allocated pool is twice this size.  The value here must be <= MP_QSTRnumber_of.
 #define MICROPY_ALLOC_QSTR_ENTRIES_INIT (10)
 
-// this must match the equivalent function in makeqstrdata.py
-mp_uint_t qstr_compute_hash(const byte *data, size_t len) {
+STATIC mp_uint_t qstr_compute_hash_full(const byte *data, size_t len) {
     // djb2 algorithm; see http://www.cse.yorku.ca/~oz/hash.html
     mp_uint_t hash = 5381;
     for (const byte *top = data + len; data < top; data++) {
         hash = ((hash << 5) + hash) ^ (*data); // hash * 33 ^ data
     }
+    return hash;
+}
+
+STATIC mp_uint_t qstr_hash_from_full(mp_uint_t hash) {
     hash &= Q_HASH_MASK;
     // Make sure that valid hash is never zero, zero means "hash not computed"
     if (hash == 0) {
@@ -100,6 +103,11 @@ mp_uint_t qstr_compute_hash(const byte *data, size_t len) {
     return hash;
 }
 
+// this must match the equivalent function in makeqstrdata.py
+mp_uint_t qstr_compute_hash(const byte *data, size_t len) {
+    return qstr_hash_from_full(qstr_compute_hash_full(data, len));
+}
+
 const qstr_pool_t mp_qstr_const_pool = {
     NULL,               // no previous pool
     0,                  // no previous pool
@@ -121,6 +129,52 @@ extern const qstr_pool_t MICROPY_QSTR_EXTRA_POOL;
 #define CONST_POOL mp_qstr_const_pool
 #endif
 
+#if MICROPY_OPT_QSTR_INDEX
+// The index is probed linearly from a slot given by the djb2 hash of the data,
+// kept to 32 bits rather than truncated like the stored hash, with its high
+// bits folded into the low ones.
+#define QSTR_INDEX_SLOT(hash, alloc) (((hash) ^ ((hash) >> 13)) & ((alloc) - 1))
+
+STATIC void qstr_index_insert(qstr_index_t *index, qstr q, const byte *q_ptr) {
+    uint32_t hash = qstr_compute_hash_full(Q_GET_DATA(q_ptr), Q_GET_LENGTH(q_ptr));
+    size_t i = QSTR_INDEX_SLOT(hash, index->alloc);
+    while (index->slots[i].q != MP_QSTRnull) {
+        i = (i + 1) & (index->alloc - 1);
+    }
+    index->slots[i].hash = hash;
+    index->slots[i].q = q;
+    index->used += 1;
+}
+
+// Replace the index with a new one of all the qstrs, at most half full.  Threads
+// reading without qstr_mutex may still be using the old one, so it's left for
+// the GC to free.  If there's no memory for it the index is dropped, and lookups
+// scan the pools until it can be built again.
+// qstr_mutex must be taken while in this function
+STATIC void qstr_index_build(void) {
+    size_t total = QSTR_TOTAL();
+    size_t alloc = 64;
+    while (alloc < 2 * total) {
+        alloc *= 2;
+    }
+    qstr_index_t *index = m_new_obj_var_maybe(qstr_index_t, qstr_index_slot_t, alloc);
+    if (index != NULL) {
+        index->alloc = alloc;
+        index->used = 0;
+        memset(index->slots, 0, alloc * sizeof(qstr_index_slot_t));
+        for (qstr_pool_t *pool = MP_STATE_VM(last_pool); pool != NULL; pool = pool->prev) {
+            for (size_t i = 0; i < pool->len; ++i) {
+                qstr q = pool->total_prev_len + i;
+                if (q != MP_QSTRnull) {
+                    qstr_index_insert(index, q, pool->qstrs[i]);
+                }
+            }
+        }
+    }
+    MP_STATE_VM(qstr_index) = index;
+}
+#endif
+
 void qstr_init(void) {
     MP_STATE_VM(last_pool) = (qstr_pool_t *)&CONST_POOL; // we won't modify the const_pool since it has no allocated room left
     MP_STATE_VM(qstr_last_chunk) = NULL;
@@ -128,6 +182,10 @@ void qstr_init(void) {
     #if MICROPY_PY_THREAD && !MICROPY_PY_THREAD_GIL
     mp_thread_mutex_init(&MP_STATE_VM(qstr_mutex));
     #endif
+
+    #if MICROPY_OPT_QSTR_INDEX
+    qstr_index_build();
+    #endif
 }
 
 STATIC const byte *find_qstr(qstr q) {
@@ -166,14 +224,47 @@ STATIC qstr qstr_add(const byte *q_ptr) {
 
     // add the new qstr
     MP_STATE_VM(last_pool)->qstrs[MP_STATE_VM(last_pool)->len++] = q_ptr;
+    qstr q = MP_STATE_VM(last_pool)->total_prev_len + MP_STATE_VM(last_pool)->len - 1;
+
+    #if MICROPY_OPT_QSTR_INDEX
+    // index it, rebuilding the index when it gets two thirds full
+    qstr_index_t *index = MP_STATE_VM(qstr_index);
+    if (index == NULL || 3 * (index->used + 1) > 2 * index->alloc) {
+        qstr_index_build();
+    } else {
+        qstr_index_insert(index, q, q_ptr);
+    }
+    #endif
 
     // return id for the newly-added qstr
-    return MP_STATE_VM(last_pool)->total_prev_len + MP_STATE_VM(last_pool)->len - 1;
+    return q;
 }
 
 qstr qstr_find_strn(const char *str, size_t str_len) {
     // work out hash of str
-    mp_uint_t str_hash = qstr_compute_hash((const byte *)str, str_len);
+    mp_uint_t str_hash_full = qstr_compute_hash_full((const byte *)str, str_len);
+    mp_uint_t str_hash = qstr_hash_from_full(str_hash_full);
+
+    #if MICROPY_OPT_QSTR_INDEX
+    // search the index for the data
+    qstr_index_t *index = MP_STATE_VM(qstr_index);
+    if (index != NULL) {
+        uint32_t hash = str_hash_full;
+        for (size_t i = QSTR_INDEX_SLOT(hash, index->alloc);; i = (i + 1) & (index->alloc - 1)) {
+            qstr q = index->slots[i].q;
+            if (q == MP_QSTRnull) {
+                break;
+            }
+            if (index->slots[i].hash == hash) {
+                const byte *q_ptr = find_qstr(q);
+                if (Q_GET_LENGTH(q_ptr) == str_len && memcmp(Q_GET_DATA(q_ptr), str, str_len) == 0) {
+                    return q;
+                }
+            }
+        }
+        return 0;
+    }
+    #endif
 
     // search pools for the data
     for (qstr_pool_t *pool = MP_STATE_VM(last_pool); pool != NULL; pool = pool->prev) {
@@ -295,6 +386,11 @@ void qstr_pool_info(size_t *n_pool, size_t *n_qstr, size_t *n_str_data_bytes, si
         *n_total_bytes += sizeof(qstr_pool_t) + sizeof(qstr) * pool->alloc;
         #endif
     }
+    #if MICROPY_OPT_QSTR_INDEX
+    if (MP_STATE_VM(qstr_index) != NULL) {
+        *n_total_bytes += sizeof(qstr_index_t) + sizeof(qstr_index_slot_t) * MP_STATE_VM(qstr_index)->alloc;
+    }
+    #endif
     *n_total_bytes += *n_str_data_bytes;
     QSTR_EXIT();
 }
@@ -55,6 +55,20 @@ typedef struct _qstr_pool_t {
     const byte *qstrs[];
 } qstr_pool_t;
 
+#if MICROPY_OPT_QSTR_INDEX
+// A hash table of all qstrs, from every pool, used to find a qstr from its data
+typedef struct _qstr_index_slot_t {
+    uint32_t hash;
+    uint32_t q; // MP_QSTRnull for an empty slot
+} qstr_index_slot_t;
+
+typedef struct _qstr_index_t {
+    size_t alloc; // number of slots, a power of 2
+    size_t used;
+    qstr_index_slot_t slots[];
+} qstr_index_t;
+#endif
+
 #define QSTR_TOTAL() (MP_STATE_VM(last_pool)->total_prev_len + MP_STATE_VM(last_pool)->len)
 
 void qstr_init(void);
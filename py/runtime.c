@@ -69,6 +69,20 @@ void mp_init(void) {
     MP_STATE_VM(sched_len) = 0;
     #endif
 
+    #if MICROPY_OPT_METHOD_CACHE
+    // start a new method cache epoch, so no entry from before a soft reset is valid
+    ++MP_STATE_VM(method_cache_epoch);
+    memset(MP_STATE_THREAD(method_cache), 0, sizeof(MP_STATE_THREAD(method_cache)));
+    #endif
+    #if MICROPY_OPT_INLINE_CACHE
+    memset(MP_STATE_THREAD(inline_cache), 0, sizeof(MP_STATE_THREAD(inline_cache)));
+    #endif
+    #if MICROPY_OPT_INLINE_CACHE_STATS
+    MP_STATE_VM(inline_cache_hits) = 0;
+    MP_STATE_VM(inline_cache_poly_hits) = 0;
+    MP_STATE_VM(inline_cache_misses) = 0;
+    #endif
+
     #if MICROPY_ENABLE_EMERGENCY_EXCEPTION_BUF
     mp_init_emergency_exception_buf();
     #endif
@@ -129,6 +143,8 @@ void mp_init(void) {
     #if MICROPY_PY_SYS_SETTRACE
     MP_STATE_THREAD(prof_trace_callback) = MP_OBJ_NULL;
     MP_STATE_THREAD(prof_callback_is_executing) = false;
+    #endif
+    #if MICROPY_PY_SYS_SETTRACE || MICROPY_GC_ALLOC_PROFILE
     MP_STATE_THREAD(current_code_state) = NULL;
     #endif
 
@@ -74,6 +74,12 @@ void mp_sched_lock(void);
 void mp_sched_unlock(void);
 #define mp_sched_num_pending() (MP_STATE_VM(sched_len))
 bool mp_sched_schedule(mp_obj_t function, mp_obj_t arg);
+#if MICROPY_GC_INCREMENTAL || MICROPY_GC_GENERATIONAL
+void mp_sched_gc_step(void);
+#endif
+#if MICROPY_GC_FINALISER_QUEUE
+void mp_sched_gc_finalisers(void);
+#endif
 #endif
 
 // extra printing method specifically for mp_obj_t's which are integral type
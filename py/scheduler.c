@@ -26,6 +26,7 @@
 
 #include <stdio.h>
 
+#include "py/gc.h"
 #include "py/runtime.h"
 
 void MICROPY_WRAP_MP_SCHED_EXCEPTION(mp_sched_exception)(mp_obj_t exc) {
@@ -88,6 +89,26 @@ void mp_handle_pending(bool raise_exc) {
 // or by the VM's inlined version of that function.
 void mp_handle_pending_tail(mp_uint_t atomic_state) {
     MP_STATE_VM(sched_state) = MP_SCHED_LOCKED;
+    #if MICROPY_GC_INCREMENTAL || MICROPY_GC_GENERATIONAL
+    if (MP_STATE_MEM(gc_step_due)) {
+        MP_STATE_MEM(gc_step_due) = false;
+        MICROPY_END_ATOMIC_SECTION(atomic_state);
+        #if MICROPY_GC_INCREMENTAL
+        gc_collect_step(MP_STATE_MEM(gc_slice_us));
+        #else
+        gc_collect_young();
+        #endif
+        atomic_state = MICROPY_BEGIN_ATOMIC_SECTION();
+    }
+    #endif
+    #if MICROPY_GC_FINALISER_QUEUE
+    if (MP_STATE_MEM(gc_fin_due)) {
+        MP_STATE_MEM(gc_fin_due) = false;
+        MICROPY_END_ATOMIC_SECTION(atomic_state);
+        gc_run_finalisers(MICROPY_GC_FINALISER_BATCH);
+        atomic_state = MICROPY_BEGIN_ATOMIC_SECTION();
+    }
+    #endif
     if (!mp_sched_empty()) {
         mp_sched_item_t item = MP_STATE_VM(sched_queue)[MP_STATE_VM(sched_idx)];
         MP_STATE_VM(sched_idx) = IDX_MASK(MP_STATE_VM(sched_idx) + 1);
@@ -115,7 +136,14 @@ void mp_sched_unlock(void) {
     assert(MP_STATE_VM(sched_state) < 0);
     if (++MP_STATE_VM(sched_state) == 0) {
         // vm became unlocked
-        if (MP_STATE_VM(mp_pending_exception) != MP_OBJ_NULL || mp_sched_num_pending()) {
+        if (MP_STATE_VM(mp_pending_exception) != MP_OBJ_NULL || mp_sched_num_pending()
+            #if MICROPY_GC_INCREMENTAL || MICROPY_GC_GENERATIONAL
+            || MP_STATE_MEM(gc_step_due)
+            #endif
+            #if MICROPY_GC_FINALISER_QUEUE
+            || MP_STATE_MEM(gc_fin_due)
+            #endif
+            ) {
             MP_STATE_VM(sched_state) = MP_SCHED_PENDING;
         } else {
             MP_STATE_VM(sched_state) = MP_SCHED_IDLE;
@@ -144,6 +172,32 @@ bool MICROPY_WRAP_MP_SCHED_SCHEDULE(mp_sched_schedule)(mp_obj_t function, mp_obj
     return ret;
 }
 
+#if MICROPY_GC_INCREMENTAL || MICROPY_GC_GENERATIONAL
+// Ask for a slice of garbage collection, or a collection of the young
+// generation, to be run like a scheduled function.
+void mp_sched_gc_step(void) {
+    mp_uint_t atomic_state = MICROPY_BEGIN_ATOMIC_SECTION();
+    MP_STATE_MEM(gc_step_due) = true;
+    if (MP_STATE_VM(sched_state) == MP_SCHED_IDLE) {
+        MP_STATE_VM(sched_state) = MP_SCHED_PENDING;
+    }
+    MICROPY_END_ATOMIC_SECTION(atomic_state);
+}
+#endif
+
+#if MICROPY_GC_FINALISER_QUEUE
+// Ask for a batch of the finalisers queued by the GC to be run like a
+// scheduled function.
+void mp_sched_gc_finalisers(void) {
+    mp_uint_t atomic_state = MICROPY_BEGIN_ATOMIC_SECTION();
+    MP_STATE_MEM(gc_fin_due) = true;
+    if (MP_STATE_VM(sched_state) == MP_SCHED_IDLE) {
+        MP_STATE_VM(sched_state) = MP_SCHED_PENDING;
+    }
+    MICROPY_END_ATOMIC_SECTION(atomic_state);
+}
+#endif
+
 #else // MICROPY_ENABLE_SCHEDULER
 
 // A variant of this is inlined in the VM at the pending exception check
@@ -25,6 +25,7 @@
  */
 
 #include <assert.h>
+#include <string.h>
 
 #include "py/scope.h"
 
@@ -40,7 +41,7 @@ STATIC const uint8_t scope_simple_name_table[] = {
     [SCOPE_GEN_EXPR] = MP_QSTR__lt_genexpr_gt_,
 };
 
-scope_t *scope_new(scope_kind_t kind, mp_parse_node_t pn, qstr source_file, mp_uint_t emit_options) {
+scope_t *scope_new(mp_arena_t *arena, scope_kind_t kind, mp_parse_node_t pn, qstr source_file, mp_uint_t emit_options) {
     // Make sure those qstrs indeed fit in an uint8_t.
     MP_STATIC_ASSERT(MP_QSTR__lt_module_gt_ <= UINT8_MAX);
     MP_STATIC_ASSERT(MP_QSTR__lt_lambda_gt_ <= UINT8_MAX);
@@ -49,7 +50,8 @@ scope_t *scope_new(scope_kind_t kind, mp_parse_node_t pn, qstr source_file, mp_u
     MP_STATIC_ASSERT(MP_QSTR__lt_setcomp_gt_ <= UINT8_MAX);
     MP_STATIC_ASSERT(MP_QSTR__lt_genexpr_gt_ <= UINT8_MAX);
 
-    scope_t *scope = m_new0(scope_t, 1);
+    scope_t *scope = mp_arena_alloc(arena, sizeof(scope_t));
+    memset(scope, 0, sizeof(scope_t));
     scope->kind = kind;
     scope->pn = pn;
     scope->source_file = source_file;
@@ -68,8 +70,8 @@ scope_t *scope_new(scope_kind_t kind, mp_parse_node_t pn, qstr source_file, mp_u
 }
 
 void scope_free(scope_t *scope) {
+    // the scope itself is in the arena it was allocated from
     m_del(id_info_t, scope->id_info, scope->id_info_alloc);
-    m_del(scope_t, scope, 1);
 }
 
 id_info_t *scope_find_or_add_id(scope_t *scope, qstr qst, id_info_kind_t kind) {
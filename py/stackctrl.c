@@ -55,3 +55,35 @@ void mp_stack_check(void) {
 }
 
 #endif // MICROPY_STACK_CHECK
+
+#if MICROPY_STACK_HIGH_WATER
+
+// Every byte 0xa5, not aligned so not a heap pointer.
+#define STACK_FILL_PATTERN ((uintptr_t)-1 / 0xff * 0xa5)
+
+// Words below the frame of mp_stack_fill() it leaves alone.
+#define STACK_FILL_MARGIN (32)
+
+void mp_stack_fill(void *bottom, void *top) {
+    volatile uintptr_t stack_dummy;
+    uintptr_t *limit = (uintptr_t *)&stack_dummy - STACK_FILL_MARGIN;
+    uintptr_t *p = bottom;
+    uintptr_t *end = top;
+    if ((uintptr_t *)&stack_dummy >= p && (uintptr_t *)&stack_dummy < end) {
+        // the stack in use, fill only below this frame
+        end = limit;
+    }
+    while (p < end) {
+        *p++ = STACK_FILL_PATTERN;
+    }
+}
+
+void *mp_stack_high_water(void *bottom, void *top) {
+    uintptr_t *p = bottom;
+    while (p < (uintptr_t *)top && *p == STACK_FILL_PATTERN) {
+        p++;
+    }
+    return p;
+}
+
+#endif // MICROPY_STACK_HIGH_WATER
@@ -45,4 +45,14 @@ void mp_stack_check(void);
 
 #endif
 
+#if MICROPY_STACK_HIGH_WATER
+
+// Fill the words of a descending stack from bottom up to top with a pattern,
+// leaving alone the frame of the caller if the range holds it.  Return the
+// deepest word used since, the pattern being taken as unused from bottom up.
+void mp_stack_fill(void *bottom, void *top);
+void *mp_stack_high_water(void *bottom, void *top);
+
+#endif
+
 #endif // MICROPY_INCLUDED_PY_STACKCTRL_H
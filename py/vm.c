@@ -30,8 +30,11 @@
 #include <assert.h>
 
 #include "py/emitglue.h"
+#include "py/gc.h"
+#include "py/objlist.h"
 #include "py/objtype.h"
 #include "py/runtime.h"
+#include "py/smallint.h"
 #include "py/bc0.h"
 #include "py/bc.h"
 #include "py/profile.h"
@@ -172,6 +175,24 @@
     } \
 } while(0)
 
+#elif MICROPY_GC_ALLOC_PROFILE
+
+// Only keep track of the running code, for the GC to find allocation sites.
+#define FRAME_SETUP() do { \
+    MP_STATE_THREAD(current_code_state) = code_state; \
+} while(0)
+
+#define FRAME_ENTER() do { \
+    code_state->prev_state = MP_STATE_THREAD(current_code_state); \
+} while(0)
+
+#define FRAME_LEAVE() do { \
+    MP_STATE_THREAD(current_code_state) = code_state->prev_state; \
+} while(0)
+
+#define FRAME_UPDATE()
+#define TRACE_TICK(current_ip, current_sp, is_exception)
+
 #else // MICROPY_PY_SYS_SETTRACE
 #define FRAME_SETUP()
 #define FRAME_ENTER()
@@ -197,6 +218,121 @@ static inline mp_map_elem_t *mp_map_cached_lookup(mp_map_t *map, qstr qst, uint8
 }
 #endif
 
+#if MICROPY_OPT_INLINE_CACHE
+#if !MICROPY_OPT_METHOD_CACHE
+#error MICROPY_OPT_INLINE_CACHE requires MICROPY_OPT_METHOD_CACHE
+#endif
+
+// Load attr of the instance obj, which is known not to be among its members,
+// into dest through the inline cache of the bytecode at site.
+STATIC void mp_inline_cache_load(const byte *site, mp_obj_t obj, qstr attr, mp_obj_t *dest) {
+    const mp_obj_type_t *type = mp_obj_get_type(obj);
+    mp_inline_cache_t *ic = &MP_STATE_THREAD(inline_cache)[
+        ((uintptr_t)site ^ ((uintptr_t)site >> 8)) & (MICROPY_OPT_INLINE_CACHE_SIZE - 1)];
+    size_t epoch = MP_STATE_VM(method_cache_epoch);
+    if (ic->site == site && ic->epoch == epoch) {
+        for (size_t i = 0; i < MICROPY_OPT_INLINE_CACHE_WAYS; ++i) {
+            if (ic->way[i].type == type) {
+                #if MICROPY_OPT_INLINE_CACHE_STATS
+                if (i == 0) {
+                    ++MP_STATE_VM(inline_cache_hits);
+                } else {
+                    ++MP_STATE_VM(inline_cache_poly_hits);
+                }
+                #endif
+                dest[0] = ic->way[i].value;
+                dest[1] = ic->way[i].self == MP_OBJ_SENTINEL ? obj : ic->way[i].self;
+                return;
+            }
+        }
+    } else {
+        // the site is new to this cache, or the caches were invalidated
+        ic->site = site;
+        ic->epoch = epoch;
+        for (size_t i = 0; i < MICROPY_OPT_INLINE_CACHE_WAYS; ++i) {
+            ic->way[i].type = NULL;
+        }
+    }
+    #if MICROPY_OPT_INLINE_CACHE_STATS
+    ++MP_STATE_VM(inline_cache_misses);
+    #endif
+    if (!mp_obj_instance_load_class_attr(obj, attr, dest)) {
+        if (dest[0] == MP_OBJ_NULL) {
+            // raise the AttributeError
+            mp_load_method(obj, attr, dest);
+        }
+        return;
+    }
+    for (size_t i = MICROPY_OPT_INLINE_CACHE_WAYS - 1; i > 0; --i) {
+        ic->way[i] = ic->way[i - 1];
+    }
+    ic->way[0].type = type;
+    ic->way[0].value = dest[0];
+    ic->way[0].self = dest[1] == obj ? MP_OBJ_SENTINEL : dest[1];
+}
+
+// Load attr of obj into dest as mp_load_method() does, using the inline cache
+// of the bytecode at site for instances of user classes.
+STATIC void mp_inline_cache_load_method(const byte *site, mp_obj_t obj, qstr attr, mp_obj_t *dest) {
+    if (mp_obj_is_instance_type(mp_obj_get_type(obj)) && attr != MP_QSTR___class__) {
+        mp_obj_instance_t *self = MP_OBJ_TO_PTR(obj);
+        mp_map_elem_t *elem = mp_map_lookup(&self->members, MP_OBJ_NEW_QSTR(attr), MP_MAP_LOOKUP);
+        if (elem != NULL) {
+            dest[0] = elem->value;
+            dest[1] = MP_OBJ_NULL;
+        } else {
+            mp_inline_cache_load(site, obj, attr, dest);
+        }
+    } else {
+        mp_load_method(obj, attr, dest);
+    }
+}
+#endif
+
+#if MICROPY_OPT_QUICKEN
+#if !MICROPY_ENABLE_GC
+#error MICROPY_OPT_QUICKEN requires MICROPY_ENABLE_GC
+#endif
+
+// The generic binary op of each MP_BC_QUICK_BINARY_OP_SMALL_INT opcode
+STATIC const byte quick_binary_op[MP_BC_QUICK_BINARY_OP_SMALL_INT_NUM] = {
+    MP_BINARY_OP_LESS,
+    MP_BINARY_OP_MORE,
+    MP_BINARY_OP_EQUAL,
+    MP_BINARY_OP_LESS_EQUAL,
+    MP_BINARY_OP_MORE_EQUAL,
+    MP_BINARY_OP_NOT_EQUAL,
+    MP_BINARY_OP_INPLACE_ADD,
+    MP_BINARY_OP_INPLACE_SUBTRACT,
+    MP_BINARY_OP_ADD,
+    MP_BINARY_OP_SUBTRACT,
+};
+
+// Write op over the opcode at ip, unless the bytecode is outside the heap, in
+// which case it may be in ROM and is left as it is.
+STATIC void vm_quicken(const byte *ip, byte op) {
+    if (gc_is_heap_ptr(ip)) {
+        *(byte *)ip = op;
+    }
+}
+
+// Quicken the generic binary op at ip, which has just seen two small ints.
+STATIC void vm_quicken_binary_op(const byte *ip) {
+    mp_binary_op_t op = *ip - MP_BC_BINARY_OP_MULTI;
+    size_t i;
+    if (op <= MP_BINARY_OP_NOT_EQUAL) {
+        i = op - MP_BINARY_OP_LESS;
+    } else if (op == MP_BINARY_OP_INPLACE_ADD || op == MP_BINARY_OP_INPLACE_SUBTRACT) {
+        i = 6 + op - MP_BINARY_OP_INPLACE_ADD;
+    } else if (op == MP_BINARY_OP_ADD || op == MP_BINARY_OP_SUBTRACT) {
+        i = 8 + op - MP_BINARY_OP_ADD;
+    } else {
+        return;
+    }
+    vm_quicken(ip, MP_BC_QUICK_BINARY_OP_SMALL_INT + i);
+}
+#endif
+
 // fastn has items in reverse order (fastn[0] is local[0], fastn[-1] is local[1], etc)
 // sp points to bottom of stack which grows up
 // returns:
@@ -414,7 +550,13 @@ dispatch_loop:
                     FRAME_UPDATE();
                     MARK_EXC_IP_SELECTIVE();
                     DECODE_QSTR;
+                    #if MICROPY_OPT_INLINE_CACHE
+                    mp_obj_t dest[2];
+                    mp_inline_cache_load_method(ip, TOP(), qst, dest);
+                    SET_TOP(dest[1] == MP_OBJ_NULL ? dest[0] : mp_obj_new_bound_meth(dest[0], dest[1]));
+                    #else
                     SET_TOP(mp_load_attr(TOP(), qst));
+                    #endif
                     DISPATCH();
                 }
                 #else
@@ -424,13 +566,20 @@ dispatch_loop:
                     DECODE_QSTR;
                     mp_obj_t top = TOP();
                     mp_map_elem_t *elem = NULL;
+                    mp_obj_instance_t *self = NULL;
                     if (mp_obj_is_instance_type(mp_obj_get_type(top))) {
-                        mp_obj_instance_t *self = MP_OBJ_TO_PTR(top);
+                        self = MP_OBJ_TO_PTR(top);
                         elem = mp_map_cached_lookup(&self->members, qst, (uint8_t*)ip);
                     }
                     mp_obj_t obj;
                     if (elem != NULL) {
                         obj = elem->value;
+                    #if MICROPY_OPT_INLINE_CACHE
+                    } else if (self != NULL) {
+                        mp_obj_t dest[2];
+                        mp_inline_cache_load(ip, top, qst, dest);
+                        obj = dest[1] == MP_OBJ_NULL ? dest[0] : mp_obj_new_bound_meth(dest[0], dest[1]);
+                    #endif
                     } else {
                         obj = mp_load_attr(top, qst);
                     }
@@ -443,7 +592,11 @@ dispatch_loop:
                 ENTRY(MP_BC_LOAD_METHOD): {
                     MARK_EXC_IP_SELECTIVE();
                     DECODE_QSTR;
+                    #if MICROPY_OPT_INLINE_CACHE
+                    mp_inline_cache_load_method(ip, *sp, qst, sp);
+                    #else
                     mp_load_method(*sp, qst, sp);
+                    #endif
                     sp += 1;
                     DISPATCH();
                 }
@@ -464,9 +617,37 @@ dispatch_loop:
                 ENTRY(MP_BC_LOAD_SUBSCR): {
                     MARK_EXC_IP_SELECTIVE();
                     mp_obj_t index = POP();
+                    #if MICROPY_OPT_QUICKEN
+                    if (mp_obj_is_type(TOP(), &mp_type_list) && mp_obj_is_small_int(index)) {
+                        vm_quicken(ip - 1, MP_BC_QUICK_LOAD_SUBSCR_LIST);
+                    }
+                    #endif
+                    SET_TOP(mp_obj_subscr(TOP(), index, MP_OBJ_SENTINEL));
+                    DISPATCH();
+                }
+
+                #if MICROPY_OPT_QUICKEN
+                ENTRY(MP_BC_QUICK_LOAD_SUBSCR_LIST): {
+                    MARK_EXC_IP_SELECTIVE();
+                    mp_obj_t index = POP();
+                    if (mp_obj_is_type(TOP(), &mp_type_list) && mp_obj_is_small_int(index)) {
+                        mp_obj_list_t *list = MP_OBJ_TO_PTR(TOP());
+                        mp_int_t i = MP_OBJ_SMALL_INT_VALUE(index);
+                        if (i < 0) {
+                            i += list->len;
+                        }
+                        if ((mp_uint_t)i < list->len) {
+                            SET_TOP(list->items[i]);
+                            DISPATCH();
+                        }
+                        // out of range, let the generic code raise
+                    } else {
+                        vm_quicken(ip - 1, MP_BC_LOAD_SUBSCR);
+                    }
                     SET_TOP(mp_obj_subscr(TOP(), index, MP_OBJ_SENTINEL));
                     DISPATCH();
                 }
+                #endif
 
                 ENTRY(MP_BC_STORE_FAST_N): {
                     DECODE_UINT;
@@ -508,19 +689,29 @@ dispatch_loop:
                 // MICROPY_PY_DESCRIPTORS enabled because if the attr exists in
                 // self->members then it can't be a property or have descriptors.  A
                 // consequence of this is that we can't use MP_MAP_LOOKUP_ADD_IF_NOT_FOUND
-                // in the fast-path below, because that store could override a property.
+                // in the fast-path below, because that store could override a property,
+                // unless the class is known to have no special accessors.
                 ENTRY(MP_BC_STORE_ATTR): {
                     FRAME_UPDATE();
                     MARK_EXC_IP_SELECTIVE();
                     DECODE_QSTR;
                     mp_map_elem_t *elem = NULL;
                     mp_obj_t top = TOP();
+                    mp_obj_instance_t *self = NULL;
                     if (mp_obj_is_instance_type(mp_obj_get_type(top)) && sp[-1] != MP_OBJ_NULL) {
-                        mp_obj_instance_t *self = MP_OBJ_TO_PTR(top);
+                        self = MP_OBJ_TO_PTR(top);
                         elem = mp_map_cached_lookup(&self->members, qst, (uint8_t*)ip);
+                        #if MICROPY_OPT_INLINE_CACHE
+                        if (elem == NULL && !(self->base.type->flags & MP_TYPE_FLAG_HAS_SPECIAL_ACCESSORS)) {
+                            // the store can only go to the members, as a new one
+                            elem = mp_map_lookup(&self->members, MP_OBJ_NEW_QSTR(qst), MP_MAP_LOOKUP_ADD_IF_NOT_FOUND);
+                            *(uint8_t*)ip = (elem - &self->members.table[0]) & 0xff;
+                        }
+                        #endif
                     }
                     if (elem != NULL) {
                         elem->value = sp[-1];
+                        MP_GC_WRITE_BARRIER(self);
                     } else {
                         mp_store_attr(sp[0], qst, sp[-1]);
                     }
@@ -532,9 +723,37 @@ dispatch_loop:
 
                 ENTRY(MP_BC_STORE_SUBSCR):
                     MARK_EXC_IP_SELECTIVE();
+                    #if MICROPY_OPT_QUICKEN
+                    if (mp_obj_is_type(sp[-1], &mp_type_list) && mp_obj_is_small_int(sp[0])) {
+                        vm_quicken(ip - 1, MP_BC_QUICK_STORE_SUBSCR_LIST);
+                    }
+                    #endif
+                    mp_obj_subscr(sp[-1], sp[0], sp[-2]);
+                    sp -= 3;
+                    DISPATCH();
+
+                #if MICROPY_OPT_QUICKEN
+                ENTRY(MP_BC_QUICK_STORE_SUBSCR_LIST):
+                    MARK_EXC_IP_SELECTIVE();
+                    if (mp_obj_is_type(sp[-1], &mp_type_list) && mp_obj_is_small_int(sp[0])) {
+                        mp_obj_list_t *list = MP_OBJ_TO_PTR(sp[-1]);
+                        mp_int_t i = MP_OBJ_SMALL_INT_VALUE(sp[0]);
+                        if (i < 0) {
+                            i += list->len;
+                        }
+                        if ((mp_uint_t)i < list->len) {
+                            list->items[i] = sp[-2];
+                            MP_GC_WRITE_BARRIER(list);
+                            sp -= 3;
+                            DISPATCH();
+                        }
+                    } else {
+                        vm_quicken(ip - 1, MP_BC_STORE_SUBSCR);
+                    }
                     mp_obj_subscr(sp[-1], sp[0], sp[-2]);
                     sp -= 3;
                     DISPATCH();
+                #endif
 
                 ENTRY(MP_BC_DELETE_FAST): {
                     MARK_EXC_IP_SELECTIVE();
@@ -1303,6 +1522,71 @@ yield:
                     mp_import_all(POP());
                     DISPATCH();
 
+                #if MICROPY_OPT_QUICKEN
+                // Binary ops on small ints.  A comparison followed by a conditional
+                // jump, or an addition or subtraction followed by a store to a
+                // local, does both in one go, without an object for the result of
+                // the comparison.  The fusion starts here rather than at the loads
+                // before, because they may be jump targets.
+                ENTRY(MP_BC_QUICK_BINARY_OP_SMALL_INT):
+                #if !MICROPY_OPT_COMPUTED_GOTO
+                quick_binary_op_small_int:
+                #endif
+                {
+                    MARK_EXC_IP_SELECTIVE();
+                    mp_obj_t rhs = POP();
+                    mp_obj_t lhs = TOP();
+                    mp_binary_op_t op = quick_binary_op[ip[-1] - MP_BC_QUICK_BINARY_OP_SMALL_INT];
+                    if (!mp_obj_is_small_int(lhs) || !mp_obj_is_small_int(rhs)) {
+                        vm_quicken(ip - 1, MP_BC_BINARY_OP_MULTI + op);
+                        SET_TOP(mp_binary_op(op, lhs, rhs));
+                        DISPATCH();
+                    }
+                    mp_int_t l = MP_OBJ_SMALL_INT_VALUE(lhs);
+                    mp_int_t r = MP_OBJ_SMALL_INT_VALUE(rhs);
+                    if (op <= MP_BINARY_OP_NOT_EQUAL) {
+                        bool res;
+                        switch (op) {
+                            case MP_BINARY_OP_LESS: res = l < r; break;
+                            case MP_BINARY_OP_MORE: res = l > r; break;
+                            case MP_BINARY_OP_EQUAL: res = l == r; break;
+                            case MP_BINARY_OP_LESS_EQUAL: res = l <= r; break;
+                            case MP_BINARY_OP_MORE_EQUAL: res = l >= r; break;
+                            default: res = l != r; break;
+                        }
+                        if (*ip == MP_BC_POP_JUMP_IF_FALSE || *ip == MP_BC_POP_JUMP_IF_TRUE) {
+                            bool jump_if = *ip++ == MP_BC_POP_JUMP_IF_TRUE;
+                            DECODE_SLABEL;
+                            sp--;
+                            if (res == jump_if) {
+                                ip += slab;
+                            }
+                            DISPATCH_WITH_PEND_EXC_CHECK();
+                        }
+                        SET_TOP(mp_obj_new_bool(res));
+                        DISPATCH();
+                    }
+                    mp_int_t res;
+                    if (op == MP_BINARY_OP_INPLACE_ADD || op == MP_BINARY_OP_ADD) {
+                        res = l + r;
+                    } else {
+                        res = l - r;
+                    }
+                    if (!MP_SMALL_INT_FITS(res)) {
+                        // overflows to a big int, which the operands don't rule out next time
+                        SET_TOP(mp_binary_op(op, lhs, rhs));
+                        DISPATCH();
+                    }
+                    if (*ip >= MP_BC_STORE_FAST_MULTI && *ip < MP_BC_STORE_FAST_MULTI + MP_BC_STORE_FAST_MULTI_NUM) {
+                        fastn[MP_BC_STORE_FAST_MULTI - (mp_int_t)*ip++] = MP_OBJ_NEW_SMALL_INT(res);
+                        sp--;
+                        DISPATCH();
+                    }
+                    SET_TOP(MP_OBJ_NEW_SMALL_INT(res));
+                    DISPATCH();
+                }
+                #endif
+
 #if MICROPY_OPT_COMPUTED_GOTO
                 ENTRY(MP_BC_LOAD_CONST_SMALL_INT_MULTI):
                     PUSH(MP_OBJ_NEW_SMALL_INT((mp_int_t)ip[-1] - MP_BC_LOAD_CONST_SMALL_INT_MULTI - MP_BC_LOAD_CONST_SMALL_INT_MULTI_EXCESS));
@@ -1326,6 +1610,11 @@ yield:
                     mp_obj_t rhs = POP();
                     mp_obj_t lhs = TOP();
                     SET_TOP(mp_binary_op(ip[-1] - MP_BC_BINARY_OP_MULTI, lhs, rhs));
+                    #if MICROPY_OPT_QUICKEN
+                    if (mp_obj_is_small_int(lhs) && mp_obj_is_small_int(rhs)) {
+                        vm_quicken_binary_op(ip - 1);
+                    }
+                    #endif
                     DISPATCH();
                 }
 
@@ -1333,6 +1622,12 @@ yield:
                     MARK_EXC_IP_SELECTIVE();
 #else
                 ENTRY_DEFAULT:
+                    #if MICROPY_OPT_QUICKEN
+                    if (ip[-1] > MP_BC_QUICK_BINARY_OP_SMALL_INT
+                        && ip[-1] < MP_BC_QUICK_BINARY_OP_SMALL_INT + MP_BC_QUICK_BINARY_OP_SMALL_INT_NUM) {
+                        goto quick_binary_op_small_int;
+                    } else
+                    #endif
                     if (ip[-1] < MP_BC_LOAD_CONST_SMALL_INT_MULTI + MP_BC_LOAD_CONST_SMALL_INT_MULTI_NUM) {
                         PUSH(MP_OBJ_NEW_SMALL_INT((mp_int_t)ip[-1] - MP_BC_LOAD_CONST_SMALL_INT_MULTI - MP_BC_LOAD_CONST_SMALL_INT_MULTI_EXCESS));
                         DISPATCH();
@@ -1349,6 +1644,11 @@ yield:
                         mp_obj_t rhs = POP();
                         mp_obj_t lhs = TOP();
                         SET_TOP(mp_binary_op(ip[-1] - MP_BC_BINARY_OP_MULTI, lhs, rhs));
+                        #if MICROPY_OPT_QUICKEN
+                        if (mp_obj_is_small_int(lhs) && mp_obj_is_small_int(rhs)) {
+                            vm_quicken_binary_op(ip - 1);
+                        }
+                        #endif
                         DISPATCH();
                     } else
 #endif
@@ -118,6 +118,11 @@ static const void *const entry_table[256] = {
     [MP_BC_STORE_FAST_MULTI ... MP_BC_STORE_FAST_MULTI + MP_BC_STORE_FAST_MULTI_NUM - 1] = &&entry_MP_BC_STORE_FAST_MULTI,
     [MP_BC_UNARY_OP_MULTI ... MP_BC_UNARY_OP_MULTI + MP_BC_UNARY_OP_MULTI_NUM - 1] = &&entry_MP_BC_UNARY_OP_MULTI,
     [MP_BC_BINARY_OP_MULTI ... MP_BC_BINARY_OP_MULTI + MP_BC_BINARY_OP_MULTI_NUM - 1] = &&entry_MP_BC_BINARY_OP_MULTI,
+    #if MICROPY_OPT_QUICKEN
+    [MP_BC_QUICK_BINARY_OP_SMALL_INT ... MP_BC_QUICK_BINARY_OP_SMALL_INT + MP_BC_QUICK_BINARY_OP_SMALL_INT_NUM - 1] = &&entry_MP_BC_QUICK_BINARY_OP_SMALL_INT,
+    [MP_BC_QUICK_LOAD_SUBSCR_LIST] = &&entry_MP_BC_QUICK_LOAD_SUBSCR_LIST,
+    [MP_BC_QUICK_STORE_SUBSCR_LIST] = &&entry_MP_BC_QUICK_STORE_SUBSCR_LIST,
+    #endif
 };
 
 #if __clang__
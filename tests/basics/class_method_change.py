@@ -0,0 +1,81 @@
+# test that lookups of class attributes see changes made to the class
+
+class A:
+    def f(self):
+        return "A.f"
+
+class B(A):
+    pass
+
+class C(B):
+    def f(self):
+        return "C.f"
+
+b = B()
+c = C()
+
+# repeat lookups so they are served from any cache
+for i in range(3):
+    print(b.f(), c.f())
+
+# redefine a method in a base class
+def f2(self):
+    return "f2"
+A.f = f2
+print(b.f(), c.f())
+
+# delete an overriding method, falling back to the base
+del C.f
+print(b.f(), c.f())
+
+# add a method after it was looked up and not found
+print(hasattr(b, "g"))
+B.g = lambda self: "B.g"
+print(hasattr(b, "g"), b.g(), c.g())
+del B.g
+print(hasattr(b, "g"), hasattr(c, "g"))
+
+# class attributes, looked up through the class and the instance
+class D:
+    x = 1
+for i in range(3):
+    D.x += 1
+    print(D.x, D().x)
+
+# classmethod found in a base class
+class E:
+    @classmethod
+    def name(cls):
+        return cls.__name__
+class F(E):
+    pass
+print(E.name(), F.name(), F().name())
+E.name = classmethod(lambda cls: "new " + cls.__name__)
+print(E.name(), F.name(), F().name())
+
+# multiple inheritance
+class G:
+    def h(self):
+        return "G.h"
+class H:
+    def h(self):
+        return "H.h"
+class I(G, H):
+    pass
+print(I().h())
+del G.h
+print(I().h())
+
+# the dict passed to type() doesn't alias the class's attributes
+d = {"k": lambda self: "k"}
+J = type("J", (), d)
+print(J().k())
+d["k"] = lambda self: "changed"
+print(J().k())
+
+# a class created after collections, maybe reusing a freed type's memory
+import gc
+for i in range(4):
+    K = type("K", (), {"v": i})
+    gc.collect()
+    print(K().v)
@@ -0,0 +1,85 @@
+# test dicts whose tables fill with deleted entries and are rebuilt
+
+# delete and reinsert keys of each kind, past the point of a rebuild
+d = {}
+for i in range(100):
+    d[i] = i
+    d[str(i)] = i
+    d[(i, i)] = i
+    if i % 3 == 0:
+        del d[i - 1 if i else 0]
+        d[i - 1 if i else 0] = -i
+    if i >= 10:
+        d.pop(str(i - 10))
+print(len(d), sum(d[k] for k in d if isinstance(k, int)))
+print(sorted(k for k in d if isinstance(k, str)))
+print(d[(50, 50)], (100, 100) in d, d.get(-1), d.get(98))
+
+# keep a few keys alive while many others come and go
+d = {"a": 1, "b": 2}
+for i in range(1000):
+    d[i] = i
+    del d[i]
+print(d, len(d))
+
+# keys that are equal but of different types
+d = {1: "int"}
+d[1.0] = "float"
+d[True] = "bool"
+print(d, 1.0 in d, 2.0 in d)
+
+# keys with colliding hashes
+class K:
+    def __init__(self, v):
+        self.v = v
+
+    def __hash__(self):
+        return self.v % 3
+
+    def __eq__(self, other):
+        return self.v == other.v
+
+d = {}
+for i in range(30):
+    d[K(i)] = i
+for i in range(0, 30, 2):
+    del d[K(i)]
+print(len(d), sorted(d[K(i)] for i in range(1, 30, 2)), K(4) in d, K(5) in d)
+
+# copies and popitem of a dict with deleted entries
+d = dict((i, i) for i in range(20))
+for i in range(5, 15):
+    del d[i]
+c = d.copy()
+c[100] = 100
+print(len(d), len(c), sorted(c))
+while d:
+    d.popitem()
+print(d, len(c))
+
+# OrderedDict keeps its order across deletes and rebuilds
+try:
+    from collections import OrderedDict
+except ImportError:
+    print("SKIP")
+    raise SystemExit
+
+o = OrderedDict()
+for i in range(40):
+    o[str(i)] = i
+for i in range(0, 40, 3):
+    del o[str(i)]
+o["0"] = 0
+print(list(o.keys()))
+print(o.popitem(), o.popitem(), len(o))
+print(list(o.copy().items())[:5])
+
+# popitem from a large dict, then reuse it
+d = dict((i, i) for i in range(200))
+for i in range(150, 190):
+    del d[i]
+popped = [d.popitem() for i in range(100)]
+for i in range(1000, 1050):
+    d[i] = i
+print(len(d), all(d[k] == k for k in d), 1049 in d)
+print(sorted(list(d) + [k for k, v in popped if k == v]) == sorted(list(range(150)) + list(range(190, 200)) + list(range(1000, 1050))))
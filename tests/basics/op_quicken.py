@@ -0,0 +1,85 @@
+# test that ops specialised for the operands they see still work when the
+# operands change
+
+# comparisons, with and without a conditional jump after them
+def cmp(a, b):
+    r = []
+    if a < b:
+        r.append("<")
+    if a > b:
+        r.append(">")
+    if a == b:
+        r.append("==")
+    if not a <= b:
+        r.append("not <=")
+    if not a >= b:
+        r.append("not >=")
+    if a != b:
+        r.append("!=")
+    r.append((a < b, a > b, a == b, a <= b, a >= b, a != b))
+    return r
+
+for args in ((1, 2), (2, 1), (3, 3), (-1, 1), (1.5, 2), (2, 1.5), ("a", "b"), (1, 1), (True, 1)):
+    print(cmp(*args))
+
+# loops whose counters are compared and stepped
+def count(n, step):
+    i = 0
+    t = 0
+    while i < n:
+        t += i
+        i = i + step
+    return t
+
+print(count(10, 1), count(10, 2.5), count(10, 3), count(-1, 1))
+
+# additions and subtractions, changing type and overflowing
+def add(a, b):
+    c = a + b
+    d = a - b
+    a += b
+    b -= a
+    return c, d, a, b
+
+print(add(1, 2), add(1.5, 2), add(3, 4), add(-5, 7))
+x = 1
+for i in range(70):
+    x = add(x, x)[0]
+print(x, add(x, 1), add(-x, -1), add(1, 2))
+
+# list subscripts, changing to other sequences and indexes
+def load(s, i):
+    return s[i]
+
+def store(s, i, v):
+    s[i] = v
+    return s
+
+l = [10, 20, 30]
+for i in (0, 1, 2, -1, -3):
+    print(load(l, i), store(l, i, i))
+print(load((4, 5), 1), load("abc", 0), load({1: "d"}, 1), load([7, 8], True))
+
+class S:
+    def __getitem__(self, i):
+        return i
+
+print(load(l, S()[1:]), store(l, S()[0:1], [9]))
+print(load(l, 1), store(l, 0, 2), store({}, "k", 0), store(bytearray(2), 1, 3))
+for i in (3, -4):
+    try:
+        load(l, i)
+    except IndexError:
+        print("IndexError")
+    try:
+        store(l, i, 0)
+    except IndexError:
+        print("IndexError")
+print(load(l, 0), store(l, -1, None))
+
+# a subclass of list has its own __getitem__
+class L(list):
+    def __getitem__(self, i):
+        return "L"
+
+print(load(L([1]), 0), load([1], 0))
@@ -0,0 +1,29 @@
+# cmdline: -X heapsize=32wk -X heapmax=1wM
+# test that the heap grows on demand and that collections trace every area
+import gc
+
+gc.collect()
+total = gc.mem_free() + gc.mem_alloc()
+print(total < 64 * 1024)
+
+# allocate more than the initial heap, linking new objects to older ones
+lst = []
+for i in range(400):
+    lst.append([i, bytearray(1000), lst[-1] if lst else None])
+gc.collect()
+print(gc.mem_free() + gc.mem_alloc() > total)
+
+# everything survived the collection
+print(sum(x[0] for x in lst), all(x[2] is lst[i - 1] for i, x in enumerate(lst) if i))
+
+# the heap can't grow past heapmax
+try:
+    bytearray(2 * 1024 * 1024)
+except MemoryError:
+    print("MemoryError")
+
+# memory freed in any area is used again
+lst = None
+gc.collect()
+lst = [bytearray(1000) for i in range(400)]
+print(len(lst))
@@ -0,0 +1,82 @@
+# Test the queue of finalisers run outside the sweep, using the files of VfsFat
+# which have a finaliser that closes them.
+
+try:
+    import gc, uos
+
+    uos.VfsFat
+    gc.finalisers
+    gc.threshold
+except (ImportError, AttributeError):
+    print("SKIP")
+    raise SystemExit
+
+
+class RAMBlockDevice:
+    def __init__(self, blocks, sec_size=512):
+        self.sec_size = sec_size
+        self.data = bytearray(blocks * self.sec_size)
+
+    def readblocks(self, n, buf):
+        for i in range(len(buf)):
+            buf[i] = self.data[n * self.sec_size + i]
+
+    def writeblocks(self, n, buf):
+        for i in range(len(buf)):
+            self.data[n * self.sec_size + i] = buf[i]
+
+    def ioctl(self, op, arg):
+        if op == 4:  # MP_BLOCKDEV_IOCTL_BLOCK_COUNT
+            return len(self.data) // self.sec_size
+        if op == 5:  # MP_BLOCKDEV_IOCTL_BLOCK_SIZE
+            return self.sec_size
+
+
+try:
+    bdev = RAMBlockDevice(50)
+except MemoryError:
+    print("SKIP")
+    raise SystemExit
+
+uos.VfsFat.mkfs(bdev)
+vfs = uos.VfsFat(bdev)
+
+gc.collect()
+print(gc.finalisers()[0])
+
+N = 4
+for i in range(N):
+    n = "x%d" % i
+    f = vfs.open(n, "w")
+    f.write(n)
+    f = None  # release f without closing
+    [0, 1, 2, 3]  # use up Python stack so f is really gone
+
+# The next allocation collects, and the files are queued, not closed.  No
+# branch follows before the queue is read, so the scheduler cannot run it.
+gc.threshold(0)
+x = [0]
+fin = gc.finalisers()
+gc.threshold(-1)
+print(fin[0], fin[1] >= N)
+
+# The scheduler runs the queue at the loop's branches.
+for i in range(N):
+    pass
+fin = gc.finalisers()
+print(fin[0], fin[2] >= N)
+for i in range(N):
+    with vfs.open("x%d" % i, "r") as f:
+        print(f.read())
+
+# gc.collect() runs the finalisers before returning.
+for i in range(N):
+    f = vfs.open("y%d" % i, "w")
+    f.write("y")
+    f = None
+    [0, 1, 2, 3]
+gc.collect()
+print(gc.finalisers()[0])
+for i in range(N):
+    with vfs.open("y%d" % i, "r") as f:
+        print(f.read())
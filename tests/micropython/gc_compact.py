@@ -0,0 +1,86 @@
+# test that buffers moved by a compaction keep their contents
+
+import gc
+
+try:
+    gc.compact
+except AttributeError:
+    print("SKIP")
+    raise SystemExit
+
+
+class A:
+    pass
+
+
+def make(n):
+    keep = []
+    junk = []
+    for i in range(n):
+        # garbage in between, to leave holes to move into
+        junk.append(bytearray(100))
+        keep.append([i] * 10)
+        junk.append(bytearray(100))
+        keep.append({i: "d%d" % i, "x": i})
+        junk.append(bytearray(100))
+        keep.append(bytearray(range(i % 200, i % 200 + 50)))
+        keep.append("str%d" % i * 10)
+        a = A()
+        a.x = i
+        a.y = str(i)
+        keep.append(a)
+    return keep
+
+
+def check(keep, n):
+    for i in range(n):
+        l, d, b, s, a = keep[5 * i : 5 * i + 5]
+        if l != [i] * 10:
+            return False
+        if d != {i: "d%d" % i, "x": i}:
+            return False
+        if b != bytearray(range(i % 200, i % 200 + 50)):
+            return False
+        if s != "str%d" % i * 10:
+            return False
+        if a.x != i or a.y != str(i):
+            return False
+    return True
+
+
+keep = make(100)
+gc.collect()
+print(gc.compact() > 0)
+print(check(keep, 100))
+
+# the buffers can still grow and be changed
+for i in range(0, len(keep), 5):
+    keep[i].append(i)
+    keep[i + 1]["y"] = i
+    keep[i + 2].extend(b"xyz")
+print(keep[0], keep[1], keep[2][-3:])
+
+# and are still intact after moving again
+keep = keep[:50]
+gc.collect()
+gc.compact()
+print(keep[0], keep[1], keep[2][-3:])
+print(keep[5 * 9][:3], keep[5 * 9 + 1]["x"], keep[5 * 9 + 3][:6], keep[5 * 9 + 4].y)
+
+# arrays of items wider than a byte move with all their items
+try:
+    import array
+except ImportError:
+    raise SystemExit
+
+keep = []
+junk = []
+for i in range(50):
+    junk.append(bytearray(100))
+    keep.append(array.array("i", range(i, i + 20)))
+    keep.append(array.array("d", [i / 2] * 10))
+junk = None
+gc.collect()
+gc.compact()
+print(all(list(keep[2 * i]) == list(range(i, i + 20)) for i in range(50)))
+print(all(list(keep[2 * i + 1]) == [i / 2] * 10 for i in range(50)))
@@ -0,0 +1,102 @@
+# test young collections, with old objects changing between them
+
+import gc
+
+try:
+    gc.nursery
+except AttributeError:
+    print("SKIP")
+    raise SystemExit
+
+
+class A:
+    pass
+
+
+def counter():
+    n = []
+
+    def inc(x):
+        nonlocal n
+        if x is not None:
+            n = n + [str(x)]
+        return n
+
+    return inc
+
+
+def gen():
+    held = []
+    while True:
+        x = yield len(held)
+        if x is not None:
+            held = held + [x]
+        yield held
+
+
+# containers that get old early on, then changed
+lst = []
+dct = {}
+obj = A()
+st = set()
+inc = counter()
+g = gen()
+next(g)
+gc.collect()
+
+
+def churn(i):
+    # only reachable through the containers once this returns
+    s = "item%d" % i
+    lst.append([s])
+    dct[i] = {"s": s}
+    setattr(obj, "a%d" % (i % 50), (s,))
+    st.add(s)
+    inc(i)
+    g.send(s)
+    next(g)
+    # garbage, to fill the nursery
+    [str(j) for j in range(5)]
+
+
+def check(n):
+    ok = True
+    for i in range(n):
+        s = "item%d" % i
+        ok = ok and lst[i] == [s] and dct[i] == {"s": s} and s in st
+    for i in range(max(0, n - 50), n):
+        ok = ok and getattr(obj, "a%d" % (i % 50)) == ("item%d" % i,)
+    ok = ok and inc(None) == [str(i) for i in range(n)]
+    ok = ok and g.send(None) == ["item%d" % i for i in range(n)]
+    next(g)
+    return ok
+
+
+try:
+    gc.nursery(-1)
+except ValueError:
+    print("ValueError")
+
+# many young collections
+gc.nursery(256)
+print(gc.nursery())
+n = 0
+for i in range(600):
+    churn(n)
+    n += 1
+print(check(n))
+
+# objects filled in across young collections, through zip() and map()
+pairs = list(zip(range(200), (str(i) for i in range(200))))
+print(pairs[-1], all(p == (i, str(i)) for i, p in enumerate(pairs)))
+print(list(map(lambda a, b: a + b, ("x%d" % i for i in range(3)), ("y",) * 3)))
+
+# full collections keep what young ones have promoted
+gc.collect()
+print(check(n))
+gc.nursery(0)
+for i in range(100):
+    churn(n)
+    n += 1
+gc.collect()
+print(check(n))
@@ -0,0 +1,101 @@
+# test incremental garbage collection, with objects changing while it runs
+
+import gc
+
+try:
+    gc.incremental
+except AttributeError:
+    print("SKIP")
+    raise SystemExit
+
+
+class A:
+    pass
+
+
+def counter():
+    n = []
+
+    def inc(x):
+        nonlocal n
+        if x is not None:
+            n = n + [str(x)]
+        return n
+
+    return inc
+
+
+def gen():
+    held = []
+    while True:
+        x = yield len(held)
+        if x is not None:
+            held = held + [x]
+        yield held
+
+
+# containers that get marked early in a collection, then changed
+lst = []
+dct = {}
+obj = A()
+st = set()
+inc = counter()
+g = gen()
+next(g)
+
+
+def churn(i):
+    # only reachable through the containers once this returns
+    s = "item%d" % i
+    lst.append([s])
+    dct[i] = {"s": s}
+    setattr(obj, "a%d" % (i % 50), (s,))
+    st.add(s)
+    inc(i)
+    g.send(s)
+    next(g)
+    # garbage, to make the heap move
+    [str(j) for j in range(5)]
+
+
+def check(n):
+    ok = True
+    for i in range(n):
+        s = "item%d" % i
+        ok = ok and lst[i] == [s] and dct[i] == {"s": s} and s in st
+    for i in range(max(0, n - 50), n):
+        ok = ok and getattr(obj, "a%d" % (i % 50)) == ("item%d" % i,)
+    ok = ok and inc(None) == [str(i) for i in range(n)]
+    ok = ok and g.send(None) == ["item%d" % i for i in range(n)]
+    next(g)
+    return ok
+
+
+# collections driven by gc.collect(budget_us)
+try:
+    gc.collect(0)
+except ValueError:
+    print("ValueError")
+gc.collect()
+n = 0
+cycles = 0
+while cycles < 3:
+    churn(n)
+    n += 1
+    if gc.collect(50):
+        cycles += 1
+print(check(n))
+gc.collect()
+print(check(n))
+
+# collections driven by allocation
+print(gc.incremental())
+gc.incremental(100)
+print(gc.incremental())
+for i in range(2000):
+    churn(n)
+    n += 1
+print(check(n))
+gc.incremental(0)
+gc.collect()
+print(check(n))
@@ -0,0 +1,33 @@
+# test micropython.heap_snapshot()
+
+import micropython
+
+if not hasattr(micropython, "heap_snapshot"):
+    print("SKIP")
+    raise SystemExit
+
+
+class Foo:
+    pass
+
+
+def make():
+    return [Foo() for _ in range(100)]
+
+
+objs = make()
+types, sites = micropython.heap_snapshot()
+
+# all the instances are counted under their class
+count, n_bytes = types[Foo]
+print(count >= 100, n_bytes >= 100 * 8)
+
+# and under the line of the list comprehension in make()
+found = False
+for site in sites:
+    if site is not None and site[1] == 15 and site[0].endswith("heap_snapshot.py"):
+        found = found or sites[site][0] >= 100
+print(found)
+
+# the totals are (count, bytes) tuples
+print(all(type(v) is tuple and len(v) == 2 for v in types.values()))
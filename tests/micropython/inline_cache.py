@@ -0,0 +1,102 @@
+# test the inline caches of attribute loads on instances
+
+import micropython
+
+try:
+    micropython.inline_cache_stats
+except AttributeError:
+    print("SKIP")
+    raise SystemExit
+
+
+class A:
+    k = "A.k"
+
+    def f(self):
+        return "A.f"
+
+    @classmethod
+    def c(cls):
+        return cls.__name__
+
+    @staticmethod
+    def s():
+        return "s"
+
+
+class B(A):
+    def f(self):
+        return "B.f"
+
+
+class C(A):
+    pass
+
+
+def calls(objs):
+    return [(o.f(), o.k, o.c(), o.s(), o.f.__name__) for o in objs]
+
+
+# monomorphic, then polymorphic sites
+a, b, c = A(), B(), C()
+print(calls([a, a, a]))
+h0, p0, m0 = micropython.inline_cache_stats()
+print(calls([a, a, a]))
+h1, p1, m1 = micropython.inline_cache_stats()
+print(h1 > h0)
+print(calls([a, b, a, b]))
+h2, p2, m2 = micropython.inline_cache_stats()
+print(p2 > p1)
+print(calls([a, b, c]))
+
+# an instance member shadows a cached method
+b.f = lambda: "member"
+print(calls([a, b]))
+del b.f
+print(calls([a, b]))
+
+# a class change invalidates the caches
+A.f = lambda self: "new A.f"
+print(calls([a, b, c]))
+
+# a new attribute stored without special accessors
+class D:
+    def __init__(self, x):
+        self.x = x
+        self.y = x + 1
+
+
+print([(d.x, d.y) for d in (D(1), D(2), D(3))])
+
+# a new attribute stored through a property
+class E:
+    def __init__(self, x):
+        self.x = x
+
+    @property
+    def x(self):
+        return self._x * 10
+
+    @x.setter
+    def x(self, v):
+        self._x = v
+
+
+print([e.x for e in (E(1), E(2))])
+
+# __getattr__ is called only for what the class doesn't have
+class F:
+    def f(self):
+        return "F.f"
+
+    def __getattr__(self, name):
+        return name
+
+
+o = F()
+print([(o.f(), o.g) for i in range(2)])
+
+try:
+    a.missing
+except AttributeError:
+    print("AttributeError")
@@ -0,0 +1,40 @@
+# Allocate small two-block objects in a heap fragmented into one-block holes
+# by freeing every other one of many small objects, so that finding a free run
+# big enough is a large part of the cost of each allocation.
+
+
+def fragment(n):
+    keep = [(i,) for i in range(n)]
+    for i in range(0, n, 2):
+        keep[i] = None
+    return keep
+
+
+def churn(n):
+    acc = 0
+    for i in range(n):
+        t = (i, i, i, i, i)
+        l = [i, i, i, i]
+        acc += t[4] + l[3]
+    return acc
+
+
+bm_params = {
+    (50, 25): (200, 500),
+    (100, 100): (1000, 2000),
+    (1000, 1000): (10000, 20000),
+    (5000, 1000): (10000, 100000),
+}
+
+
+def bm_setup(ps):
+    state = []
+
+    def run():
+        state.append(fragment(ps[0]))
+        state.append(churn(ps[1]))
+
+    def result():
+        return ps[1], state[1]
+
+    return run, result
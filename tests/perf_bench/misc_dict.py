@@ -0,0 +1,56 @@
+# Insert, look up and delete keys of different types in dicts and OrderedDicts
+# of a range of sizes, to measure the cost of hashing and probing in the dict
+# implementation.
+
+from collections import OrderedDict
+
+
+def run_dict(new, keys, nloop):
+    total = 0
+    for _ in range(nloop):
+        d = new()
+        for k in keys:
+            d[k] = 1
+        for k in keys:
+            total += d[k]
+        for k in keys:
+            total += k in d
+        for k in keys[::2]:
+            del d[k]
+        for k in keys[::2]:
+            d[k] = 2
+        total += len(d)
+    return total
+
+
+bm_params = {
+    (50, 25): (1, 10),
+    (100, 100): (4, 50),
+    (1000, 1000): (5, 200),
+    (5000, 1000): (10, 400),
+}
+
+
+def bm_setup(params):
+    nloop, n = params
+    key_sets = (
+        list(range(n)),
+        ["k%d" % i for i in range(n)],
+        [(i, -i) for i in range(n)],
+        list(range(0, 4 * n, 4)) + ["k%d" % i for i in range(n)],
+    )
+    state = None
+
+    def run():
+        nonlocal state
+        state = sum(
+            run_dict(new, keys[:size], nloop)
+            for new in (dict, OrderedDict)
+            for keys in key_sets
+            for size in (5, n)
+        )
+
+    def result():
+        return nloop * n * 16, state
+
+    return run, result
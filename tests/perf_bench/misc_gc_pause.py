@@ -0,0 +1,31 @@
+# Time full collections of a heap holding a tree of small lists, to measure
+# the pause that gc.collect() imposes; the score is collections per second.
+
+import gc
+
+
+def make_tree(depth, width):
+    if depth == 0:
+        return [None] * width
+    return [make_tree(depth - 1, width) for _ in range(width)]
+
+
+bm_params = {
+    (50, 25): (10, 4),
+    (100, 100): (20, 5),
+    (1000, 1000): (40, 6),
+    (5000, 1000): (100, 6),
+}
+
+
+def bm_setup(ps):
+    tree = make_tree(ps[1], 4)
+
+    def run():
+        for _ in range(ps[0]):
+            gc.collect()
+
+    def result():
+        return ps[0], len(tree)
+
+    return run, result
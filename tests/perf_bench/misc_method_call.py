@@ -0,0 +1,67 @@
+# Call methods and load class attributes on instances of a small class
+# hierarchy, from call sites that see one type and from sites that see two,
+# to measure the cost of attribute lookups on user classes.
+
+
+class Shape:
+    sides = 0
+
+    def __init__(self, size):
+        self.size = size
+
+    def area(self):
+        return self.size * self.size
+
+    def scaled(self, k):
+        return self.area() * k
+
+
+class Square(Shape):
+    sides = 4
+
+
+class Triangle(Shape):
+    sides = 3
+
+    def area(self):
+        return self.size * self.size // 2
+
+
+def run_mono(n, shapes):
+    total = 0
+    for i in range(n):
+        s = shapes[0]
+        total += s.area() + s.scaled(2) + s.sides
+    return total
+
+
+def run_poly(n, shapes):
+    total = 0
+    for i in range(n):
+        s = shapes[i & 1]
+        total += s.area() + s.scaled(2) + s.sides
+    return total
+
+
+bm_params = {
+    (50, 25): (1, 100),
+    (100, 100): (1, 1000),
+    (1000, 1000): (1, 10000),
+    (5000, 1000): (1, 50000),
+}
+
+
+def bm_setup(params):
+    nloop, n = params
+    shapes = [Square(3), Triangle(4)]
+    state = None
+
+    def run():
+        nonlocal state
+        for _ in range(nloop):
+            state = (run_mono(n, shapes), run_poly(n, shapes))
+
+    def result():
+        return nloop * n * 2, state
+
+    return run, result
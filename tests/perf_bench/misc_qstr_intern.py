@@ -0,0 +1,42 @@
+# Intern thousands of new attribute names, then look them up again by name, to
+# measure the cost of finding interned strings as their number grows.
+
+
+class Namespace:
+    pass
+
+
+def intern(names, tag):
+    ns = Namespace()
+    for name in names:
+        setattr(ns, name + tag, 1)
+    total = 0
+    for name in names:
+        total += getattr(ns, name + tag)
+    return total
+
+
+bm_params = {
+    (50, 25): (1, 100),
+    (100, 100): (2, 500),
+    (1000, 1000): (2, 2000),
+    (5000, 1000): (4, 2500),
+}
+
+
+def bm_setup(params):
+    nloop, n = params
+    names = ["name_%d_" % i for i in range(n)]
+    state = None
+
+    def run():
+        nonlocal state
+        total = 0
+        for i in range(nloop):
+            total += intern(names, str(i))
+        state = total
+
+    def result():
+        return nloop * n, state
+
+    return run, result
@@ -0,0 +1,43 @@
+# Allocate small objects from several threads at once, to measure how the
+# heap scales with threads; the score is allocations per second.  Run it with
+# a different number of threads, the first parameter, to see the scaling.
+
+import _thread
+
+
+def work(n, lock, done):
+    x = None
+    for i in range(n):
+        x = (i, x) if i & 15 else None
+        y = [i, i]
+        z = [y, (i,)]
+    with lock:
+        done.append(z[0][1])
+
+
+bm_params = {
+    (50, 25): (1, 1000),
+    (100, 100): (2, 10000),
+    (1000, 1000): (4, 50000),
+    (5000, 1000): (4, 200000),
+}
+
+
+def bm_setup(ps):
+    n_threads, n = ps
+    lock = _thread.allocate_lock()
+    done = []
+
+    def run():
+        for _ in range(n_threads - 1):
+            _thread.start_new_thread(work, (n, lock, done))
+        work(n, lock, done)
+        while True:
+            with lock:
+                if len(done) == n_threads:
+                    break
+
+    def result():
+        return n_threads * n, sum(done)
+
+    return run, result
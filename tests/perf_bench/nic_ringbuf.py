@@ -0,0 +1,31 @@
+# Stream bytes through the ring buffer of the rp2 NIC receive path, from one
+# thread and between a producer and a consumer thread, in chunks of a few
+# sizes.  Needs the unix coverage build.
+
+import nicloop
+
+
+bm_params = {
+    (50, 10): (2000,),
+    (100, 100): (20000,),
+    (1000, 1000): (200000,),
+    (5000, 1000): (1000000,),
+}
+
+
+def bm_setup(params):
+    (nbytes,) = params
+    state = None
+
+    def run():
+        nonlocal state
+        state = 0
+        for chunk in (1, 16, 100, 512):
+            for spsc in (False, True):
+                state += nicloop.ring(nbytes, chunk, spsc)
+
+    def result():
+        # the data is checked by ring
+        return nbytes * 8, None
+
+    return run, result
@@ -0,0 +1,32 @@
+# Send commands through the ESP8285 SPI frame protocol to a loopback NIC that
+# echoes each frame back after some filler, to measure the framing and the
+# number of bus transfers per command.  Needs the unix coverage build.
+
+import nicloop
+
+
+bm_params = {
+    (50, 10): (5,),
+    (100, 100): (20,),
+    (1000, 1000): (100,),
+    (5000, 1000): (400,),
+}
+
+
+def bm_setup(params):
+    (n,) = params
+    state = None
+
+    def run():
+        nonlocal state
+        state = 0
+        for size in (1, 16, 64, 256, 500):
+            for filler in (0, 40):
+                state += nicloop.spi_echo(n, size, filler)
+
+    def result():
+        # the replies are checked by spi_echo, the transfer count is only
+        # meaningful to this implementation
+        return n * 10, None
+
+    return run, result
@@ -86,6 +86,7 @@ def run_benchmark_on_target(target, script):
 def run_benchmarks(target, param_n, param_m, n_average, test_list):
     skip_complex = run_feature_test(target, "complex") != "complex"
     skip_native = run_feature_test(target, "native_check") != "native"
+    skip_coverage = run_feature_test(target, "coverage") != "coverage"
 
     for test_file in sorted(test_list):
         print(test_file + ": ", end="")
@@ -96,6 +97,8 @@ def run_benchmarks(target, param_n, param_m, n_average, test_list):
             and test_file.find("bm_fft") != -1
             or skip_native
             and test_file.find("viper_") != -1
+            or skip_coverage
+            and test_file.find("nic_") != -1
         )
         if skip:
             print("skip")
@@ -402,6 +402,22 @@ function ci_unix_float_run_tests {
     ci_unix_run_tests_helper CFLAGS_EXTRA="-DMICROPY_FLOAT_IMPL=MICROPY_FLOAT_IMPL_FLOAT"
 }
 
+function ci_unix_map_compact_build {
+    ci_unix_build_helper VARIANT=standard CFLAGS_EXTRA="-DMICROPY_OPT_MAP_COMPACT=1"
+}
+
+function ci_unix_map_compact_run_tests {
+    ci_unix_run_tests_helper CFLAGS_EXTRA="-DMICROPY_OPT_MAP_COMPACT=1"
+}
+
+function ci_unix_gc_generational_build {
+    ci_unix_build_helper VARIANT=standard CFLAGS_EXTRA="-DMICROPY_GC_GENERATIONAL=1 -DMICROPY_ENABLE_SCHEDULER=1"
+}
+
+function ci_unix_gc_generational_run_tests {
+    ci_unix_run_tests_helper CFLAGS_EXTRA="-DMICROPY_GC_GENERATIONAL=1 -DMICROPY_ENABLE_SCHEDULER=1"
+}
+
 function ci_unix_clang_setup {
     sudo apt-get install clang
     clang --version